@@ -0,0 +1,555 @@
+#include "chip8_batch.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "chip8_impl.h"
+#include "opcodes_impl.h"
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+// Lockstep batch core. Each step groups the runnable lanes by PC (and opcode,
+// for lanes whose memory no longer matches the shared ROM image). A group
+// executing a data instruction (6/7/8xy_/skips/Annn/Fx07/Fx15/Fx18/Fx1E) runs
+// as byte-vector ops over V[reg][lane] under a lane mask; everything touching
+// per-lane memory, stack, RNG or frame buffer runs lane by lane through
+// lane_execute(), which mirrors execute() in opcodes.c.
+
+// 8 mask bits -> 8 bytes of 0x00/0xFF, lane 0 in the lowest byte
+static uint64_t expand_bits(unsigned bits) {
+  uint64_t x = ((uint64_t)bits * 0x0101010101010101ull) & 0x8040201008040201ull;
+  x = ((x + 0x7F7F7F7F7F7F7F7Full) | x) & 0x8080808080808080ull;
+  return (x >> 7) * 0xFF;
+}
+
+static inline unsigned popcount64(uint64_t v) {
+#if defined(_MSC_VER)
+  return (unsigned)__popcnt64(v);
+#else
+  return (unsigned)__builtin_popcountll(v);
+#endif
+}
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define VW 32
+typedef __m256i vb;
+static inline vb vb_load(const uint8_t* p) { return _mm256_loadu_si256((const __m256i*)p); }
+static inline void vb_store(uint8_t* p, vb v) { _mm256_storeu_si256((__m256i*)p, v); }
+static inline vb vb_set1(uint8_t v) { return _mm256_set1_epi8((char)v); }
+static inline vb vb_add(vb a, vb b) { return _mm256_add_epi8(a, b); }
+static inline vb vb_sub(vb a, vb b) { return _mm256_sub_epi8(a, b); }
+static inline vb vb_and(vb a, vb b) { return _mm256_and_si256(a, b); }
+static inline vb vb_or(vb a, vb b) { return _mm256_or_si256(a, b); }
+static inline vb vb_xor(vb a, vb b) { return _mm256_xor_si256(a, b); }
+static inline vb vb_eq(vb a, vb b) { return _mm256_cmpeq_epi8(a, b); }
+static inline vb vb_subs(vb a, vb b) { return _mm256_subs_epu8(a, b); }
+static inline vb vb_srl16(vb a, int s) { return _mm256_srli_epi16(a, s); }
+static inline uint64_t vb_movemask(vb m) { return (uint32_t)_mm256_movemask_epi8(m); }
+static inline vb vb_from_bits(uint64_t bits) {
+  return _mm256_set_epi64x((long long)expand_bits((unsigned)(bits >> 24) & 0xFF),
+                           (long long)expand_bits((unsigned)(bits >> 16) & 0xFF),
+                           (long long)expand_bits((unsigned)(bits >> 8) & 0xFF),
+                           (long long)expand_bits((unsigned)bits & 0xFF));
+}
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define VW 16
+typedef __m128i vb;
+static inline vb vb_load(const uint8_t* p) { return _mm_loadu_si128((const __m128i*)p); }
+static inline void vb_store(uint8_t* p, vb v) { _mm_storeu_si128((__m128i*)p, v); }
+static inline vb vb_set1(uint8_t v) { return _mm_set1_epi8((char)v); }
+static inline vb vb_add(vb a, vb b) { return _mm_add_epi8(a, b); }
+static inline vb vb_sub(vb a, vb b) { return _mm_sub_epi8(a, b); }
+static inline vb vb_and(vb a, vb b) { return _mm_and_si128(a, b); }
+static inline vb vb_or(vb a, vb b) { return _mm_or_si128(a, b); }
+static inline vb vb_xor(vb a, vb b) { return _mm_xor_si128(a, b); }
+static inline vb vb_eq(vb a, vb b) { return _mm_cmpeq_epi8(a, b); }
+static inline vb vb_subs(vb a, vb b) { return _mm_subs_epu8(a, b); }
+static inline vb vb_srl16(vb a, int s) { return _mm_srli_epi16(a, s); }
+static inline uint64_t vb_movemask(vb m) { return (uint32_t)_mm_movemask_epi8(m); }
+static inline vb vb_from_bits(uint64_t bits) {
+  return _mm_set_epi64x((long long)expand_bits((unsigned)(bits >> 8) & 0xFF),
+                        (long long)expand_bits((unsigned)bits & 0xFF));
+}
+#else
+// Portable fallback: plain byte loops the compiler may vectorize on its own
+#define VW 16
+typedef struct vb { uint8_t b[VW]; } vb;
+#define VB_MAP(expr) vb r; for (int i = 0; i < VW; ++i) r.b[i] = (uint8_t)(expr); return r
+static inline vb vb_load(const uint8_t* p) { vb r; memcpy(r.b, p, VW); return r; }
+static inline void vb_store(uint8_t* p, vb v) { memcpy(p, v.b, VW); }
+static inline vb vb_set1(uint8_t v) { VB_MAP(v); }
+static inline vb vb_add(vb a, vb b) { VB_MAP(a.b[i] + b.b[i]); }
+static inline vb vb_sub(vb a, vb b) { VB_MAP(a.b[i] - b.b[i]); }
+static inline vb vb_and(vb a, vb b) { VB_MAP(a.b[i] & b.b[i]); }
+static inline vb vb_or(vb a, vb b) { VB_MAP(a.b[i] | b.b[i]); }
+static inline vb vb_xor(vb a, vb b) { VB_MAP(a.b[i] ^ b.b[i]); }
+static inline vb vb_eq(vb a, vb b) { VB_MAP(a.b[i] == b.b[i] ? 0xFF : 0); }
+static inline vb vb_subs(vb a, vb b) { VB_MAP(a.b[i] > b.b[i] ? a.b[i] - b.b[i] : 0); }
+// Per-byte shift is all the 16-bit shift is used for below (callers mask)
+static inline vb vb_srl16(vb a, int s) { VB_MAP(a.b[i] >> s); }
+static inline uint64_t vb_movemask(vb m) {
+  uint64_t bits = 0;
+  for (int i = 0; i < VW; ++i) bits |= (uint64_t)(m.b[i] >> 7) << i;
+  return bits;
+}
+static inline vb vb_from_bits(uint64_t bits) {
+  vb r;
+  uint64_t lo = expand_bits((unsigned)bits & 0xFF), hi = expand_bits((unsigned)(bits >> 8) & 0xFF);
+  memcpy(r.b, &lo, 8);
+  memcpy(r.b + 8, &hi, 8);
+  return r;
+}
+#undef VB_MAP
+#endif
+
+#define CHUNK_MASK ((1ull << VW) - 1)
+
+static inline vb vb_not(vb a) { return vb_xor(a, vb_set1(0xFF)); }
+static inline vb vb_gt(vb a, vb b) { return vb_not(vb_eq(vb_subs(a, b), vb_set1(0))); } // unsigned a > b
+static inline vb vb_bit(vb m) { return vb_and(m, vb_set1(1)); }                    // 0xFF/0 -> 1/0
+static inline vb vb_shr1(vb a) { return vb_and(vb_srl16(a, 1), vb_set1(0x7F)); }
+static inline vb vb_msb(vb a) { return vb_and(vb_srl16(a, 7), vb_set1(0x01)); }
+// Store `v` into the lanes selected by `m`, keep the others
+static inline void vb_put(uint8_t* p, vb v, vb m) {
+  vb old = vb_load(p);
+  vb_store(p, vb_xor(old, vb_and(vb_xor(old, v), m)));
+}
+
+#define B_LANES CHIP8_BATCH_MAX_LANES
+
+// Groups smaller than this are cheaper to run lane by lane
+#define B_VECTOR_MIN 2
+
+struct Chip8Batch {
+  // Lane-major registers: row r holds register r of every lane, so a group
+  // operation on Vx is a handful of contiguous vector loads and stores.
+  uint8_t V[16][B_LANES];
+  uint8_t delay_timer[B_LANES];
+  uint8_t sound_timer[B_LANES];
+  uint16_t pc[B_LANES];
+  uint16_t I[B_LANES];
+  uint8_t sp[B_LANES];
+  uint8_t wait_key_reg[B_LANES];
+  uint64_t waiting;   // lanes stalled in Fx0A
+  uint64_t vblank;    // lanes held after Dxyn until the next tick (display wait quirk)
+  uint64_t mem_dirty; // lanes whose memory may differ from `image`
+  bool uniform;       // every runnable lane is known to share one PC
+
+  // Per-lane state only ever touched one lane at a time
+  uint16_t stack[B_LANES][16];
+  uint64_t fb[B_LANES][FB_HEIGHT];
+  uint8_t keypad[B_LANES][16];
+  chip8_rand_func rng[B_LANES];
+  void* rng_user[B_LANES];
+
+  uint8_t image[MEM_SIZE];    // font + ROM as loaded into every lane
+  uint8_t (*memory)[MEM_SIZE]; // `lanes` private copies
+  unsigned lanes;
+  uint64_t lane_mask;
+  uint8_t quirks; // C8_Q_* bits
+  Chip8BatchStats stats;
+};
+
+static inline uint16_t lane_fetch(const Chip8Batch* b, unsigned l, uint16_t pc) {
+  const uint8_t* m = b->memory[l];
+  return (uint16_t)(m[pc & MEM_MASK] << 8 | m[(pc + 1) & MEM_MASK]);
+}
+
+static inline void lane_written(Chip8Batch* b, unsigned l) { b->mem_dirty |= 1ull << l; }
+
+// One instruction on one lane; same semantics and PC handling as execute().
+static void lane_execute(Chip8Batch* b, unsigned l, uint16_t opcode) {
+  unsigned q = b->quirks;
+  uint8_t x = (opcode >> 8) & 0xF, y = (opcode >> 4) & 0xF, n = opcode & 0xF;
+  uint8_t kk = opcode & 0xFF;
+  uint16_t nnn = opcode & 0x0FFF;
+  uint8_t vx = b->V[x][l], vy = b->V[y][l];
+  uint8_t* mem = b->memory[l];
+  uint16_t pc = b->pc[l], next = (uint16_t)(pc + 2);
+
+  switch (opcode >> 12) {
+    case 0x0:
+      if (kk == 0xE0) {
+        memset(b->fb[l], 0, sizeof(b->fb[l]));
+      } else if (kk == 0xEE) {
+        if (b->sp[l] > 0) next = b->stack[l][--b->sp[l]];
+        else next = pc;
+      }
+      break;
+    case 0x1: next = nnn; break;
+    case 0x2:
+      if (b->sp[l] < 16) { b->stack[l][b->sp[l]++] = next; next = nnn; }
+      else next = pc;
+      break;
+    case 0x3: if (vx == kk) next += 2; break;
+    case 0x4: if (vx != kk) next += 2; break;
+    case 0x5: if (n == 0 && vx == vy) next += 2; break;
+    case 0x6: b->V[x][l] = kk; break;
+    case 0x7: b->V[x][l] = (uint8_t)(vx + kk); break;
+    case 0x8: {
+      // Statement order matches op_alu() so x/y aliasing VF behaves the same
+      switch (n) {
+        case 0x0: b->V[x][l] = vy; break;
+        case 0x1: b->V[x][l] = vx | vy; b->V[0xF][l] &= c8_qvf_keep(q); break;
+        case 0x2: b->V[x][l] = vx & vy; b->V[0xF][l] &= c8_qvf_keep(q); break;
+        case 0x3: b->V[x][l] = vx ^ vy; b->V[0xF][l] &= c8_qvf_keep(q); break;
+        case 0x4: b->V[0xF][l] = (uint16_t)(vx + vy) > 0xFF; b->V[x][l] = (uint8_t)(vx + vy); break;
+        case 0x5:
+          b->V[0xF][l] = vx > vy;
+          b->V[x][l] = (uint8_t)(b->V[x][l] - b->V[y][l]);
+          break;
+        case 0x6: {
+          uint8_t src = b->V[c8_qshift_src(q, x, y)][l];
+          b->V[0xF][l] = src & 1;
+          b->V[x][l] = src >> 1;
+          break;
+        }
+        case 0x7:
+          b->V[0xF][l] = vy > vx;
+          b->V[x][l] = (uint8_t)(b->V[y][l] - b->V[x][l]);
+          break;
+        case 0xE: {
+          uint8_t src = b->V[c8_qshift_src(q, x, y)][l];
+          b->V[0xF][l] = (src & 0x80) != 0;
+          b->V[x][l] = (uint8_t)(src << 1);
+          break;
+        }
+        default: break;
+      }
+      break;
+    }
+    case 0x9: if (n == 0 && vx != vy) next += 2; break;
+    case 0xA: b->I[l] = nnn; break;
+    case 0xB:
+      next = (uint16_t)(nnn + b->V[c8_qjump_reg(q, x)][l]);
+      break;
+    case 0xC: b->V[x][l] = (uint8_t)((b->rng[l] ? b->rng[l](b->rng_user[l]) : 0) & kk); break;
+    case 0xD: {
+      unsigned px = vx % FB_WIDTH, py = vy % FB_HEIGHT;
+      uint64_t keep = q & C8_Q_CLIP ? ~0ull >> px : ~0ull;
+      uint64_t hit = 0;
+      for (unsigned row = 0; row < n && py + row < FB_HEIGHT; ++row) {
+        uint64_t bits = c8_rotr64((uint64_t)mem[(b->I[l] + row) & MEM_MASK] << 56, px) & keep;
+        hit |= b->fb[l][py + row] & bits;
+        b->fb[l][py + row] ^= bits;
+      }
+      b->V[0xF][l] = hit != 0;
+      if (q & C8_Q_DISPLAY_WAIT) b->vblank |= 1ull << l;
+      break;
+    }
+    case 0xE:
+      if (kk == 0x9E && b->keypad[l][vx & 0xF]) next += 2;
+      else if (kk == 0xA1 && !b->keypad[l][vx & 0xF]) next += 2;
+      break;
+    case 0xF:
+      switch (kk) {
+        case 0x07: b->V[x][l] = b->delay_timer[l]; break;
+        case 0x0A: b->waiting |= 1ull << l; b->wait_key_reg[l] = x; break;
+        case 0x15: b->delay_timer[l] = vx; break;
+        case 0x18: b->sound_timer[l] = vx; break;
+        case 0x1E: b->I[l] = (uint16_t)(b->I[l] + vx); break;
+        case 0x29: b->I[l] = (uint16_t)(C8_FONTSET_ADDR + (vx & 0xF) * 5); break;
+        case 0x33:
+          mem[(b->I[l] + 0) & MEM_MASK] = (uint8_t)(vx / 100);
+          mem[(b->I[l] + 1) & MEM_MASK] = (uint8_t)((vx / 10) % 10);
+          mem[(b->I[l] + 2) & MEM_MASK] = (uint8_t)(vx % 10);
+          lane_written(b, l);
+          break;
+        case 0x55:
+          for (uint8_t i = 0; i <= x; ++i) mem[(b->I[l] + i) & MEM_MASK] = b->V[i][l];
+          lane_written(b, l);
+          b->I[l] = (uint16_t)(b->I[l] + c8_qmem_step(q, x));
+          break;
+        case 0x65:
+          for (uint8_t i = 0; i <= x; ++i) b->V[i][l] = mem[(b->I[l] + i) & MEM_MASK];
+          b->I[l] = (uint16_t)(b->I[l] + c8_qmem_step(q, x));
+          break;
+        default: break;
+      }
+      break;
+  }
+  b->pc[l] = next;
+}
+
+// Mask of the lanes in `g` covered by the chunk at lane `off`, as a byte
+// vector. Returns false when the chunk holds none of them.
+static inline bool chunk_mask(uint64_t g, unsigned off, vb* m) {
+  uint64_t bits = (g >> off) & CHUNK_MASK;
+  if (!bits) return false;
+  *m = vb_from_bits(bits);
+  return true;
+}
+
+static void vec_alu(Chip8Batch* b, uint64_t g, uint8_t x, uint8_t y, uint8_t sub) {
+  for (unsigned off = 0; off < b->lanes; off += VW) {
+    vb m;
+    if (!chunk_mask(g, off, &m)) continue;
+    uint8_t* px = &b->V[x][off];
+    uint8_t* py = &b->V[y][off];
+    uint8_t* pf = &b->V[0xF][off];
+    vb X = vb_load(px), Y = vb_load(py);
+    vb src = b->quirks & C8_Q_SHIFT_VY ? Y : X;
+    vb vf_keep = vb_set1(c8_qvf_keep(b->quirks));
+    switch (sub) {
+      case 0x0: vb_put(px, Y, m); break;
+      case 0x1: vb_put(px, vb_or(X, Y), m); vb_put(pf, vb_and(vb_load(pf), vf_keep), m); break;
+      case 0x2: vb_put(px, vb_and(X, Y), m); vb_put(pf, vb_and(vb_load(pf), vf_keep), m); break;
+      case 0x3: vb_put(px, vb_xor(X, Y), m); vb_put(pf, vb_and(vb_load(pf), vf_keep), m); break;
+      case 0x4: vb_put(pf, vb_bit(vb_gt(Y, vb_not(X))), m); vb_put(px, vb_add(X, Y), m); break;
+      case 0x5:
+        vb_put(pf, vb_bit(vb_gt(X, Y)), m);
+        vb_put(px, vb_sub(vb_load(px), vb_load(py)), m);
+        break;
+      case 0x6: vb_put(pf, vb_and(src, vb_set1(1)), m); vb_put(px, vb_shr1(src), m); break;
+      case 0x7:
+        vb_put(pf, vb_bit(vb_gt(Y, X)), m);
+        vb_put(px, vb_sub(vb_load(py), vb_load(px)), m);
+        break;
+      case 0xE: vb_put(pf, vb_msb(src), m); vb_put(px, vb_add(src, src), m); break;
+    }
+  }
+}
+
+// Lanes of `g` whose skip condition holds: Vx == rhs (eq) or != rhs (!eq),
+// where rhs is Vy or the immediate.
+static uint64_t vec_skip(const Chip8Batch* b, uint64_t g, uint8_t x, const uint8_t* vy,
+                         uint8_t kk, bool eq) {
+  uint64_t hits = 0;
+  for (unsigned off = 0; off < b->lanes; off += VW) {
+    if (!((g >> off) & CHUNK_MASK)) continue;
+    vb rhs = vy ? vb_load(vy + off) : vb_set1(kk);
+    hits |= vb_movemask(vb_eq(vb_load(&b->V[x][off]), rhs)) << off;
+  }
+  return (eq ? hits : ~hits) & g;
+}
+
+static void vec_store_byte(uint8_t* row, const Chip8Batch* b, uint64_t g, const uint8_t* src,
+                           uint8_t imm, bool add) {
+  for (unsigned off = 0; off < b->lanes; off += VW) {
+    vb m;
+    if (!chunk_mask(g, off, &m)) continue;
+    vb v = src ? vb_load(src + off) : vb_set1(imm);
+    vb_put(row + off, add ? vb_add(vb_load(row + off), v) : v, m);
+  }
+}
+
+// Run `opcode` at `pc` on every lane of `g` with vector ops when it only
+// touches registers and timers. Returns false to have the caller fall back to
+// lane_execute(). Sets *pcs_equal when the group still shares one PC.
+static bool vec_execute(Chip8Batch* b, uint64_t g, uint16_t pc, uint16_t opcode, bool* pcs_equal) {
+  uint8_t x = (opcode >> 8) & 0xF, y = (opcode >> 4) & 0xF, n = opcode & 0xF;
+  uint8_t kk = opcode & 0xFF;
+  uint16_t next = (uint16_t)(pc + 2);
+  uint64_t skip = 0;
+
+  switch (opcode >> 12) {
+    case 0x1: next = opcode & 0x0FFF; break;
+    case 0x3: skip = vec_skip(b, g, x, NULL, kk, true); break;
+    case 0x4: skip = vec_skip(b, g, x, NULL, kk, false); break;
+    case 0x5: if (n) return false; skip = vec_skip(b, g, x, b->V[y], 0, true); break;
+    case 0x9: if (n) return false; skip = vec_skip(b, g, x, b->V[y], 0, false); break;
+    case 0x6: vec_store_byte(b->V[x], b, g, NULL, kk, false); break;
+    case 0x7: vec_store_byte(b->V[x], b, g, NULL, kk, true); break;
+    case 0x8:
+      if (n > 0x7 && n != 0xE) return false;
+      vec_alu(b, g, x, y, n);
+      break;
+    case 0xA:
+      for (uint64_t m = g; m; m &= m - 1) b->I[c8_ctz64(m)] = opcode & 0x0FFF;
+      break;
+    case 0xF:
+      switch (kk) {
+        case 0x07: vec_store_byte(b->V[x], b, g, b->delay_timer, 0, false); break;
+        case 0x15: vec_store_byte(b->delay_timer, b, g, b->V[x], 0, false); break;
+        case 0x18: vec_store_byte(b->sound_timer, b, g, b->V[x], 0, false); break;
+        case 0x1E:
+          for (uint64_t m = g; m; m &= m - 1) {
+            unsigned l = c8_ctz64(m);
+            b->I[l] = (uint16_t)(b->I[l] + b->V[x][l]);
+          }
+          break;
+        default: return false;
+      }
+      break;
+    default: return false;
+  }
+
+  for (uint64_t m = g; m; m &= m - 1) {
+    unsigned l = c8_ctz64(m);
+    b->pc[l] = (uint16_t)(next + ((skip >> l & 1) ? 2 : 0));
+  }
+  *pcs_equal = skip == 0 || skip == g;
+  return true;
+}
+
+Chip8Batch* chip8_batch_create(unsigned lanes) {
+  if (lanes == 0 || lanes > B_LANES) return NULL;
+  Chip8Batch* b = (Chip8Batch*)calloc(1, sizeof(*b));
+  if (!b) return NULL;
+  b->memory = (uint8_t(*)[MEM_SIZE])calloc(lanes, MEM_SIZE);
+  if (!b->memory) { free(b); return NULL; }
+  b->lanes = lanes;
+  b->lane_mask = lanes == 64 ? ~0ull : (1ull << lanes) - 1;
+  b->quirks = C8_Q_DEFAULT;
+  chip8_batch_reset(b);
+  return b;
+}
+
+void chip8_batch_destroy(Chip8Batch* b) {
+  if (!b) return;
+  free(b->memory);
+  free(b);
+}
+
+unsigned chip8_batch_lanes(const Chip8Batch* b) { return b->lanes; }
+
+void chip8_batch_set_rng(Chip8Batch* b, unsigned lane, chip8_rand_func rng, void* rng_user) {
+  if (lane >= b->lanes) return;
+  b->rng[lane] = rng;
+  b->rng_user[lane] = rng_user;
+}
+
+void chip8_batch_set_quirks(Chip8Batch* b, const Chip8Quirks* quirks) {
+  b->quirks = c8_quirk_bits(quirks);
+  if (!(b->quirks & C8_Q_DISPLAY_WAIT) && b->vblank) {
+    b->vblank = 0;
+    b->uniform = false;
+  }
+}
+
+void chip8_batch_reset(Chip8Batch* b) {
+  memset(b->V, 0, sizeof(b->V));
+  memset(b->delay_timer, 0, sizeof(b->delay_timer));
+  memset(b->sound_timer, 0, sizeof(b->sound_timer));
+  memset(b->I, 0, sizeof(b->I));
+  memset(b->sp, 0, sizeof(b->sp));
+  memset(b->wait_key_reg, 0, sizeof(b->wait_key_reg));
+  memset(b->stack, 0, sizeof(b->stack));
+  memset(b->fb, 0, sizeof(b->fb));
+  memset(b->keypad, 0, sizeof(b->keypad));
+  for (unsigned l = 0; l < B_LANES; ++l) b->pc[l] = 0x200;
+  b->waiting = 0;
+  b->vblank = 0;
+  b->mem_dirty = 0;
+  b->uniform = true;
+
+  memset(b->image, 0, sizeof(b->image));
+  memcpy(&b->image[C8_FONTSET_ADDR], c8_fontset, sizeof(c8_fontset));
+  for (unsigned l = 0; l < b->lanes; ++l) memcpy(b->memory[l], b->image, MEM_SIZE);
+}
+
+bool chip8_batch_load_rom(Chip8Batch* b, const uint8_t* data, size_t size) {
+  if (!data && size > 0) return false;
+  if (0x200 + size > MEM_SIZE) return false;
+  if (size) {
+    memcpy(&b->image[0x200], data, size);
+    for (unsigned l = 0; l < b->lanes; ++l) memcpy(&b->memory[l][0x200], data, size);
+  }
+  for (unsigned l = 0; l < B_LANES; ++l) b->pc[l] = 0x200;
+  b->uniform = true;
+  return true;
+}
+
+void chip8_batch_step(Chip8Batch* b) {
+  uint64_t runnable = b->lane_mask & ~b->waiting & ~b->vblank;
+  uint64_t pending = runnable;
+  unsigned groups = 0;
+  bool pcs_equal = true;
+
+  while (pending) {
+    unsigned lead = c8_ctz64(pending);
+    uint16_t pc = b->pc[lead];
+    uint64_t g = 0;
+    if (b->uniform && pending == runnable) {
+      g = pending;
+    } else {
+      for (unsigned l = 0; l < b->lanes; ++l) g |= (uint64_t)(b->pc[l] == pc) << l;
+      g &= pending;
+    }
+
+    // Lanes that rewrote their memory may hold different code at this PC.
+    // Clean lanes all match the shared image, so one fetch covers them.
+    uint16_t opcode = lane_fetch(b, lead, pc);
+    if (g & b->mem_dirty) {
+      uint64_t clean = g & ~b->mem_dirty;
+      uint16_t image_op = (uint16_t)(b->image[pc & MEM_MASK] << 8 | b->image[(pc + 1) & MEM_MASK]);
+      if (clean && image_op != opcode) g &= ~clean;
+      for (uint64_t m = g & b->mem_dirty; m; m &= m - 1) {
+        unsigned l = c8_ctz64(m);
+        if (lane_fetch(b, l, pc) != opcode) g &= ~(1ull << l);
+      }
+    }
+    pending &= ~g;
+    ++groups;
+    b->stats.groups++;
+
+    bool equal = true;
+    if (g & (g - 1) && vec_execute(b, g, pc, opcode, &equal)) {
+      b->stats.vector_lane_steps += (uint64_t)popcount64(g);
+    } else {
+      for (uint64_t m = g; m; m &= m - 1) lane_execute(b, c8_ctz64(m), opcode);
+      b->stats.scalar_lane_steps += (uint64_t)popcount64(g);
+      // Control flow that depends on per-lane state can split the group
+      uint16_t first = b->pc[c8_ctz64(g)];
+      for (uint64_t m = g; m; m &= m - 1) equal &= b->pc[c8_ctz64(m)] == first;
+    }
+    pcs_equal &= equal;
+  }
+  // Lanes that just entered Fx0A or a display wait drop out of `runnable`,
+  // which keeps this true
+  b->uniform = groups <= 1 && pcs_equal;
+}
+
+void chip8_batch_run(Chip8Batch* b, uint32_t steps) {
+  while (steps--) chip8_batch_step(b);
+}
+
+void chip8_batch_tick_60hz(Chip8Batch* b) {
+  for (unsigned l = 0; l < b->lanes; ++l) {
+    if (b->delay_timer[l] > 0) b->delay_timer[l]--;
+    if (b->sound_timer[l] > 0) b->sound_timer[l]--;
+  }
+  if (b->vblank) {
+    b->vblank = 0;
+    b->uniform = false; // the held lanes resume at their own PCs
+  }
+}
+
+void chip8_batch_key_down(Chip8Batch* b, unsigned lane, uint8_t hex_key) {
+  if (lane >= b->lanes || (hex_key & 0xF) != hex_key) return;
+  b->keypad[lane][hex_key] = 1;
+  if (b->waiting >> lane & 1) {
+    b->V[b->wait_key_reg[lane]][lane] = hex_key;
+    b->waiting &= ~(1ull << lane);
+    b->uniform = false; // the lane resumes at its own PC
+  }
+}
+
+void chip8_batch_key_up(Chip8Batch* b, unsigned lane, uint8_t hex_key) {
+  if (lane >= b->lanes || (hex_key & 0xF) != hex_key) return;
+  b->keypad[lane][hex_key] = 0;
+}
+
+void chip8_batch_get_snapshot(const Chip8Batch* b, unsigned lane, Chip8Snapshot* out) {
+  if (!out || lane >= b->lanes) return;
+  out->pc = b->pc[lane];
+  out->I = b->I[lane];
+  for (unsigned r = 0; r < 16; ++r) out->V[r] = b->V[r][lane];
+  out->delay_timer = b->delay_timer[lane];
+  out->sound_timer = b->sound_timer[lane];
+  out->sp = b->sp[lane];
+  out->stack_top = b->sp[lane] ? b->stack[lane][b->sp[lane] - 1] : 0;
+  out->display_hash = c8_display_hash(b->fb[lane]);
+}
+
+const uint64_t* chip8_batch_framebuffer_packed(const Chip8Batch* b, unsigned lane) {
+  return lane < b->lanes ? b->fb[lane] : NULL;
+}
+
+void chip8_batch_get_stats(const Chip8Batch* b, Chip8BatchStats* out) {
+  if (out) *out = b->stats;
+}
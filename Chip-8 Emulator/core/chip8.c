@@ -6,48 +6,77 @@
 #include <string.h>
 #include <stdlib.h>
 
+#include "chip8_impl.h"
 #include "opcodes.h"
 
-#define MEM_SIZE 4096
-#define FB_WIDTH 64
-#define FB_HEIGHT 32
-
-typedef struct Chip8 {
-  // Memory and registers
-  uint8_t memory[MEM_SIZE];
-  uint8_t V[16];
-  uint16_t I;
-  uint16_t pc;
-
-  // Stack
-  uint16_t stack[16];
-  uint8_t sp;
-
-  // Timers
-  uint8_t delay_timer;
-  uint8_t sound_timer;
+void c8_mem_touch_range(Chip8Impl* c8, uint32_t addr, uint32_t len) {
+  if (!len) return;
+  for (uint32_t page = addr >> C8_PAGE_SHIFT; page <= (addr + len - 1) >> C8_PAGE_SHIFT && page < C8_PAGES; ++page) {
+    c8->mem_used[page >> 6] |= 1ull << (page & 63);
+    c8->mem_dirty[page >> 6] |= 1ull << (page & 63);
+  }
+}
 
-  // Frame buffer and keypad
-  uint8_t gfx[FB_WIDTH * FB_HEIGHT];
-  uint8_t keypad[16];
+// Drop what the engines decoded from a page that changed under them. They
+// only run classic machines, whose memory is the first MEM_SIZE bytes.
+void c8_mem_forget_page(Chip8Impl* c8, unsigned page) {
+  if (page >= (MEM_SIZE >> C8_PAGE_SHIFT)) return;
+  chip8_decoded_invalidate(c8, (uint16_t)(page << C8_PAGE_SHIFT), C8_PAGE_SIZE);
+  chip8_jit_invalidate(c8, (uint16_t)(page << C8_PAGE_SHIFT), C8_PAGE_SIZE);
+}
 
-  // RNG
-  chip8_rand_func rng;
-  void* rng_user;
+bool c8_pristine_alloc(Chip8Impl* c8, uint32_t size) {
+  if (c8->pristine && c8->pristine_size == size) return true;
+  uint8_t* image = (uint8_t*)calloc(size, 1);
+  if (!image) return false;
+  free(c8->pristine);
+  c8->pristine = image;
+  c8->pristine_size = size;
+  c8->pristine_valid = false;
+  memset(c8->pristine_used, 0, sizeof(c8->pristine_used));
+  return true;
+}
 
-  // Execution state
-  bool waiting_for_key;
-  uint8_t wait_key_reg;
+// Zero every page that may be non-zero. Afterwards memory differs from the
+// pristine image exactly where that image is non-zero.
+static void clear_memory(Chip8Impl* c8) {
+  for (unsigned w = 0; w < C8_PAGE_WORDS; ++w) {
+    for (uint64_t bits = c8->mem_used[w]; bits; bits &= bits - 1) {
+      unsigned page = w * 64 + c8_ctz64(bits);
+      memset(&c8->memory[page << C8_PAGE_SHIFT], 0, C8_PAGE_SIZE);
+      c8_mem_forget_page(c8, page);
+    }
+    c8->mem_used[w] = 0;
+    c8->mem_dirty[w] = c8->pristine_used[w];
+  }
+}
 
-  // Quirks
-  Chip8Quirks quirks;
-} Chip8Impl;
+// Copy back the pages that may differ from the pristine image
+static void restore_pristine(Chip8Impl* c8) {
+  for (unsigned w = 0; w < C8_PAGE_WORDS; ++w) {
+    for (uint64_t bits = c8->mem_dirty[w]; bits; bits &= bits - 1) {
+      unsigned page = w * 64 + c8_ctz64(bits);
+      memcpy(&c8->memory[page << C8_PAGE_SHIFT], &c8->pristine[page << C8_PAGE_SHIFT], C8_PAGE_SIZE);
+      c8_mem_forget_page(c8, page);
+    }
+    c8->mem_used[w] = c8->pristine_used[w];
+    c8->mem_dirty[w] = 0;
+  }
+}
 
-static void c8_clear(Chip8Impl* c8) {
-  memset(c8->memory, 0, sizeof(c8->memory));
+// Everything chip8_reset() resets except memory
+static void clear_machine(Chip8Impl* c8) {
   memset(c8->V, 0, sizeof(c8->V));
   memset(c8->stack, 0, sizeof(c8->stack));
-  memset(c8->gfx, 0, sizeof(c8->gfx));
+  memset(c8->fb, 0, sizeof(c8->fb));
+  c8->fb_hash = 0;
+  c8->hires = false;
+  c8->planes = 1;
+  memset(c8->audio_pattern, 0, sizeof(c8->audio_pattern));
+  c8->pitch = 64; // XO-CHIP's 4000 Hz pattern playback rate
+  c8->gfx_stale = true; // rebuilt from fb on demand
+  c8->fb_generation++;
+  c8->fb_dirty = 0xFFFFFFFFu; // whole screen must be redrawn
   memset(c8->keypad, 0, sizeof(c8->keypad));
   c8->I = 0;
   c8->pc = 0x200;
@@ -56,6 +85,18 @@ static void c8_clear(Chip8Impl* c8) {
   c8->sound_timer = 0;
   c8->waiting_for_key = false;
   c8->wait_key_reg = 0;
+  c8->waiting_for_vblank = false;
+  c8->events = 0;
+  c8->invalid_opcode = 0;
+  c8->clock_frac = 0;
+  c8->tick_phase = 0;
+  c8_sound_edge(c8);
+}
+
+// Bytes past mem_mask are never written, so they are still zero
+static void c8_clear(Chip8Impl* c8) {
+  clear_memory(c8);
+  clear_machine(c8);
 }
 
 Chip8* chip8_create(chip8_rand_func rng, void* rng_user) {
@@ -64,9 +105,10 @@ Chip8* chip8_create(chip8_rand_func rng, void* rng_user) {
   memset(c8, 0, sizeof(*c8));
   c8->rng = rng;
   c8->rng_user = rng_user;
-  c8->quirks.shift_uses_vy = false;
-  c8->quirks.mem_ops_increment_i = true; // original semantics increment I
-  c8->quirks.jump_with_offset_uses_vx0 = false; // original Bnnn uses V0
+  c8->mem_mask = MEM_MASK;
+  c8->quirks = C8_Q_DEFAULT;
+  c8->quirk_variant = C8_QV_DEFAULT;
+  c8->cpu_hz = CHIP8_DEFAULT_CPU_HZ;
   c8_clear(c8);
   chip8_install_fontset((Chip8*)c8);
   return (Chip8*)c8;
@@ -74,39 +116,222 @@ Chip8* chip8_create(chip8_rand_func rng, void* rng_user) {
 
 void chip8_destroy(Chip8* c8p) {
   Chip8Impl* c8 = (Chip8Impl*)c8p;
-  if (c8) free(c8);
+  if (!c8) return;
+  chip8_decoded_free(c8);
+  chip8_jit_free(c8);
+  free(c8->pristine);
+  free(c8);
 }
 
 void chip8_reset(Chip8* c8p) {
   Chip8Impl* c8 = (Chip8Impl*)c8p;
-  // Preserve fontset area, so save it before clear and restore
-  uint8_t font_copy[80];
-  memcpy(font_copy, &c8->memory[0x50], 80);
+  // Preserve the font area (and the large digits that follow it on extended
+  // machines), so save it before clear and restore
+  uint8_t font_copy[C8_FONTSET_SIZE + C8_BIGFONT_SIZE];
+  size_t font_size = C8_FONTSET_SIZE + (c8->machine ? C8_BIGFONT_SIZE : 0);
+  memcpy(font_copy, &c8->memory[C8_FONTSET_ADDR], font_size);
   c8_clear(c8);
-  memcpy(&c8->memory[0x50], font_copy, 80);
+  memcpy(&c8->memory[C8_FONTSET_ADDR], font_copy, font_size);
+  c8_mem_touch_range(c8, C8_FONTSET_ADDR, (uint32_t)font_size);
+}
+
+void chip8_restart(Chip8* c8p) {
+  Chip8Impl* c8 = (Chip8Impl*)c8p;
+  // A state of another machine may have been loaded since
+  if (!c8->pristine_valid || c8->pristine_size != (uint32_t)c8->mem_mask + 1) {
+    chip8_reset(c8p);
+    return;
+  }
+  restore_pristine(c8);
+  clear_machine(c8);
+}
+
+bool chip8_set_machine(Chip8* c8p, Chip8Machine machine) {
+  Chip8Impl* c8 = (Chip8Impl*)c8p;
+  if (machine != CHIP8_MACHINE_CHIP8 && machine != CHIP8_MACHINE_SCHIP && machine != CHIP8_MACHINE_XOCHIP) {
+    return false;
+  }
+  c8->machine = machine;
+  c8->mem_mask = machine == CHIP8_MACHINE_XOCHIP ? 0xFFFF : MEM_MASK;
+  c8_clear(c8);
+  c8->pristine_valid = false;
+  chip8_install_fontset(c8p);
+  if (machine != CHIP8_MACHINE_CHIP8) {
+    memcpy(&c8->memory[C8_BIGFONT_ADDR], c8_bigfont, C8_BIGFONT_SIZE);
+    c8_mem_touch_range(c8, C8_BIGFONT_ADDR, C8_BIGFONT_SIZE);
+  }
+  chip8_decoded_flush(c8);
+  chip8_jit_flush(c8);
+  return true;
+}
+
+Chip8Machine chip8_get_machine(const Chip8* c8p) { return ((const Chip8Impl*)c8p)->machine; }
+
+static const uint8_t profile_bits[] = {
+#define X(name) C8_Q_##name,
+  C8_QUIRK_PROFILES(X)
+#undef X
+};
+
+static void quirks_from_bits(unsigned bits, Chip8Quirks* out) {
+  out->shift_uses_vy = bits & C8_Q_SHIFT_VY;
+  out->mem_ops_increment_i = bits & C8_Q_MEM_INC;
+  out->mem_ops_increment_by_x = bits & C8_Q_MEM_INC_X;
+  out->jump_with_offset_uses_vx0 = bits & C8_Q_JUMP_VX;
+  out->vf_reset = bits & C8_Q_VF_RESET;
+  out->clip_sprites = bits & C8_Q_CLIP;
+  out->display_wait = bits & C8_Q_DISPLAY_WAIT;
+}
+
+bool chip8_quirk_profile(Chip8QuirkProfile profile, Chip8Quirks* out) {
+  if ((unsigned)profile >= sizeof(profile_bits)) return false;
+  quirks_from_bits(profile_bits[profile], out);
+  return true;
+}
+
+void c8_apply_quirks(Chip8Impl* c8, uint8_t bits) {
+  c8->quirks = bits;
+  c8->quirk_variant = C8_QV_GENERIC;
+  for (unsigned v = 0; v < sizeof(profile_bits); ++v) {
+    if (profile_bits[v] == bits) c8->quirk_variant = (uint8_t)v;
+  }
+  if (!(bits & C8_Q_DISPLAY_WAIT)) c8->waiting_for_vblank = false;
+  // Decoded operands and generated code have the old quirks baked in
+  chip8_decoded_flush(c8);
+  chip8_jit_flush(c8);
+}
+
+uint8_t c8_quirk_bits(const Chip8Quirks* q) {
+  uint8_t bits = 0;
+  if (q->shift_uses_vy) bits |= C8_Q_SHIFT_VY;
+  if (q->mem_ops_increment_i) bits |= C8_Q_MEM_INC;
+  if (q->mem_ops_increment_i && q->mem_ops_increment_by_x) bits |= C8_Q_MEM_INC_X;
+  if (q->jump_with_offset_uses_vx0) bits |= C8_Q_JUMP_VX;
+  if (q->vf_reset) bits |= C8_Q_VF_RESET;
+  if (q->clip_sprites) bits |= C8_Q_CLIP;
+  if (q->display_wait) bits |= C8_Q_DISPLAY_WAIT;
+  return bits;
+}
+
+void chip8_set_quirks(Chip8* c8p, const Chip8Quirks* q) { c8_apply_quirks((Chip8Impl*)c8p, c8_quirk_bits(q)); }
+
+void chip8_get_quirks(const Chip8* c8p, Chip8Quirks* out) {
+  quirks_from_bits(((const Chip8Impl*)c8p)->quirks, out);
 }
 
 bool chip8_load_rom(Chip8* c8p, const uint8_t* data, size_t size) {
   Chip8Impl* c8 = (Chip8Impl*)c8p;
   if (!data && size > 0) return false;
-  if (0x200 + size > MEM_SIZE) return false;
+  if (0x200 + size > (size_t)c8->mem_mask + 1) return false;
+  if (!c8_pristine_alloc(c8, (uint32_t)c8->mem_mask + 1)) return false;
   memcpy(&c8->memory[0x200], data, size);
+  chip8_decoded_invalidate(c8, 0x200, (uint16_t)size);
+  chip8_jit_invalidate(c8, 0x200, (uint16_t)size);
+  c8_mem_touch_range(c8, 0x200, (uint32_t)size);
   c8->pc = 0x200;
+
+  // The image chip8_restart() returns to: refresh the pages either copy may have non-zero
+  for (unsigned w = 0; w < C8_PAGE_WORDS; ++w) {
+    for (uint64_t bits = c8->mem_used[w] | c8->pristine_used[w]; bits; bits &= bits - 1) {
+      unsigned page = w * 64 + c8_ctz64(bits);
+      memcpy(&c8->pristine[page << C8_PAGE_SHIFT], &c8->memory[page << C8_PAGE_SHIFT], C8_PAGE_SIZE);
+    }
+    c8->pristine_used[w] = c8->mem_used[w];
+    c8->mem_dirty[w] = 0;
+  }
+  c8->pristine_valid = true;
   return true;
 }
 
 void chip8_step(Chip8* c8p) {
   Chip8Impl* c8 = (Chip8Impl*)c8p;
-  if (c8->waiting_for_key) return; // stall
-  uint16_t opcode = (uint16_t)c8->memory[c8->pc] << 8 | c8->memory[c8->pc + 1];
+  c8->clock_cycles++;
+  if (c8->waiting_for_key) { // stall
+    C8_STATS_ADD(c8, key_wait_steps, 1);
+    return;
+  }
+  if (c8->waiting_for_vblank) return; // stall until the next tick
+  uint16_t pc = c8->pc;
+  uint16_t opcode = (uint16_t)(c8->memory[pc & c8->mem_mask] << 8 |
+                                c8->memory[(pc + 1) & c8->mem_mask]);
   bool auto_advance = chip8_execute_opcode((Chip8*)c8, opcode);
   if (auto_advance) c8->pc = (uint16_t)(c8->pc + 2);
+  if (c8->trace) chip8_trace_step(c8, pc, opcode);
+  c8_sound_edge(c8);
+}
+
+uint32_t chip8_run_cycles(Chip8* c8p, uint32_t budget, Chip8RunResult* out) {
+  Chip8Impl* c8 = (Chip8Impl*)c8p;
+  c8->events = 0;
+  // Nothing runs before the tick that ends a display wait
+  uint32_t done = c8->waiting_for_vblank ? budget : 0;
+  uint32_t interval = C8_IDLE_CHECK_FIRST;
+  while (done < budget) {
+    // Traces record every instruction, so traced runs never fast-forward.
+    // Slices double, so a spin entered after n instructions is found within
+    // about n more, and busy code pays for O(log budget) checks.
+    uint32_t slice = budget - done;
+    if (!c8->trace) {
+      uint32_t idle = c8_skip_idle(c8, slice);
+      if (idle) { done += idle; break; }
+      if (slice > interval) slice = interval;
+      if (interval < UINT32_MAX / 2) interval *= 2;
+    }
+    uint32_t n;
+    switch (c8->trace || c8->machine ? CHIP8_ENGINE_SWITCH : c8->engine) {
+      case CHIP8_ENGINE_CACHED: n = chip8_run_decoded(c8, slice); break;
+      case CHIP8_ENGINE_JIT: n = chip8_run_jit(c8, slice); break;
+      default: n = c8->trace ? chip8_interpret_traced(c8, slice) : chip8_interpret(c8, slice); break;
+    }
+    done += n;
+    if (n < slice || c8->events || c8->waiting_for_key) break;
+  }
+  c8->clock_cycles += done;
+  c8_sound_edge(c8);
+
+  Chip8RunResult r = {CHIP8_EXIT_BUDGET, done, 0};
+  if (c8->events & C8_EVT_INVALID) {
+    r.reason = CHIP8_EXIT_INVALID_OPCODE;
+    r.opcode = c8->invalid_opcode;
+  } else if (c8->waiting_for_key) {
+    r.reason = CHIP8_EXIT_KEY_WAIT;
+  } else if (c8->events & C8_EVT_SOUND) {
+    r.reason = CHIP8_EXIT_SOUND;
+  } else if (c8->events & C8_EVT_DISPLAY) {
+    r.reason = CHIP8_EXIT_DISPLAY;
+  }
+  if (out) *out = r;
+  return done;
+}
+
+bool chip8_set_engine(Chip8* c8p, Chip8Engine engine) {
+  Chip8Impl* c8 = (Chip8Impl*)c8p;
+  switch (engine) {
+    case CHIP8_ENGINE_SWITCH: break;
+    case CHIP8_ENGINE_CACHED:
+      if (!chip8_decoded_init(c8)) return false;
+      break;
+    case CHIP8_ENGINE_JIT:
+      if (!chip8_jit_init(c8)) return false;
+      break;
+    default: return false;
+  }
+  c8->engine = engine;
+  return true;
+}
+
+Chip8Engine chip8_get_engine(const Chip8* c8p) {
+  const Chip8Impl* c8 = (const Chip8Impl*)c8p;
+  return c8->engine;
 }
 
 void chip8_tick_60hz(Chip8* c8p) {
   Chip8Impl* c8 = (Chip8Impl*)c8p;
   if (c8->delay_timer > 0) c8->delay_timer--;
   if (c8->sound_timer > 0) c8->sound_timer--;
+  c8->waiting_for_vblank = false;
+  C8_STATS_FRAME(c8);
+  c8_sound_edge(c8);
 }
 
 void chip8_key_down(Chip8* c8p, uint8_t hex_key) {
@@ -126,10 +351,51 @@ void chip8_key_up(Chip8* c8p, uint8_t hex_key) {
 }
 
 const uint8_t* chip8_framebuffer(const Chip8* c8p) {
-  const Chip8Impl* c8 = (const Chip8Impl*)c8p;
+  // The unpacked view is a cache of fb; refreshing it does not change machine state
+  Chip8Impl* c8 = (Chip8Impl*)c8p;
+  if (c8->gfx_stale) {
+    unsigned width, height;
+    chip8_display_size(c8p, &width, &height);
+    for (unsigned y = 0; y < height; ++y) {
+      uint8_t* out = &c8->gfx[y * width];
+      for (unsigned x = 0; x < width; ++x) {
+        unsigned w = x >> 6, bit = 63 - (x & 63);
+        out[x] = (uint8_t)((c8->fb[0][w][y] >> bit & 1u) | (c8->fb[1][w][y] >> bit & 1u) << 1);
+      }
+    }
+    c8->gfx_stale = false;
+  }
   return c8->gfx;
 }
 
+const uint64_t* chip8_framebuffer_packed(const Chip8* c8p) {
+  const Chip8Impl* c8 = (const Chip8Impl*)c8p;
+  return c8->fb[0][0];
+}
+
+const uint64_t* chip8_display_planes(const Chip8* c8p) {
+  const Chip8Impl* c8 = (const Chip8Impl*)c8p;
+  return &c8->fb[0][0][0];
+}
+
+void chip8_display_size(const Chip8* c8p, unsigned* width, unsigned* height) {
+  const Chip8Impl* c8 = (const Chip8Impl*)c8p;
+  if (width) *width = c8->hires ? C8_HIRES_W : FB_WIDTH;
+  if (height) *height = c8->hires ? C8_HIRES_H : FB_HEIGHT;
+}
+
+uint32_t chip8_frame_generation(const Chip8* c8p) {
+  const Chip8Impl* c8 = (const Chip8Impl*)c8p;
+  return c8->fb_generation;
+}
+
+uint32_t chip8_consume_dirty_rows(Chip8* c8p) {
+  Chip8Impl* c8 = (Chip8Impl*)c8p;
+  uint32_t rows = c8->fb_dirty;
+  c8->fb_dirty = 0;
+  return rows;
+}
+
 void chip8_get_snapshot(const Chip8* c8p, Chip8Snapshot* out) {
   const Chip8Impl* c8 = (const Chip8Impl*)c8p;
   if (!out) return;
@@ -140,13 +406,29 @@ void chip8_get_snapshot(const Chip8* c8p, Chip8Snapshot* out) {
   out->sound_timer = c8->sound_timer;
   out->sp = c8->sp;
   out->stack_top = c8->sp ? c8->stack[c8->sp - 1] : 0;
-  // Simple hash of display buffer
-  uint32_t h = 2166136261u; // FNV-1a seed
-  for (size_t i = 0; i < FB_WIDTH * FB_HEIGHT; ++i) {
-    h ^= c8->gfx[i];
-    h *= 16777619u;
+  out->display_hash = c8->fb_hash;
+}
+
+uint16_t chip8_pc(const Chip8* c8p) { return ((const Chip8Impl*)c8p)->pc; }
+
+uint8_t chip8_delay_timer(const Chip8* c8p) { return ((const Chip8Impl*)c8p)->delay_timer; }
+
+uint8_t chip8_sound_timer(const Chip8* c8p) { return ((const Chip8Impl*)c8p)->sound_timer; }
+
+uint32_t chip8_display_hash(const Chip8* c8p) { return ((const Chip8Impl*)c8p)->fb_hash; }
+
+const uint8_t* chip8_memory(const Chip8* c8p, size_t* size) {
+  const Chip8Impl* c8 = (const Chip8Impl*)c8p;
+  if (size) *size = (size_t)c8->mem_mask + 1;
+  return c8->memory;
+}
+
+uint32_t c8_display_hash(const uint64_t fb[FB_HEIGHT]) {
+  uint32_t h = 0;
+  for (unsigned y = 0; y < FB_HEIGHT; ++y) {
+    if (fb[y]) h ^= c8_row_hash(y, fb[y]);
   }
-  out->display_hash = h;
+  return h;
 }
 
 const char* chip8_core_version(void) { return CHIP8_VERSION; }
@@ -1,9 +1,10 @@
 /**
  * CHIP-8 core API (platform-agnostic, no SDL or timing). This module exposes
  * an opaque `Chip8` instance that holds CPU state, memory, keypad, timers,
- * and a 64x32 1bpp frame buffer. The platform is responsible for providing a
- * deterministic RNG function and for calling chip8_tick_60hz() to decrement
- * timers at 60Hz.
+ * and a 64x32 1bpp frame buffer (128x64 and two planes on the SUPER-CHIP and
+ * XO-CHIP machines). The platform is responsible for providing a
+ * deterministic RNG function and for pacing: either chip8_run_for() with the
+ * host time that passed, or chip8_run_cycles() plus chip8_tick_60hz() at 60Hz.
  */
 
 #ifndef CHIP8_CORE_H
@@ -29,27 +30,249 @@ Chip8* chip8_create(chip8_rand_func rng, void* rng_user);
 void chip8_destroy(Chip8*);
 
 // Reset CPU, memory (keeps fontset installed), registers, timers, display and keypad.
+// Memory is tracked in pages, so this only clears what was written since.
 void chip8_reset(Chip8*);
 
 // Load a ROM into memory starting at 0x200. Returns false if it would overflow memory.
+// The memory image after loading is kept for chip8_restart(), in a buffer of
+// the machine's memory size allocated by the first load (false if that fails).
 bool chip8_load_rom(Chip8*, const uint8_t* data, size_t size);
 
+// chip8_reset(), but with memory as it was right after the last
+// chip8_load_rom() (font included), restoring only the pages written since:
+// the fast way to run a ROM again from the start. Without a loaded ROM (or
+// after chip8_set_machine()) it is chip8_reset().
+void chip8_restart(Chip8*);
+
+// Make dst a copy of src's machine: memory, the chip8_restart() image,
+// registers, display, keypad, quirks, machine variant and clock. Only the
+// memory pages either machine has written are compared, and only those that
+// differ are copied. dst keeps its own RNG, engine selection, sound callback,
+// trace and statistics; with an RNG whose state lives in rng_user, copy that
+// too for the clone to repeat src exactly.
+void chip8_clone(Chip8* dst, const Chip8* src);
+
 // Execute one fetch-decode-execute CPU cycle. Does not tick timers.
 void chip8_step(Chip8*);
 
-// Tick timers at 60Hz: if delay/sound timers > 0, decrement by 1.
+// Reason chip8_run_cycles() returned. Every reason except BUDGET means the run
+// stopped right after the instruction that caused it.
+typedef enum Chip8ExitReason {
+  CHIP8_EXIT_BUDGET = 0,     // executed the full budget
+  CHIP8_EXIT_DISPLAY,        // 00E0 or Dxyn updated the frame buffer
+  CHIP8_EXIT_KEY_WAIT,       // stalled in Fx0A until chip8_key_down()
+  CHIP8_EXIT_SOUND,          // Fx18 started the sound timer from 0
+  CHIP8_EXIT_INVALID_OPCODE, // opcode outside the CHIP-8 set (skipped like a no-op)
+} Chip8ExitReason;
+
+typedef struct Chip8RunResult {
+  Chip8ExitReason reason;
+  uint32_t cycles; // instructions executed by this call
+  uint16_t opcode; // offending opcode for CHIP8_EXIT_INVALID_OPCODE, else 0
+} Chip8RunResult;
+
+// Execute up to `budget` CPU cycles in one call, returning early with a reason.
+// Returns the number of cycles executed (also in out->cycles); out may be NULL.
+// Does not tick timers. Returns 0 with CHIP8_EXIT_KEY_WAIT while stalled in Fx0A.
+// While the display_wait quirk holds the machine after a Dxyn, the whole
+// budget passes waiting for the next tick.
+// A call that starts in a delay-timer spin or a jump to itself (see
+// chip8_idle_state()) spins out the whole budget in constant time, leaving
+// exactly the state executing it would.
+uint32_t chip8_run_cycles(Chip8*, uint32_t budget, Chip8RunResult* out);
+
+// Execution engines selectable for chip8_run_cycles(). All produce identical
+// machine state; they differ only in speed.
+typedef enum Chip8Engine {
+  CHIP8_ENGINE_SWITCH = 0, // reference decode-and-switch interpreter
+  CHIP8_ENGINE_CACHED,     // pre-decoded instruction cache with threaded dispatch
+  CHIP8_ENGINE_JIT,        // x86-64 basic-block recompiler (x86-64 Linux/BSD builds only)
+} Chip8Engine;
+
+// Select the engine used by chip8_run_cycles(); chip8_step() always runs the
+// reference interpreter. Returns false if the engine cannot be set up.
+bool chip8_set_engine(Chip8*, Chip8Engine engine);
+Chip8Engine chip8_get_engine(const Chip8*);
+
+// Machine variants. SUPER-CHIP adds the 128x64 mode (00FE/00FF), 16x16
+// sprites (Dxy0), scrolling (00Cn/00FB/00FC), exit (00FD), large digits
+// (Fx30) and persistent flags (Fx75/Fx85). XO-CHIP adds scrolling up (00Dn),
+// range saves and loads (5xy2/5xy3), 16-bit I loads (F000 nnnn), two
+// bitplanes (Fn01), the audio pattern and pitch (F002/Fx3A) and 64 KB of
+// memory. Scroll amounts are in pixels of the current resolution, switching
+// resolution clears the display, and Dxyn on an extended machine sets VF to
+// 1 on any collision. Selecting a machine resets it like chip8_reset() and
+// installs its fonts; load the ROM afterwards. Extended machines always run
+// on the reference interpreter, whatever chip8_set_engine() selected. The
+// flags survive resets, and are saved with states.
+typedef enum Chip8Machine {
+  CHIP8_MACHINE_CHIP8 = 0,
+  CHIP8_MACHINE_SCHIP,
+  CHIP8_MACHINE_XOCHIP,
+} Chip8Machine;
+
+bool chip8_set_machine(Chip8*, Chip8Machine machine); // false for an unknown machine
+Chip8Machine chip8_get_machine(const Chip8*);
+
+// Quirks: behaviors that differ between the historical interpreters. They
+// are independent of the machine variant and can be changed at any time;
+// chip8_reset() keeps them and save states and movies carry them.
+typedef struct Chip8Quirks {
+  bool shift_uses_vy;             // 8xy6/8xyE shift Vy into Vx; false shifts Vx in place
+  bool mem_ops_increment_i;       // Fx55/Fx65 leave I past the last register moved (I += x + 1)
+  bool mem_ops_increment_by_x;    // with the above, I += x only (CHIP-48)
+  bool jump_with_offset_uses_vx0; // Bxnn jumps to xnn + Vx; false jumps to nnn + V0
+  bool vf_reset;                  // 8xy1/8xy2/8xy3 clear VF
+  bool clip_sprites;              // Dxyn clips at the right edge instead of wrapping to the left
+  bool display_wait;              // Dxyn waits for the next 60Hz tick before anything else runs
+} Chip8Quirks;
+
+// Named quirk sets. DEFAULT is what chip8_create() selects: shift Vx, I
+// incremented by x + 1, Bnnn plus V0, VF reset, sprites wrapping, no wait.
+// The engines run specialized code for each of these sets, with no quirk
+// tests per instruction; any other combination works but tests them.
+typedef enum Chip8QuirkProfile {
+  CHIP8_QUIRKS_DEFAULT = 0,
+  CHIP8_QUIRKS_VIP,    // COSMAC VIP: shift Vy, I += x + 1, VF reset, clipping, display wait
+  CHIP8_QUIRKS_CHIP48, // HP-48 CHIP-48: shift Vx, I += x, Bxnn + Vx, clipping
+  CHIP8_QUIRKS_SCHIP,  // SUPER-CHIP 1.1: shift Vx, I kept, Bxnn + Vx, clipping
+  CHIP8_QUIRKS_XOCHIP, // XO-CHIP (Octo): shift Vy, I += x + 1, wrapping
+} Chip8QuirkProfile;
+
+// Fill *out with a profile's quirks; false for an unknown profile.
+bool chip8_quirk_profile(Chip8QuirkProfile profile, Chip8Quirks* out);
+
+// Select the quirks used from the next instruction on. Leaving display_wait
+// ends a wait in progress.
+void chip8_set_quirks(Chip8*, const Chip8Quirks* quirks);
+void chip8_get_quirks(const Chip8*, Chip8Quirks* out);
+
+// Tick timers at 60Hz: if delay/sound timers > 0, decrement by 1. Ends a
+// display wait.
 void chip8_tick_60hz(Chip8*);
 
+// Scheduler. chip8_run_for() runs the machine for `host_ns` nanoseconds of
+// emulated time at the CPU clock and derives the 60Hz timer ticks from the
+// cycle count, so every cpu_hz cycles make exactly 60 ticks whatever the
+// rate. Fractions of a cycle and of a tick carry over to the next call; cycles
+// spent stalled in Fx0A count as elapsed. Turbo or slow motion is a matter of
+// scaling host_ns. Returns the number of ticks applied. chip8_reset() drops
+// the carried fractions; changing the clock does too.
+#define CHIP8_DEFAULT_CPU_HZ 700
+
+uint32_t chip8_run_for(Chip8*, uint64_t host_ns);
+void chip8_set_cpu_hz(Chip8*, uint32_t hz); // 0 is ignored
+uint32_t chip8_get_cpu_hz(const Chip8*);
+
+// Host time chip8_run_for() needs to reach the next 60Hz tick.
+uint64_t chip8_ns_until_tick(const Chip8*);
+
+// Emulated time: every cycle executed (or stalled in chip8_run_for()) counts
+// 1/cpu_hz seconds. Resets do not rewind it.
+uint64_t chip8_emulated_ns(const Chip8*);
+
+// Sound edges. The callback runs, on the thread driving the core, whenever
+// the sound output turns on (the sound timer set from 0) or off (it reaches
+// 0), stamped with the emulated time of that cycle: exact for starts and
+// ticks; a stop by Fx18 with 0 is stamped at the end of the run that did it.
+// fn may be NULL to detach.
+typedef void (*chip8_sound_func)(void* user, uint64_t time_ns, bool on);
+void chip8_set_sound_callback(Chip8*, chip8_sound_func fn, void* user);
+
+// Idle detection, for hosts that want to sleep instead of spinning. Until the
+// event named, the machine only repeats itself (timers still tick).
+typedef enum Chip8Idle {
+  CHIP8_IDLE_NONE = 0,
+  CHIP8_IDLE_DELAY_SPIN,   // Fx07 / 3xkk or 4xkk / 1nnn polling the delay timer: next tick
+  CHIP8_IDLE_HALT,         // 1nnn jumping to itself, or SUPER-CHIP 00FD: reset
+  CHIP8_IDLE_KEY_WAIT,     // stalled in Fx0A: chip8_key_down()
+  CHIP8_IDLE_DISPLAY_WAIT, // held after Dxyn by the display_wait quirk: next tick
+} Chip8Idle;
+
+Chip8Idle chip8_idle_state(const Chip8*);
+
 // Keypad input: hex_key is 0x0..0xF. Keys outside range are ignored.
 void chip8_key_down(Chip8*, uint8_t hex_key);
 void chip8_key_up(Chip8*, uint8_t hex_key);
 
-// Access the 64x32 monochrome frame buffer (values are 0 or 1 per pixel).
+// Current display resolution: 64x32, or 128x64 after 00FF.
+#define CHIP8_DISPLAY_MAX_WIDTH 128
+#define CHIP8_DISPLAY_MAX_HEIGHT 64
+#define CHIP8_DISPLAY_PLANES 2
+void chip8_display_size(const Chip8*, unsigned* width, unsigned* height);
+
+// Access the frame buffer unpacked, one byte per pixel of the current
+// resolution, row by row. Each value has bit p set when plane p is lit, so a
+// CHIP-8 or SUPER-CHIP display holds 0 or 1. This view is rebuilt on demand
+// after the display changes.
 const uint8_t* chip8_framebuffer(const Chip8*);
 
+// Access the 64x32 frame buffer as stored: 32 rows of 64 bits, the most
+// significant bit is the leftmost pixel. Plane 0 in low resolution.
+const uint64_t* chip8_framebuffer_packed(const Chip8*);
+
+// Every plane as stored, for any resolution: CHIP8_DISPLAY_PLANES planes of
+// two column words of CHIP8_DISPLAY_MAX_HEIGHT rows, i.e.
+// uint64_t[CHIP8_DISPLAY_PLANES][2][CHIP8_DISPLAY_MAX_HEIGHT]. Word 0 of a row
+// holds pixels 0..63 (bit 63 leftmost) and word 1 pixels 64..127; low
+// resolution uses word 0 of rows 0..31.
+const uint64_t* chip8_display_planes(const Chip8*);
+
+// Frame-change tracking for renderers. The generation increases whenever an
+// instruction (or reset) changes at least one pixel, so an unchanged value
+// means the previous frame can be reused. The dirty set has bit y set for
+// every row changed since the last consume call (rows 2y and 2y + 1 in
+// 128x64); consuming clears it.
+uint32_t chip8_frame_generation(const Chip8*);
+uint32_t chip8_consume_dirty_rows(Chip8*);
+
+// Save states: a versioned, little-endian image of the whole machine (memory,
+// registers, stack, timers, keypad, Fx0A wait, frame buffer, quirks, machine
+// variant and its extra registers). The engine selection is not part of the
+// state. No heap allocation is involved. CHIP-8 states stay about 4 KB; an
+// XO-CHIP state holds all 64 KB of memory.
+typedef enum Chip8StateFlags {
+  CHIP8_STATE_RAW = 0,        // fixed size, every byte of memory stored
+  CHIP8_STATE_COMPRESSED = 1, // only non-zero memory spans and frame rows; font implied
+} Chip8StateFlags;
+
+// Upper bound of chip8_state_size() for any machine and flags, and for
+// CHIP-8 machines.
+#define CHIP8_STATE_MAX_SIZE 67760
+#define CHIP8_STATE_MAX_SIZE_CHIP8 4480
+
+// Exact number of bytes chip8_save_state() will write with these flags.
+size_t chip8_state_size(const Chip8*, unsigned flags);
+
+// Write the state into buf. Returns the bytes written, or 0 if size is too small.
+size_t chip8_save_state(const Chip8*, void* buf, size_t size, unsigned flags);
+
+// Restore a state written by chip8_save_state() (either encoding). Returns
+// false, leaving the machine untouched, if the buffer is malformed or from an
+// unsupported version.
+bool chip8_load_state(Chip8*, const void* buf, size_t size);
+
+// 64-bit hash of everything a save state holds, for comparing machines
+// often: memory is read only from pages the machine has used, so it costs
+// far less than a save. Equal machines hash equal within one build; the
+// value is not stable across hosts or versions.
+uint64_t chip8_state_hash(const Chip8*);
+
 // Extract a compact snapshot for tests.
 void chip8_get_snapshot(const Chip8*, Chip8Snapshot* out);
 
+// Single fields of the snapshot, without building one. The display hash is
+// maintained by every instruction that draws, so none of these scan the
+// frame buffer.
+uint16_t chip8_pc(const Chip8*);
+uint8_t chip8_delay_timer(const Chip8*);
+uint8_t chip8_sound_timer(const Chip8*);
+uint32_t chip8_display_hash(const Chip8*);
+
+// Read-only view of memory (4 KB, 64 KB on XO-CHIP), e.g. for debuggers;
+// *size gets its length. Valid until the machine is destroyed.
+const uint8_t* chip8_memory(const Chip8*, size_t* size);
+
 // Returns the Chip-8 core version string.
 const char* chip8_core_version(void);
 
@@ -0,0 +1,69 @@
+/**
+ * Lockstep batch core: N independent CHIP-8 machines ("lanes") running the
+ * same ROM, e.g. for seed or input sweeps. Registers, timers and PCs are kept
+ * structure-of-arrays so lanes that sit at the same PC execute data
+ * instructions with one SIMD operation per 16/32 lanes; lanes that diverge
+ * (different PC or self-modified code) are stepped one at a time.
+ *
+ * Every lane behaves exactly like a Chip8 driven by chip8_step() with the
+ * same quirks: same RNG calls, same stall in Fx0A and in display waits.
+ */
+
+#ifndef CHIP8_BATCH_H
+#define CHIP8_BATCH_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "chip8.h"
+#include "chip8_state.h"
+
+#define CHIP8_BATCH_MAX_LANES 64
+
+typedef struct Chip8Batch Chip8Batch; // Opaque state
+
+// Create `lanes` machines (1..CHIP8_BATCH_MAX_LANES), all reset with the
+// fontset installed and no RNG (Cxkk yields 0) until chip8_batch_set_rng().
+Chip8Batch* chip8_batch_create(unsigned lanes);
+void chip8_batch_destroy(Chip8Batch*);
+unsigned chip8_batch_lanes(const Chip8Batch*);
+
+// Per-lane RNG for Cxkk, same contract as chip8_create().
+void chip8_batch_set_rng(Chip8Batch*, unsigned lane, chip8_rand_func rng, void* rng_user);
+
+// Quirks for every lane, as chip8_set_quirks(); the default is
+// CHIP8_QUIRKS_DEFAULT. Kept by resets.
+void chip8_batch_set_quirks(Chip8Batch*, const Chip8Quirks* quirks);
+
+// Reset every lane as chip8_reset() does.
+void chip8_batch_reset(Chip8Batch*);
+
+// Load the same ROM into every lane at 0x200. Returns false if it would overflow memory.
+bool chip8_batch_load_rom(Chip8Batch*, const uint8_t* data, size_t size);
+
+// Execute one chip8_step() on every lane; lanes stalled in Fx0A or a
+// display wait stay put.
+void chip8_batch_step(Chip8Batch*);
+void chip8_batch_run(Chip8Batch*, uint32_t steps);
+
+// Timers tick on all lanes together; keys are per lane.
+void chip8_batch_tick_60hz(Chip8Batch*);
+void chip8_batch_key_down(Chip8Batch*, unsigned lane, uint8_t hex_key);
+void chip8_batch_key_up(Chip8Batch*, unsigned lane, uint8_t hex_key);
+
+// Per-lane state, equal to chip8_get_snapshot()/chip8_framebuffer_packed()
+// of a Chip8 that ran the same instructions.
+void chip8_batch_get_snapshot(const Chip8Batch*, unsigned lane, Chip8Snapshot* out);
+const uint64_t* chip8_batch_framebuffer_packed(const Chip8Batch*, unsigned lane);
+
+// How lane-steps were executed so far, to judge how well a ROM stays in lockstep.
+typedef struct Chip8BatchStats {
+  uint64_t vector_lane_steps; // lane-steps run by a SIMD group operation
+  uint64_t scalar_lane_steps; // lane-steps run one lane at a time
+  uint64_t groups;            // (pc, opcode) groups dispatched
+} Chip8BatchStats;
+
+void chip8_batch_get_stats(const Chip8Batch*, Chip8BatchStats* out);
+
+#endif // CHIP8_BATCH_H
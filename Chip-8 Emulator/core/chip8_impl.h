@@ -0,0 +1,354 @@
+
+#ifndef CHIP8_IMPL_H
+#define CHIP8_IMPL_H
+
+// Private definition of the Chip8 instance shared by the core translation units.
+// Not installed and not part of the public API; platforms only see `Chip8*`.
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "chip8.h"
+#include "chip8_stats.h"
+#include "chip8_trace.h"
+#include "opcodes.h"
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+// The classic machine's address space and display. Extended machines
+// (chip8_set_machine()) address up to C8_MEM_MAX bytes through mem_mask and
+// draw on up to C8_PLANES planes of C8_HIRES_W x C8_HIRES_H.
+#define MEM_SIZE 4096
+#define FB_WIDTH 64
+#define FB_HEIGHT 32
+#define MEM_MASK (MEM_SIZE - 1)
+#define C8_MEM_MAX 0x10000
+#define C8_HIRES_W 128
+#define C8_HIRES_H 64
+#define C8_PLANES 2
+#define C8_FONTSET_ADDR 0x50
+#define C8_FONTSET_SIZE 80
+#define C8_BIGFONT_ADDR (C8_FONTSET_ADDR + C8_FONTSET_SIZE) // 10-byte digits for Fx30
+#define C8_BIGFONT_SIZE 160
+
+// Dirty tracking granularity: memory is reset, restored and cloned in pages
+#define C8_PAGE_SHIFT 8
+#define C8_PAGE_SIZE (1u << C8_PAGE_SHIFT)
+#define C8_PAGES (C8_MEM_MAX >> C8_PAGE_SHIFT)
+#define C8_PAGE_WORDS (C8_PAGES / 64)
+
+// Events raised by opcode handlers; chip8_run_cycles() stops after the
+// instruction that raised one.
+#define C8_EVT_DISPLAY (1u << 0)  // 00E0 / Dxyn touched the frame buffer
+#define C8_EVT_KEY_WAIT (1u << 1) // Fx0A entered the key wait
+#define C8_EVT_SOUND (1u << 2)    // Fx18 started the sound timer from 0
+#define C8_EVT_INVALID (1u << 3)  // opcode not in the CHIP-8 set
+
+// Chip8Quirks as bits, the form every engine tests. A helper whose behavior
+// depends on a quirk takes these bits as an argument; the switch interpreter
+// passes a constant from one of its per-profile loops so the tests fold away.
+#define C8_Q_SHIFT_VY (1u << 0)
+#define C8_Q_MEM_INC (1u << 1)
+#define C8_Q_JUMP_VX (1u << 2)
+#define C8_Q_VF_RESET (1u << 3)
+#define C8_Q_CLIP (1u << 4)
+#define C8_Q_DISPLAY_WAIT (1u << 5)
+#define C8_Q_MEM_INC_X (1u << 6) // with C8_Q_MEM_INC: I += x
+#define C8_Q_ALL 0x7Fu
+
+// The Chip8QuirkProfile sets, in enum order. Each gets its own specialized
+// interpreter loop; other combinations run the GENERIC one.
+#define C8_Q_DEFAULT (C8_Q_MEM_INC | C8_Q_VF_RESET)
+#define C8_Q_VIP (C8_Q_SHIFT_VY | C8_Q_MEM_INC | C8_Q_VF_RESET | C8_Q_CLIP | C8_Q_DISPLAY_WAIT)
+#define C8_Q_CHIP48 (C8_Q_MEM_INC | C8_Q_MEM_INC_X | C8_Q_JUMP_VX | C8_Q_CLIP)
+#define C8_Q_SCHIP (C8_Q_JUMP_VX | C8_Q_CLIP)
+#define C8_Q_XOCHIP (C8_Q_SHIFT_VY | C8_Q_MEM_INC)
+#define C8_QUIRK_PROFILES(X) X(DEFAULT) X(VIP) X(CHIP48) X(SCHIP) X(XOCHIP)
+
+enum {
+#define X(name) C8_QV_##name,
+  C8_QUIRK_PROFILES(X)
+#undef X
+  C8_QV_GENERIC,
+  C8_QV_COUNT
+};
+
+// For the bodies the per-profile loops are instantiated from: inlined into
+// each, the constant quirk bits fold away.
+#if defined(__GNUC__)
+#define C8_ALWAYS_INLINE inline __attribute__((always_inline))
+#elif defined(_MSC_VER)
+#define C8_ALWAYS_INLINE __forceinline
+#else
+#define C8_ALWAYS_INLINE inline
+#endif
+
+// Quirk operands. VF after 8xy1/8xy2/8xy3 is VF & c8_qvf_keep().
+static inline uint8_t c8_qvf_keep(unsigned q) { return q & C8_Q_VF_RESET ? 0 : 0xFF; }
+
+// Register 8xy6/8xyE shift
+static inline uint8_t c8_qshift_src(unsigned q, uint8_t x, uint8_t y) { return q & C8_Q_SHIFT_VY ? y : x; }
+
+// Register Bnnn adds to the address
+static inline uint8_t c8_qjump_reg(unsigned q, uint8_t x) { return q & C8_Q_JUMP_VX ? x : 0; }
+
+// How far Fx55/Fx65 advance I
+static inline uint8_t c8_qmem_step(unsigned q, uint8_t x) {
+  if (!(q & C8_Q_MEM_INC)) return 0;
+  return (uint8_t)(q & C8_Q_MEM_INC_X ? x : x + 1);
+}
+
+// Quirk bits as stored in save states and movies. VF reset is stored
+// inverted: files from before it was a quirk have the bit clear and were
+// made with VF always reset.
+static inline uint8_t c8_quirks_serial(uint8_t q) { return (uint8_t)(q ^ C8_Q_VF_RESET); }
+
+typedef struct Chip8 {
+  // Memory and registers. Only memory[0..mem_mask] is addressable.
+  uint8_t memory[C8_MEM_MAX];
+  uint16_t mem_mask; // MEM_MASK, or 0xFFFF on XO-CHIP
+
+  // Dirty pages, one bit per C8_PAGE_SIZE bytes, so that resets, restarts
+  // and clones cost what the program wrote rather than the address space.
+  // pristine is memory right after the last chip8_load_rom() (valid until
+  // the machine changes), allocated at that machine's memory size by the
+  // first load; pristine_used covers whatever the buffer holds even when it
+  // is no longer valid.
+  uint64_t mem_used[C8_PAGE_WORDS];      // pages that may be non-zero
+  uint64_t mem_dirty[C8_PAGE_WORDS];     // pages that may differ from pristine
+  uint64_t pristine_used[C8_PAGE_WORDS]; // pages of pristine that may be non-zero
+  bool pristine_valid;
+  uint8_t* pristine;      // pristine_size bytes, NULL before the first load
+  uint32_t pristine_size; // mem_mask + 1 when it was allocated
+  uint8_t V[16];
+  uint16_t I;
+  uint16_t pc;
+
+  // Stack
+  uint16_t stack[16];
+  uint8_t sp;
+
+  // Timers
+  uint8_t delay_timer;
+  uint8_t sound_timer;
+
+  // Frame buffer, word-major: fb[plane][word][y] holds pixels 64 * word ..
+  // 64 * word + 63 of row y, bit 63 leftmost. Low resolution uses word 0 of
+  // rows 0..31 only, so fb[0][0] is the classic 64x32 display. gfx is the
+  // unpacked per-pixel view for chip8_framebuffer(), rebuilt lazily when stale.
+  uint64_t fb[C8_PLANES][2][C8_HIRES_H];
+  uint8_t gfx[C8_HIRES_W * C8_HIRES_H];
+  bool gfx_stale;
+  uint32_t fb_generation; // bumped by every instruction that changes a pixel
+  uint32_t fb_dirty;      // bit y: row y (row pair 2y..2y+1 in hires) changed since consumed
+  uint32_t fb_hash;       // c8_fb_hash(), kept up to date by everything that draws
+
+  // Extended machines (schip.c)
+  Chip8Machine machine;
+  bool hires;               // 128x64, selected by 00FF
+  uint8_t planes;           // XO-CHIP plane mask selected by Fn01; 1 otherwise
+  uint8_t flags[16];        // Fx75/Fx85 persistent flags; survive resets
+  uint8_t audio_pattern[16]; // XO-CHIP F002 pattern buffer
+  uint8_t pitch;            // XO-CHIP Fx3A
+
+  // Keypad
+  uint8_t keypad[16];
+
+  // RNG
+  chip8_rand_func rng;
+  void* rng_user;
+
+  // Execution state
+  bool waiting_for_key;
+  uint8_t wait_key_reg;
+  bool waiting_for_vblank; // held after Dxyn until the next tick (display_wait quirk)
+  uint32_t events;         // C8_EVT_* raised since the last run_cycles() entry
+  uint16_t invalid_opcode; // last opcode that raised C8_EVT_INVALID
+
+  // Engine selection; per-engine state is allocated on first selection
+  Chip8Engine engine;
+  struct C8Decoded* dcache;
+  struct C8Jit* jit;
+
+  // Quirks
+  uint8_t quirks;        // C8_Q_* bits
+  uint8_t quirk_variant; // C8_QV_* loop specialized for them
+
+  // Scheduler (sched.c): the CPU clock and the fractions chip8_run_for() carries
+  uint32_t cpu_hz;
+  uint64_t clock_frac; // host ns * cpu_hz not yet worth a whole cycle, in 1e-9 cycles
+  uint32_t tick_phase; // 60 * cycles since the last 60Hz tick, always < cpu_hz
+  uint64_t clock_base_ns; // emulated time when cpu_hz was last set
+  uint64_t clock_cycles;  // cycles executed or stalled since then
+
+  // Sound edges (chip8_set_sound_callback)
+  chip8_sound_func sound_fn;
+  void* sound_user;
+  bool sound_on; // sound_timer > 0 as last reported
+
+  // Attached execution trace (trace.c), NULL when not tracing
+  Chip8TraceHeader* trace;
+  uint32_t trace_countdown; // instructions until the next checkpoint
+
+#ifdef CHIP8_ENABLE_STATS
+  Chip8Stats stats;
+  uint64_t frame_start; // stats.instructions at the previous 60Hz tick
+#endif
+} Chip8Impl;
+
+// Hex digit sprites installed at C8_FONTSET_ADDR (opcodes.c), and the large
+// digits extended machines install at C8_BIGFONT_ADDR (schip.c)
+extern const uint8_t c8_fontset[C8_FONTSET_SIZE];
+extern const uint8_t c8_bigfont[C8_BIGFONT_SIZE];
+
+// Index of the lowest set bit of a non-zero word
+static inline unsigned c8_ctz64(uint64_t v) {
+#if defined(_MSC_VER)
+  unsigned long i;
+  _BitScanForward64(&i, v);
+  return (unsigned)i;
+#else
+  return (unsigned)__builtin_ctzll(v);
+#endif
+}
+
+// Mark the pages of memory[addr .. addr + len) written (chip8.c)
+void c8_mem_touch_range(Chip8Impl* c8, uint32_t addr, uint32_t len);
+
+// Drop what the engines decoded from a page whose bytes were replaced (chip8.c)
+void c8_mem_forget_page(Chip8Impl* c8, unsigned page);
+
+// Give c8 an all-zero restart image of size bytes, keeping the one it has if
+// that is the size already. Invalidates it otherwise; false if out of memory.
+bool c8_pristine_alloc(Chip8Impl* c8, uint32_t size);
+
+// Mark a store of len bytes at addr, wrapping at mem_mask. No store is longer
+// than a page, so the pages of its first and last byte cover it.
+static inline void c8_mem_touch(Chip8Impl* c8, uint16_t addr, uint16_t len) {
+  unsigned first = (unsigned)(addr & c8->mem_mask) >> C8_PAGE_SHIFT;
+  unsigned last = (unsigned)((addr + len - 1u) & c8->mem_mask) >> C8_PAGE_SHIFT;
+  uint64_t first_bit = 1ull << (first & 63), last_bit = 1ull << (last & 63);
+  c8->mem_used[first >> 6] |= first_bit;
+  c8->mem_dirty[first >> 6] |= first_bit;
+  c8->mem_used[last >> 6] |= last_bit;
+  c8->mem_dirty[last >> 6] |= last_bit;
+}
+
+// Display hash: the XOR over all rows of c8_row_hash(y, row). A row's term
+// depends on its position and its bits, and is 0 for a blank row, so drawing
+// into one row updates the hash with two row hashes and a clear resets it to 0.
+static inline uint32_t c8_row_hash(unsigned y, uint64_t row) {
+  // Odd per-row multiplier, then the murmur3 finalizer; both are bijective
+  uint64_t v = row * (0x9E3779B97F4A7C15ull * (2 * y + 1));
+  v ^= v >> 33;
+  v *= 0xFF51AFD7ED558CCDull;
+  v ^= v >> 33;
+  v *= 0xC4CEB9FE1A85EC53ull;
+  v ^= v >> 33;
+  return (uint32_t)(v ^ v >> 32);
+}
+
+// Full recomputation over the classic 64x32 rows, as reported in Chip8Snapshot
+uint32_t c8_display_hash(const uint64_t fb[FB_HEIGHT]);
+
+// Extended displays hash every word: word w of row y in plane p counts as
+// row (2p + w) * C8_HIRES_H + y, so fb[0][0] hashes as the classic display.
+static inline unsigned c8_fb_index(unsigned plane, unsigned word, unsigned y) {
+  return (2 * plane + word) * C8_HIRES_H + y;
+}
+
+// Full recomputation over every plane (schip.c)
+uint32_t c8_fb_hash(const Chip8Impl* c8);
+
+// SUPER-CHIP / XO-CHIP instructions (schip.c). c8_execute_ext() runs an
+// opcode outside the classic set on an extended machine, with the contract of
+// chip8_execute_opcode(); c8_draw_ext() and c8_cls_ext() replace Dxyn and 00E0
+// there.
+bool c8_execute_ext(Chip8Impl* c8, uint16_t opcode);
+void c8_draw_ext(Chip8Impl* c8, uint8_t x, uint8_t y, uint8_t n, unsigned q);
+void c8_cls_ext(Chip8Impl* c8);
+
+// Chip8Quirks as C8_Q_* bits (chip8.c)
+uint8_t c8_quirk_bits(const Chip8Quirks* q);
+
+// Select quirk bits (C8_Q_ALL at most), their specialized loop, and drop
+// what the engines compiled for the previous ones (chip8.c)
+void c8_apply_quirks(Chip8Impl* c8, uint8_t bits);
+
+// Emulated time of the current cycle (sched.c)
+uint64_t c8_emulated_ns(const Chip8Impl* c8);
+
+// Report a change of sound_timer > 0 to the sound callback. Called after
+// anything that can start or stop the sound: runs, steps, ticks, resets and
+// state loads.
+static inline void c8_sound_edge(Chip8Impl* c8) {
+  bool on = c8->sound_timer > 0;
+  if (on == c8->sound_on) return;
+  c8->sound_on = on;
+  if (c8->sound_fn) c8->sound_fn(c8->sound_user, c8_emulated_ns(c8), on);
+}
+
+// Statistics hooks (stats.c); without CHIP8_ENABLE_STATS they compile to nothing
+#ifdef CHIP8_ENABLE_STATS
+static inline void c8_stats_insn(Chip8Impl* c8, unsigned cls) {
+  c8->stats.instructions++;
+  c8->stats.op_class[cls]++;
+  c8->stats.pc_heat[c8->pc & MEM_MASK]++;
+}
+void chip8_stats_frame(Chip8Impl* c8);
+#define C8_STATS_INSN(c8, cls) c8_stats_insn((c8), (cls))
+#define C8_STATS_ADD(c8, field, n) ((c8)->stats.field += (n))
+#define C8_STATS_FRAME(c8) chip8_stats_frame(c8)
+#else
+#define C8_STATS_INSN(c8, cls) ((void)0)
+#define C8_STATS_ADD(c8, field, n) ((void)0)
+#define C8_STATS_FRAME(c8) ((void)0)
+#endif
+
+// Run up to `budget` instructions with the switch interpreter, stopping after
+// any instruction that raises an event. Returns the number executed.
+uint32_t chip8_interpret(Chip8Impl* c8, uint32_t budget);
+
+// Switch interpreter that appends every instruction to the attached trace.
+uint32_t chip8_interpret_traced(Chip8Impl* c8, uint32_t budget);
+
+// Append the instruction at `pc` that just executed to the attached trace (trace.c).
+void chip8_trace_step(Chip8Impl* c8, uint16_t pc, uint16_t opcode);
+
+// Pre-decoded engine (decoded.c): same contract as chip8_interpret().
+bool chip8_decoded_init(Chip8Impl* c8);
+void chip8_decoded_free(Chip8Impl* c8);
+uint32_t chip8_run_decoded(Chip8Impl* c8, uint32_t budget);
+// Drop decoded instructions overlapping [addr, addr + len), or all of them.
+void chip8_decoded_invalidate(Chip8Impl* c8, uint16_t addr, uint16_t len);
+void chip8_decoded_flush(Chip8Impl* c8);
+
+// What the scheduler drives: plain chip8_run_cycles()/chip8_tick_60hz(), or
+// the movie recorder's wrappers so every scheduled tick becomes an event.
+typedef struct C8SchedOps {
+  uint32_t (*run)(void* user, Chip8* c8, uint32_t budget, Chip8RunResult* out);
+  void (*tick)(void* user, Chip8* c8);
+  void* user;
+} C8SchedOps;
+
+// chip8_run_for() through `ops` (sched.c). Returns the 60Hz ticks applied.
+uint32_t c8_run_for(Chip8Impl* c8, uint64_t host_ns, const C8SchedOps* ops);
+
+// chip8_run_cycles() looks for an idle loop before each engine slice; the
+// first slice is this long and each one after doubles.
+#define C8_IDLE_CHECK_FIRST 64
+
+// If pc is in an idle loop that would spin for the whole budget, leave the
+// machine as running it would and return budget; otherwise 0 (sched.c).
+uint32_t c8_skip_idle(Chip8Impl* c8, uint32_t budget);
+
+// x86-64 JIT engine (jit_x64.c): same contract; init fails where unsupported.
+bool chip8_jit_init(Chip8Impl* c8);
+void chip8_jit_free(Chip8Impl* c8);
+uint32_t chip8_run_jit(Chip8Impl* c8, uint32_t budget);
+void chip8_jit_invalidate(Chip8Impl* c8, uint16_t addr, uint16_t len);
+void chip8_jit_flush(Chip8Impl* c8);
+
+#endif // CHIP8_IMPL_H
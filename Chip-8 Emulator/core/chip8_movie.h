@@ -0,0 +1,75 @@
+/**
+ * Input movies: a recording of everything that feeds a deterministic run (the
+ * RNG seed, the machine variant and quirks, the ROM's hash) plus every keypad
+ * change, 60Hz tick and reset, each stamped with the number of instructions
+ * executed before it. Every tick also stores the display hash, so playback
+ * checks each frame against the recording as it goes.
+ *
+ * Movies do not depend on wall-clock time: playback runs as fast as the engine
+ * allows, and a recording made in the SDL front-end replays bit-exactly in a
+ * headless tool and vice versa. The machine must draw RND bytes from
+ * chip8_movie_rng() (pass it with the movie to chip8_create()).
+ */
+
+#ifndef CHIP8_MOVIE_H
+#define CHIP8_MOVIE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "chip8.h"
+
+typedef struct Chip8Movie Chip8Movie; // Opaque state
+
+// Create an empty movie whose RNG is xorshift32 seeded with `seed` (0 = 1).
+Chip8Movie* chip8_movie_create(uint32_t seed);
+void chip8_movie_destroy(Chip8Movie*);
+
+// chip8_rand_func for machines that record or play this movie; user is the movie.
+uint8_t chip8_movie_rng(void* movie);
+
+// Start recording: reseed the RNG, reset c8, load the ROM (copied into the
+// movie for later resets) and remember c8's machine and quirks. Drops any earlier events.
+bool chip8_movie_record_begin(Chip8Movie*, Chip8* c8, const uint8_t* rom, size_t rom_size);
+
+// Recording wrappers: the same as the plain core calls, plus the event.
+uint32_t chip8_movie_run_cycles(Chip8Movie*, Chip8* c8, uint32_t budget, Chip8RunResult* out);
+void chip8_movie_key_down(Chip8Movie*, Chip8* c8, uint8_t hex_key);
+void chip8_movie_key_up(Chip8Movie*, Chip8* c8, uint8_t hex_key);
+void chip8_movie_tick_60hz(Chip8Movie*, Chip8* c8);
+uint32_t chip8_movie_run_for(Chip8Movie*, Chip8* c8, uint64_t host_ns);
+void chip8_movie_reset(Chip8Movie*, Chip8* c8); // chip8_reset() and reload the ROM
+
+// Serialized form: a little-endian header and the events delta-encoded, a few
+// bytes per frame. chip8_movie_save() returns the bytes written, or 0 if size
+// is smaller than chip8_movie_size(). chip8_movie_load() returns NULL if the
+// buffer is malformed or from an unsupported version.
+size_t chip8_movie_size(const Chip8Movie*);
+size_t chip8_movie_save(const Chip8Movie*, void* buf, size_t size);
+Chip8Movie* chip8_movie_load(const void* buf, size_t size);
+
+// Start playback: reseed, reset c8, apply the recorded machine and quirks and
+// load the ROM. Returns false if the ROM is not the one the movie was
+// recorded with.
+bool chip8_movie_play_begin(Chip8Movie*, Chip8* c8, const uint8_t* rom, size_t rom_size);
+
+// Replay events until `max_frames` more ticks have been played or the movie
+// ends. Returns true while there is more to play.
+bool chip8_movie_play(Chip8Movie*, Chip8* c8, uint64_t max_frames);
+
+typedef struct Chip8MovieStatus {
+  uint64_t frames;          // ticks recorded, or played so far
+  uint64_t total_frames;    // ticks in the movie
+  uint64_t instructions;    // instructions executed since recording/playback began
+  uint64_t mismatches;      // played frames whose display hash differs from the recording
+  uint64_t first_mismatch;  // frame number of the first one
+  uint32_t expected_hash;   // recorded and actual display hash at that frame
+  uint32_t actual_hash;
+  bool done;                // every event played
+  bool stalled;             // playback stopped: c8 sat in Fx0A where the movie had instructions
+} Chip8MovieStatus;
+
+void chip8_movie_get_status(const Chip8Movie*, Chip8MovieStatus* out);
+
+#endif // CHIP8_MOVIE_H
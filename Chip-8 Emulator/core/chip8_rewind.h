@@ -0,0 +1,58 @@
+/**
+ * Rewind history: a fixed-size ring of machine states, normally captured once
+ * per 60Hz tick. Every capture is a raw save state (chip8_save_state()) stored
+ * as an XOR delta against the latest keyframe and run-length encoded, so a
+ * frame that only moved a sprite and a few registers costs tens of bytes.
+ * A full keyframe is stored every `keyframe_interval` captures. When the ring
+ * is full the oldest keyframe and its deltas are dropped together.
+ *
+ * All memory is allocated by chip8_rewind_create(); capturing and stepping
+ * back never allocate.
+ */
+
+#ifndef CHIP8_REWIND_H
+#define CHIP8_REWIND_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "chip8.h"
+
+typedef struct Chip8Rewind Chip8Rewind; // Opaque state
+
+// Create a history holding at most `max_frames` captures in `data_bytes` of
+// encoded data, with a keyframe every `keyframe_interval` captures (0 = 60).
+// Returns NULL if data_bytes cannot hold at least one CHIP-8 keyframe. A
+// capture too large to fit at all (a 64 KB XO-CHIP image in a small buffer)
+// empties the history and counts as evicted; switching machines empties it too.
+Chip8Rewind* chip8_rewind_create(size_t data_bytes, uint32_t max_frames, uint32_t keyframe_interval);
+void chip8_rewind_destroy(Chip8Rewind*);
+
+// Append the current state of c8, evicting the oldest history if needed.
+void chip8_rewind_capture(Chip8Rewind*, const Chip8* c8);
+
+// Restore the newest capture into c8 and drop it from the history, so repeated
+// calls walk backwards one capture at a time. Returns false when empty, or if
+// the capture fails to load, leaving both c8 and the history as they were.
+bool chip8_rewind_step_back(Chip8Rewind*, Chip8* c8);
+
+// Number of captures currently held, and forget all of them.
+uint32_t chip8_rewind_frames(const Chip8Rewind*);
+void chip8_rewind_clear(Chip8Rewind*);
+
+// Sizing information: what the history holds now and what capturing costs.
+typedef struct Chip8RewindStats {
+  uint32_t frames;        // captures held
+  uint32_t keyframes;     // of which keyframes
+  size_t data_used;       // encoded bytes held
+  size_t data_capacity;   // data_bytes given at creation
+  size_t total_bytes;     // everything allocated, including index and scratch
+  uint64_t captures;      // chip8_rewind_capture() calls so far
+  uint64_t encoded_bytes; // bytes encoded by those calls
+  uint64_t evicted;       // captures dropped to make room
+} Chip8RewindStats;
+
+void chip8_rewind_get_stats(const Chip8Rewind*, Chip8RewindStats* out);
+
+#endif // CHIP8_REWIND_H
@@ -14,7 +14,7 @@ typedef struct Chip8Snapshot {
   uint8_t sound_timer;
   uint8_t sp;            // stack pointer index (0-15)
   uint16_t stack_top;    // top value on stack if sp>0, else 0
-  uint32_t display_hash; // simple rolling hash of 64x32 frame buffer
+  uint32_t display_hash; // position-dependent hash of the 64x32 frame buffer, 0 when blank
 } Chip8Snapshot;
 
 #endif // CHIP8_STATE_H
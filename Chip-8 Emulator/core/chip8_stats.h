@@ -0,0 +1,61 @@
+/**
+ * Execution statistics: per-opcode-class counts, a per-address execution
+ * heatmap, draw/collision counts, instructions per 60Hz frame and time stalled
+ * in Fx0A. Counting is compiled into the core only when it is configured with
+ * -DCHIP8_STATS=ON; otherwise the hooks expand to nothing and
+ * chip8_stats_get() returns false. Instrumented builds do not offer the JIT
+ * engine, whose generated code has no counters.
+ */
+
+#ifndef CHIP8_STATS_H
+#define CHIP8_STATS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "chip8.h"
+
+// Opcode classes, one per instruction of the CHIP-8 set; EXT covers the
+// SUPER-CHIP and XO-CHIP additions
+#define CHIP8_OP_CLASSES(X)                                                             \
+  X(SYS) X(CLS) X(RET) X(JP) X(CALL) X(SE_B) X(SNE_B) X(SE_R) X(LD_B) X(ADD_B)         \
+  X(LD_R) X(OR) X(AND) X(XOR) X(ADD_R) X(SUB) X(SHR) X(SUBN) X(SHL) X(SNE_R)           \
+  X(LD_I) X(JP_V0) X(RND) X(DRW) X(SKP) X(SKNP) X(LD_VDT) X(LD_K) X(LD_DT) X(LD_ST)    \
+  X(ADD_I) X(LD_F) X(BCD) X(STORE) X(LOAD) X(EXT) X(INVALID)
+
+typedef enum Chip8OpClass {
+#define X(k) CHIP8_OP_##k,
+  CHIP8_OP_CLASSES(X)
+#undef X
+  CHIP8_OP_CLASS_COUNT
+} Chip8OpClass;
+
+typedef struct Chip8Stats {
+  uint64_t instructions;                     // instructions executed
+  uint64_t op_class[CHIP8_OP_CLASS_COUNT];   // by Chip8OpClass
+  uint64_t pc_heat[4096];                    // by address of the instruction (modulo 4 KB)
+  uint64_t draws;                            // Dxyn executed
+  uint64_t collisions;                       // Dxyn that set VF
+  uint64_t sprite_rows;                      // sprite rows drawn (clipped rows excluded)
+  uint64_t frames;                           // chip8_tick_60hz() calls
+  uint64_t frame_cycles_min;                 // instructions between two ticks
+  uint64_t frame_cycles_max;
+  uint64_t key_waits;                        // Fx0A executed
+  uint64_t key_wait_frames;                  // ticks that found the machine stalled in Fx0A
+  uint64_t key_wait_steps;                   // chip8_step() calls that stalled in Fx0A
+  uint64_t idle_cycles;                      // instructions fast-forwarded in idle loops (also in the above)
+} Chip8Stats;
+
+// True when the core was built with statistics.
+bool chip8_stats_available(void);
+
+// Copy the counters gathered since creation or the last chip8_stats_reset().
+// Returns false (and clears out) when statistics are compiled out.
+bool chip8_stats_get(const Chip8*, Chip8Stats* out);
+void chip8_stats_reset(Chip8*);
+
+// Classify an opcode, and name a class ("DRW", "LD_K", ...); available in every build.
+Chip8OpClass chip8_stats_classify(uint16_t opcode);
+const char* chip8_stats_class_name(Chip8OpClass cls);
+
+#endif // CHIP8_STATS_H
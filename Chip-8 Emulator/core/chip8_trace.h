@@ -0,0 +1,84 @@
+/**
+ * Execution trace: while a trace buffer is attached, every executed
+ * instruction appends a fixed-size record to a ring inside that buffer, and a
+ * full save state is copied into a second ring every `checkpoint_interval`
+ * instructions. The buffer is plain memory laid out as below, so a tool can
+ * mmap a file as the buffer and the trace survives a crash of the process.
+ *
+ *   Chip8TraceHeader | Chip8TraceRecord[record_capacity] | Chip8TraceCheckpoint[checkpoint_capacity]
+ *
+ * Integers are in host byte order. Traced instructions always run on the
+ * reference interpreter, whatever engine is selected.
+ */
+
+#ifndef CHIP8_TRACE_H
+#define CHIP8_TRACE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "chip8.h"
+
+#define CHIP8_TRACE_MAGIC "C8TRACE1"
+#define CHIP8_TRACE_NO_REG 0xFF
+
+// One executed instruction; every field except pc/opcode is the value after it ran.
+typedef struct Chip8TraceRecord {
+  uint32_t cycle;  // low 32 bits of the instruction's trace cycle
+  uint16_t pc;
+  uint16_t opcode;
+  uint16_t I;
+  uint8_t reg;     // register the instruction wrote (last one for Fx65), or CHIP8_TRACE_NO_REG
+  uint8_t value;   // its new value
+  uint8_t vf;
+  uint8_t sp;
+  uint8_t delay_timer;
+  uint8_t sound_timer;
+} Chip8TraceRecord;
+
+typedef struct Chip8TraceHeader {
+  char magic[8];                // CHIP8_TRACE_MAGIC
+  uint32_t record_size;         // sizeof(Chip8TraceRecord)
+  uint32_t record_capacity;     // power of two
+  uint32_t checkpoint_size;     // sizeof(Chip8TraceCheckpoint)
+  uint32_t checkpoint_capacity;
+  uint32_t checkpoint_interval; // instructions between checkpoints, 0 = none
+  uint32_t reserved;
+  uint64_t cycle;               // instructions recorded so far; record c is at c % record_capacity
+  uint64_t checkpoints;         // checkpoints taken so far; checkpoint k is at k % checkpoint_capacity
+  uint64_t reserved2[2];
+} Chip8TraceHeader;
+
+// Raw save state (chip8_save_state()) taken just before trace cycle `cycle` ran.
+typedef struct Chip8TraceCheckpoint {
+  uint64_t cycle;
+  uint32_t size;
+  uint32_t reserved;
+  uint8_t state[CHIP8_STATE_MAX_SIZE];
+} Chip8TraceCheckpoint;
+
+// Bytes needed for a trace buffer; 0 unless `records` is a power of two.
+size_t chip8_trace_size(uint32_t records, uint32_t checkpoints);
+
+// Lay out an empty trace in buf (at least chip8_trace_size() bytes, 8-byte aligned).
+bool chip8_trace_init(void* buf, size_t size, uint32_t records, uint32_t checkpoints, uint32_t checkpoint_interval);
+
+// Check that buf holds a well-formed trace of `size` bytes written by this build.
+bool chip8_trace_valid(const void* buf, size_t size);
+
+// Start appending to the trace in buf (continuing its cycle count), taking a
+// checkpoint first when checkpoints are enabled. Replaces any attached trace.
+// False if the `size` bytes at buf do not pass chip8_trace_valid(), e.g. a
+// file too short for the ring and checkpoints its header declares. buf must
+// stay valid until chip8_trace_detach() or chip8_destroy().
+bool chip8_trace_attach(Chip8*, void* buf, size_t size);
+void chip8_trace_detach(Chip8*);
+
+// Record of trace cycle `cycle`, or NULL if not recorded yet or overwritten.
+const Chip8TraceRecord* chip8_trace_record(const void* buf, uint64_t cycle);
+
+// Checkpoint number `index`, or NULL if not taken yet or overwritten.
+const Chip8TraceCheckpoint* chip8_trace_checkpoint(const void* buf, uint64_t index);
+
+#endif // CHIP8_TRACE_H
@@ -0,0 +1,98 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "chip8.h"
+#include "chip8_impl.h"
+
+// Instance cloning for search and fuzzing workloads, which fork one machine
+// into many. Memory dominates the instance, and the dirty page sets say which
+// pages can hold anything, so a clone compares only those and copies the
+// pages that differ. Everything else is a few hundred bytes of registers.
+
+// Make dst[page] equal src[page] for each page either may have non-zero;
+// true if any page of `dst_mem` changed. `changed` gets the copied pages.
+static bool sync_pages(uint8_t* dst_mem, const uint8_t* src_mem, const uint64_t* dst_used, const uint64_t* src_used,
+                       uint64_t* changed) {
+  bool any = false;
+  for (unsigned w = 0; w < C8_PAGE_WORDS; ++w) {
+    changed[w] = 0;
+    for (uint64_t bits = dst_used[w] | src_used[w]; bits; bits &= bits - 1) {
+      unsigned bit = c8_ctz64(bits);
+      size_t at = (size_t)(w * 64 + bit) << C8_PAGE_SHIFT;
+      if (memcmp(&dst_mem[at], &src_mem[at], C8_PAGE_SIZE) == 0) continue;
+      memcpy(&dst_mem[at], &src_mem[at], C8_PAGE_SIZE);
+      changed[w] |= 1ull << bit;
+      any = true;
+    }
+  }
+  return any;
+}
+
+void chip8_clone(Chip8* dstp, const Chip8* srcp) {
+  Chip8Impl* dst = (Chip8Impl*)dstp;
+  const Chip8Impl* src = (const Chip8Impl*)srcp;
+  if (dst == src) return;
+
+  uint64_t changed[C8_PAGE_WORDS];
+  bool machine_changed = dst->machine != src->machine;
+  if (sync_pages(dst->memory, src->memory, dst->mem_used, src->mem_used, changed) && !machine_changed) {
+    // A machine change drops all decoded code below
+    for (unsigned w = 0; w < C8_PAGE_WORDS; ++w) {
+      for (uint64_t bits = changed[w]; bits; bits &= bits - 1) c8_mem_forget_page(dst, w * 64 + c8_ctz64(bits));
+    }
+  }
+  memcpy(dst->mem_used, src->mem_used, sizeof(dst->mem_used));
+  // Without memory for the image dst's restart falls back to a reset
+  bool pristine_valid = src->pristine_valid && c8_pristine_alloc(dst, src->pristine_size);
+  if (pristine_valid) {
+    sync_pages(dst->pristine, src->pristine, dst->pristine_used, src->pristine_used, changed);
+    memcpy(dst->pristine_used, src->pristine_used, sizeof(dst->pristine_used));
+  }
+  memcpy(dst->mem_dirty, src->mem_dirty, sizeof(dst->mem_dirty));
+  dst->pristine_valid = pristine_valid;
+  dst->mem_mask = src->mem_mask;
+
+  memcpy(dst->V, src->V, sizeof(dst->V));
+  dst->I = src->I;
+  dst->pc = src->pc;
+  memcpy(dst->stack, src->stack, sizeof(dst->stack));
+  dst->sp = src->sp;
+  dst->delay_timer = src->delay_timer;
+  dst->sound_timer = src->sound_timer;
+
+  // Classic machines only ever draw into the first word of plane 0
+  size_t fb_size = dst->machine || src->machine ? sizeof(dst->fb) : sizeof(dst->fb[0][0]);
+  memcpy(dst->fb, src->fb, fb_size);
+  dst->gfx_stale = true;
+  dst->fb_generation++;
+  dst->fb_dirty = 0xFFFFFFFFu;
+  dst->fb_hash = src->fb_hash;
+
+  dst->machine = src->machine;
+  dst->hires = src->hires;
+  dst->planes = src->planes;
+  memcpy(dst->flags, src->flags, sizeof(dst->flags));
+  memcpy(dst->audio_pattern, src->audio_pattern, sizeof(dst->audio_pattern));
+  dst->pitch = src->pitch;
+  memcpy(dst->keypad, src->keypad, sizeof(dst->keypad));
+
+  if (dst->quirks != src->quirks) {
+    c8_apply_quirks(dst, src->quirks); // also drops decoded code
+  } else if (machine_changed) {
+    chip8_decoded_flush(dst);
+    chip8_jit_flush(dst);
+  }
+  dst->waiting_for_key = src->waiting_for_key;
+  dst->wait_key_reg = src->wait_key_reg;
+  dst->waiting_for_vblank = src->waiting_for_vblank;
+  dst->events = 0;
+  dst->invalid_opcode = 0;
+
+  dst->cpu_hz = src->cpu_hz;
+  dst->clock_frac = src->clock_frac;
+  dst->tick_phase = src->tick_phase;
+  dst->clock_base_ns = src->clock_base_ns;
+  dst->clock_cycles = src->clock_cycles;
+  c8_sound_edge(dst);
+}
@@ -0,0 +1,203 @@
+
+// Pre-decoded instruction engine (CHIP8_ENGINE_CACHED).
+//
+// Each even address in memory owns one slot holding the handler kind and the
+// operands already extracted from the opcode, so a hot loop decodes once and
+// afterwards costs one indirect branch per instruction. Slots are filled lazily
+// on first execution and dropped when Fx33/Fx55, ROM loading or reset write
+// over the bytes they were decoded from. Instructions at odd addresses are rare
+// and go through chip8_execute_opcode() instead of being cached.
+//
+// Quirks are folded into the operands when decoding (the shift source, the
+// Bnnn register, the Fx55/Fx65 step, the VF mask of 8xy1..3), so only Dxyn
+// tests any, once per draw; chip8_set_quirks() flushes the cache.
+//
+// On GCC/Clang the handlers are dispatched with computed goto (direct
+// threading: every handler ends in its own indirect jump); other compilers use
+// the same handler bodies inside a switch.
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "chip8_impl.h"
+#include "opcodes_impl.h"
+
+#if defined(__GNUC__)
+#define C8_THREADED 1
+#else
+#define C8_THREADED 0
+#endif
+
+// Handler kinds are the opcode classes shifted by one; K_UNDECODED is 0 so
+// clearing the cache is a memset.
+#define C8_KINDS(X) X(UNDECODED) CHIP8_OP_CLASSES(X)
+
+enum {
+#define X(k) K_##k,
+  C8_KINDS(X)
+#undef X
+  K_COUNT
+};
+
+typedef struct C8Decoded {
+  uint8_t kind;
+  uint8_t x;  // x, or the register Bnnn adds
+  uint8_t y;  // y, or the register 8xy6/8xyE shift
+  uint8_t kk; // kk, n for Dxyn, the I step for Fx55/Fx65, the VF mask for 8xy1..3
+  uint16_t nnn;
+  uint16_t opcode;
+} C8Decoded;
+
+#define DCACHE_SLOTS (MEM_SIZE / 2)
+
+static void decode(C8Decoded* d, uint16_t opcode, unsigned q) {
+  uint8_t kind = (uint8_t)(c8_op_class(opcode) + 1);
+  uint8_t x = (opcode >> 8) & 0xF, y = (opcode >> 4) & 0xF;
+  d->kind = kind;
+  d->x = x;
+  d->y = y;
+  d->kk = opcode & 0xFF;
+  d->nnn = opcode & 0x0FFF;
+  d->opcode = opcode;
+  switch (kind) {
+    case K_DRW: d->kk = opcode & 0xF; break;
+    case K_SHR: case K_SHL: d->y = c8_qshift_src(q, x, y); break;
+    case K_JP_V0: d->x = c8_qjump_reg(q, x); break;
+    case K_STORE: case K_LOAD: d->kk = c8_qmem_step(q, x); break;
+    case K_OR: case K_AND: case K_XOR: d->kk = c8_qvf_keep(q); break;
+    default: break;
+  }
+}
+
+bool chip8_decoded_init(Chip8Impl* c8) {
+  if (c8->dcache) return true;
+  c8->dcache = (C8Decoded*)calloc(DCACHE_SLOTS, sizeof(C8Decoded));
+  return c8->dcache != NULL;
+}
+
+void chip8_decoded_free(Chip8Impl* c8) {
+  free(c8->dcache);
+  c8->dcache = NULL;
+}
+
+void chip8_decoded_flush(Chip8Impl* c8) {
+  if (c8->dcache) memset(c8->dcache, 0, DCACHE_SLOTS * sizeof(C8Decoded));
+}
+
+void chip8_decoded_invalidate(Chip8Impl* c8, uint16_t addr, uint16_t len) {
+  if (!c8->dcache) return;
+  // Byte a belongs to the instruction decoded at the even address a & ~1
+  for (uint16_t i = 0; i < len; ++i) {
+    c8->dcache[((addr + i) & MEM_MASK) >> 1].kind = K_UNDECODED;
+  }
+}
+
+#define PC_ADD(n) (c8->pc = (uint16_t)(c8->pc + (n)))
+
+// Count each handler entry except the decode step, which dispatches again
+#ifdef CHIP8_ENABLE_STATS
+#define HANDLER_STATS(k) if (K_##k != K_UNDECODED) C8_STATS_INSN(c8, K_##k - 1);
+#else
+#define HANDLER_STATS(k)
+#endif
+
+#if C8_THREADED
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpedantic"
+#define HANDLER(k) L_##k: HANDLER_STATS(k)
+#define DISPATCH()                                        \
+  do {                                                    \
+    if (c8->pc & 1) goto odd_pc;                          \
+    d = &cache[(c8->pc & MEM_MASK) >> 1];                 \
+    goto* labels[d->kind];                                \
+  } while (0)
+#else
+#define HANDLER(k) case K_##k: HANDLER_STATS(k)
+#define DISPATCH() goto dispatch
+#endif
+
+// Retire the current instruction and dispatch the next one.
+#define NEXT()                                            \
+  do {                                                    \
+    if (++done >= budget || c8->events) return done;      \
+    DISPATCH();                                           \
+  } while (0)
+
+uint32_t chip8_run_decoded(Chip8Impl* c8, uint32_t budget) {
+  C8Decoded* cache = c8->dcache;
+  const C8Decoded* d;
+  uint32_t done = 0;
+  uint16_t adv;
+
+  if (budget == 0 || c8->waiting_for_key) return 0;
+
+#if C8_THREADED
+  static const void* const labels[K_COUNT] = {
+#define X(k) [K_##k] = &&L_##k,
+    C8_KINDS(X)
+#undef X
+  };
+  DISPATCH();
+#else
+dispatch:
+  if (c8->pc & 1) goto odd_pc;
+  d = &cache[(c8->pc & MEM_MASK) >> 1];
+  switch (d->kind) {
+#endif
+
+  HANDLER(UNDECODED) {
+    decode(&cache[(c8->pc & MEM_MASK) >> 1], c8_fetch(c8, c8->pc), c8->quirks);
+    DISPATCH();
+  }
+  HANDLER(SYS) { PC_ADD(2); NEXT(); }
+  HANDLER(CLS) { op_cls(c8); PC_ADD(2); NEXT(); }
+  HANDLER(RET) { op_ret(c8); NEXT(); }
+  HANDLER(JP) { op_jp(c8, d->nnn); NEXT(); }
+  HANDLER(CALL) { op_call(c8, d->nnn); NEXT(); }
+  HANDLER(SE_B) { adv = 2; op_se_byte(c8, d->x, d->kk, &adv); PC_ADD(adv); NEXT(); }
+  HANDLER(SNE_B) { adv = 2; op_sne_byte(c8, d->x, d->kk, &adv); PC_ADD(adv); NEXT(); }
+  HANDLER(SE_R) { adv = 2; op_se_xy(c8, d->x, d->y, &adv); PC_ADD(adv); NEXT(); }
+  HANDLER(LD_B) { op_ld_byte(c8, d->x, d->kk); PC_ADD(2); NEXT(); }
+  HANDLER(ADD_B) { op_add_byte(c8, d->x, d->kk); PC_ADD(2); NEXT(); }
+  HANDLER(LD_R) { op_alu(c8, d->x, d->y, 0x0, d->opcode, 0); PC_ADD(2); NEXT(); }
+  HANDLER(OR) { op_or(c8, d->x, d->y, d->kk); PC_ADD(2); NEXT(); }
+  HANDLER(AND) { op_and(c8, d->x, d->y, d->kk); PC_ADD(2); NEXT(); }
+  HANDLER(XOR) { op_xor(c8, d->x, d->y, d->kk); PC_ADD(2); NEXT(); }
+  HANDLER(ADD_R) { op_alu(c8, d->x, d->y, 0x4, d->opcode, 0); PC_ADD(2); NEXT(); }
+  HANDLER(SUB) { op_alu(c8, d->x, d->y, 0x5, d->opcode, 0); PC_ADD(2); NEXT(); }
+  HANDLER(SHR) { op_shr(c8, d->x, d->y); PC_ADD(2); NEXT(); }
+  HANDLER(SUBN) { op_alu(c8, d->x, d->y, 0x7, d->opcode, 0); PC_ADD(2); NEXT(); }
+  HANDLER(SHL) { op_shl(c8, d->x, d->y); PC_ADD(2); NEXT(); }
+  HANDLER(SNE_R) { adv = 2; op_sne_xy(c8, d->x, d->y, &adv); PC_ADD(adv); NEXT(); }
+  HANDLER(LD_I) { op_ld_i(c8, d->nnn); PC_ADD(2); NEXT(); }
+  HANDLER(JP_V0) { op_jp_offset(c8, d->x, d->nnn); NEXT(); }
+  HANDLER(RND) { op_rnd(c8, d->x, d->kk); PC_ADD(2); NEXT(); }
+  HANDLER(DRW) { op_drw(c8, d->x, d->y, d->kk, c8->quirks); PC_ADD(2); NEXT(); }
+  HANDLER(SKP) { adv = 2; op_skp(c8, d->x, &adv); PC_ADD(adv); NEXT(); }
+  HANDLER(SKNP) { adv = 2; op_sknp(c8, d->x, &adv); PC_ADD(adv); NEXT(); }
+  HANDLER(LD_VDT) { op_ld_vx_dt(c8, d->x); PC_ADD(2); NEXT(); }
+  HANDLER(LD_K) { op_ld_key(c8, d->x); PC_ADD(2); NEXT(); }
+  HANDLER(LD_DT) { op_ld_dt(c8, d->x); PC_ADD(2); NEXT(); }
+  HANDLER(LD_ST) { op_ld_st(c8, d->x); PC_ADD(2); NEXT(); }
+  HANDLER(ADD_I) { op_add_i(c8, d->x); PC_ADD(2); NEXT(); }
+  HANDLER(LD_F) { op_ld_f(c8, d->x); PC_ADD(2); NEXT(); }
+  HANDLER(BCD) { op_bcd(c8, d->x); PC_ADD(2); NEXT(); }
+  HANDLER(STORE) { op_store(c8, d->x, d->kk); PC_ADD(2); NEXT(); }
+  HANDLER(LOAD) { op_load(c8, d->x, d->kk); PC_ADD(2); NEXT(); }
+  // Extended-machine opcodes only reach this engine on CHIP-8, where they are
+  // ignored (00Cn...) or invalid
+  HANDLER(EXT) { if (d->opcode >> 12) op_invalid(c8, d->opcode); PC_ADD(2); NEXT(); }
+  HANDLER(INVALID) { op_invalid(c8, d->opcode); PC_ADD(2); NEXT(); }
+
+#if !C8_THREADED
+  }
+#endif
+
+odd_pc:
+  if (chip8_execute_opcode((Chip8*)c8, c8_fetch(c8, c8->pc))) PC_ADD(2);
+  NEXT();
+}
+
+#if C8_THREADED
+#pragma GCC diagnostic pop
+#endif
@@ -0,0 +1,713 @@
+
+// x86-64 JIT engine (CHIP8_ENGINE_JIT).
+//
+// Translates CHIP-8 basic blocks into native code in an mmap'd arena. A block
+// starts at an even address and ends after the first instruction that
+// transfers control (1nnn/2nnn/00EE/Bnnn/skips) or can raise a run_cycles()
+// event (00E0/Dxyn/Fx0A/Fx18/invalid). Fx33/Fx55 leave it early only when
+// the store drops a compiled block, so self-modifying code never keeps running
+// inside a stale one.
+//
+// Inside a block pc is a compile-time constant written back only at exits,
+// I lives in r12 and the Chip8Impl pointer in rbx. V registers are accessed as
+// [rbx+disp32] memory operands: several opcodes write VF before re-reading
+// Vx/Vy, and doing exactly the same loads and stores keeps every result equal
+// to the reference interpreter. CALL, RET and the keypad skips are native;
+// other opcodes without a translation call back into chip8_execute_opcode().
+//
+// Blocks chain without returning to C. r13d holds the cycles left in the
+// slice and r14 the table of chained block entries by pc / 2. A block's entry
+// charges its whole instruction count, or returns if the slice cannot pay it;
+// its exits jump through the table, or return when the next block is not
+// compiled. Invalidation only clears table slots, so generated code is never
+// patched once it has run. The arena is writable only while compiling and
+// executable only while running (W^X); compiling a block also compiles the
+// blocks its static exits lead to, so a loop or call tree costs one
+// mprotect() pair.
+//
+// Only built for x86-64 System V targets (CHIP8_ENABLE_JIT on Linux/BSD), and
+// not into CHIP8_STATS builds since generated code has no counters; elsewhere
+// chip8_jit_init() fails and chip8_set_engine() reports it.
+
+#if defined(CHIP8_ENABLE_JIT) && defined(__x86_64__) && defined(__unix__) && !defined(CHIP8_ENABLE_STATS)
+#define C8_JIT_AVAILABLE 1
+#define _DEFAULT_SOURCE // MAP_ANONYMOUS under -std=c17
+#else
+#define C8_JIT_AVAILABLE 0
+#endif
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "chip8_impl.h"
+#include "opcodes_impl.h"
+
+#if C8_JIT_AVAILABLE
+
+#include <sys/mman.h>
+
+#define JIT_ARENA_SIZE (1u << 20)
+#define JIT_MAX_BLOCK 64    // instructions per block
+#define JIT_INSN_ROOM 512   // worst-case bytes for one instruction plus epilogue
+#define JIT_BLOCK_ROOM (JIT_MAX_BLOCK * 64 + JIT_INSN_ROOM)
+#define JIT_BATCH 16        // most blocks compiled per writable window
+#define SLOTS (MEM_SIZE / 2)
+
+// Runs blocks from the one at pc; returns the cycles of `budget` left unspent
+typedef uint32_t (*JitFn)(Chip8Impl*, uint32_t budget, uint8_t* const* entries);
+
+typedef struct JitBlock {
+  uint8_t* code;  // entry from C; NULL when not compiled
+  uint16_t count; // instructions in the block
+  uint16_t span;  // bytes of CHIP-8 code covered, from the start address
+} JitBlock;
+
+typedef struct C8Jit {
+  uint8_t* arena;
+  size_t used;
+  bool writable;           // arena mapped RW, else RX
+  bool dropped;            // chip8_jit_invalidate() has dropped a block
+  JitBlock blocks[SLOTS];  // indexed by start pc / 2
+  uint8_t* entries[SLOTS]; // chained entry of each compiled block, or NULL
+  uint8_t covered[SLOTS];  // slot is inside some compiled block (conservative)
+} C8Jit;
+
+// ---------------------------------------------------------------------------
+// Emitter
+
+enum { AL = 0, CL = 1, DL = 2, RBX = 3 };
+
+#define JIT_MAX_EXITS (JIT_MAX_BLOCK + 8)
+
+typedef struct Emit {
+  uint8_t* p;
+  uint8_t* end;
+  uint8_t* exits[JIT_MAX_EXITS];      // rel32 fields of jumps to the block's return
+  unsigned nexits;
+  uint16_t start;                     // block address
+  uint8_t* refunds[JIT_MAX_BLOCK];    // imm8 cycles given back by each store exit
+  uint8_t refund_done[JIT_MAX_BLOCK]; // instructions run up to that exit
+  unsigned nrefunds;
+  uint16_t next[2];                   // static successors, compiled in the same batch
+  unsigned nnext;
+} Emit;
+
+static void e8(Emit* e, uint8_t b) {
+  if (e->p < e->end) *e->p++ = b;
+}
+
+static void e16(Emit* e, uint16_t v) {
+  e8(e, (uint8_t)v);
+  e8(e, (uint8_t)(v >> 8));
+}
+
+static void e32(Emit* e, uint32_t v) {
+  e16(e, (uint16_t)v);
+  e16(e, (uint16_t)(v >> 16));
+}
+
+static void e64(Emit* e, uint64_t v) {
+  e32(e, (uint32_t)v);
+  e32(e, (uint32_t)(v >> 32));
+}
+
+#define OFF_V(i) ((uint32_t)(offsetof(Chip8Impl, V) + (i)))
+#define OFF_I ((uint32_t)offsetof(Chip8Impl, I))
+#define OFF_PC ((uint32_t)offsetof(Chip8Impl, pc))
+#define OFF_DT ((uint32_t)offsetof(Chip8Impl, delay_timer))
+#define OFF_SP ((uint32_t)offsetof(Chip8Impl, sp))
+#define OFF_STACK ((uint32_t)offsetof(Chip8Impl, stack))
+#define OFF_KEYPAD ((uint32_t)offsetof(Chip8Impl, keypad))
+#define OFF_KEY_WAIT ((uint32_t)offsetof(Chip8Impl, waiting_for_key))
+#define OFF_EVENTS ((uint32_t)offsetof(Chip8Impl, events))
+
+// <opc> r8, [rbx+disp32]  (or [rbx+disp32], r8 for store forms)
+static void op_rm(Emit* e, uint8_t opc, uint8_t reg, uint32_t disp) {
+  e8(e, opc);
+  e8(e, (uint8_t)(0x80 | reg << 3 | RBX));
+  e32(e, disp);
+}
+
+static void mov_r_m(Emit* e, uint8_t reg, uint32_t disp) { op_rm(e, 0x8A, reg, disp); }
+static void mov_m_r(Emit* e, uint32_t disp, uint8_t reg) { op_rm(e, 0x88, reg, disp); }
+
+static void mov_m_imm(Emit* e, uint32_t disp, uint8_t imm) {
+  op_rm(e, 0xC6, 0, disp);
+  e8(e, imm);
+}
+
+static void load_i(Emit* e) { // movzx r12d, word [rbx+I]
+  e8(e, 0x44);
+  e8(e, 0x0F);
+  op_rm(e, 0xB7, 4, OFF_I);
+}
+
+static void store_i(Emit* e) { // mov [rbx+I], r12w
+  e8(e, 0x66);
+  e8(e, 0x44);
+  op_rm(e, 0x89, 4, OFF_I);
+}
+
+static void wrap_i(Emit* e) { // movzx r12d, r12w
+  static const uint8_t code[] = { 0x45, 0x0F, 0xB7, 0xE4 };
+  for (size_t i = 0; i < sizeof(code); ++i) e8(e, code[i]);
+}
+
+static void store_pc(Emit* e, uint16_t pc) { // mov word [rbx+pc], imm16
+  e8(e, 0x66);
+  op_rm(e, 0xC7, 0, OFF_PC);
+  e16(e, pc);
+}
+
+static void emit_bytes(Emit* e, const uint8_t* code, size_t n) {
+  for (size_t i = 0; i < n; ++i) e8(e, code[i]);
+}
+
+// Entry from C: fn(rdi = c8, esi = budget, rdx = entries)
+static void prologue(Emit* e) {
+  static const uint8_t code[] = {
+    0x53,                   // push rbx
+    0x41, 0x54,             // push r12
+    0x41, 0x55,             // push r13
+    0x41, 0x56,             // push r14
+    0x48, 0x83, 0xEC, 0x08, // sub rsp, 8 (16-byte aligned calls)
+    0x48, 0x89, 0xFB,       // mov rbx, rdi
+    0x41, 0x89, 0xF5,       // mov r13d, esi
+    0x49, 0x89, 0xD6,       // mov r14, rdx
+  };
+  emit_bytes(e, code, sizeof(code));
+  load_i(e);
+}
+
+// The block's one return to C; every exit has stored pc before jumping here
+static void epilogue(Emit* e) {
+  static const uint8_t code[] = {
+    0x44, 0x89, 0xE8,       // mov eax, r13d
+    0x48, 0x83, 0xC4, 0x08, // add rsp, 8
+    0x41, 0x5E,             // pop r14
+    0x41, 0x5D,             // pop r13
+    0x41, 0x5C,             // pop r12
+    0x5B,                   // pop rbx
+    0xC3,                   // ret
+  };
+  store_i(e);
+  emit_bytes(e, code, sizeof(code));
+}
+
+#define JMP 0
+#define JB 0x82
+#define JAE 0x83
+#define JE 0x84
+#define JNE 0x85
+
+// jcc (jmp for JMP) with a rel32 to patch; returns the rel32 field
+static uint8_t* jump(Emit* e, uint8_t cc) {
+  if (cc == JMP) {
+    e8(e, 0xE9);
+  } else {
+    e8(e, 0x0F);
+    e8(e, cc);
+  }
+  uint8_t* rel = e->p;
+  e32(e, 0);
+  return rel;
+}
+
+static void patch(Emit* e, uint8_t* rel, const uint8_t* target) {
+  if (e->p > e->end) return; // arena full: the block is discarded
+  int32_t v = (int32_t)(target - (rel + 4));
+  memcpy(rel, &v, 4);
+}
+
+static void jump_exit(Emit* e, uint8_t cc) {
+  uint8_t* rel = jump(e, cc);
+  if (e->nexits < JIT_MAX_EXITS) e->exits[e->nexits++] = rel;
+}
+
+// Continue at the even pc in eax if its block is compiled (rax = entries[eax / 2])
+static void chain_eax(Emit* e) {
+  e8(e, 0x49); e8(e, 0x8B); e8(e, 0x04); e8(e, 0x86); // mov rax, [r14+rax*4]
+  e8(e, 0x48); e8(e, 0x85); e8(e, 0xC0);              // test rax, rax
+  jump_exit(e, JE);
+  e8(e, 0xFF); e8(e, 0xE0);                           // jmp rax
+}
+
+// Continue at the pc in eax, already stored in memory
+static void dispatch_eax(Emit* e) {
+  e8(e, 0xA8); e8(e, 0x01);      // test al, 1
+  jump_exit(e, JNE);
+  e8(e, 0x3D); e32(e, MEM_SIZE); // cmp eax, MEM_SIZE
+  jump_exit(e, JAE);
+  chain_eax(e);
+}
+
+// Continue at a pc known when compiling; `hot` also queues its block for compiling
+static void dispatch_to(Emit* e, uint16_t target, bool hot) {
+  store_pc(e, target);
+  if ((target & 1) || target >= MEM_SIZE) {
+    jump_exit(e, JMP);
+    return;
+  }
+  if (hot && e->nnext < 2) e->next[e->nnext++] = target;
+  e8(e, 0x49); e8(e, 0x8B); e8(e, 0x86); e32(e, (uint32_t)target * 4); // mov rax, [r14+target/2*8]
+  e8(e, 0x48); e8(e, 0x85); e8(e, 0xC0);                               // test rax, rax
+  jump_exit(e, JE);
+  e8(e, 0xFF); e8(e, 0xE0);                                            // jmp rax
+}
+
+static void fallback_helper(Chip8Impl* c8, uint32_t opcode) {
+  if (chip8_execute_opcode((Chip8*)c8, (uint16_t)opcode)) c8->pc = (uint16_t)(c8->pc + 2);
+}
+
+// Fx33/Fx55. Returns nonzero if the store dropped compiled blocks, which may
+// include the running one.
+static uint32_t store_helper(Chip8Impl* c8, uint32_t opcode) {
+  uint8_t x = (opcode >> 8) & 0xF;
+  c8->jit->dropped = false;
+  if ((opcode & 0xFF) == 0x33) op_bcd(c8, x);
+  else op_store(c8, x, c8_qmem_step(c8->quirks, x));
+  return c8->jit->dropped;
+}
+
+// helper(c8, opcode) with I synced around the call
+static void emit_helper_call(Emit* e, uint64_t addr, uint16_t opcode) {
+  store_i(e);
+  e8(e, 0x48); e8(e, 0x89); e8(e, 0xDF); // mov rdi, rbx
+  e8(e, 0xBE); e32(e, opcode);            // mov esi, opcode
+  e8(e, 0x48); e8(e, 0xB8); e64(e, addr); // mov rax, helper
+  e8(e, 0xFF); e8(e, 0xD0);               // call rax
+  load_i(e);
+}
+
+// Execute `opcode` at `pc` through the interpreter. A terminal fallback ends
+// the block: it returns on an event, else goes to the new pc.
+static void emit_fallback(Emit* e, uint16_t pc, uint16_t opcode, bool terminal) {
+  void (*fn)(Chip8Impl*, uint32_t) = fallback_helper;
+  uint64_t addr;
+  memcpy(&addr, &fn, sizeof(addr));
+
+  store_pc(e, pc);
+  emit_helper_call(e, addr, opcode);
+  if (!terminal) return;
+  op_rm(e, 0x80, 7, OFF_KEY_WAIT);         // cmp byte [waiting_for_key], 0
+  e8(e, 0);
+  jump_exit(e, JNE);
+  op_rm(e, 0x83, 7, OFF_EVENTS);           // cmp dword [events], 0
+  e8(e, 0);
+  jump_exit(e, JNE);
+  e8(e, 0x0F); op_rm(e, 0xB7, AL, OFF_PC); // movzx eax, word [rbx+pc]
+  dispatch_eax(e);
+}
+
+// Fx33/Fx55 go on with the block unless they stored over compiled code. Then
+// the block returns at pc + 2, giving back the cycles charged for the rest.
+static void emit_store(Emit* e, uint16_t pc, uint16_t opcode) {
+  uint32_t (*fn)(Chip8Impl*, uint32_t) = store_helper;
+  uint64_t addr;
+  memcpy(&addr, &fn, sizeof(addr));
+
+  emit_helper_call(e, addr, opcode);
+  static const uint8_t test_jz[] = { 0x85, 0xC0, 0x74, 0x12 }; // test eax, eax; jz past the exit
+  emit_bytes(e, test_jz, sizeof(test_jz));
+  store_pc(e, (uint16_t)(pc + 2));
+  e8(e, 0x41); e8(e, 0x83); e8(e, 0xC5); // add r13d, instructions not run
+  e->refunds[e->nrefunds] = e->p;
+  e->refund_done[e->nrefunds++] = (uint8_t)((pc + 2 - e->start) / 2);
+  e8(e, 0);
+  jump_exit(e, JMP);
+}
+
+// pc = (flags satisfy cc) ? pc + 4 : pc + 2, then go there. cc is the cmovcc opcode.
+static void emit_skip_exit(Emit* e, uint16_t pc, uint8_t cmov) {
+  e8(e, 0xB8); e32(e, (uint16_t)(pc + 2)); // mov eax, pc+2
+  e8(e, 0xB9); e32(e, (uint16_t)(pc + 4)); // mov ecx, pc+4
+  e8(e, 0x0F); e8(e, cmov); e8(e, 0xC1);   // cmovcc eax, ecx
+  e8(e, 0x66);
+  op_rm(e, 0x89, AL, OFF_PC);              // mov [rbx+pc], ax
+  e->next[0] = (uint16_t)(pc + 2);
+  e->next[1] = (uint16_t)(pc + 4);
+  e->nnext = 2;
+  dispatch_eax(e);
+}
+
+#define CMOVE 0x44
+#define CMOVNE 0x45
+
+// 2nnn as op_call(): push pc + 2 and go to nnn; with the stack full, stay put
+static void emit_call(Emit* e, uint16_t pc, uint16_t nnn) {
+  e8(e, 0x0F); op_rm(e, 0xB6, AL, OFF_SP);                         // movzx eax, byte [sp]
+  e8(e, 0x83); e8(e, 0xF8); e8(e, 16);                             // cmp eax, 16
+  uint8_t* full = jump(e, JAE);
+  e8(e, 0x66); e8(e, 0xC7); e8(e, 0x84); e8(e, 0x43); e32(e, OFF_STACK); // mov word [rbx+rax*2+stack], pc+2
+  e16(e, (uint16_t)(pc + 2));
+  e8(e, 0xFF); e8(e, 0xC0);                                        // inc eax
+  mov_m_r(e, OFF_SP, AL);
+  dispatch_to(e, nnn, true);
+  if (e->nnext < 2) e->next[e->nnext++] = (uint16_t)(pc + 2);      // where the RET lands
+  patch(e, full, e->p);
+  dispatch_to(e, pc, false);
+}
+
+// 00EE as op_ret(): pop the return address; with the stack empty, stay put
+static void emit_ret(Emit* e, uint16_t pc) {
+  e8(e, 0x0F); op_rm(e, 0xB6, AL, OFF_SP);                         // movzx eax, byte [sp]
+  e8(e, 0x85); e8(e, 0xC0);                                        // test eax, eax
+  uint8_t* empty = jump(e, JE);
+  e8(e, 0xFF); e8(e, 0xC8);                                        // dec eax
+  mov_m_r(e, OFF_SP, AL);
+  e8(e, 0x0F); e8(e, 0xB7); e8(e, 0x84); e8(e, 0x43); e32(e, OFF_STACK); // movzx eax, word [rbx+rax*2+stack]
+  e8(e, 0x66); op_rm(e, 0x89, AL, OFF_PC);                         // mov [rbx+pc], ax
+  dispatch_eax(e);
+  patch(e, empty, e->p);
+  dispatch_to(e, pc, false);
+}
+
+// Ex9E/ExA1: skip if key Vx is down (up)
+static void emit_key_skip(Emit* e, uint16_t pc, uint8_t x, bool down) {
+  e8(e, 0x0F); op_rm(e, 0xB6, AL, OFF_V(x));                       // movzx eax, byte [Vx]
+  e8(e, 0x83); e8(e, 0xE0); e8(e, 0x0F);                           // and eax, 0xF
+  e8(e, 0x80); e8(e, 0xBC); e8(e, 0x03); e32(e, OFF_KEYPAD); e8(e, 0); // cmp byte [rbx+rax+keypad], 0
+  emit_skip_exit(e, pc, down ? CMOVNE : CMOVE);
+}
+
+// Flag-producing ALU ops write VF first and then reload operands, as op_alu()
+// does. Quirks are compile-time here; chip8_set_quirks() flushes the arena.
+static bool emit_alu(Emit* e, const Chip8Impl* c8, uint8_t x, uint8_t y, uint8_t sub) {
+  uint8_t src = c8_qshift_src(c8->quirks, x, y);
+  switch (sub) {
+    case 0x0:
+      mov_r_m(e, AL, OFF_V(y));
+      mov_m_r(e, OFF_V(x), AL);
+      return true;
+    case 0x1:
+    case 0x2:
+    case 0x3: {
+      static const uint8_t opc[4] = { 0, 0x0A, 0x22, 0x32 }; // or/and/xor r8, m8
+      mov_r_m(e, AL, OFF_V(x));
+      op_rm(e, opc[sub], AL, OFF_V(y));
+      mov_m_r(e, OFF_V(x), AL);
+      if (c8->quirks & C8_Q_VF_RESET) mov_m_imm(e, OFF_V(0xF), 0);
+      return true;
+    }
+    case 0x4:
+      mov_r_m(e, AL, OFF_V(x));
+      op_rm(e, 0x02, AL, OFF_V(y));          // add al, [Vy]
+      e8(e, 0x0F); e8(e, 0x92); e8(e, 0xC2); // setc dl
+      mov_m_r(e, OFF_V(0xF), DL);
+      mov_m_r(e, OFF_V(x), AL);
+      return true;
+    case 0x5:
+    case 0x7: {
+      uint8_t a = sub == 0x5 ? x : y, b = sub == 0x5 ? y : x;
+      mov_r_m(e, AL, OFF_V(a));
+      op_rm(e, 0x3A, AL, OFF_V(b));          // cmp al, [b]
+      e8(e, 0x0F); e8(e, 0x97); e8(e, 0xC2); // seta dl
+      mov_m_r(e, OFF_V(0xF), DL);
+      mov_r_m(e, AL, OFF_V(a));
+      op_rm(e, 0x2A, AL, OFF_V(b));          // sub al, [b]
+      mov_m_r(e, OFF_V(x), AL);
+      return true;
+    }
+    case 0x6:
+      mov_r_m(e, AL, OFF_V(src));
+      e8(e, 0x88); e8(e, 0xC2);              // mov dl, al
+      e8(e, 0x80); e8(e, 0xE2); e8(e, 0x01); // and dl, 1
+      mov_m_r(e, OFF_V(0xF), DL);
+      e8(e, 0xD0); e8(e, 0xE8);              // shr al, 1
+      mov_m_r(e, OFF_V(x), AL);
+      return true;
+    case 0xE:
+      mov_r_m(e, AL, OFF_V(src));
+      e8(e, 0x88); e8(e, 0xC2);              // mov dl, al
+      e8(e, 0xC0); e8(e, 0xEA); e8(e, 0x07); // shr dl, 7
+      mov_m_r(e, OFF_V(0xF), DL);
+      e8(e, 0x00); e8(e, 0xC0);              // add al, al
+      mov_m_r(e, OFF_V(x), AL);
+      return true;
+    default: return false; // invalid: interpreter raises the event
+  }
+}
+
+static void emit_load_regs(Emit* e, const Chip8Impl* c8, uint8_t x) { // Fx65
+  for (uint8_t i = 0; i <= x; ++i) {
+    e8(e, 0x44); e8(e, 0x89); e8(e, 0xE0);                      // mov eax, r12d
+    if (i) { e8(e, 0x83); e8(e, 0xC0); e8(e, i); }              // add eax, i
+    e8(e, 0x25); e32(e, MEM_MASK);                              // and eax, 0xFFF
+    e8(e, 0x8A); e8(e, 0x0C); e8(e, 0x03);                      // mov cl, [rbx+rax]
+    mov_m_r(e, OFF_V(i), CL);
+  }
+  uint8_t step = c8_qmem_step(c8->quirks, x);
+  if (step) {
+    e8(e, 0x41); e8(e, 0x83); e8(e, 0xC4); e8(e, step); // add r12d, step
+    wrap_i(e);
+  }
+}
+
+// Emit one instruction. Returns false if it ends the block (exit code emitted).
+static bool emit_insn(Emit* e, const Chip8Impl* c8, uint16_t pc, uint16_t op) {
+  uint8_t x = (op >> 8) & 0xF, y = (op >> 4) & 0xF, n = op & 0xF, kk = op & 0xFF;
+  uint16_t nnn = op & 0x0FFF;
+
+  switch (op >> 12) {
+    case 0x0:
+      if (kk == 0xEE) {
+        emit_ret(e, pc);
+        return false;
+      }
+      if (kk != 0xE0) return true; // 0nnn: ignored
+      break;
+    case 0x1:
+      dispatch_to(e, nnn, true);
+      return false;
+    case 0x2:
+      emit_call(e, pc, nnn);
+      return false;
+    case 0x3:
+    case 0x4:
+      op_rm(e, 0x80, 7, OFF_V(x)); // cmp byte [Vx], kk
+      e8(e, kk);
+      emit_skip_exit(e, pc, (op >> 12) == 0x3 ? CMOVE : CMOVNE);
+      return false;
+    case 0x5:
+    case 0x9:
+      if (n != 0) break;
+      mov_r_m(e, AL, OFF_V(x));
+      op_rm(e, 0x3A, AL, OFF_V(y)); // cmp al, [Vy]
+      emit_skip_exit(e, pc, (op >> 12) == 0x5 ? CMOVE : CMOVNE);
+      return false;
+    case 0x6:
+      mov_m_imm(e, OFF_V(x), kk);
+      return true;
+    case 0x7:
+      op_rm(e, 0x80, 0, OFF_V(x)); // add byte [Vx], kk
+      e8(e, kk);
+      return true;
+    case 0x8:
+      if (emit_alu(e, c8, x, y, n)) return true;
+      break;
+    case 0xA:
+      e8(e, 0x41); e8(e, 0xBC); e32(e, nnn); // mov r12d, nnn
+      return true;
+    case 0xC:
+      emit_fallback(e, pc, op, false);
+      return true;
+    case 0xE:
+      if (kk != 0x9E && kk != 0xA1) break;
+      emit_key_skip(e, pc, x, kk == 0x9E);
+      return false;
+    case 0xF:
+      switch (kk) {
+        case 0x07:
+          mov_r_m(e, AL, OFF_DT);
+          mov_m_r(e, OFF_V(x), AL);
+          return true;
+        case 0x15:
+          mov_r_m(e, AL, OFF_V(x));
+          mov_m_r(e, OFF_DT, AL);
+          return true;
+        case 0x1E:
+          e8(e, 0x0F); op_rm(e, 0xB6, AL, OFF_V(x)); // movzx eax, byte [Vx]
+          e8(e, 0x41); e8(e, 0x01); e8(e, 0xC4);     // add r12d, eax
+          wrap_i(e);
+          return true;
+        case 0x29:
+          e8(e, 0x0F); op_rm(e, 0xB6, AL, OFF_V(x)); // movzx eax, byte [Vx]
+          e8(e, 0x83); e8(e, 0xE0); e8(e, 0x0F);     // and eax, 0xF
+          e8(e, 0x44); e8(e, 0x8D); e8(e, 0x64); e8(e, 0x80); e8(e, 0x50); // lea r12d, [rax*5+0x50]
+          return true;
+        case 0x65:
+          emit_load_regs(e, c8, x);
+          return true;
+        case 0x33:
+        case 0x55:
+          emit_store(e, pc, op);
+          return true;
+      }
+      break;
+  }
+
+  // Everything else (Bnnn, CLS/DRW, Fx0A/Fx18, invalid opcodes) runs in the
+  // interpreter and ends the block.
+  emit_fallback(e, pc, op, true);
+  return false;
+}
+
+// ---------------------------------------------------------------------------
+// Block management
+
+static void flush_all(C8Jit* jit) {
+  memset(jit->blocks, 0, sizeof(jit->blocks));
+  memset(jit->entries, 0, sizeof(jit->entries));
+  memset(jit->covered, 0, sizeof(jit->covered));
+  jit->used = 0;
+}
+
+static bool set_writable(C8Jit* jit, bool writable) {
+  if (jit->writable == writable) return true;
+  int prot = writable ? PROT_READ | PROT_WRITE : PROT_READ | PROT_EXEC;
+  if (mprotect(jit->arena, JIT_ARENA_SIZE, prot) != 0) return false;
+  jit->writable = writable;
+  return true;
+}
+
+// Compile the block at `start` into the writable arena; e->next gets its
+// static successors
+static void compile_block(Chip8Impl* c8, uint16_t start, Emit* e) {
+  C8Jit* jit = c8->jit;
+  e->p = jit->arena + jit->used;
+  e->end = jit->arena + JIT_ARENA_SIZE;
+  e->nexits = 0;
+  e->nnext = 0;
+  e->start = start;
+  e->nrefunds = 0;
+  uint8_t* code = e->p;
+  prologue(e);
+  // Chained entry: cmp r13d, count; jb exit; sub r13d, count
+  uint8_t* entry = e->p;
+  e8(e, 0x41); e8(e, 0x83); e8(e, 0xFD); e8(e, 0);
+  jump_exit(e, JB);
+  e8(e, 0x41); e8(e, 0x83); e8(e, 0xED); e8(e, 0);
+
+  uint16_t pc = start, count = 0;
+  for (;;) {
+    uint16_t op = (uint16_t)(c8->memory[pc] << 8 | c8->memory[pc + 1]);
+    bool more = emit_insn(e, c8, pc, op);
+    pc = (uint16_t)(pc + 2);
+    ++count;
+    if (!more) break;
+    if (count == JIT_MAX_BLOCK || pc >= MEM_SIZE || e->end - e->p < JIT_INSN_ROOM) {
+      dispatch_to(e, pc, true);
+      break;
+    }
+  }
+  for (unsigned i = 0; i < e->nexits; ++i) patch(e, e->exits[i], e->p);
+  epilogue(e);
+  entry[3] = (uint8_t)count;
+  entry[13] = (uint8_t)count;
+  for (unsigned i = 0; i < e->nrefunds; ++i) {
+    if (e->refunds[i] < e->end) *e->refunds[i] = (uint8_t)(count - e->refund_done[i]);
+  }
+
+  jit->used = (size_t)(e->p - jit->arena);
+  jit->used = (jit->used + 15) & ~(size_t)15;
+  JitBlock* b = &jit->blocks[start >> 1];
+  b->code = code;
+  b->count = count;
+  b->span = (uint16_t)(pc - start);
+  jit->entries[start >> 1] = entry;
+  memset(&jit->covered[start >> 1], 1, b->span / 2);
+}
+
+// Compile the block at `start`, then the blocks its static exits reach while
+// the batch and the arena have room. The arena is left writable.
+static JitBlock* compile(Chip8Impl* c8, uint16_t start) {
+  C8Jit* jit = c8->jit;
+  if (!set_writable(jit, true)) return NULL;
+  if (JIT_ARENA_SIZE - jit->used < JIT_BLOCK_ROOM) flush_all(jit);
+
+  uint16_t queue[JIT_BATCH];
+  unsigned head = 0, tail = 0;
+  queue[tail++] = start;
+  while (head < tail) {
+    uint16_t pc = queue[head++];
+    if (jit->blocks[pc >> 1].code) continue;
+    if (head > 1 && JIT_ARENA_SIZE - jit->used < JIT_BLOCK_ROOM) break;
+    Emit e;
+    compile_block(c8, pc, &e);
+    for (unsigned i = 0; i < e.nnext && tail < JIT_BATCH; ++i) {
+      uint16_t next = e.next[i];
+      if (!(next & 1) && next < MEM_SIZE && !jit->blocks[next >> 1].code) queue[tail++] = next;
+    }
+  }
+  return &jit->blocks[start >> 1];
+}
+
+bool chip8_jit_init(Chip8Impl* c8) {
+  if (c8->jit) return true;
+  C8Jit* jit = (C8Jit*)calloc(1, sizeof(C8Jit));
+  if (!jit) return false;
+  void* arena = mmap(NULL, JIT_ARENA_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (arena == MAP_FAILED) {
+    free(jit);
+    return false;
+  }
+  jit->arena = (uint8_t*)arena;
+  jit->writable = true;
+  c8->jit = jit;
+  return true;
+}
+
+void chip8_jit_free(Chip8Impl* c8) {
+  if (!c8->jit) return;
+  munmap(c8->jit->arena, JIT_ARENA_SIZE);
+  free(c8->jit);
+  c8->jit = NULL;
+}
+
+void chip8_jit_flush(Chip8Impl* c8) {
+  if (c8->jit) flush_all(c8->jit);
+}
+
+void chip8_jit_invalidate(Chip8Impl* c8, uint16_t addr, uint16_t len) {
+  C8Jit* jit = c8->jit;
+  if (!jit) return;
+  for (uint16_t i = 0; i < len; ++i) {
+    unsigned slot = ((addr + i) & MEM_MASK) >> 1;
+    if (!jit->covered[slot]) continue;
+    // Only blocks starting at most JIT_MAX_BLOCK slots earlier can reach here
+    unsigned first = slot >= JIT_MAX_BLOCK ? slot - JIT_MAX_BLOCK : 0;
+    for (unsigned s = first; s <= slot; ++s) {
+      JitBlock* b = &jit->blocks[s];
+      if (b->code && s + b->span / 2u > slot) {
+        b->code = NULL;
+        jit->entries[s] = NULL;
+        jit->dropped = true;
+      }
+    }
+  }
+}
+
+uint32_t chip8_run_jit(Chip8Impl* c8, uint32_t budget) {
+  C8Jit* jit = c8->jit;
+  uint32_t done = 0;
+  while (done < budget && !c8->waiting_for_key && !c8->events) {
+    uint16_t pc = c8->pc;
+    if ((pc & 1) || pc >= MEM_SIZE) {
+      done += chip8_interpret(c8, 1);
+      continue;
+    }
+    JitBlock* b = &jit->blocks[pc >> 1];
+    if (!b->code) b = compile(c8, pc);
+    if (!b || b->count > budget - done || !set_writable(jit, false)) {
+      done += chip8_interpret(c8, b ? budget - done : 1);
+      continue;
+    }
+    JitFn fn;
+    memcpy(&fn, &b->code, sizeof(fn));
+    done = budget - fn(c8, budget - done, jit->entries);
+  }
+  return done;
+}
+
+#else // !C8_JIT_AVAILABLE
+
+bool chip8_jit_init(Chip8Impl* c8) {
+  (void)c8;
+  return false;
+}
+
+void chip8_jit_free(Chip8Impl* c8) { (void)c8; }
+void chip8_jit_flush(Chip8Impl* c8) { (void)c8; }
+
+void chip8_jit_invalidate(Chip8Impl* c8, uint16_t addr, uint16_t len) {
+  (void)c8;
+  (void)addr;
+  (void)len;
+}
+
+uint32_t chip8_run_jit(Chip8Impl* c8, uint32_t budget) {
+  return chip8_interpret(c8, budget);
+}
+
+#endif
@@ -0,0 +1,332 @@
+#include "chip8_movie.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "chip8_impl.h"
+
+// Movie format, all integers little-endian:
+//
+//   header  "C8MV"  u16 version  u8 quirk bits  u8 Chip8Machine  u32 seed
+//           u32 FNV-1a(ROM)  u32 ROM size  u32 event count  u32 FNV-1a(events)
+//   events  ULEB128 instructions since the previous event, then
+//           u8 kind | key << 4, then u32 display hash for MOVIE_FRAME
+//
+// A recording is saved with a closing MOVIE_END event, so playback also runs
+// the instructions after the last tick.
+// Quirk bits are packed as in save states (c8_quirks_serial()). Movies from before the machine
+// byte was assigned have 0 there, which is CHIP-8.
+
+#define MOVIE_MAGIC "C8MV"
+#define MOVIE_VERSION 1
+#define MOVIE_HEADER_SIZE 28
+
+enum { MOVIE_KEY_DOWN, MOVIE_KEY_UP, MOVIE_FRAME, MOVIE_RESET, MOVIE_END, MOVIE_KIND_COUNT };
+
+typedef struct MovieEvent {
+  uint64_t cycle; // instructions executed before the event
+  uint32_t hash;  // MOVIE_FRAME: display hash after the tick
+  uint8_t kind;
+  uint8_t key;
+} MovieEvent;
+
+struct Chip8Movie {
+  uint32_t seed, rng;
+  uint8_t quirks; // C8_Q_* bits
+  uint8_t machine;
+  uint8_t* rom;
+  size_t rom_size;
+  uint32_t rom_hash;
+
+  MovieEvent* events;
+  size_t count, capacity;
+  uint64_t frames; // MOVIE_FRAME events held
+
+  // Recording or playback position
+  bool recording, playing;
+  size_t next;
+  uint64_t cycle;
+  Chip8MovieStatus status;
+};
+
+static uint32_t fnv1a(const uint8_t* p, size_t len) {
+  uint32_t h = 2166136261u;
+  for (size_t i = 0; i < len; ++i) { h ^= p[i]; h *= 16777619u; }
+  return h;
+}
+
+Chip8Movie* chip8_movie_create(uint32_t seed) {
+  Chip8Movie* m = (Chip8Movie*)calloc(1, sizeof(*m));
+  if (!m) return NULL;
+  m->seed = seed ? seed : 1;
+  m->rng = m->seed;
+  return m;
+}
+
+void chip8_movie_destroy(Chip8Movie* m) {
+  if (!m) return;
+  free(m->rom);
+  free(m->events);
+  free(m);
+}
+
+uint8_t chip8_movie_rng(void* movie) {
+  Chip8Movie* m = (Chip8Movie*)movie;
+  m->rng ^= m->rng << 13;
+  m->rng ^= m->rng >> 17;
+  m->rng ^= m->rng << 5;
+  return (uint8_t)m->rng;
+}
+
+static bool set_rom(Chip8Movie* m, const uint8_t* rom, size_t rom_size) {
+  uint8_t* copy = (uint8_t*)malloc(rom_size ? rom_size : 1);
+  if (!copy) return false;
+  if (rom_size) memcpy(copy, rom, rom_size);
+  free(m->rom);
+  m->rom = copy;
+  m->rom_size = rom_size;
+  return true;
+}
+
+// Common start of recording and playback: fresh RNG, machine and position
+static bool restart(Chip8Movie* m, Chip8* c8) {
+  m->rng = m->seed;
+  m->next = 0;
+  m->cycle = 0;
+  memset(&m->status, 0, sizeof(m->status));
+  chip8_reset(c8);
+  return chip8_load_rom(c8, m->rom, m->rom_size);
+}
+
+bool chip8_movie_record_begin(Chip8Movie* m, Chip8* c8, const uint8_t* rom, size_t rom_size) {
+  if (!rom && rom_size) return false;
+  if (!set_rom(m, rom, rom_size)) return false;
+  m->rom_hash = fnv1a(rom, rom_size);
+  m->quirks = ((Chip8Impl*)c8)->quirks;
+  m->machine = (uint8_t)chip8_get_machine(c8);
+  m->count = 0;
+  m->frames = 0;
+  m->recording = true;
+  m->playing = false;
+  return restart(m, c8);
+}
+
+static void record(Chip8Movie* m, uint8_t kind, uint8_t key, uint32_t hash) {
+  if (!m->recording) return;
+  if (m->count == m->capacity) {
+    size_t capacity = m->capacity ? m->capacity * 2 : 1024;
+    MovieEvent* events = (MovieEvent*)realloc(m->events, capacity * sizeof(*events));
+    if (!events) return; // out of memory: the movie stops growing and will fail to verify
+    m->events = events;
+    m->capacity = capacity;
+  }
+  m->events[m->count++] = (MovieEvent){ m->cycle, hash, kind, key };
+  if (kind == MOVIE_FRAME) m->frames++;
+}
+
+uint32_t chip8_movie_run_cycles(Chip8Movie* m, Chip8* c8, uint32_t budget, Chip8RunResult* out) {
+  uint32_t done = chip8_run_cycles(c8, budget, out);
+  m->cycle += done;
+  return done;
+}
+
+void chip8_movie_key_down(Chip8Movie* m, Chip8* c8, uint8_t hex_key) {
+  if ((hex_key & 0xF) != hex_key) return;
+  chip8_key_down(c8, hex_key);
+  record(m, MOVIE_KEY_DOWN, hex_key, 0);
+}
+
+void chip8_movie_key_up(Chip8Movie* m, Chip8* c8, uint8_t hex_key) {
+  if ((hex_key & 0xF) != hex_key) return;
+  chip8_key_up(c8, hex_key);
+  record(m, MOVIE_KEY_UP, hex_key, 0);
+}
+
+void chip8_movie_tick_60hz(Chip8Movie* m, Chip8* c8) {
+  chip8_tick_60hz(c8);
+  record(m, MOVIE_FRAME, 0, chip8_display_hash(c8));
+}
+
+static uint32_t sched_run(void* m, Chip8* c8, uint32_t budget, Chip8RunResult* out) {
+  return chip8_movie_run_cycles((Chip8Movie*)m, c8, budget, out);
+}
+
+static void sched_tick(void* m, Chip8* c8) { chip8_movie_tick_60hz((Chip8Movie*)m, c8); }
+
+uint32_t chip8_movie_run_for(Chip8Movie* m, Chip8* c8, uint64_t host_ns) {
+  const C8SchedOps ops = { sched_run, sched_tick, m };
+  return c8_run_for((Chip8Impl*)c8, host_ns, &ops);
+}
+
+void chip8_movie_reset(Chip8Movie* m, Chip8* c8) {
+  chip8_reset(c8);
+  chip8_load_rom(c8, m->rom, m->rom_size);
+  record(m, MOVIE_RESET, 0, 0);
+}
+
+// Events to save: a recording gets its closing MOVIE_END appended
+static size_t saved_count(const Chip8Movie* m) { return m->count + m->recording; }
+
+// Encode the events; with out NULL only count the bytes
+static size_t encode_events(const Chip8Movie* m, uint8_t* out) {
+  size_t n = 0;
+  uint64_t prev = 0;
+  for (size_t i = 0; i < saved_count(m); ++i) {
+    MovieEvent end = { m->cycle, 0, MOVIE_END, 0 };
+    const MovieEvent* e = i < m->count ? &m->events[i] : &end;
+    uint64_t delta = e->cycle - prev;
+    prev = e->cycle;
+    do {
+      uint8_t b = (uint8_t)(delta & 0x7F);
+      delta >>= 7;
+      if (out) out[n] = (uint8_t)(b | (delta ? 0x80 : 0));
+      n++;
+    } while (delta);
+    if (out) out[n] = (uint8_t)(e->kind | e->key << 4);
+    n++;
+    if (e->kind == MOVIE_FRAME) {
+      if (out) for (int k = 0; k < 4; ++k) out[n + k] = (uint8_t)(e->hash >> 8 * k);
+      n += 4;
+    }
+  }
+  return n;
+}
+
+static void put32(uint8_t* p, uint32_t v) {
+  for (int k = 0; k < 4; ++k) p[k] = (uint8_t)(v >> 8 * k);
+}
+
+static uint32_t get32(const uint8_t* p) {
+  return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+size_t chip8_movie_size(const Chip8Movie* m) { return MOVIE_HEADER_SIZE + encode_events(m, NULL); }
+
+size_t chip8_movie_save(const Chip8Movie* m, void* buf, size_t size) {
+  size_t total = chip8_movie_size(m);
+  if (!buf || size < total || saved_count(m) > UINT32_MAX) return 0;
+  uint8_t* p = (uint8_t*)buf;
+  memcpy(p, MOVIE_MAGIC, 4);
+  p[4] = (uint8_t)MOVIE_VERSION;
+  p[5] = (uint8_t)(MOVIE_VERSION >> 8);
+  p[6] = c8_quirks_serial(m->quirks);
+  p[7] = m->machine;
+  put32(p + 8, m->seed);
+  put32(p + 12, m->rom_hash);
+  put32(p + 16, (uint32_t)m->rom_size);
+  put32(p + 20, (uint32_t)saved_count(m));
+  encode_events(m, p + MOVIE_HEADER_SIZE);
+  put32(p + 24, fnv1a(p + MOVIE_HEADER_SIZE, total - MOVIE_HEADER_SIZE));
+  return total;
+}
+
+Chip8Movie* chip8_movie_load(const void* buf, size_t size) {
+  const uint8_t* p = (const uint8_t*)buf;
+  if (!p || size < MOVIE_HEADER_SIZE || memcmp(p, MOVIE_MAGIC, 4) != 0) return NULL;
+  uint8_t quirks = c8_quirks_serial(p[6]);
+  if ((p[4] | p[5] << 8) != MOVIE_VERSION || quirks > C8_Q_ALL || p[7] > CHIP8_MACHINE_XOCHIP) return NULL;
+  if (fnv1a(p + MOVIE_HEADER_SIZE, size - MOVIE_HEADER_SIZE) != get32(p + 24)) return NULL;
+  uint32_t count = get32(p + 20);
+  // Every event takes at least two bytes, which bounds the allocation
+  if (count > (size - MOVIE_HEADER_SIZE) / 2) return NULL;
+
+  Chip8Movie* m = chip8_movie_create(get32(p + 8));
+  if (!m) return NULL;
+  m->quirks = quirks;
+  m->machine = p[7];
+  m->rom_hash = get32(p + 12);
+  m->rom_size = get32(p + 16);
+  m->events = (MovieEvent*)malloc((count ? count : 1) * sizeof(MovieEvent));
+  if (!m->events) { chip8_movie_destroy(m); return NULL; }
+  m->capacity = count;
+
+  size_t n = MOVIE_HEADER_SIZE;
+  uint64_t cycle = 0;
+  for (uint32_t i = 0; i < count; ++i) {
+    uint64_t delta = 0;
+    for (unsigned shift = 0;; shift += 7) {
+      if (n >= size || shift > 63) goto bad;
+      uint8_t b = p[n++];
+      delta |= (uint64_t)(b & 0x7F) << shift;
+      if (!(b & 0x80)) break;
+    }
+    if (n >= size) goto bad;
+    MovieEvent e = { cycle += delta, 0, (uint8_t)(p[n] & 0xF), (uint8_t)(p[n] >> 4) };
+    n++;
+    if (e.kind >= MOVIE_KIND_COUNT) goto bad;
+    if (e.kind == MOVIE_FRAME) {
+      if (size - n < 4) goto bad;
+      e.hash = get32(p + n);
+      n += 4;
+      m->frames++;
+    }
+    m->events[m->count++] = e;
+  }
+  if (n != size) goto bad;
+  return m;
+
+bad:
+  chip8_movie_destroy(m);
+  return NULL;
+}
+
+bool chip8_movie_play_begin(Chip8Movie* m, Chip8* c8, const uint8_t* rom, size_t rom_size) {
+  if ((!rom && rom_size) || rom_size != m->rom_size || fnv1a(rom, rom_size) != m->rom_hash) return false;
+  if (!set_rom(m, rom, rom_size)) return false;
+  if (chip8_get_machine(c8) != (Chip8Machine)m->machine) chip8_set_machine(c8, (Chip8Machine)m->machine);
+  c8_apply_quirks((Chip8Impl*)c8, m->quirks);
+  m->recording = false;
+  m->playing = true;
+  return restart(m, c8);
+}
+
+bool chip8_movie_play(Chip8Movie* m, Chip8* c8, uint64_t max_frames) {
+  Chip8MovieStatus* st = &m->status;
+  if (!m->playing || st->stalled) return false;
+  uint64_t played = 0;
+  while (m->next < m->count && played < max_frames) {
+    const MovieEvent* e = &m->events[m->next];
+    if (m->cycle < e->cycle) {
+      uint64_t span = e->cycle - m->cycle;
+      Chip8RunResult r;
+      uint32_t done = chip8_run_cycles(c8, span > UINT32_MAX ? UINT32_MAX : (uint32_t)span, &r);
+      m->cycle += done;
+      if (done == 0 && r.reason == CHIP8_EXIT_KEY_WAIT) {
+        st->stalled = true;
+        return false;
+      }
+      continue;
+    }
+    switch (e->kind) {
+      case MOVIE_KEY_DOWN: chip8_key_down(c8, e->key); break;
+      case MOVIE_KEY_UP: chip8_key_up(c8, e->key); break;
+      case MOVIE_RESET:
+        chip8_reset(c8);
+        chip8_load_rom(c8, m->rom, m->rom_size);
+        break;
+      case MOVIE_END: break;
+      case MOVIE_FRAME: {
+        chip8_tick_60hz(c8);
+        uint32_t hash = chip8_display_hash(c8);
+        if (hash != e->hash && st->mismatches++ == 0) {
+          st->first_mismatch = st->frames;
+          st->expected_hash = e->hash;
+          st->actual_hash = hash;
+        }
+        st->frames++;
+        played++;
+        break;
+      }
+    }
+    m->next++;
+  }
+  return m->next < m->count;
+}
+
+void chip8_movie_get_status(const Chip8Movie* m, Chip8MovieStatus* out) {
+  *out = m->status;
+  if (!m->playing) out->frames = m->frames;
+  out->total_frames = m->frames;
+  out->instructions = m->cycle;
+  out->done = m->playing && m->next == m->count;
+}
@@ -0,0 +1,293 @@
+
+#ifndef CHIP8_OPCODES_IMPL_H
+#define CHIP8_OPCODES_IMPL_H
+
+// Opcode semantics shared by every execution engine. Each helper implements one
+// instruction (or one family) on a Chip8Impl and is static inline so the switch
+// interpreter and the pre-decoded engine both compile it into their loops.
+// Skip helpers add 2 to *pc_adv when taken; the caller owns all other PC updates.
+// Quirks reach the helpers as operands derived from the C8_Q_* bits by the
+// c8_q*() functions (chip8_impl.h): the switch interpreter derives them from
+// constant bits per specialized loop, the cached engine once when it decodes.
+
+#include <string.h>
+
+#include "chip8_impl.h"
+
+// Fetch the big-endian opcode at pc; addresses wrap at the end of memory.
+static inline uint16_t c8_fetch(const Chip8Impl* c8, uint16_t pc) {
+  return (uint16_t)(c8->memory[pc & c8->mem_mask] << 8 | c8->memory[(pc + 1) & c8->mem_mask]);
+}
+
+// Instruction class of an opcode; decoding for the cached engine and the
+// statistics hooks both start from this.
+static inline Chip8OpClass c8_op_class(uint16_t opcode) {
+  uint8_t n = opcode & 0xF;
+  uint8_t kk = opcode & 0xFF;
+  switch (opcode >> 12) {
+    case 0x0:
+      if (kk == 0xE0) return CHIP8_OP_CLS;
+      if (kk == 0xEE) return CHIP8_OP_RET;
+      // 00Cn/00Dn scrolls, 00FB-00FF
+      if ((opcode & 0xFFE0) == 0x00C0 || (opcode >= 0x00FB && opcode <= 0x00FF)) return CHIP8_OP_EXT;
+      return CHIP8_OP_SYS;
+    case 0x1: return CHIP8_OP_JP;
+    case 0x2: return CHIP8_OP_CALL;
+    case 0x3: return CHIP8_OP_SE_B;
+    case 0x4: return CHIP8_OP_SNE_B;
+    case 0x5: return n == 0 ? CHIP8_OP_SE_R : (n == 2 || n == 3) ? CHIP8_OP_EXT : CHIP8_OP_INVALID;
+    case 0x6: return CHIP8_OP_LD_B;
+    case 0x7: return CHIP8_OP_ADD_B;
+    case 0x8: {
+      static const uint8_t alu[16] = {
+        CHIP8_OP_LD_R, CHIP8_OP_OR, CHIP8_OP_AND, CHIP8_OP_XOR,
+        CHIP8_OP_ADD_R, CHIP8_OP_SUB, CHIP8_OP_SHR, CHIP8_OP_SUBN,
+        CHIP8_OP_INVALID, CHIP8_OP_INVALID, CHIP8_OP_INVALID, CHIP8_OP_INVALID,
+        CHIP8_OP_INVALID, CHIP8_OP_INVALID, CHIP8_OP_SHL, CHIP8_OP_INVALID,
+      };
+      return (Chip8OpClass)alu[n];
+    }
+    case 0x9: return n == 0 ? CHIP8_OP_SNE_R : CHIP8_OP_INVALID;
+    case 0xA: return CHIP8_OP_LD_I;
+    case 0xB: return CHIP8_OP_JP_V0;
+    case 0xC: return CHIP8_OP_RND;
+    case 0xD: return CHIP8_OP_DRW;
+    case 0xE: return kk == 0x9E ? CHIP8_OP_SKP : kk == 0xA1 ? CHIP8_OP_SKNP : CHIP8_OP_INVALID;
+    default:
+      switch (kk) {
+        case 0x07: return CHIP8_OP_LD_VDT;
+        case 0x0A: return CHIP8_OP_LD_K;
+        case 0x15: return CHIP8_OP_LD_DT;
+        case 0x18: return CHIP8_OP_LD_ST;
+        case 0x1E: return CHIP8_OP_ADD_I;
+        case 0x29: return CHIP8_OP_LD_F;
+        case 0x33: return CHIP8_OP_BCD;
+        case 0x55: return CHIP8_OP_STORE;
+        case 0x65: return CHIP8_OP_LOAD;
+        case 0x01: case 0x30: case 0x3A: case 0x75: case 0x85: return CHIP8_OP_EXT;
+        case 0x00: case 0x02: return opcode == 0xF000 || opcode == 0xF002 ? CHIP8_OP_EXT : CHIP8_OP_INVALID;
+        default: return CHIP8_OP_INVALID;
+      }
+  }
+}
+
+// Called after an opcode stores `len` bytes at `addr` so decoded copies of that
+// code are dropped and its pages are reset.
+static inline void c8_mem_written(Chip8Impl* c8, uint16_t addr, uint16_t len) {
+  c8_mem_touch(c8, addr, len);
+  if (c8->dcache) chip8_decoded_invalidate(c8, addr, len);
+  if (c8->jit) chip8_jit_invalidate(c8, addr, len);
+}
+
+static inline uint8_t c8_rand(Chip8Impl* c8) {
+  return c8->rng ? c8->rng(c8->rng_user) : 0;
+}
+
+static inline uint64_t c8_rotr64(uint64_t v, unsigned s) {
+  return (v >> s) | (v << ((64 - s) & 63));
+}
+
+// Record that the rows in `rows` changed
+static inline void c8_fb_changed(Chip8Impl* c8, uint32_t rows) {
+  if (!rows) return;
+  c8->fb_dirty |= rows;
+  c8->fb_generation++;
+  c8->gfx_stale = true;
+}
+
+static inline void op_cls(Chip8Impl* c8) {
+  if (c8->machine) {
+    c8_cls_ext(c8);
+    return;
+  }
+  uint32_t rows = 0;
+  for (unsigned y = 0; y < FB_HEIGHT; ++y) rows |= (uint32_t)(c8->fb[0][0][y] != 0) << y;
+  memset(c8->fb[0][0], 0, FB_HEIGHT * sizeof(uint64_t));
+  c8->fb_hash = 0;
+  c8_fb_changed(c8, rows);
+  c8->events |= C8_EVT_DISPLAY;
+}
+
+static inline void op_ret(Chip8Impl* c8) {
+  if (c8->sp > 0) {
+    c8->sp--;
+    c8->pc = c8->stack[c8->sp];
+  }
+}
+
+static inline void op_jp(Chip8Impl* c8, uint16_t addr) { c8->pc = addr; }
+
+static inline void op_call(Chip8Impl* c8, uint16_t addr) {
+  if (c8->sp < 16) {
+    c8->stack[c8->sp++] = (uint16_t)(c8->pc + 2); // return past the CALL
+    c8->pc = addr;
+  }
+}
+
+static inline void op_se_byte(Chip8Impl* c8, uint8_t x, uint8_t kk, uint16_t* pc_adv) {
+  if (c8->V[x] == kk) *pc_adv += 2;
+}
+
+static inline void op_sne_byte(Chip8Impl* c8, uint8_t x, uint8_t kk, uint16_t* pc_adv) {
+  if (c8->V[x] != kk) *pc_adv += 2;
+}
+
+static inline void op_se_xy(Chip8Impl* c8, uint8_t x, uint8_t y, uint16_t* pc_adv) {
+  if (c8->V[x] == c8->V[y]) *pc_adv += 2;
+}
+
+static inline void op_ld_byte(Chip8Impl* c8, uint8_t x, uint8_t kk) { c8->V[x] = kk; }
+static inline void op_add_byte(Chip8Impl* c8, uint8_t x, uint8_t kk) { c8->V[x] += kk; }
+
+static inline void op_invalid(Chip8Impl* c8, uint16_t opcode) {
+  c8->invalid_opcode = opcode;
+  c8->events |= C8_EVT_INVALID;
+}
+
+static inline void op_or(Chip8Impl* c8, uint8_t x, uint8_t y, uint8_t vf_keep) {
+  c8->V[x] |= c8->V[y];
+  c8->V[0xF] &= vf_keep;
+}
+
+static inline void op_and(Chip8Impl* c8, uint8_t x, uint8_t y, uint8_t vf_keep) {
+  c8->V[x] &= c8->V[y];
+  c8->V[0xF] &= vf_keep;
+}
+
+static inline void op_xor(Chip8Impl* c8, uint8_t x, uint8_t y, uint8_t vf_keep) {
+  c8->V[x] ^= c8->V[y];
+  c8->V[0xF] &= vf_keep;
+}
+
+static inline void op_shr(Chip8Impl* c8, uint8_t x, uint8_t src) {
+  uint8_t v = c8->V[src];
+  c8->V[0xF] = v & 0x1;
+  c8->V[x] = v >> 1;
+}
+
+static inline void op_shl(Chip8Impl* c8, uint8_t x, uint8_t src) {
+  uint8_t v = c8->V[src];
+  c8->V[0xF] = (v & 0x80) != 0;
+  c8->V[x] = (uint8_t)(v << 1);
+}
+
+static C8_ALWAYS_INLINE void op_alu(Chip8Impl* c8, uint8_t x, uint8_t y, uint8_t subcode, uint16_t opcode, unsigned q) {
+  uint16_t tmp;
+  switch (subcode) {
+    case 0x0: c8->V[x] = c8->V[y]; break;                 // LD Vx, Vy
+    case 0x1: op_or(c8, x, y, c8_qvf_keep(q)); break;     // OR
+    case 0x2: op_and(c8, x, y, c8_qvf_keep(q)); break;    // AND
+    case 0x3: op_xor(c8, x, y, c8_qvf_keep(q)); break;    // XOR
+    case 0x4:                                           // ADD
+      tmp = (uint16_t)c8->V[x] + (uint16_t)c8->V[y];
+      c8->V[0xF] = tmp > 0xFF;
+      c8->V[x] = (uint8_t)tmp;
+      break;
+    case 0x5:                                           // SUB Vx = Vx - Vy
+      c8->V[0xF] = (c8->V[x] > c8->V[y]);
+      c8->V[x] = (uint8_t)(c8->V[x] - c8->V[y]);
+      break;
+    case 0x6: op_shr(c8, x, c8_qshift_src(q, x, y)); break; // SHR
+    case 0x7:                                           // SUBN Vx = Vy - Vx
+      c8->V[0xF] = (c8->V[y] > c8->V[x]);
+      c8->V[x] = (uint8_t)(c8->V[y] - c8->V[x]);
+      break;
+    case 0xE: op_shl(c8, x, c8_qshift_src(q, x, y)); break; // SHL
+    default: op_invalid(c8, opcode); break;
+  }
+}
+
+static inline void op_sne_xy(Chip8Impl* c8, uint8_t x, uint8_t y, uint16_t* pc_adv) {
+  if (c8->V[x] != c8->V[y]) *pc_adv += 2;
+}
+
+static inline void op_ld_i(Chip8Impl* c8, uint16_t addr) { c8->I = addr; }
+
+// Bnnn: jump to addr + Vr, r from c8_qjump_reg()
+static inline void op_jp_offset(Chip8Impl* c8, uint8_t r, uint16_t addr) {
+  c8->pc = (uint16_t)(addr + c8->V[r]);
+}
+
+static inline void op_rnd(Chip8Impl* c8, uint8_t x, uint8_t kk) {
+  c8->V[x] = (uint8_t)(c8_rand(c8) & kk);
+}
+
+// Each sprite row is placed at bit 63 and rotated right by vx, which wraps it
+// horizontally (C8_Q_CLIP masks off what wrapped); one AND detects collision
+// and one XOR draws it. C8_Q_DISPLAY_WAIT then holds the machine until the
+// next tick.
+static C8_ALWAYS_INLINE void op_drw(Chip8Impl* c8, uint8_t x, uint8_t y, uint8_t n, unsigned q) {
+  if (q & C8_Q_DISPLAY_WAIT) c8->waiting_for_vblank = true;
+  if (c8->machine) {
+    c8_draw_ext(c8, x, y, n, q);
+    return;
+  }
+  unsigned vx = c8->V[x] % FB_WIDTH;
+  unsigned vy = c8->V[y] % FB_HEIGHT;
+  uint64_t keep = q & C8_Q_CLIP ? ~0ull >> vx : ~0ull;
+  uint64_t hit = 0;
+  uint32_t rows = 0;
+  for (unsigned row = 0; row < n; ++row) {
+    if (vy + row >= FB_HEIGHT) break; // wrap vertically optional; here stop
+    uint64_t bits = c8_rotr64((uint64_t)c8->memory[(c8->I + row) & c8->mem_mask] << 56, vx) & keep;
+    if (!bits) continue;
+    uint64_t old = c8->fb[0][0][vy + row];
+    hit |= old & bits;
+    c8->fb[0][0][vy + row] = old ^ bits;
+    c8->fb_hash ^= c8_row_hash(vy + row, old) ^ c8_row_hash(vy + row, old ^ bits);
+    rows |= 1u << (vy + row);
+  }
+  c8->V[0xF] = hit != 0;
+  C8_STATS_ADD(c8, draws, 1);
+  C8_STATS_ADD(c8, collisions, hit != 0);
+  C8_STATS_ADD(c8, sprite_rows, n < FB_HEIGHT - vy ? n : FB_HEIGHT - vy);
+  c8_fb_changed(c8, rows);
+  c8->events |= C8_EVT_DISPLAY;
+}
+
+static inline void op_skp(Chip8Impl* c8, uint8_t x, uint16_t* pc_adv) {
+  if (c8->keypad[c8->V[x] & 0xF]) *pc_adv += 2;
+}
+static inline void op_sknp(Chip8Impl* c8, uint8_t x, uint16_t* pc_adv) {
+  if (!c8->keypad[c8->V[x] & 0xF]) *pc_adv += 2;
+}
+
+static inline void op_ld_st(Chip8Impl* c8, uint8_t x) {
+  if (c8->sound_timer == 0 && c8->V[x] > 0) c8->events |= C8_EVT_SOUND;
+  c8->sound_timer = c8->V[x];
+}
+
+static inline void op_ld_vx_dt(Chip8Impl* c8, uint8_t x) { c8->V[x] = c8->delay_timer; }
+
+static inline void op_ld_key(Chip8Impl* c8, uint8_t x) {
+  c8->waiting_for_key = true;
+  c8->wait_key_reg = x;
+  c8->events |= C8_EVT_KEY_WAIT;
+  C8_STATS_ADD(c8, key_waits, 1);
+}
+
+static inline void op_ld_dt(Chip8Impl* c8, uint8_t x) { c8->delay_timer = c8->V[x]; }
+static inline void op_add_i(Chip8Impl* c8, uint8_t x) { c8->I = (uint16_t)(c8->I + c8->V[x]); }
+static inline void op_ld_f(Chip8Impl* c8, uint8_t x) { c8->I = (uint16_t)(0x50 + (c8->V[x] & 0xF) * 5); }
+
+static inline void op_bcd(Chip8Impl* c8, uint8_t x) {
+  uint8_t v = c8->V[x];
+  c8->memory[(c8->I + 0) & c8->mem_mask] = (uint8_t)(v / 100);
+  c8->memory[(c8->I + 1) & c8->mem_mask] = (uint8_t)((v / 10) % 10);
+  c8->memory[(c8->I + 2) & c8->mem_mask] = (uint8_t)(v % 10);
+  c8_mem_written(c8, c8->I, 3);
+}
+
+// Fx55/Fx65; I advances by step, from c8_qmem_step()
+static inline void op_store(Chip8Impl* c8, uint8_t x, uint8_t step) {
+  for (uint8_t i = 0; i <= x; ++i) c8->memory[(c8->I + i) & c8->mem_mask] = c8->V[i];
+  c8_mem_written(c8, c8->I, (uint16_t)(x + 1));
+  c8->I = (uint16_t)(c8->I + step);
+}
+
+static inline void op_load(Chip8Impl* c8, uint8_t x, uint8_t step) {
+  for (uint8_t i = 0; i <= x; ++i) c8->V[i] = c8->memory[(c8->I + i) & c8->mem_mask];
+  c8->I = (uint16_t)(c8->I + step);
+}
+
+#endif // CHIP8_OPCODES_IMPL_H
@@ -0,0 +1,241 @@
+#include "chip8_rewind.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+// Every capture is a CHIP8_STATE_RAW image. Raw images have a fixed layout, so
+// XOR against the keyframe image leaves zeros wherever nothing changed. Both
+// keyframes (against zero) and deltas are then run-length encoded:
+//
+//   0x00-0x7F  run of (c + 1) zero bytes
+//   0x80-0xFF  (c - 0x7F) literal bytes follow
+//
+// Encoded captures are packed back to back in one byte ring. A capture that
+// does not fit at the end wraps to offset 0; the tail left behind is unused
+// until the ring wraps again.
+
+#define REWIND_RUN_MAX 128
+#define REWIND_ENC_MAX (CHIP8_STATE_MAX_SIZE + CHIP8_STATE_MAX_SIZE / REWIND_RUN_MAX + 1)
+#define REWIND_ENC_MIN (CHIP8_STATE_MAX_SIZE_CHIP8 + CHIP8_STATE_MAX_SIZE_CHIP8 / REWIND_RUN_MAX + 1)
+#define REWIND_DEFAULT_INTERVAL 60
+#define REWIND_MAX_INTERVAL UINT16_MAX
+#define REWIND_NO_KEY UINT64_MAX
+
+typedef struct RewindEntry {
+  uint32_t offset;
+  uint32_t len;
+  uint16_t key_dist; // captures back to the keyframe it is encoded against (0 for keyframes)
+} RewindEntry;
+
+struct Chip8Rewind {
+  uint8_t* data;
+  size_t capacity;
+  size_t head; // where the next capture is written
+  size_t used;
+
+  // Captures first..next-1 live in entries[seq % max_frames]
+  RewindEntry* entries;
+  uint32_t max_frames;
+  uint64_t first, next;
+  uint32_t keyframes;
+  uint32_t interval;
+
+  // Decoded image of keyframe key_seq, the base for new deltas and step-back
+  uint64_t key_seq;
+  size_t state_size;
+  uint8_t key_image[CHIP8_STATE_MAX_SIZE];
+  uint8_t raw[CHIP8_STATE_MAX_SIZE];
+  uint8_t diff[CHIP8_STATE_MAX_SIZE];
+  uint8_t enc[REWIND_ENC_MAX];
+
+  uint64_t captures, encoded_bytes, evicted;
+};
+
+static size_t rle_encode(uint8_t* out, const uint8_t* d, size_t n) {
+  size_t i = 0, o = 0;
+  while (i < n) {
+    size_t e = i;
+    if (d[i] == 0) {
+      uint64_t w;
+      while (e + 8 <= n && e - i + 8 <= REWIND_RUN_MAX && (memcpy(&w, d + e, 8), w == 0)) e += 8;
+      while (e < n && e - i < REWIND_RUN_MAX && d[e] == 0) ++e;
+      out[o++] = (uint8_t)(e - i - 1);
+    } else {
+      // A zero run shorter than 3 bytes is cheaper kept inside the literal
+      while (e < n && e - i < REWIND_RUN_MAX) {
+        if (d[e] == 0 && (e + 1 >= n || d[e + 1] == 0) && (e + 2 >= n || d[e + 2] == 0)) break;
+        ++e;
+      }
+      out[o++] = (uint8_t)(0x80 | (e - i - 1));
+      memcpy(out + o, d + i, e - i);
+      o += e - i;
+    }
+    i = e;
+  }
+  return o;
+}
+
+// Decode into out[0..n), XORed with base when given
+static void rle_decode(uint8_t* out, const uint8_t* base, size_t n, const uint8_t* enc, size_t len) {
+  size_t o = 0;
+  for (size_t p = 0; p < len && o < n;) {
+    uint8_t c = enc[p++];
+    size_t run = (size_t)(c & 0x7F) + 1;
+    if (run > n - o) run = n - o;
+    if (c < 0x80) {
+      if (base) memcpy(out + o, base + o, run);
+      else memset(out + o, 0, run);
+    } else {
+      for (size_t k = 0; k < run; ++k) out[o + k] = (uint8_t)(enc[p + k] ^ (base ? base[o + k] : 0));
+      p += run;
+    }
+    o += run;
+  }
+}
+
+static RewindEntry* entry(const Chip8Rewind* r, uint64_t seq) { return &r->entries[seq % r->max_frames]; }
+
+static uint64_t key_of(const Chip8Rewind* r, uint64_t seq) { return seq - entry(r, seq)->key_dist; }
+
+static void evict_oldest_group(Chip8Rewind* r) {
+  do {
+    RewindEntry* e = entry(r, r->first);
+    r->used -= e->len;
+    if (e->key_dist == 0) r->keyframes--;
+    r->first++;
+    r->evicted++;
+  } while (r->first != r->next && entry(r, r->first)->key_dist != 0);
+  if (r->first == r->next) r->head = 0;
+}
+
+// Evict until `len` contiguous bytes are free; returns their offset.
+static size_t make_room(Chip8Rewind* r, size_t len) {
+  for (;;) {
+    if (r->first == r->next) { r->head = 0; return 0; }
+    if (r->next - r->first < r->max_frames) {
+      size_t tail = entry(r, r->first)->offset;
+      if (tail < r->head) {
+        if (r->head + len <= r->capacity) return r->head;
+        if (len <= tail) return 0;
+      } else if (r->head + len <= tail) {
+        return r->head;
+      }
+    }
+    evict_oldest_group(r);
+  }
+}
+
+Chip8Rewind* chip8_rewind_create(size_t data_bytes, uint32_t max_frames, uint32_t keyframe_interval) {
+  if (data_bytes < REWIND_ENC_MIN || data_bytes > UINT32_MAX || max_frames == 0) return NULL;
+  Chip8Rewind* r = (Chip8Rewind*)calloc(1, sizeof(*r));
+  if (!r) return NULL;
+  r->data = (uint8_t*)malloc(data_bytes);
+  r->entries = (RewindEntry*)calloc(max_frames, sizeof(RewindEntry));
+  if (!r->data || !r->entries) { chip8_rewind_destroy(r); return NULL; }
+  r->capacity = data_bytes;
+  r->max_frames = max_frames;
+  r->interval = keyframe_interval ? keyframe_interval : REWIND_DEFAULT_INTERVAL;
+  if (r->interval > REWIND_MAX_INTERVAL) r->interval = REWIND_MAX_INTERVAL;
+  r->key_seq = REWIND_NO_KEY;
+  return r;
+}
+
+void chip8_rewind_destroy(Chip8Rewind* r) {
+  if (!r) return;
+  free(r->data);
+  free(r->entries);
+  free(r);
+}
+
+void chip8_rewind_capture(Chip8Rewind* r, const Chip8* c8) {
+  // Raw images only line up while the machine variant stays the same
+  size_t size = chip8_save_state(c8, r->raw, sizeof(r->raw), CHIP8_STATE_RAW);
+  if (size != r->state_size) chip8_rewind_clear(r);
+  r->state_size = size;
+  bool keyframe = r->first == r->next || r->key_seq != key_of(r, r->next - 1) ||
+                  r->next - r->key_seq >= r->interval;
+  size_t len, offset;
+  for (;;) {
+    if (keyframe) {
+      len = rle_encode(r->enc, r->raw, r->state_size);
+    } else {
+      for (size_t i = 0; i < r->state_size; ++i) r->diff[i] = r->raw[i] ^ r->key_image[i];
+      len = rle_encode(r->enc, r->diff, r->state_size);
+    }
+    if (len > r->capacity) {
+      // Only an XO-CHIP keyframe can outgrow a buffer sized for CHIP-8
+      if (!keyframe) { keyframe = true; continue; }
+      chip8_rewind_clear(r);
+      r->captures++;
+      r->evicted++;
+      return;
+    }
+    offset = make_room(r, len);
+    // Making room may have evicted the keyframe this delta refers to
+    if (keyframe || (r->first != r->next && r->key_seq >= r->first)) break;
+    keyframe = true;
+  }
+
+  memcpy(r->data + offset, r->enc, len);
+  RewindEntry* e = entry(r, r->next);
+  e->offset = (uint32_t)offset;
+  e->len = (uint32_t)len;
+  e->key_dist = (uint16_t)(keyframe ? 0 : r->next - r->key_seq);
+  if (keyframe) {
+    memcpy(r->key_image, r->raw, r->state_size);
+    r->key_seq = r->next;
+    r->keyframes++;
+  }
+  r->next++;
+  r->head = offset + len;
+  r->used += len;
+  r->captures++;
+  r->encoded_bytes += len;
+}
+
+bool chip8_rewind_step_back(Chip8Rewind* r, Chip8* c8) {
+  if (r->first == r->next) return false;
+  RewindEntry e = *entry(r, r->next - 1);
+  uint64_t key = r->next - 1 - e.key_dist;
+  if (r->key_seq != key) {
+    const RewindEntry* k = entry(r, key);
+    rle_decode(r->key_image, NULL, r->state_size, r->data + k->offset, k->len);
+    r->key_seq = key;
+  }
+  const uint8_t* image = r->key_image;
+  if (e.key_dist != 0) {
+    rle_decode(r->raw, r->key_image, r->state_size, r->data + e.offset, e.len);
+    image = r->raw;
+  }
+  if (!chip8_load_state(c8, image, r->state_size)) return false; // keep the capture; c8 is untouched
+
+  r->next--;
+  r->used -= e.len;
+  r->head = r->first == r->next ? 0 : e.offset;
+  if (e.key_dist == 0) {
+    r->keyframes--;
+    r->key_seq = REWIND_NO_KEY;
+  }
+  return true;
+}
+
+uint32_t chip8_rewind_frames(const Chip8Rewind* r) { return (uint32_t)(r->next - r->first); }
+
+void chip8_rewind_clear(Chip8Rewind* r) {
+  r->first = r->next;
+  r->head = 0;
+  r->used = 0;
+  r->keyframes = 0;
+  r->key_seq = REWIND_NO_KEY;
+}
+
+void chip8_rewind_get_stats(const Chip8Rewind* r, Chip8RewindStats* out) {
+  out->frames = chip8_rewind_frames(r);
+  out->keyframes = r->keyframes;
+  out->data_used = r->used;
+  out->data_capacity = r->capacity;
+  out->total_bytes = sizeof(*r) + r->capacity + (size_t)r->max_frames * sizeof(RewindEntry);
+  out->captures = r->captures;
+  out->encoded_bytes = r->encoded_bytes;
+  out->evicted = r->evicted;
+}
@@ -0,0 +1,169 @@
+#include "chip8.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "chip8_impl.h"
+#include "chip8_stats.h"
+
+// Host nanoseconds are turned into cycles in steps of at most a second, so
+// ns * cpu_hz stays far below 2^64 for any clock that fits in 32 bits.
+#define NS_PER_S 1000000000ull
+
+static uint32_t plain_run(void* user, Chip8* c8, uint32_t budget, Chip8RunResult* out) {
+  (void)user;
+  return chip8_run_cycles(c8, budget, out);
+}
+
+static void plain_tick(void* user, Chip8* c8) {
+  (void)user;
+  chip8_tick_60hz(c8);
+}
+
+// Run `cycles` cycles, stopping at each 60Hz tick to apply it
+static uint32_t run_cycles_ticked(Chip8Impl* c8, uint64_t cycles, const C8SchedOps* ops) {
+  uint32_t ticks = 0;
+  while (cycles > 0) {
+    // Cycles until tick_phase reaches cpu_hz, rounded up; at least 1
+    uint64_t to_tick = (c8->cpu_hz - c8->tick_phase + 59) / 60;
+    uint32_t chunk = (uint32_t)(cycles < to_tick ? cycles : to_tick);
+    uint32_t left = chunk;
+    while (left > 0) {
+      Chip8RunResult r;
+      left -= ops->run(ops->user, (Chip8*)c8, left, &r);
+      if (r.reason == CHIP8_EXIT_KEY_WAIT) break;
+    }
+    c8->clock_cycles += left; // the rest of the chunk is spent waiting in Fx0A
+    cycles -= chunk;
+    uint64_t phase = c8->tick_phase + 60ull * chunk;
+    if (phase >= c8->cpu_hz) {
+      phase -= c8->cpu_hz;
+      ops->tick(ops->user, (Chip8*)c8);
+      ticks++;
+    }
+    c8->tick_phase = (uint32_t)phase;
+  }
+  return ticks;
+}
+
+// Idle loops. A delay-timer spin is Fx07 / 3xkk or 4xkk / 1nnn back to the
+// Fx07; as long as the skip does not fire on the delay timer's value, each
+// pass leaves the machine as it was, and nothing but a tick can change that.
+typedef struct C8Spin {
+  unsigned head; // address of the loop's first instruction
+  unsigned len;  // instructions in the loop: 3, or 1 for a jump to itself
+  unsigned pos;  // index of the instruction at pc
+  unsigned x;    // register the spin loads the delay timer into
+} C8Spin;
+
+static uint16_t op_at(const Chip8Impl* c8, unsigned addr) {
+  return (uint16_t)(c8->memory[addr & c8->mem_mask] << 8 | c8->memory[(addr + 1) & c8->mem_mask]);
+}
+
+// True when the skip instruction, testing value v, falls through to the jump back
+static bool spin_continues(uint16_t skip, uint8_t v) {
+  bool equal = v == (skip & 0xFF);
+  return (skip & 0xF000) == 0x3000 ? !equal : equal;
+}
+
+static bool find_spin(const Chip8Impl* c8, C8Spin* out) {
+  if (c8->waiting_for_key) return false;
+  unsigned pc = c8->pc & c8->mem_mask;
+  uint16_t op = op_at(c8, pc);
+  // JP to itself (1nnn reaches the first 4 KB only), or the SUPER-CHIP exit
+  if ((pc < MEM_SIZE && op == (0x1000 | pc)) || (c8->machine && op == 0x00FD)) {
+    *out = (C8Spin){ pc, 1, 0, 0 };
+    return true;
+  }
+  for (unsigned pos = 0; pos < 3; ++pos) {
+    unsigned head = (pc - 2 * pos) & c8->mem_mask;
+    uint16_t load = op_at(c8, head), skip = op_at(c8, head + 2), jump = op_at(c8, head + 4);
+    unsigned x = load >> 8 & 0xF;
+    if ((load & 0xF0FF) != 0xF007 || head >= MEM_SIZE || jump != (0x1000 | head)) continue;
+    if (((skip & 0xF000) != 0x3000 && (skip & 0xF000) != 0x4000) || (skip >> 8 & 0xF) != x) continue;
+    // Still spinning at the next test, and, when pc is at the skip, at this one
+    if (!spin_continues(skip, c8->delay_timer)) return false;
+    if (pos == 1 && !spin_continues(skip, c8->V[x])) return false;
+    *out = (C8Spin){ head, 3, pos, x };
+    return true;
+  }
+  return false;
+}
+
+uint32_t c8_skip_idle(Chip8Impl* c8, uint32_t budget) {
+  C8Spin s;
+  if (budget == 0 || !find_spin(c8, &s)) return 0;
+  // The loop's Fx07 comes up at index (len - pos) % len of the budget
+  if (s.len == 3 && (3 - s.pos) % 3 < budget) c8->V[s.x] = c8->delay_timer;
+  c8->pc = (uint16_t)((s.head + 2 * ((s.pos + budget) % s.len)) & c8->mem_mask);
+#ifdef CHIP8_ENABLE_STATS
+  // Count what executing the budget would have counted
+  for (unsigned k = 0; k < s.len; ++k) {
+    uint64_t n = budget / s.len + ((k + s.len - s.pos) % s.len < budget % s.len);
+    unsigned addr = (s.head + 2 * k) & c8->mem_mask;
+    c8->stats.op_class[chip8_stats_classify(op_at(c8, addr))] += n;
+    c8->stats.pc_heat[addr & MEM_MASK] += n;
+  }
+  c8->stats.instructions += budget;
+  c8->stats.idle_cycles += budget;
+#endif
+  return budget;
+}
+
+Chip8Idle chip8_idle_state(const Chip8* c8p) {
+  const Chip8Impl* c8 = (const Chip8Impl*)c8p;
+  C8Spin s;
+  if (c8->waiting_for_key) return CHIP8_IDLE_KEY_WAIT;
+  if (c8->waiting_for_vblank) return CHIP8_IDLE_DISPLAY_WAIT;
+  if (!find_spin(c8, &s)) return CHIP8_IDLE_NONE;
+  return s.len == 1 ? CHIP8_IDLE_HALT : CHIP8_IDLE_DELAY_SPIN;
+}
+
+uint64_t chip8_ns_until_tick(const Chip8* c8p) {
+  const Chip8Impl* c8 = (const Chip8Impl*)c8p;
+  uint64_t cycles = (c8->cpu_hz - c8->tick_phase + 59) / 60;
+  return (cycles * NS_PER_S - c8->clock_frac + c8->cpu_hz - 1) / c8->cpu_hz;
+}
+
+uint32_t c8_run_for(Chip8Impl* c8, uint64_t host_ns, const C8SchedOps* ops) {
+  uint32_t ticks = 0;
+  while (host_ns > 0) {
+    uint64_t ns = host_ns < NS_PER_S ? host_ns : NS_PER_S;
+    host_ns -= ns;
+    c8->clock_frac += ns * c8->cpu_hz;
+    uint64_t cycles = c8->clock_frac / NS_PER_S;
+    c8->clock_frac %= NS_PER_S;
+    ticks += run_cycles_ticked(c8, cycles, ops);
+  }
+  return ticks;
+}
+
+uint32_t chip8_run_for(Chip8* c8, uint64_t host_ns) {
+  const C8SchedOps ops = { plain_run, plain_tick, NULL };
+  return c8_run_for((Chip8Impl*)c8, host_ns, &ops);
+}
+
+uint64_t c8_emulated_ns(const Chip8Impl* c8) {
+  uint64_t c = c8->clock_cycles;
+  return c8->clock_base_ns + c / c8->cpu_hz * NS_PER_S + c % c8->cpu_hz * NS_PER_S / c8->cpu_hz;
+}
+
+uint64_t chip8_emulated_ns(const Chip8* c8) { return c8_emulated_ns((const Chip8Impl*)c8); }
+
+void chip8_set_sound_callback(Chip8* c8p, chip8_sound_func fn, void* user) {
+  Chip8Impl* c8 = (Chip8Impl*)c8p;
+  c8->sound_fn = fn;
+  c8->sound_user = user;
+}
+
+void chip8_set_cpu_hz(Chip8* c8p, uint32_t hz) {
+  Chip8Impl* c8 = (Chip8Impl*)c8p;
+  if (hz == 0 || hz == c8->cpu_hz) return;
+  c8->clock_base_ns = c8_emulated_ns(c8);
+  c8->clock_cycles = 0;
+  c8->cpu_hz = hz;
+  c8->clock_frac = 0;
+  c8->tick_phase = 0;
+}
+
+uint32_t chip8_get_cpu_hz(const Chip8* c8) { return ((const Chip8Impl*)c8)->cpu_hz; }
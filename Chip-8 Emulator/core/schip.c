@@ -0,0 +1,258 @@
+// SUPER-CHIP and XO-CHIP instructions (CHIP8_MACHINE_SCHIP/XOCHIP).
+//
+// The display keeps the word-major layout of chip8_impl.h: a plane is two
+// columns of 64-bit words, one word per row, so scrolling a plane vertically
+// is a memmove of each column and scrolling it horizontally shifts each row
+// pair of words by 4 bits, loops the compiler vectorizes. A hires sprite row
+// is rotated into place as one 128-bit value spread over the two words; each
+// plane selected by Fn01 takes the next block of sprite data.
+//
+// Only the reference interpreter runs these machines, so nothing here needs a
+// counterpart in the cached or JIT engines.
+
+#include <string.h>
+
+#include "chip8_impl.h"
+#include "opcodes_impl.h"
+
+// Large digits 0-F, 8x10 (SUPER-CHIP has 0-9; XO-CHIP adds A-F)
+const uint8_t c8_bigfont[C8_BIGFONT_SIZE] = {
+    0x3C, 0x7E, 0xE7, 0xC3, 0xC3, 0xC3, 0xC3, 0xE7, 0x7E, 0x3C, // 0
+    0x18, 0x38, 0x58, 0x18, 0x18, 0x18, 0x18, 0x18, 0x18, 0x3C, // 1
+    0x3E, 0x7F, 0xC3, 0x06, 0x0C, 0x18, 0x30, 0x60, 0xFF, 0xFF, // 2
+    0x3C, 0x7E, 0xC3, 0x03, 0x0E, 0x0E, 0x03, 0xC3, 0x7E, 0x3C, // 3
+    0x06, 0x0E, 0x1E, 0x36, 0x66, 0xC6, 0xFF, 0xFF, 0x06, 0x06, // 4
+    0xFF, 0xFF, 0xC0, 0xC0, 0xFC, 0xFE, 0x03, 0xC3, 0x7E, 0x3C, // 5
+    0x3E, 0x7C, 0xE0, 0xC0, 0xFC, 0xFE, 0xC3, 0xC3, 0x7E, 0x3C, // 6
+    0xFF, 0xFF, 0x03, 0x06, 0x0C, 0x18, 0x30, 0x60, 0x60, 0x60, // 7
+    0x3C, 0x7E, 0xC3, 0xC3, 0x7E, 0x7E, 0xC3, 0xC3, 0x7E, 0x3C, // 8
+    0x3C, 0x7E, 0xC3, 0xC3, 0x7F, 0x3F, 0x03, 0x03, 0x3E, 0x7C, // 9
+    0x7E, 0xFF, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF, 0xC3, 0xC3, 0xC3, // A
+    0xFC, 0xFC, 0xC3, 0xC3, 0xFC, 0xFC, 0xC3, 0xC3, 0xFC, 0xFC, // B
+    0x3C, 0xFF, 0xC3, 0xC0, 0xC0, 0xC0, 0xC0, 0xC3, 0xFF, 0x3C, // C
+    0xFC, 0xFE, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xFE, 0xFC, // D
+    0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, // E
+    0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC0, 0xC0, 0xC0, 0xC0  // F
+};
+
+uint32_t c8_fb_hash(const Chip8Impl* c8) {
+  uint32_t h = 0;
+  for (unsigned p = 0; p < C8_PLANES; ++p) {
+    for (unsigned w = 0; w < 2; ++w) {
+      for (unsigned y = 0; y < C8_HIRES_H; ++y) {
+        uint64_t v = c8->fb[p][w][y];
+        if (v) h ^= c8_row_hash(c8_fb_index(p, w, y), v);
+      }
+    }
+  }
+  return h;
+}
+
+static unsigned fb_height(const Chip8Impl* c8) { return c8->hires ? C8_HIRES_H : FB_HEIGHT; }
+
+// Dirty bits for a set of rows of the current resolution
+static uint32_t dirty_bits(const Chip8Impl* c8, uint64_t rows) {
+  if (!c8->hires) return (uint32_t)rows;
+  uint32_t out = 0;
+  for (unsigned y = 0; y < 32; ++y) out |= (uint32_t)((rows >> (2 * y) & 3) != 0) << y;
+  return out;
+}
+
+// Everything but the incremental draw path changes many words at once and
+// rehashes the whole display.
+static void display_rewritten(Chip8Impl* c8) {
+  c8->fb_hash = c8_fb_hash(c8);
+  c8_fb_changed(c8, 0xFFFFFFFFu);
+  c8->events |= C8_EVT_DISPLAY;
+}
+
+void c8_cls_ext(Chip8Impl* c8) {
+  for (unsigned p = 0; p < C8_PLANES; ++p) {
+    if (c8->planes >> p & 1) memset(c8->fb[p], 0, sizeof(c8->fb[p]));
+  }
+  display_rewritten(c8);
+}
+
+static void set_hires(Chip8Impl* c8, bool hires) {
+  c8->hires = hires;
+  memset(c8->fb, 0, sizeof(c8->fb));
+  display_rewritten(c8);
+}
+
+// 128-bit rotate right of hi:lo by s (0..127)
+static void rotr128(uint64_t* hi, uint64_t* lo, unsigned s) {
+  uint64_t h = *hi, l = *lo;
+  if (s & 64) { uint64_t t = h; h = l; l = t; }
+  s &= 63;
+  if (s) {
+    uint64_t nh = h >> s | l << (64 - s);
+    l = l >> s | h << (64 - s);
+    h = nh;
+  }
+  *hi = h;
+  *lo = l;
+}
+
+static uint64_t xor_word(Chip8Impl* c8, unsigned p, unsigned w, unsigned y, uint64_t bits) {
+  uint64_t old = c8->fb[p][w][y];
+  unsigned idx = c8_fb_index(p, w, y);
+  c8->fb[p][w][y] = old ^ bits;
+  c8->fb_hash ^= c8_row_hash(idx, old) ^ c8_row_hash(idx, old ^ bits);
+  return old & bits;
+}
+
+// Dxyn, and Dxy0 as a 16x16 sprite of two bytes per row. Wraps horizontally
+// (or clips, with C8_Q_CLIP) and clips at the bottom like the CHIP-8 Dxyn.
+void c8_draw_ext(Chip8Impl* c8, uint8_t x, uint8_t y, uint8_t n, unsigned q) {
+  unsigned width = c8->hires ? C8_HIRES_W : FB_WIDTH, height = fb_height(c8);
+  unsigned vx = c8->V[x] % width, vy = c8->V[y] % height;
+  unsigned bytes = n == 0 ? 2 : 1, rows = n == 0 ? 16 : n;
+  // Pixels a clipped sprite may touch: columns vx and right of it
+  uint64_t keep_hi = ~0ull, keep_lo = ~0ull;
+  if (q & C8_Q_CLIP) {
+    if (vx < 64) {
+      keep_hi = ~0ull >> vx;
+    } else {
+      keep_hi = 0;
+      keep_lo = ~0ull >> (vx - 64);
+    }
+  }
+  uint16_t addr = c8->I;
+  uint64_t hit = 0, changed = 0;
+  for (unsigned p = 0; p < C8_PLANES; ++p) {
+    if (!(c8->planes >> p & 1)) continue;
+    for (unsigned r = 0; r < rows && vy + r < height; ++r) {
+      uint16_t at = (uint16_t)(addr + r * bytes);
+      uint64_t hi = (uint64_t)c8->memory[at & c8->mem_mask] << 56, lo = 0;
+      if (bytes == 2) hi |= (uint64_t)c8->memory[(at + 1) & c8->mem_mask] << 48;
+      if (!hi) continue;
+      if (c8->hires) {
+        rotr128(&hi, &lo, vx);
+        hit |= xor_word(c8, p, 0, vy + r, hi & keep_hi) | xor_word(c8, p, 1, vy + r, lo & keep_lo);
+      } else {
+        hit |= xor_word(c8, p, 0, vy + r, c8_rotr64(hi, vx) & keep_hi);
+      }
+      changed |= 1ull << (vy + r);
+    }
+    addr = (uint16_t)(addr + rows * bytes);
+  }
+  c8->V[0xF] = hit != 0;
+  C8_STATS_ADD(c8, draws, 1);
+  C8_STATS_ADD(c8, collisions, hit != 0);
+  C8_STATS_ADD(c8, sprite_rows, rows < height - vy ? rows : height - vy);
+  c8_fb_changed(c8, dirty_bits(c8, changed));
+  c8->events |= C8_EVT_DISPLAY;
+}
+
+// 00Cn / 00Dn: move the selected planes down (or up) n rows
+static void scroll_vertical(Chip8Impl* c8, unsigned n, bool down) {
+  unsigned height = fb_height(c8), words = c8->hires ? 2 : 1;
+  if (n > height) n = height;
+  for (unsigned p = 0; p < C8_PLANES; ++p) {
+    if (!(c8->planes >> p & 1)) continue;
+    for (unsigned w = 0; w < words; ++w) {
+      uint64_t* col = c8->fb[p][w];
+      if (down) {
+        memmove(col + n, col, (height - n) * sizeof(uint64_t));
+        memset(col, 0, n * sizeof(uint64_t));
+      } else {
+        memmove(col, col + n, (height - n) * sizeof(uint64_t));
+        memset(col + height - n, 0, n * sizeof(uint64_t));
+      }
+    }
+  }
+  display_rewritten(c8);
+}
+
+// 00FB / 00FC: move the selected planes 4 pixels right (or left)
+static void scroll_horizontal(Chip8Impl* c8, bool right) {
+  unsigned height = fb_height(c8);
+  for (unsigned p = 0; p < C8_PLANES; ++p) {
+    if (!(c8->planes >> p & 1)) continue;
+    uint64_t* a = c8->fb[p][0];
+    uint64_t* b = c8->fb[p][1];
+    if (!c8->hires) {
+      for (unsigned y = 0; y < height; ++y) a[y] = right ? a[y] >> 4 : a[y] << 4;
+    } else if (right) {
+      for (unsigned y = 0; y < height; ++y) {
+        b[y] = b[y] >> 4 | a[y] << 60;
+        a[y] >>= 4;
+      }
+    } else {
+      for (unsigned y = 0; y < height; ++y) {
+        a[y] = a[y] << 4 | b[y] >> 60;
+        b[y] <<= 4;
+      }
+    }
+  }
+  display_rewritten(c8);
+}
+
+// 5xy2 / 5xy3: Vx..Vy to or from memory at I, in either direction; I unchanged
+static void range_copy(Chip8Impl* c8, uint8_t x, uint8_t y, bool store) {
+  unsigned count = (x <= y ? y - x : x - y) + 1u;
+  for (unsigned i = 0; i < count; ++i) {
+    uint8_t reg = (uint8_t)(x <= y ? x + i : x - i);
+    uint8_t* m = &c8->memory[(c8->I + i) & c8->mem_mask];
+    if (store) *m = c8->V[reg];
+    else c8->V[reg] = *m;
+  }
+  if (store) c8_mem_written(c8, c8->I, (uint16_t)count);
+}
+
+bool c8_execute_ext(Chip8Impl* c8, uint16_t opcode) {
+  bool xo = c8->machine == CHIP8_MACHINE_XOCHIP;
+  uint8_t x = (opcode >> 8) & 0xF;
+  uint8_t y = (opcode >> 4) & 0xF;
+  uint8_t n = opcode & 0xF;
+
+  switch (opcode >> 12) {
+    case 0x0:
+      if ((opcode & 0xFFF0) == 0x00C0) scroll_vertical(c8, n, true);
+      else if ((opcode & 0xFFF0) == 0x00D0 && xo) scroll_vertical(c8, n, false);
+      else if (opcode == 0x00FB) scroll_horizontal(c8, true);
+      else if (opcode == 0x00FC) scroll_horizontal(c8, false);
+      else if (opcode == 0x00FD) return false; // exit: stay here until reset
+      else if (opcode == 0x00FE) set_hires(c8, false);
+      else if (opcode == 0x00FF) set_hires(c8, true);
+      return true; // any other 0nnn is ignored, as on CHIP-8
+    case 0x5:
+      if (xo && (n == 2 || n == 3)) {
+        range_copy(c8, x, y, n == 2);
+        return true;
+      }
+      break;
+    case 0xF:
+      switch (opcode & 0xFF) {
+        case 0x00:
+          if (!xo || x != 0) break;
+          c8->I = c8_fetch(c8, (uint16_t)(c8->pc + 2)); // F000 nnnn
+          c8->pc = (uint16_t)(c8->pc + 2);
+          return true;
+        case 0x01:
+          if (!xo) break;
+          c8->planes = x & 3;
+          return true;
+        case 0x02:
+          if (!xo || x != 0) break;
+          for (unsigned i = 0; i < 16; ++i) c8->audio_pattern[i] = c8->memory[(c8->I + i) & c8->mem_mask];
+          return true;
+        case 0x30:
+          c8->I = (uint16_t)(C8_BIGFONT_ADDR + (c8->V[x] & 0xF) * 10);
+          return true;
+        case 0x3A:
+          if (!xo) break;
+          c8->pitch = c8->V[x];
+          return true;
+        case 0x75:
+          memcpy(c8->flags, c8->V, x + 1u);
+          return true;
+        case 0x85:
+          memcpy(c8->V, c8->flags, x + 1u);
+          return true;
+      }
+      break;
+  }
+  op_invalid(c8, opcode);
+  return true;
+}
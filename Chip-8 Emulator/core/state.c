@@ -0,0 +1,354 @@
+#include "chip8.h"
+
+#include <string.h>
+
+#include "chip8_impl.h"
+
+// Save-state format, all integers little-endian:
+//
+//   header   "C8ST"  u16 version  u16 flags  u32 payload size  u32 FNV-1a(payload)
+//   cpu      u16 pc, u16 I, V[16], u8 sp, u8 delay, u8 sound,
+//            u8 waiting (1: Fx0A, 2: display wait), u8 wait_key_reg,
+//            u16 keypad bits, u16 stack[16], u8 quirk bits (c8_quirks_serial())
+//   machine  u8 Chip8Machine, u8 hires, u8 plane mask, u8 flags[16],
+//            u8 audio pattern[16], u8 pitch (version 2 on)
+//   display  the words of fb in memory order: fb[0][0][0..31] on CHIP-8,
+//            all of fb[plane][word][row] on the extended machines
+//            raw: u64 per word
+//            compressed: bitmap of nonzero words, then u64 per nonzero word
+//   memory   raw: every addressable byte (4 KB, 64 KB on XO-CHIP)
+//            compressed: u16 span count, then spans of (u16 addr, u16 len, bytes);
+//            everything else is zero, plus the machine's standard fonts when
+//            STATE_FONT_IMPLIED is set
+//
+// Version 1 states have no machine section and load as CHIP-8.
+// Engine choice and per-engine caches are host state and are not saved.
+
+#define STATE_MAGIC "C8ST"
+#define STATE_VERSION 2
+#define STATE_MAX_WORDS (C8_PLANES * 2 * C8_HIRES_H)
+#define STATE_HEADER_SIZE 16
+
+#define STATE_FONT_IMPLIED (1u << 8) // internal flag, compressed only
+
+// Zero gaps shorter than a span header are cheaper to store inline
+#define STATE_MIN_GAP 5
+
+typedef struct Writer {
+  uint8_t* p; // NULL: only count
+  size_t n;
+} Writer;
+
+static void put8(Writer* w, uint8_t v) {
+  if (w->p) w->p[w->n] = v;
+  w->n++;
+}
+static void put16(Writer* w, uint16_t v) { put8(w, (uint8_t)v); put8(w, (uint8_t)(v >> 8)); }
+static void put32(Writer* w, uint32_t v) { put16(w, (uint16_t)v); put16(w, (uint16_t)(v >> 16)); }
+static void put64(Writer* w, uint64_t v) { put32(w, (uint32_t)v); put32(w, (uint32_t)(v >> 32)); }
+static void put_bytes(Writer* w, const uint8_t* src, size_t len) {
+  if (w->p) memcpy(w->p + w->n, src, len);
+  w->n += len;
+}
+
+typedef struct Reader {
+  const uint8_t* p;
+  size_t n, size;
+  bool ok;
+} Reader;
+
+static bool need(Reader* r, size_t len) {
+  if (!r->ok || r->size - r->n < len) r->ok = false;
+  return r->ok;
+}
+static uint8_t get8(Reader* r) { return need(r, 1) ? r->p[r->n++] : 0; }
+static uint16_t get16(Reader* r) { uint16_t lo = get8(r); return (uint16_t)(lo | get8(r) << 8); }
+static uint32_t get32(Reader* r) { uint32_t lo = get16(r); return lo | (uint32_t)get16(r) << 16; }
+static uint64_t get64(Reader* r) { uint64_t lo = get32(r); return lo | (uint64_t)get32(r) << 32; }
+
+static uint32_t fnv1a(const uint8_t* p, size_t len) {
+  uint32_t h = 2166136261u;
+  for (size_t i = 0; i < len; ++i) { h ^= p[i]; h *= 16777619u; }
+  return h;
+}
+
+// Words of fb a state holds for this machine
+static unsigned display_words(Chip8Machine machine) {
+  return machine == CHIP8_MACHINE_CHIP8 ? FB_HEIGHT : STATE_MAX_WORDS;
+}
+
+static bool font_is_standard(const Chip8Impl* c8) {
+  return memcmp(&c8->memory[C8_FONTSET_ADDR], c8_fontset, C8_FONTSET_SIZE) == 0 &&
+         (!c8->machine || memcmp(&c8->memory[C8_BIGFONT_ADDR], c8_bigfont, C8_BIGFONT_SIZE) == 0);
+}
+
+// Byte at `addr` as the compressed decoder would rebuild it without a span
+static uint8_t implied_byte(unsigned addr, bool font, Chip8Machine machine) {
+  if (font && addr >= C8_FONTSET_ADDR && addr < C8_FONTSET_ADDR + C8_FONTSET_SIZE) {
+    return c8_fontset[addr - C8_FONTSET_ADDR];
+  }
+  if (font && machine && addr >= C8_BIGFONT_ADDR && addr < C8_BIGFONT_ADDR + C8_BIGFONT_SIZE) {
+    return c8_bigfont[addr - C8_BIGFONT_ADDR];
+  }
+  return 0;
+}
+
+static void write_memory_spans(Writer* w, const Chip8Impl* c8, bool font) {
+  size_t count_at = w->n;
+  uint16_t count = 0;
+  put16(w, 0);
+  unsigned addr = 0, size = (unsigned)c8->mem_mask + 1;
+  while (addr < size) {
+    if (c8->memory[addr] == implied_byte(addr, font, c8->machine)) { ++addr; continue; }
+    // Extend the span until a gap of STATE_MIN_GAP implied bytes
+    unsigned end = addr + 1, gap = 0;
+    while (end + gap < size && gap < STATE_MIN_GAP) {
+      if (c8->memory[end + gap] == implied_byte(end + gap, font, c8->machine)) {
+        ++gap;
+      } else {
+        end += gap + 1;
+        gap = 0;
+      }
+    }
+    if (end - addr > UINT16_MAX) end = addr + UINT16_MAX;
+    put16(w, (uint16_t)addr);
+    put16(w, (uint16_t)(end - addr));
+    put_bytes(w, &c8->memory[addr], end - addr);
+    ++count;
+    addr = end;
+  }
+  if (w->p) {
+    Writer fix = { w->p, count_at };
+    put16(&fix, count);
+  }
+}
+
+// The cpu and machine sections
+static void write_cpu(Writer* w, const Chip8Impl* c8) {
+  put16(w, c8->pc);
+  put16(w, c8->I);
+  put_bytes(w, c8->V, 16);
+  put8(w, c8->sp);
+  put8(w, c8->delay_timer);
+  put8(w, c8->sound_timer);
+  put8(w, (uint8_t)(c8->waiting_for_key | c8->waiting_for_vblank << 1));
+  put8(w, c8->wait_key_reg);
+  uint16_t keys = 0;
+  for (int k = 0; k < 16; ++k) keys |= (uint16_t)((c8->keypad[k] != 0) << k);
+  put16(w, keys);
+  for (int i = 0; i < 16; ++i) put16(w, c8->stack[i]);
+  put8(w, c8_quirks_serial(c8->quirks));
+  put8(w, (uint8_t)c8->machine);
+  put8(w, c8->hires);
+  put8(w, c8->planes);
+  put_bytes(w, c8->flags, 16);
+  put_bytes(w, c8->audio_pattern, 16);
+  put8(w, c8->pitch);
+}
+
+static void write_state(Writer* w, const Chip8Impl* c8, unsigned flags) {
+  bool compressed = flags & CHIP8_STATE_COMPRESSED;
+  bool font = compressed && font_is_standard(c8);
+  uint16_t header_flags = (uint16_t)((compressed ? CHIP8_STATE_COMPRESSED : 0) | (font ? STATE_FONT_IMPLIED : 0));
+
+  put_bytes(w, (const uint8_t*)STATE_MAGIC, 4);
+  put16(w, STATE_VERSION);
+  put16(w, header_flags);
+  size_t size_at = w->n;
+  put32(w, 0);
+  put32(w, 0);
+  size_t payload = w->n;
+
+  write_cpu(w, c8);
+
+  // Word k of the display is fb[0][0][k] for k < words (word-major layout)
+  const uint64_t* fb = &c8->fb[0][0][0];
+  unsigned words = display_words(c8->machine);
+  if (compressed) {
+    for (unsigned k = 0; k < words; k += 8) {
+      uint8_t bits = 0;
+      for (unsigned i = 0; i < 8; ++i) bits |= (uint8_t)((fb[k + i] != 0) << i);
+      put8(w, bits);
+    }
+    for (unsigned k = 0; k < words; ++k) if (fb[k]) put64(w, fb[k]);
+    write_memory_spans(w, c8, font);
+  } else {
+    for (unsigned k = 0; k < words; ++k) put64(w, fb[k]);
+    put_bytes(w, c8->memory, (size_t)c8->mem_mask + 1);
+  }
+
+  if (w->p) {
+    Writer fix = { w->p, size_at };
+    put32(&fix, (uint32_t)(w->n - payload));
+    put32(&fix, fnv1a(w->p + payload, w->n - payload));
+  }
+}
+
+size_t chip8_state_size(const Chip8* c8p, unsigned flags) {
+  Writer w = { NULL, 0 };
+  write_state(&w, (const Chip8Impl*)c8p, flags);
+  return w.n;
+}
+
+size_t chip8_save_state(const Chip8* c8p, void* buf, size_t size, unsigned flags) {
+  if (!buf || size < chip8_state_size(c8p, flags)) return 0;
+  Writer w = { (uint8_t*)buf, 0 };
+  write_state(&w, (const Chip8Impl*)c8p, flags);
+  return w.n;
+}
+
+static uint64_t hash_mix(uint64_t h, uint64_t v) {
+  h = (h ^ v) * 0x9E3779B97F4A7C15ull;
+  return h ^ h >> 32;
+}
+
+uint64_t chip8_state_hash(const Chip8* c8p) {
+  const Chip8Impl* c8 = (const Chip8Impl*)c8p;
+  uint8_t cpu[128] = { 0 };
+  Writer w = { cpu, 0 };
+  write_cpu(&w, c8);
+  uint64_t h = 0;
+  for (size_t i = 0; i < w.n; i += 8) {
+    uint64_t v;
+    memcpy(&v, &cpu[i], 8);
+    h = hash_mix(h, v);
+  }
+
+  const uint64_t* fb = &c8->fb[0][0][0];
+  unsigned words = display_words(c8->machine);
+  for (unsigned k = 0; k < words; ++k) h = hash_mix(h, fb[k]);
+
+  // Pages outside mem_used are zero; so may be some inside, which are
+  // skipped too so that the hash depends on the contents alone
+  for (unsigned w64 = 0; w64 < C8_PAGE_WORDS; ++w64) {
+    for (uint64_t bits = c8->mem_used[w64]; bits; bits &= bits - 1) {
+      unsigned page = w64 * 64 + c8_ctz64(bits);
+      size_t at = (size_t)page << C8_PAGE_SHIFT;
+      if (at > c8->mem_mask) break;
+      uint64_t ph = 0, any = 0;
+      for (size_t i = 0; i < C8_PAGE_SIZE; i += 8) {
+        uint64_t v;
+        memcpy(&v, &c8->memory[at + i], 8);
+        ph = hash_mix(ph, v);
+        any |= v;
+      }
+      if (any) h = hash_mix(h, ph + page);
+    }
+  }
+  return h;
+}
+
+// Decode the payload into `c8`, or only validate it when c8 is NULL.
+static bool read_payload(Reader* r, Chip8Impl* c8, uint16_t version, uint16_t flags) {
+  uint16_t pc = get16(r), I = get16(r);
+  uint8_t V[16];
+  for (int i = 0; i < 16; ++i) V[i] = get8(r);
+  uint8_t sp = get8(r), dt = get8(r), st = get8(r);
+  uint8_t waiting = get8(r), wait_reg = get8(r);
+  uint16_t keys = get16(r);
+  uint16_t stack[16];
+  for (int i = 0; i < 16; ++i) stack[i] = get16(r);
+  uint8_t quirks = c8_quirks_serial(get8(r));
+  uint8_t machine = CHIP8_MACHINE_CHIP8, hires = 0, planes = 1, pitch = 64;
+  uint8_t flag_regs[16] = { 0 }, pattern[16] = { 0 };
+  if (version >= 2) {
+    machine = get8(r);
+    hires = get8(r);
+    planes = get8(r);
+    for (int i = 0; i < 16; ++i) flag_regs[i] = get8(r);
+    for (int i = 0; i < 16; ++i) pattern[i] = get8(r);
+    pitch = get8(r);
+  }
+  if (!r->ok || sp > 16 || waiting > 2 || wait_reg > 0xF || quirks > C8_Q_ALL) return false;
+  if ((quirks & C8_Q_MEM_INC_X && !(quirks & C8_Q_MEM_INC)) || (waiting == 2 && !(quirks & C8_Q_DISPLAY_WAIT))) {
+    return false;
+  }
+  if (machine > CHIP8_MACHINE_XOCHIP || hires > 1 || planes > 3 || (!machine && (hires || planes != 1))) return false;
+
+  if (c8) {
+    c8->pc = pc;
+    c8->I = I;
+    memcpy(c8->V, V, 16);
+    c8->sp = sp;
+    c8->delay_timer = dt;
+    c8->sound_timer = st;
+    c8_apply_quirks(c8, quirks);
+    c8->waiting_for_key = waiting == 1;
+    c8->waiting_for_vblank = waiting == 2;
+    c8->wait_key_reg = wait_reg;
+    for (int k = 0; k < 16; ++k) c8->keypad[k] = (uint8_t)(keys >> k & 1);
+    memcpy(c8->stack, stack, sizeof(stack));
+    c8->machine = (Chip8Machine)machine;
+    c8->mem_mask = machine == CHIP8_MACHINE_XOCHIP ? 0xFFFF : MEM_MASK;
+    c8->hires = hires;
+    c8->planes = planes;
+    if (version >= 2) memcpy(c8->flags, flag_regs, 16);
+    memcpy(c8->audio_pattern, pattern, 16);
+    c8->pitch = pitch;
+    memset(c8->fb, 0, sizeof(c8->fb));
+  }
+
+  uint64_t* fb = c8 ? &c8->fb[0][0][0] : NULL;
+  unsigned words = display_words((Chip8Machine)machine);
+  size_t mem_size = machine == CHIP8_MACHINE_XOCHIP ? C8_MEM_MAX : MEM_SIZE;
+  if (flags & CHIP8_STATE_COMPRESSED) {
+    uint8_t present[STATE_MAX_WORDS / 8];
+    for (unsigned i = 0; i < words / 8; ++i) present[i] = get8(r);
+    for (unsigned k = 0; k < words; ++k) {
+      uint64_t word = (present[k / 8] >> (k % 8) & 1) ? get64(r) : 0;
+      if (fb) fb[k] = word;
+    }
+    if (c8) {
+      memset(c8->memory, 0, mem_size);
+      if (flags & STATE_FONT_IMPLIED) {
+        memcpy(&c8->memory[C8_FONTSET_ADDR], c8_fontset, C8_FONTSET_SIZE);
+        if (machine) memcpy(&c8->memory[C8_BIGFONT_ADDR], c8_bigfont, C8_BIGFONT_SIZE);
+      }
+    }
+    uint16_t spans = get16(r);
+    for (uint16_t i = 0; i < spans && r->ok; ++i) {
+      uint16_t addr = get16(r), len = get16(r);
+      if (len == 0 || (size_t)addr + len > mem_size || !need(r, len)) return false;
+      if (c8) memcpy(&c8->memory[addr], r->p + r->n, len);
+      r->n += len;
+    }
+  } else {
+    for (unsigned k = 0; k < words; ++k) {
+      uint64_t word = get64(r);
+      if (fb) fb[k] = word;
+    }
+    if (!need(r, mem_size)) return false;
+    if (c8) memcpy(c8->memory, r->p + r->n, mem_size);
+    r->n += mem_size;
+  }
+  return r->ok && r->n == r->size;
+}
+
+bool chip8_load_state(Chip8* c8p, const void* buf, size_t size) {
+  Chip8Impl* c8 = (Chip8Impl*)c8p;
+  if (!buf || size < STATE_HEADER_SIZE) return false;
+  Reader r = { (const uint8_t*)buf, 0, size, true };
+  if (memcmp(r.p, STATE_MAGIC, 4) != 0) return false;
+  r.n = 4;
+  uint16_t version = get16(&r), flags = get16(&r);
+  uint32_t payload = get32(&r), sum = get32(&r);
+  if (version < 1 || version > STATE_VERSION || (flags & ~(CHIP8_STATE_COMPRESSED | STATE_FONT_IMPLIED))) return false;
+  if (payload != size - STATE_HEADER_SIZE || fnv1a(r.p + r.n, payload) != sum) return false;
+
+  // Validate everything before touching the machine so a bad buffer leaves it intact
+  Reader check = r;
+  if (!read_payload(&check, NULL, version, flags)) return false;
+  read_payload(&r, c8, version, flags);
+
+  c8_mem_touch_range(c8, 0, (uint32_t)c8->mem_mask + 1); // any page may have changed
+  c8->events = 0;
+  c8->invalid_opcode = 0;
+  c8->gfx_stale = true;
+  c8->fb_generation++;
+  c8->fb_dirty = 0xFFFFFFFFu;
+  c8->fb_hash = c8_fb_hash(c8);
+  chip8_decoded_flush(c8);
+  chip8_jit_flush(c8);
+  c8_sound_edge(c8);
+  return true;
+}
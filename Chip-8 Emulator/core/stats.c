@@ -0,0 +1,57 @@
+#include "chip8_stats.h"
+
+#include <string.h>
+
+#include "chip8_impl.h"
+#include "opcodes_impl.h"
+
+static const char* const class_names[CHIP8_OP_CLASS_COUNT] = {
+#define X(k) #k,
+  CHIP8_OP_CLASSES(X)
+#undef X
+};
+
+Chip8OpClass chip8_stats_classify(uint16_t opcode) { return c8_op_class(opcode); }
+
+const char* chip8_stats_class_name(Chip8OpClass cls) {
+  return (unsigned)cls < CHIP8_OP_CLASS_COUNT ? class_names[cls] : "?";
+}
+
+#ifdef CHIP8_ENABLE_STATS
+
+bool chip8_stats_available(void) { return true; }
+
+bool chip8_stats_get(const Chip8* c8p, Chip8Stats* out) {
+  *out = ((const Chip8Impl*)c8p)->stats;
+  return true;
+}
+
+void chip8_stats_reset(Chip8* c8p) {
+  Chip8Impl* c8 = (Chip8Impl*)c8p;
+  memset(&c8->stats, 0, sizeof(c8->stats));
+  c8->frame_start = 0;
+}
+
+void chip8_stats_frame(Chip8Impl* c8) {
+  Chip8Stats* s = &c8->stats;
+  uint64_t cycles = s->instructions - c8->frame_start;
+  c8->frame_start = s->instructions;
+  if (s->frames == 0 || cycles < s->frame_cycles_min) s->frame_cycles_min = cycles;
+  if (cycles > s->frame_cycles_max) s->frame_cycles_max = cycles;
+  s->frames++;
+  if (c8->waiting_for_key) s->key_wait_frames++;
+}
+
+#else
+
+bool chip8_stats_available(void) { return false; }
+
+bool chip8_stats_get(const Chip8* c8p, Chip8Stats* out) {
+  (void)c8p;
+  memset(out, 0, sizeof(*out));
+  return false;
+}
+
+void chip8_stats_reset(Chip8* c8p) { (void)c8p; }
+
+#endif
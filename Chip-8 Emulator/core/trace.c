@@ -0,0 +1,104 @@
+#include "chip8_trace.h"
+
+#include <string.h>
+
+#include "chip8_impl.h"
+#include "opcodes_impl.h"
+
+_Static_assert(sizeof(Chip8TraceRecord) == 16, "trace records are packed into 16 bytes");
+_Static_assert(sizeof(Chip8TraceHeader) == 64, "trace header is 64 bytes");
+
+static Chip8TraceRecord* records_of(Chip8TraceHeader* h) { return (Chip8TraceRecord*)(h + 1); }
+
+static Chip8TraceCheckpoint* checkpoints_of(Chip8TraceHeader* h) {
+  return (Chip8TraceCheckpoint*)(records_of(h) + h->record_capacity);
+}
+
+size_t chip8_trace_size(uint32_t records, uint32_t checkpoints) {
+  if (records == 0 || (records & (records - 1)) != 0) return 0;
+  return sizeof(Chip8TraceHeader) + (size_t)records * sizeof(Chip8TraceRecord) +
+         (size_t)checkpoints * sizeof(Chip8TraceCheckpoint);
+}
+
+bool chip8_trace_init(void* buf, size_t size, uint32_t records, uint32_t checkpoints, uint32_t checkpoint_interval) {
+  size_t need = chip8_trace_size(records, checkpoints);
+  if (!buf || need == 0 || size < need) return false;
+  Chip8TraceHeader* h = (Chip8TraceHeader*)buf;
+  memset(h, 0, sizeof(*h));
+  memcpy(h->magic, CHIP8_TRACE_MAGIC, sizeof(h->magic));
+  h->record_size = sizeof(Chip8TraceRecord);
+  h->record_capacity = records;
+  h->checkpoint_size = sizeof(Chip8TraceCheckpoint);
+  h->checkpoint_capacity = checkpoints;
+  h->checkpoint_interval = checkpoints ? checkpoint_interval : 0;
+  return true;
+}
+
+bool chip8_trace_valid(const void* buf, size_t size) {
+  const Chip8TraceHeader* h = (const Chip8TraceHeader*)buf;
+  if (!buf || size < sizeof(*h) || memcmp(h->magic, CHIP8_TRACE_MAGIC, sizeof(h->magic)) != 0) return false;
+  if (h->record_size != sizeof(Chip8TraceRecord) || h->checkpoint_size != sizeof(Chip8TraceCheckpoint)) return false;
+  if (h->checkpoint_interval && !h->checkpoint_capacity) return false; // as chip8_trace_init() leaves it
+  size_t need = chip8_trace_size(h->record_capacity, h->checkpoint_capacity);
+  return need != 0 && size >= need;
+}
+
+static void take_checkpoint(Chip8Impl* c8, Chip8TraceHeader* h) {
+  Chip8TraceCheckpoint* cp = &checkpoints_of(h)[h->checkpoints % h->checkpoint_capacity];
+  cp->cycle = h->cycle;
+  cp->size = (uint32_t)chip8_save_state((const Chip8*)c8, cp->state, sizeof(cp->state), CHIP8_STATE_RAW);
+  h->checkpoints++;
+  c8->trace_countdown = h->checkpoint_interval;
+}
+
+bool chip8_trace_attach(Chip8* c8p, void* buf, size_t size) {
+  Chip8Impl* c8 = (Chip8Impl*)c8p;
+  Chip8TraceHeader* h = (Chip8TraceHeader*)buf;
+  if (!chip8_trace_valid(buf, size)) return false;
+  c8->trace = h;
+  c8->trace_countdown = 0;
+  if (h->checkpoint_interval) take_checkpoint(c8, h);
+  return true;
+}
+
+void chip8_trace_detach(Chip8* c8p) { ((Chip8Impl*)c8p)->trace = NULL; }
+
+void chip8_trace_step(Chip8Impl* c8, uint16_t pc, uint16_t opcode) {
+  Chip8TraceHeader* h = c8->trace;
+  Chip8TraceRecord* r = &records_of(h)[h->cycle & (h->record_capacity - 1)];
+  uint8_t reg = CHIP8_TRACE_NO_REG;
+  switch (c8_op_class(opcode)) {
+    case CHIP8_OP_LD_B: case CHIP8_OP_ADD_B: case CHIP8_OP_LD_R: case CHIP8_OP_OR:
+    case CHIP8_OP_AND: case CHIP8_OP_XOR: case CHIP8_OP_ADD_R: case CHIP8_OP_SUB:
+    case CHIP8_OP_SHR: case CHIP8_OP_SUBN: case CHIP8_OP_SHL: case CHIP8_OP_RND:
+    case CHIP8_OP_LD_VDT: case CHIP8_OP_LOAD:
+      reg = (opcode >> 8) & 0xF;
+      break;
+    case CHIP8_OP_DRW: reg = 0xF; break;
+    default: break;
+  }
+  r->cycle = (uint32_t)h->cycle;
+  r->pc = pc;
+  r->opcode = opcode;
+  r->I = c8->I;
+  r->reg = reg;
+  r->value = reg == CHIP8_TRACE_NO_REG ? 0 : c8->V[reg];
+  r->vf = c8->V[0xF];
+  r->sp = c8->sp;
+  r->delay_timer = c8->delay_timer;
+  r->sound_timer = c8->sound_timer;
+  h->cycle++;
+  if (h->checkpoint_interval && --c8->trace_countdown == 0) take_checkpoint(c8, h);
+}
+
+const Chip8TraceRecord* chip8_trace_record(const void* buf, uint64_t cycle) {
+  Chip8TraceHeader* h = (Chip8TraceHeader*)buf;
+  if (cycle >= h->cycle || h->cycle - cycle > h->record_capacity) return NULL;
+  return &records_of(h)[cycle & (h->record_capacity - 1)];
+}
+
+const Chip8TraceCheckpoint* chip8_trace_checkpoint(const void* buf, uint64_t index) {
+  Chip8TraceHeader* h = (Chip8TraceHeader*)buf;
+  if (index >= h->checkpoints || h->checkpoints - index > h->checkpoint_capacity) return NULL;
+  return &checkpoints_of(h)[index % h->checkpoint_capacity];
+}
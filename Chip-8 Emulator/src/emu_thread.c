@@ -0,0 +1,323 @@
+#include "emu_thread.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include "../core/chip8_stats.h"
+
+#define EMU_RING_MASK (2 * EMU_RING_SIZE - 1)
+#define EMU_FRAME_FRESH 4
+#define NS_PER_S 1000000000ull
+// Longest host time one slice may make up for, e.g. after the process was
+// suspended; anything beyond is dropped instead of fast-forwarded
+#define EMU_MAX_CATCH_UP_NS (NS_PER_S / 10)
+// Longest sleep when only a command can change anything
+#define EMU_IDLE_WAIT_MS 100
+
+// Core calls, routed through the movie recorder when recording
+static void core_key(EmuThread* t, uint8_t key, bool down) {
+  Chip8Movie* rec = t->cfg.rec;
+  if (rec) { if (down) chip8_movie_key_down(rec, t->cfg.c8, key); else chip8_movie_key_up(rec, t->cfg.c8, key); }
+  else if (down) chip8_key_down(t->cfg.c8, key);
+  else chip8_key_up(t->cfg.c8, key);
+}
+
+static uint32_t core_run(EmuThread* t, uint32_t budget, Chip8RunResult* r) {
+  if (t->cfg.rec) return chip8_movie_run_cycles(t->cfg.rec, t->cfg.c8, budget, r);
+  return chip8_run_cycles(t->cfg.c8, budget, r);
+}
+
+static uint32_t core_run_for(EmuThread* t, uint64_t ns) {
+  if (t->cfg.rec) return chip8_movie_run_for(t->cfg.rec, t->cfg.c8, ns);
+  return chip8_run_for(t->cfg.c8, ns);
+}
+
+static void handle_command(EmuThread* t, EmuCommand cmd) {
+  Chip8* c8 = t->cfg.c8;
+  bool replay = t->cfg.replay != NULL;
+  switch ((EmuCommandType)cmd.type) {
+    case EMU_KEY_DOWN: if (!replay) core_key(t, cmd.arg, true); break;
+    case EMU_KEY_UP: if (!replay) core_key(t, cmd.arg, false); break;
+    case EMU_PAUSE: t->paused = !t->paused; break;
+    case EMU_STEP:
+      if (!t->paused || replay) break;
+      if (t->cfg.rec) core_run(t, 1, NULL);
+      else chip8_step(c8);
+      break;
+    case EMU_RESET:
+      if (replay) break;
+      if (t->cfg.rec) chip8_movie_reset(t->cfg.rec, c8);
+      else { chip8_reset(c8); chip8_load_rom(c8, t->cfg.rom, t->cfg.rom_size); }
+      if (t->cfg.rewind) chip8_rewind_clear(t->cfg.rewind);
+      break;
+    case EMU_REWIND: t->rewinding = cmd.arg && t->cfg.rewind; break;
+    case EMU_TURBO: t->turbo = cmd.arg != 0; break;
+    case EMU_DUMP_STATS: emu_dump_stats(c8); break;
+    case EMU_DUMP_SNAPSHOT: emu_dump_snapshot(c8); emu_print_rewind_stats(t); break;
+  }
+}
+
+static void drain_commands(EmuThread* t) {
+  int tail = SDL_AtomicGet(&t->ring_tail);
+  int head = SDL_AtomicGet(&t->ring_head);
+  while (tail != head) {
+    handle_command(t, t->ring[tail & (EMU_RING_SIZE - 1)]);
+    tail = (tail + 1) & EMU_RING_MASK;
+  }
+  SDL_AtomicSet(&t->ring_tail, tail);
+}
+
+// One rewind capture after any slice that ticked the timers
+static void capture(EmuThread* t) {
+  if (!t->cfg.rewind) return;
+  uint64_t t0 = SDL_GetPerformanceCounter();
+  chip8_rewind_capture(t->cfg.rewind, t->cfg.c8);
+  t->capture_ticks += SDL_GetPerformanceCounter() - t0;
+}
+
+// Wake the main thread out of SDL_WaitEventTimeout()
+static void wake_main(EmuThread* t) {
+  SDL_Event e;
+  SDL_zero(e);
+  e.type = t->frame_event;
+  SDL_PushEvent(&e);
+}
+
+// Core sound callback: forward the edge to the audio ring
+static void sound_edge(void* audio, uint64_t time_ns, bool on) {
+  platform_audio_edge((PlatformAudio*)audio, time_ns, on);
+}
+
+static void take_frame(EmuFrame* f, const Chip8* c8, uint32_t generation, uint32_t dirty_rows) {
+  unsigned width, height;
+  chip8_display_size(c8, &width, &height);
+  memcpy(f->planes, chip8_display_planes(c8), sizeof(f->planes));
+  f->width = (uint16_t)width;
+  f->height = (uint16_t)height;
+  f->generation = generation;
+  f->dirty_rows = dirty_rows;
+}
+
+// Hand the frame buffer to the main thread if it changed, and the emulated
+// time reached to the audio callback
+static void publish(EmuThread* t) {
+  Chip8* c8 = t->cfg.c8;
+  if (t->cfg.audio) platform_audio_clock(t->cfg.audio, chip8_emulated_ns(c8));
+  uint32_t generation = chip8_frame_generation(c8);
+  if (generation == t->published) return;
+  // The frame also carries the rows of frames the main thread skipped
+  uint32_t rows = chip8_consume_dirty_rows(c8);
+  take_frame(&t->frames[t->back], c8, generation, t->unseen_rows | rows);
+  int old = SDL_AtomicSet(&t->middle, t->back | EMU_FRAME_FRESH);
+  t->back = old & ~EMU_FRAME_FRESH;
+  // A slot coming back fresh was never taken, so the rows it carried are
+  // still unseen; otherwise the main thread took the previous frame
+  t->unseen_rows = old & EMU_FRAME_FRESH ? t->unseen_rows | rows : rows;
+  t->published = generation;
+  if (SDL_AtomicCAS(&t->frame_pending, 0, 1)) wake_main(t);
+}
+
+// How long the thread may sleep before it has work: until the next tick
+// when the machine idles, until a command when it is paused, else 1 ms
+static Uint32 idle_wait_ms(const EmuThread* t) {
+  const Chip8* c8 = t->cfg.c8;
+  if (t->rewinding) return 1;
+  if (t->paused) return EMU_IDLE_WAIT_MS;
+  Chip8Idle idle = chip8_idle_state(c8);
+  if (idle == CHIP8_IDLE_NONE) return 1;
+  // Halted or waiting for a key with both timers stopped: only a command
+  // matters. Delay spins and display waits end with a tick.
+  bool tick_ends_it = idle == CHIP8_IDLE_DELAY_SPIN || idle == CHIP8_IDLE_DISPLAY_WAIT;
+  if (!tick_ends_it && !chip8_delay_timer(c8) && !chip8_sound_timer(c8)) return EMU_IDLE_WAIT_MS;
+  uint64_t ns = chip8_ns_until_tick(c8);
+  if (t->turbo && t->cfg.turbo > 0) ns /= (uint64_t)t->cfg.turbo;
+  uint64_t ms = (ns + 999999) / 1000000;
+  return ms < 1 ? 1 : ms > EMU_IDLE_WAIT_MS ? EMU_IDLE_WAIT_MS : (Uint32)ms;
+}
+
+// Performance counter ticks to nanoseconds, exact for any counter frequency
+static uint64_t counter_ns(uint64_t count, uint64_t freq) {
+  return count / freq * NS_PER_S + count % freq * NS_PER_S / freq;
+}
+
+static int emu_main(void* user) {
+  EmuThread* t = (EmuThread*)user;
+  const uint64_t freq = SDL_GetPerformanceFrequency();
+  const uint64_t start = SDL_GetPerformanceCounter();
+  uint64_t last_ns = 0;
+  uint64_t rewind_phase = 0; // 60 * ns held in rewind since the last step back
+  t->replay_start = start;
+
+  while (SDL_AtomicGet(&t->running)) {
+    drain_commands(t);
+
+    uint64_t now_ns = counter_ns(SDL_GetPerformanceCounter() - start, freq);
+    uint64_t elapsed = now_ns - last_ns;
+    last_ns = now_ns;
+    if (elapsed > EMU_MAX_CATCH_UP_NS) elapsed = EMU_MAX_CATCH_UP_NS;
+    bool unthrottled = false;
+
+    if (t->cfg.replay && !t->paused) {
+      // Unthrottled: play frames for up to 10 ms, then publish the latest one
+      uint64_t t0 = SDL_GetPerformanceCounter(), slice = freq / 100;
+      bool more;
+      do more = chip8_movie_play(t->cfg.replay, t->cfg.c8, 1);
+      while (more && SDL_GetPerformanceCounter() - t0 < slice);
+      if (!more) {
+        t->replay_end = SDL_GetPerformanceCounter();
+        SDL_AtomicSet(&t->running, 0);
+      }
+    } else if (t->rewinding) {
+      // Step back one frame per 60Hz of host time
+      for (rewind_phase += 60 * elapsed; rewind_phase >= NS_PER_S; rewind_phase -= NS_PER_S) {
+        chip8_rewind_step_back(t->cfg.rewind, t->cfg.c8);
+      }
+    } else if (!t->paused && t->turbo && t->cfg.turbo == 0) {
+      // Unthrottled: whole frames of emulated time for up to 10 ms
+      unthrottled = true;
+      uint64_t t0 = SDL_GetPerformanceCounter(), slice = freq / 100;
+      do {
+        if (core_run_for(t, NS_PER_S / 60)) capture(t);
+      } while (SDL_GetPerformanceCounter() - t0 < slice);
+    } else if (!t->paused) {
+      uint64_t ns = t->turbo ? elapsed * (uint64_t)t->cfg.turbo : elapsed;
+      if (core_run_for(t, ns)) capture(t);
+    }
+    publish(t);
+
+    // Sleep until there is work; commands wake the thread early. The next
+    // slice runs for the time that really passed, so oversleeping does not
+    // slow the machine down
+    if ((!t->cfg.replay || t->paused) && !unthrottled) SDL_SemWaitTimeout(t->wake, idle_wait_ms(t));
+  }
+  if (t->cfg.replay && !t->replay_end) t->replay_end = SDL_GetPerformanceCounter();
+  wake_main(t); // a replay that ended must not wait for the main thread's timeout
+  return 0;
+}
+
+bool emu_start(EmuThread* t, const EmuConfig* cfg) {
+  memset(t, 0, sizeof(*t));
+  t->cfg = *cfg;
+  t->back = 0;
+  SDL_AtomicSet(&t->middle, 1);
+  t->front = 2;
+  // Frame 0 is what the machine shows now, so the first present has something
+  t->published = chip8_frame_generation(cfg->c8);
+  chip8_consume_dirty_rows(cfg->c8);
+  for (int i = 0; i < 3; ++i) take_frame(&t->frames[i], cfg->c8, t->published, UINT32_MAX);
+  t->frame_event = SDL_RegisterEvents(1);
+  t->wake = SDL_CreateSemaphore(0);
+  if (t->frame_event == (Uint32)-1 || !t->wake) {
+    SDL_DestroySemaphore(t->wake);
+    t->wake = NULL;
+    return false;
+  }
+  if (cfg->audio) chip8_set_sound_callback(cfg->c8, sound_edge, cfg->audio);
+  SDL_AtomicSet(&t->running, 1);
+  t->thread = SDL_CreateThread(emu_main, "chip8-emu", t);
+  if (!t->thread) {
+    chip8_set_sound_callback(cfg->c8, NULL, NULL);
+    SDL_DestroySemaphore(t->wake);
+    t->wake = NULL;
+    return false;
+  }
+  return true;
+}
+
+void emu_stop(EmuThread* t) {
+  SDL_AtomicSet(&t->running, 0);
+  if (t->thread) {
+    SDL_SemPost(t->wake);
+    SDL_WaitThread(t->thread, NULL);
+  }
+  t->thread = NULL;
+  chip8_set_sound_callback(t->cfg.c8, NULL, NULL);
+  SDL_DestroySemaphore(t->wake);
+  t->wake = NULL;
+}
+
+bool emu_running(EmuThread* t) { return SDL_AtomicGet(&t->running) != 0; }
+
+bool emu_send(EmuThread* t, EmuCommandType type, uint8_t arg) {
+  int head = SDL_AtomicGet(&t->ring_head);
+  int tail = SDL_AtomicGet(&t->ring_tail);
+  if (((head - tail) & EMU_RING_MASK) == EMU_RING_SIZE) return false; // full
+  t->ring[head & (EMU_RING_SIZE - 1)] = (EmuCommand){ (uint8_t)type, arg };
+  SDL_AtomicSet(&t->ring_head, (head + 1) & EMU_RING_MASK); // publishes the slot
+  SDL_SemPost(t->wake);
+  return true;
+}
+
+const EmuFrame* emu_frame(EmuThread* t) {
+  SDL_AtomicSet(&t->frame_pending, 0);
+  if (SDL_AtomicGet(&t->middle) & EMU_FRAME_FRESH) {
+    t->front = SDL_AtomicSet(&t->middle, t->front) & ~EMU_FRAME_FRESH;
+  }
+  return &t->frames[t->front];
+}
+
+void emu_dump_snapshot(const Chip8* c8) {
+  Chip8Snapshot s; chip8_get_snapshot(c8, &s);
+  printf("PC=%03X I=%03X DT=%u ST=%u SP=%u TOP=%03X HASH=%08X\n",
+         s.pc, s.I, s.delay_timer, s.sound_timer, s.sp, s.stack_top, s.display_hash);
+  printf("V:");
+  for (int i = 0; i < 16; ++i) printf(" %02X", s.V[i]);
+  printf("\n");
+}
+
+void emu_print_rewind_stats(const EmuThread* t) {
+  const Chip8Rewind* rw = t->cfg.rewind;
+  if (!rw) return;
+  Chip8RewindStats s; chip8_rewind_get_stats(rw, &s);
+  double us = s.captures ? (double)t->capture_ticks * 1e6 / (double)SDL_GetPerformanceFrequency() / (double)s.captures : 0.0;
+  printf("Rewind: %u frames (%.1f s), %u keyframes, %.2f of %.2f MB (%.2f MB total), %.0f B/frame, %.1f us/capture\n",
+         s.frames, s.frames / 60.0, s.keyframes, s.data_used / 1048576.0, s.data_capacity / 1048576.0,
+         s.total_bytes / 1048576.0, s.captures ? (double)s.encoded_bytes / (double)s.captures : 0.0, us);
+}
+
+// Execution statistics: opcode classes by count, hottest addresses, draws,
+// instructions per frame, key-wait stalls and idle-loop fast-forwards
+void emu_dump_stats(const Chip8* c8) {
+  static Chip8Stats s; // 33 KB, kept off the stack
+  if (!chip8_stats_get(c8, &s)) {
+    printf("Statistics not compiled in (configure with -DCHIP8_STATS=ON)\n");
+    return;
+  }
+  printf("Stats: %llu instructions, %llu frames, %.1f instr/frame (min %llu, max %llu)\n",
+         (unsigned long long)s.instructions, (unsigned long long)s.frames,
+         s.frames ? (double)s.instructions / (double)s.frames : 0.0,
+         (unsigned long long)s.frame_cycles_min, (unsigned long long)s.frame_cycles_max);
+  printf("  draws %llu (%llu collisions, %llu rows), key waits %llu (%llu frames, %llu stalled steps)\n",
+         (unsigned long long)s.draws, (unsigned long long)s.collisions, (unsigned long long)s.sprite_rows,
+         (unsigned long long)s.key_waits, (unsigned long long)s.key_wait_frames,
+         (unsigned long long)s.key_wait_steps);
+  printf("  idle loops: %llu instructions fast-forwarded (%.1f%%)\n", (unsigned long long)s.idle_cycles,
+         s.instructions ? 100.0 * (double)s.idle_cycles / (double)s.instructions : 0.0);
+
+  bool shown[CHIP8_OP_CLASS_COUNT] = { false };
+  printf("  classes:");
+  for (int n = 0; n < CHIP8_OP_CLASS_COUNT; ++n) {
+    int best = -1;
+    for (int c = 0; c < CHIP8_OP_CLASS_COUNT; ++c) {
+      if (!shown[c] && s.op_class[c] && (best < 0 || s.op_class[c] > s.op_class[best])) best = c;
+    }
+    if (best < 0) break;
+    shown[best] = true;
+    printf(" %s=%.1f%%", chip8_stats_class_name((Chip8OpClass)best),
+           100.0 * (double)s.op_class[best] / (double)s.instructions);
+  }
+  // Top 16 addresses by execution count, insertion-sorted
+  int hot[16], nhot = 0;
+  for (int pc = 0; pc < 4096; ++pc) {
+    if (!s.pc_heat[pc]) continue;
+    int i = nhot < 16 ? nhot++ : 16;
+    while (i > 0 && s.pc_heat[hot[i - 1]] < s.pc_heat[pc]) {
+      if (i < 16) hot[i] = hot[i - 1];
+      --i;
+    }
+    if (i < 16) hot[i] = pc;
+  }
+  printf("\n  hot PCs:");
+  for (int i = 0; i < nhot; ++i) printf(" %03X=%llu", hot[i], (unsigned long long)s.pc_heat[hot[i]]);
+  printf("\n");
+}
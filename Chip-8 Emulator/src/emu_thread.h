@@ -0,0 +1,117 @@
+#ifndef EMU_THREAD_H
+#define EMU_THREAD_H
+
+// Emulation thread for the SDL front-end. The core, its rewind history and
+// movie run on their own thread; the main thread polls events and renders.
+// The two share no locks, only:
+//   - an SPSC command ring, main -> emulation (keys, pause, reset, ...)
+//   - a triple buffer of frames, emulation -> main, always holding the latest
+//   - the audio ring (platform_sdl.h), fed with the core's sound edges and
+//     the emulated time reached
+//   - the running flag
+// Pacing uses the performance counter: each slice runs chip8_run_for() for
+// the host time that passed, which also derives the 60Hz ticks. While the
+// machine idles (chip8_idle_state()) the thread sleeps until the next tick,
+// and it pushes an SDL event per new frame, so the main thread can block in
+// SDL_WaitEventTimeout() instead of polling.
+// The Chip8 instance must not be touched from other threads between
+// emu_start() and emu_stop().
+
+#include <SDL.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "../core/chip8.h"
+#include "../core/chip8_movie.h"
+#include "../core/chip8_rewind.h"
+#include "platform_sdl.h"
+
+#define EMU_RING_SIZE 256 // commands; a power of two
+
+typedef enum EmuCommandType {
+  EMU_KEY_DOWN,      // arg: hex key
+  EMU_KEY_UP,        // arg: hex key
+  EMU_PAUSE,         // toggle
+  EMU_STEP,          // one instruction while paused
+  EMU_RESET,         // reset and reload the ROM
+  EMU_REWIND,        // arg: 1 while Backspace is held
+  EMU_TURBO,         // arg: 1 while Tab is held
+  EMU_DUMP_STATS,    // print execution statistics
+  EMU_DUMP_SNAPSHOT, // print registers and rewind usage
+} EmuCommandType;
+
+typedef struct EmuCommand {
+  uint8_t type; // EmuCommandType
+  uint8_t arg;
+} EmuCommand;
+
+typedef struct EmuFrame {
+  uint64_t planes[CHIP8_DISPLAY_PLANES][2][CHIP8_DISPLAY_MAX_HEIGHT]; // chip8_display_planes() copy
+  uint16_t width, height; // chip8_display_size()
+  uint32_t generation;    // chip8_frame_generation() it was taken at
+  uint32_t dirty_rows;    // chip8_consume_dirty_rows() bits changed since the last frame emu_frame() returned
+} EmuFrame;
+
+typedef struct EmuConfig {
+  Chip8* c8;
+  const uint8_t* rom; // for resets when not recording
+  size_t rom_size;
+  int turbo;          // speed multiplier while turbo is held, 0 = unthrottled
+  Chip8Movie* rec;    // record through this movie, or NULL
+  Chip8Movie* replay; // play this movie unthrottled instead of running, or NULL
+  Chip8Rewind* rewind;
+  PlatformAudio* audio; // receives sound edges and the emulated time, or NULL
+} EmuConfig;
+
+typedef struct EmuThread {
+  EmuConfig cfg;
+  SDL_Thread* thread;
+  SDL_atomic_t running;       // cleared by emu_stop(), or by the thread when a replay ends
+  SDL_sem* wake;              // posted with every command, so sleeps end early
+  Uint32 frame_event;         // SDL event type pushed when a new frame is published
+  SDL_atomic_t frame_pending; // set with that event, cleared by emu_frame()
+
+  // Command ring: head is written only by the main thread, tail only by the
+  // emulation thread. Both count modulo 2 * EMU_RING_SIZE.
+  EmuCommand ring[EMU_RING_SIZE];
+  SDL_atomic_t ring_head, ring_tail;
+
+  // Triple buffer: the emulation thread fills frames[back], then swaps it
+  // with the shared middle slot; the main thread swaps a fresh middle slot
+  // into frames[front]. middle holds a slot index, plus EMU_FRAME_FRESH when
+  // it has not been taken yet.
+  EmuFrame frames[3];
+  SDL_atomic_t middle;
+  int back, front;
+
+  // Owned by the emulation thread until emu_stop()
+  bool paused, rewinding, turbo;
+  uint32_t published; // generation of the latest published frame
+  uint32_t unseen_rows; // dirty rows of published frames emu_frame() has not returned yet
+  uint64_t capture_ticks; // performance counter ticks spent in rewind captures
+  uint64_t replay_start, replay_end;
+} EmuThread;
+
+// Start running cfg->c8 on a new thread; false if the thread cannot be created.
+bool emu_start(EmuThread*, const EmuConfig* cfg);
+
+// Stop and join the thread. The machine, movie and rewind history are then
+// safe to use from the calling thread again.
+void emu_stop(EmuThread*);
+
+// False once emu_stop() was called or a replay has ended.
+bool emu_running(EmuThread*);
+
+// Queue a command; false (command dropped) when the ring is full.
+bool emu_send(EmuThread*, EmuCommandType type, uint8_t arg);
+
+// Latest published frame (main thread only). Stays valid until the next call.
+const EmuFrame* emu_frame(EmuThread*);
+
+// Diagnostics printed by the emulation thread, and by the front-end at exit
+void emu_dump_snapshot(const Chip8* c8);
+void emu_dump_stats(const Chip8* c8);
+void emu_print_rewind_stats(const EmuThread*);
+
+#endif // EMU_THREAD_H
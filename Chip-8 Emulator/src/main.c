@@ -1,21 +1,38 @@
 #include <SDL.h>
+#include <ctype.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
 
+#include "catalog.h"
+#include "emu_thread.h"
 #include "platform_sdl.h"
 #include "../core/chip8.h"
-#include "../core/chip8_state.h"
+#include "../core/chip8_movie.h"
+#include "../core/chip8_rewind.h"
 
 typedef struct Args {
   const char* rom_path;
   int scale;
-  int hz;
-  bool log;
+  int hz;           // 0 = the catalog's or the core's default
+  bool log;         // dump execution statistics on exit (CHIP8_STATS builds)
   bool vsync;
-  bool delay_quirk; // accepted but not used currently
-  bool mem_quirk;   // controls Fx55/Fx65 increment I
+  RenderFilter filter;
+  uint32_t palette[4]; // RGBA8888: off, plane 0, plane 1, both
+  int quirks;       // Chip8QuirkProfile, -1 = the machine's own
+  int delay_quirk;  // display wait override: 1 on, 0 off, -1 = profile's
+  int mem_quirk;    // Fx55/Fx65 increment I override: 1 on, 0 off, -1 = profile's
+  Chip8Engine engine;
+  Chip8Machine machine;
+  bool machine_set; // --machine given; otherwise the catalog's
+  char keymap[16];  // host key for CHIP-8 keys 0-F
+  const char* catalog_path; // ROM catalog for per-ROM settings (chip8_roms)
+  int turbo;        // speed multiplier while Tab is held, 0 = unthrottled
+  int rewind_mb;    // rewind history budget, 0 disables
+  uint32_t seed;    // RNG seed for recorded movies
+  const char* record_path; // record an input movie to this file
+  const char* replay_path; // play this movie back unthrottled and verify it
 } Args;
 
 static uint8_t default_rng(void* user) {
@@ -28,16 +45,37 @@ static uint8_t default_rng(void* user) {
 }
 
 static void print_usage(const char* prog) {
-  printf("Usage: %s rom.ch8 [--scale N] [--hz N] [--log] [--vsync] [--delay-quirk on|off] [--mem-quirk on|off]\n", prog);
+  printf("Usage: %s rom.ch8 [--scale N] [--filter none|scale2x|scale3x|scanlines] [--palette RRGGBB,...] [--hz N] [--log] [--vsync] [--quirks default|vip|chip48|schip|xochip] [--delay-quirk on|off] [--mem-quirk on|off] [--engine switch|cached|jit] [--machine chip8|schip|xochip] [--turbo N] [--rewind-mb N] [--record FILE | --replay FILE] [--seed N] [--catalog FILE]\n", prog);
+}
+
+// Up to four comma-separated RRGGBB colours, replacing palette entries in order
+static bool parse_palette(const char* s, uint32_t palette[4]) {
+  for (int i = 0; i < 4; ++i) {
+    char* end;
+    unsigned long rgb = strtoul(s, &end, 16);
+    if (end - s != 6) return false;
+    palette[i] = (uint32_t)rgb << 8 | 0xFFu;
+    if (*end == '\0') return true;
+    if (*end != ',') return false;
+    s = end + 1;
+  }
+  return false;
 }
 
 static bool parse_args(int argc, char** argv, Args* out) {
   memset(out, 0, sizeof(*out));
   out->scale = 10;
-  out->hz = 700;
   out->vsync = false;
-  out->delay_quirk = false;
-  out->mem_quirk = true; // original increments I
+  out->filter = RENDER_FILTER_NONE;
+  memcpy(out->palette, render_default_palette, sizeof(out->palette));
+  out->quirks = -1;
+  out->delay_quirk = -1;
+  out->mem_quirk = -1;
+  out->turbo = 0;
+  out->rewind_mb = 4;
+  out->seed = 0x12345678u; // same sequence as default_rng
+  memcpy(out->keymap, CATALOG_KEYMAP_DEFAULT, sizeof(out->keymap));
+  out->catalog_path = getenv("CHIP8_CATALOG");
 
   if (argc < 2) return false;
   out->rom_path = argv[1];
@@ -46,15 +84,60 @@ static bool parse_args(int argc, char** argv, Args* out) {
     else if (strcmp(argv[i], "--hz") == 0 && i + 1 < argc) { out->hz = atoi(argv[++i]); }
     else if (strcmp(argv[i], "--log") == 0) { out->log = true; }
     else if (strcmp(argv[i], "--vsync") == 0) { out->vsync = true; }
+    else if (strcmp(argv[i], "--filter") == 0 && i + 1 < argc) {
+      const char* v = argv[++i];
+      if (strcmp(v, "none") == 0) out->filter = RENDER_FILTER_NONE;
+      else if (strcmp(v, "scale2x") == 0) out->filter = RENDER_FILTER_SCALE2X;
+      else if (strcmp(v, "scale3x") == 0) out->filter = RENDER_FILTER_SCALE3X;
+      else if (strcmp(v, "scanlines") == 0) out->filter = RENDER_FILTER_SCANLINES;
+      else { printf("Unknown filter: %s\n", v); return false; }
+    } else if (strcmp(argv[i], "--palette") == 0 && i + 1 < argc) {
+      const char* v = argv[++i];
+      if (!parse_palette(v, out->palette)) { printf("Bad palette: %s\n", v); return false; }
+    }
     else if (strcmp(argv[i], "--delay-quirk") == 0 && i + 1 < argc) {
       const char* v = argv[++i]; out->delay_quirk = (strcmp(v, "on") == 0);
     } else if (strcmp(argv[i], "--mem-quirk") == 0 && i + 1 < argc) {
       const char* v = argv[++i]; out->mem_quirk = (strcmp(v, "on") == 0);
+    } else if (strcmp(argv[i], "--quirks") == 0 && i + 1 < argc) {
+      const char* v = argv[++i];
+      if (strcmp(v, "default") == 0) out->quirks = CHIP8_QUIRKS_DEFAULT;
+      else if (strcmp(v, "vip") == 0) out->quirks = CHIP8_QUIRKS_VIP;
+      else if (strcmp(v, "chip48") == 0) out->quirks = CHIP8_QUIRKS_CHIP48;
+      else if (strcmp(v, "schip") == 0) out->quirks = CHIP8_QUIRKS_SCHIP;
+      else if (strcmp(v, "xochip") == 0) out->quirks = CHIP8_QUIRKS_XOCHIP;
+      else { printf("Unknown quirk profile: %s\n", v); return false; }
+    } else if (strcmp(argv[i], "--turbo") == 0 && i + 1 < argc) {
+      out->turbo = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "--rewind-mb") == 0 && i + 1 < argc) {
+      out->rewind_mb = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "--record") == 0 && i + 1 < argc) {
+      out->record_path = argv[++i];
+    } else if (strcmp(argv[i], "--replay") == 0 && i + 1 < argc) {
+      out->replay_path = argv[++i];
+    } else if (strcmp(argv[i], "--catalog") == 0 && i + 1 < argc) {
+      out->catalog_path = argv[++i];
+    } else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+      out->seed = (uint32_t)strtoul(argv[++i], NULL, 0);
+    } else if (strcmp(argv[i], "--engine") == 0 && i + 1 < argc) {
+      const char* v = argv[++i];
+      if (strcmp(v, "switch") == 0) out->engine = CHIP8_ENGINE_SWITCH;
+      else if (strcmp(v, "cached") == 0) out->engine = CHIP8_ENGINE_CACHED;
+      else if (strcmp(v, "jit") == 0) out->engine = CHIP8_ENGINE_JIT;
+      else { printf("Unknown engine: %s\n", v); return false; }
+    } else if (strcmp(argv[i], "--machine") == 0 && i + 1 < argc) {
+      const char* v = argv[++i];
+      if (strcmp(v, "chip8") == 0) out->machine = CHIP8_MACHINE_CHIP8;
+      else if (strcmp(v, "schip") == 0) out->machine = CHIP8_MACHINE_SCHIP;
+      else if (strcmp(v, "xochip") == 0) out->machine = CHIP8_MACHINE_XOCHIP;
+      else { printf("Unknown machine: %s\n", v); return false; }
+      out->machine_set = true;
     } else {
       printf("Unknown option: %s\n", argv[i]);
       return false;
     }
   }
+  if (out->record_path && out->replay_path) { printf("--record and --replay are exclusive\n"); return false; }
   return true;
 }
 
@@ -73,106 +156,228 @@ static bool load_file(const char* path, uint8_t** data_out, size_t* size_out) {
   *data_out = buf; *size_out = (size_t)sz; return true;
 }
 
-static void dump_snapshot(struct Chip8* c8) {
-  Chip8Snapshot s; chip8_get_snapshot(c8, &s);
-  printf("PC=%03X I=%03X DT=%u ST=%u SP=%u TOP=%03X HASH=%08X\n",
-         s.pc, s.I, s.delay_timer, s.sound_timer, s.sp, s.stack_top, s.display_hash);
-  printf("V:");
-  for (int i = 0; i < 16; ++i) printf(" %02X", s.V[i]);
-  printf("\n");
+static bool save_file(const char* path, const void* data, size_t size) {
+  FILE* f = fopen(path, "wb");
+  if (!f) return false;
+  bool ok = fwrite(data, 1, size, f) == size;
+  return fclose(f) == 0 && ok;
+}
+
+// Rewind history: one capture per 60Hz tick, keyframe every second
+#define REWIND_BYTES_PER_FRAME 64 // index sized for this average capture size
+
+static Chip8Rewind* create_rewind(int mb) {
+  if (mb <= 0) return NULL;
+  size_t bytes = (size_t)mb << 20;
+  return chip8_rewind_create(bytes, (uint32_t)(bytes / REWIND_BYTES_PER_FRAME), 60);
+}
+
+// The --quirks profile, or the machine's own, with the single-quirk overrides
+static void apply_quirks(Chip8* c8, const Args* args) {
+  Chip8QuirkProfile profile = args->machine == CHIP8_MACHINE_SCHIP    ? CHIP8_QUIRKS_SCHIP
+                              : args->machine == CHIP8_MACHINE_XOCHIP ? CHIP8_QUIRKS_XOCHIP
+                                                                      : CHIP8_QUIRKS_DEFAULT;
+  if (args->quirks >= 0) profile = (Chip8QuirkProfile)args->quirks;
+  Chip8Quirks q;
+  chip8_quirk_profile(profile, &q);
+  if (args->delay_quirk >= 0) q.display_wait = args->delay_quirk;
+  if (args->mem_quirk >= 0) q.mem_ops_increment_i = args->mem_quirk;
+  chip8_set_quirks(c8, &q);
+}
+
+// Input movies: while recording, everything that feeds the core goes through
+// the recorder; a replay drives the core from the movie alone.
+static Chip8Movie* open_movie(const Args* args) {
+  if (args->record_path) return chip8_movie_create(args->seed);
+  if (!args->replay_path) return NULL;
+  uint8_t* data = NULL; size_t size = 0;
+  Chip8Movie* m = NULL;
+  if (load_file(args->replay_path, &data, &size)) m = chip8_movie_load(data, size);
+  free(data);
+  if (!m) printf("Not a movie file: %s\n", args->replay_path);
+  return m;
+}
+
+static bool save_movie(const Chip8Movie* m, const char* path) {
+  size_t size = chip8_movie_size(m);
+  uint8_t* buf = (uint8_t*)malloc(size);
+  bool ok = buf && chip8_movie_save(m, buf, size) && save_file(path, buf, size);
+  free(buf);
+  Chip8MovieStatus st; chip8_movie_get_status(m, &st);
+  if (ok) printf("Recorded %s: %llu frames, %zu bytes\n", path, (unsigned long long)st.frames, size);
+  else printf("Failed to write movie: %s\n", path);
+  return ok;
+}
+
+// Prints the verdict; false if any frame differed or playback stalled
+static bool report_replay(const Chip8Movie* m, const char* path, double seconds) {
+  Chip8MovieStatus st; chip8_movie_get_status(m, &st);
+  printf("Replayed %s: %llu/%llu frames, %llu instructions in %.2f s: ", path, (unsigned long long)st.frames,
+         (unsigned long long)st.total_frames, (unsigned long long)st.instructions, seconds);
+  if (st.stalled) printf("STALLED in Fx0A\n");
+  else if (st.mismatches) printf("MISMATCH at frame %llu (expected %08X, got %08X), %llu frames differ\n",
+                                 (unsigned long long)st.first_mismatch, st.expected_hash, st.actual_hash,
+                                 (unsigned long long)st.mismatches);
+  else if (!st.done) printf("stopped early\n");
+  else printf("OK\n");
+  return !st.stalled && !st.mismatches;
+}
+
+// Audio pipeline health: underruns and late edges mean emulation fell behind the device
+static void print_audio_stats(PlatformSDL* plat) {
+  AudioStats a;
+  if (!platform_sdl_audio_stats(plat, &a) || !a.callbacks) return;
+  printf("Audio: %llu buffers, %llu underruns, %llu stalls, %llu resyncs, %llu late / %llu dropped edges, "
+         "latency %.1f ms avg %.1f ms max\n",
+         (unsigned long long)a.callbacks, (unsigned long long)a.underruns, (unsigned long long)a.stalls,
+         (unsigned long long)a.resyncs, (unsigned long long)a.late_edges, (unsigned long long)a.dropped_edges,
+         a.latency_ms_avg, a.latency_ms_max);
 }
 
-static void set_mem_quirk(struct Chip8* c8, bool on) {
-  // Not exposed; rely on default true for original behavior. No-op here.
-  (void)c8; (void)on;
+static void print_render_stats(const PlatformSDL* plat) {
+  RenderStats r;
+  platform_sdl_render_stats(plat, &r);
+  if (!r.frames) return;
+  printf("Render: %llu frames, %llu rows converted, update %.1f us avg %.1f us max\n",
+         (unsigned long long)r.frames, (unsigned long long)r.rows, r.update_us_avg, r.update_us_max);
 }
 
-static int key_to_hex(SDL_Keycode key) {
-  switch (key) {
-    case SDLK_1: return 0x1; case SDLK_2: return 0x2; case SDLK_3: return 0x3; case SDLK_4: return 0xC;
-    case SDLK_q: return 0x4; case SDLK_w: return 0x5; case SDLK_e: return 0x6; case SDLK_r: return 0xD;
-    case SDLK_a: return 0x7; case SDLK_s: return 0x8; case SDLK_d: return 0x9; case SDLK_f: return 0xE;
-    case SDLK_z: return 0xA; case SDLK_x: return 0x0; case SDLK_c: return 0xB; case SDLK_v: return 0xF;
-    default: return -1;
+// Printable keys have their ASCII code as SDL_Keycode
+static int key_to_hex(const char keymap[16], SDL_Keycode key) {
+  for (int i = 0; i < 16; ++i) {
+    if (key == (SDL_Keycode)(unsigned char)keymap[i]) return i;
   }
+  return -1;
+}
+
+// Settings the catalog has for this ROM, where the command line left them open
+static void apply_catalog(Args* args, const uint8_t* rom, size_t rom_size) {
+  if (!args->catalog_path) return;
+  Catalog* cat = catalog_open(args->catalog_path);
+  if (!cat) { printf("Not a catalog index: %s\n", args->catalog_path); return; }
+  CatalogEntry e;
+  if (catalog_find(cat, catalog_hash(rom, rom_size), &e)) {
+    if (!args->machine_set) args->machine = (Chip8Machine)e.machine;
+    if (args->quirks < 0 && e.quirks) args->quirks = e.quirks - 1;
+    if (args->hz <= 0) args->hz = (int)e.hz;
+    // A key the front-end also handles would do both; keep the default map
+    char clash = catalog_keymap_clash(e.keymap);
+    if (clash) {
+      printf("Catalog keymap ignored: key '%c' is a control key\n", isprint((unsigned char)clash) ? clash : '?');
+    } else if (e.keymap[0]) {
+      for (int i = 0; i < 16; ++i) args->keymap[i] = (char)tolower((unsigned char)e.keymap[i]);
+    }
+    printf("Catalog: %s, %s quirks, %u Hz\n", catalog_machine_name(e.machine), catalog_quirks_name(e.quirks),
+           args->hz > 0 ? (unsigned)args->hz : CHIP8_DEFAULT_CPU_HZ);
+  }
+  catalog_close(cat);
 }
 
 int main(int argc, char** argv) {
   Args args;
   if (!parse_args(argc, argv, &args)) { print_usage(argv[0]); return 1; }
 
-  uint8_t* rom_data = NULL; size_t rom_size = 0;
-  if (!load_file(args.rom_path, &rom_data, &rom_size)) {
+  CatalogMap rom;
+  if (!catalog_map_file(args.rom_path, &rom)) {
     printf("Failed to read ROM: %s\n", args.rom_path);
     return 1;
   }
+  const uint8_t* rom_data = rom.data; size_t rom_size = rom.size;
+  apply_catalog(&args, rom_data, rom_size);
 
-  Chip8* c8 = chip8_create(default_rng, NULL);
-  if (!c8) { free(rom_data); return 1; }
-  if (!chip8_load_rom(c8, rom_data, rom_size)) { printf("ROM too large\n"); free(rom_data); chip8_destroy(c8); return 1; }
-  set_mem_quirk(c8, args.mem_quirk);
+  Chip8Movie* movie = open_movie(&args);
+  if ((args.record_path || args.replay_path) && !movie) { catalog_unmap(&rom); return 1; }
+  Chip8Movie* rec = args.record_path ? movie : NULL;
+  Chip8Movie* replay = args.replay_path ? movie : NULL;
 
-  PlatformSDL plat;
-  if (!platform_sdl_init(&plat, "chip8-c", args.scale, args.vsync, c8)) {
+  Chip8* c8 = movie ? chip8_create(chip8_movie_rng, movie) : chip8_create(default_rng, NULL);
+  if (!c8) { chip8_movie_destroy(movie); catalog_unmap(&rom); return 1; }
+  chip8_set_machine(c8, args.machine);
+  if (!chip8_load_rom(c8, rom_data, rom_size)) { printf("ROM too large\n"); chip8_movie_destroy(movie); catalog_unmap(&rom); chip8_destroy(c8); return 1; }
+  apply_quirks(c8, &args);
+  if (args.hz > 0) chip8_set_cpu_hz(c8, (uint32_t)args.hz);
+  if (!chip8_set_engine(c8, args.engine)) printf("Engine unavailable, using switch interpreter\n");
+  if (rec) chip8_movie_record_begin(rec, c8, rom_data, rom_size);
+  if (replay && !chip8_movie_play_begin(replay, c8, rom_data, rom_size)) {
+    printf("%s was recorded with a different ROM\n", args.replay_path);
+    chip8_movie_destroy(movie); catalog_unmap(&rom); chip8_destroy(c8);
+    return 1;
+  }
+
+  static PlatformSDL plat; // audio ring and wavetable, kept off the stack
+  if (!platform_sdl_init(&plat, "chip8-c", args.scale, args.vsync, args.palette, args.filter)) {
     printf("SDL init failed\n");
-    free(rom_data);
+    chip8_movie_destroy(movie);
+    catalog_unmap(&rom);
     chip8_destroy(c8);
     return 1;
   }
-  SDL_TimerID t60 = platform_sdl_add_60hz_timer(c8);
 
-  bool running = true;
-  bool paused = false;
-  uint32_t last = SDL_GetTicks();
-  double cycles_accum = 0.0;
-  const double cycles_per_ms = (double)args.hz / 1000.0;
+  // Stepping back would desynchronize a movie from its events. Replays run
+  // unthrottled, far ahead of any audio clock, so they stay silent.
+  EmuConfig cfg = { c8, rom_data, rom_size, args.turbo > 0 ? args.turbo : 0, rec, replay,
+                    movie ? NULL : create_rewind(args.rewind_mb),
+                    plat.audio_device && !replay ? &plat.audio : NULL };
+  static EmuThread emu; // command ring and frames, kept off the stack
+  if (!emu_start(&emu, &cfg)) {
+    printf("Cannot start the emulation thread: %s\n", SDL_GetError());
+    platform_sdl_shutdown(&plat);
+    chip8_rewind_destroy(cfg.rewind);
+    chip8_movie_destroy(movie);
+    catalog_unmap(&rom);
+    chip8_destroy(c8);
+    return 1;
+  }
 
-  while (running) {
-    // Events
+  // This thread only handles events and presents; the core runs in emu_thread.c
+  while (emu_running(&emu)) {
+    // Block until input or a new frame; the timeout only bounds how late a
+    // stop is noticed
     SDL_Event e;
-    while (SDL_PollEvent(&e)) {
-      if (e.type == SDL_QUIT) { running = false; }
-      else if (e.type == SDL_KEYDOWN) {
-        if (e.key.keysym.sym == SDLK_ESCAPE) running = false;
-        else if (e.key.keysym.sym == SDLK_p) paused = !paused;
-        else if (e.key.keysym.sym == SDLK_n && paused) chip8_step(c8);
-        else if (e.key.keysym.sym == SDLK_F1) { chip8_reset(c8); chip8_load_rom(c8, rom_data, rom_size); }
-        else if (e.key.keysym.sym == SDLK_F5) { chip8_reset(c8); chip8_load_rom(c8, rom_data, rom_size); }
-        else if (e.key.keysym.sym == SDLK_F12) { dump_snapshot(c8); }
-        int hx = key_to_hex(e.key.keysym.sym);
-        if (hx >= 0) chip8_key_down(c8, (uint8_t)hx);
+    bool have = SDL_WaitEventTimeout(&e, 100) != 0;
+    for (; have; have = SDL_PollEvent(&e) != 0) {
+      if (e.type == SDL_QUIT) { emu_stop(&emu); }
+      else if (e.type == SDL_WINDOWEVENT) { platform_sdl_invalidate(&plat); }
+      else if (e.type == SDL_KEYDOWN && !e.key.repeat) {
+        // Auto-repeat would press CHIP-8 keys again and land in movies
+        SDL_Keycode k = e.key.keysym.sym;
+        if (k == SDLK_ESCAPE) emu_stop(&emu);
+        else if (k == SDLK_p) emu_send(&emu, EMU_PAUSE, 0);
+        else if (k == SDLK_n) emu_send(&emu, EMU_STEP, 0);
+        else if (k == SDLK_BACKSPACE) emu_send(&emu, EMU_REWIND, 1);
+        else if (k == SDLK_TAB) emu_send(&emu, EMU_TURBO, 1);
+        else if (k == SDLK_F1 || k == SDLK_F5) emu_send(&emu, EMU_RESET, 0);
+        else if (k == SDLK_F11) emu_send(&emu, EMU_DUMP_STATS, 0);
+        else if (k == SDLK_F12) emu_send(&emu, EMU_DUMP_SNAPSHOT, 0);
+        int hx = key_to_hex(args.keymap, k);
+        if (hx >= 0) emu_send(&emu, EMU_KEY_DOWN, (uint8_t)hx);
       } else if (e.type == SDL_KEYUP) {
-        int hx = key_to_hex(e.key.keysym.sym);
-        if (hx >= 0) chip8_key_up(c8, (uint8_t)hx);
-      } else if (e.type == SDL_USEREVENT && e.user.code == 1) {
-        chip8_tick_60hz((Chip8*)e.user.data1);
-      }
-    }
-
-    uint32_t now = SDL_GetTicks();
-    uint32_t elapsed_ms = now - last;
-    last = now;
-    cycles_accum += elapsed_ms * cycles_per_ms;
-
-    if (!paused) {
-      int steps = (int)cycles_accum;
-      if (steps > 0) {
-        for (int i = 0; i < steps; ++i) chip8_step(c8);
-        cycles_accum -= steps;
+        if (e.key.keysym.sym == SDLK_BACKSPACE) emu_send(&emu, EMU_REWIND, 0);
+        if (e.key.keysym.sym == SDLK_TAB) emu_send(&emu, EMU_TURBO, 0);
+        int hx = key_to_hex(args.keymap, e.key.keysym.sym);
+        if (hx >= 0) emu_send(&emu, EMU_KEY_UP, (uint8_t)hx);
       }
     }
 
-    platform_sdl_render(&plat, chip8_framebuffer(c8));
-
-    // Small sleep to avoid 100% CPU when vsync off
-    SDL_Delay(1);
+    const EmuFrame* frame = emu_frame(&emu);
+    platform_sdl_render(&plat, frame->planes, frame->width, frame->height, frame->generation, frame->dirty_rows);
   }
 
-  SDL_RemoveTimer(t60);
+  emu_stop(&emu);
+  emu_print_rewind_stats(&emu);
+  print_audio_stats(&plat);
+  print_render_stats(&plat);
+  chip8_rewind_destroy(cfg.rewind);
+  if (args.log) emu_dump_stats(c8);
+  if (rec) save_movie(rec, args.record_path);
+  bool replay_ok = true;
+  if (replay) {
+    double seconds = (double)(emu.replay_end - emu.replay_start) / (double)SDL_GetPerformanceFrequency();
+    replay_ok = report_replay(replay, args.replay_path, seconds);
+  }
   platform_sdl_shutdown(&plat);
-  free(rom_data);
+  chip8_movie_destroy(movie);
+  catalog_unmap(&rom);
   chip8_destroy(c8);
-  return 0;
+  return replay_ok ? 0 : 1;
 }
-
-
@@ -1,44 +1,135 @@
 #include "platform_sdl.h"
 
 #include <SDL.h>
+#include <math.h>
 #include <string.h>
 
-#include "../core/chip8.h"
-
-#define FB_WIDTH 64
+#define FB_WIDTH 64  // window size in units of the scale: low resolution pixels
 #define FB_HEIGHT 32
 
+#define NS_PER_S 1000000000ull
+#define AUDIO_AMPLITUDE 12000
+
+// One period of a square wave from its odd harmonics below Nyquist, with
+// Lanczos sigma factors to tame the Gibbs overshoot, peak-normalized
+static void build_wavetable(PlatformAudio* a, int rate) {
+  const int size = 1 << AUDIO_TABLE_BITS;
+  const double pi = 3.14159265358979323846;
+  int harmonics = rate / 2 / AUDIO_TONE_HZ;
+  static double wave[1 << AUDIO_TABLE_BITS];
+  double peak = 0.0;
+  for (int i = 0; i < size; ++i) {
+    double phi = 2.0 * pi * i / size, v = 0.0;
+    for (int k = 1; k <= harmonics; k += 2) {
+      double x = pi * k / (harmonics + 1);
+      v += sin(x) / x * sin(k * phi) / k;
+    }
+    wave[i] = v;
+    if (fabs(v) > peak) peak = fabs(v);
+  }
+  for (int i = 0; i < size; ++i) a->table[i] = (int16_t)(wave[i] / peak * AUDIO_AMPLITUDE);
+  a->rate = rate;
+  a->phase_step = (uint32_t)((double)AUDIO_TONE_HZ * 4294967296.0 / rate);
+}
+
+void platform_audio_edge(PlatformAudio* a, uint64_t time_ns, bool on) {
+  int head = SDL_AtomicGet(&a->head);
+  int tail = SDL_AtomicGet(&a->tail);
+  if (((head - tail) & (2 * AUDIO_RING_SIZE - 1)) == AUDIO_RING_SIZE) { // full
+    SDL_AtomicAdd(&a->dropped, 1);
+    return;
+  }
+  a->ring[head & (AUDIO_RING_SIZE - 1)] = (AudioEdge){ time_ns, on };
+  SDL_AtomicSet(&a->head, (head + 1) & (2 * AUDIO_RING_SIZE - 1)); // publishes the slot
+}
+
+void platform_audio_clock(PlatformAudio* a, uint64_t now_ns) {
+  SDL_AtomicSet(&a->now_us, (int)(uint32_t)(now_ns / 1000));
+}
+
+static uint64_t play_ns(const PlatformAudio* a) {
+  return a->anchor_ns + a->pos / (uint64_t)a->rate * NS_PER_S + a->pos % (uint64_t)a->rate * NS_PER_S / (uint64_t)a->rate;
+}
+
 static void audio_callback(void* userdata, Uint8* stream, int len) {
-  PlatformSDL* p = (PlatformSDL*)userdata;
-  memset(stream, 0, (size_t)len);
-  if (!p || !p->chip8) return;
-  // Simple square wave when sound_timer > 0
-  // We can't read timer directly via API; we use snapshot
-  Chip8Snapshot s = {0};
-  chip8_get_snapshot(p->chip8, &s);
-  if (s.sound_timer == 0) return;
-
-  // Generate a fixed-frequency square wave ~440Hz
-  const int sample_rate = 48000; // SDL default often 48k
-  static int phase = 0;
+  PlatformAudio* a = (PlatformAudio*)userdata;
   int16_t* out = (int16_t*)stream;
   int frames = len / (int)sizeof(int16_t);
-  int period = sample_rate / 440;
+  uint64_t buffer_ns = (uint64_t)frames * NS_PER_S / (uint64_t)a->rate;
+  uint64_t latency_ns = AUDIO_LATENCY_BUFFERS * buffer_ns;
+  a->stats.callbacks++;
+
+  // Emulated time reached, widened from 32-bit µs around the play position
+  uint32_t now_us = (uint32_t)SDL_AtomicGet(&a->now_us);
+  uint64_t start_ns = play_ns(a);
+  int64_t lead = (int64_t)(int32_t)(now_us - (uint32_t)(start_ns / 1000)) * 1000;
+  if (lead <= 0) {
+    // Emulation stands still (not started, paused, rewinding): hold the play
+    // position and stay silent
+    memset(stream, 0, (size_t)len);
+    if (a->started) {
+      a->stats.stalls++;
+      a->stalled = true;
+    }
+    return;
+  }
+  if (!a->started || a->stalled || lead > (int64_t)(latency_ns + 4 * buffer_ns)) {
+    // Re-anchor one latency behind; after a stall that is expected, not a drift
+    if (a->started && !a->stalled) a->stats.resyncs++;
+    uint64_t now_ns = start_ns + (uint64_t)lead;
+    a->anchor_ns = now_ns > latency_ns ? now_ns - latency_ns : 0;
+    a->pos = 0;
+    a->started = true;
+    a->stalled = false;
+    start_ns = a->anchor_ns;
+    lead = (int64_t)(now_ns - start_ns);
+  }
+  if (lead < (int64_t)buffer_ns) a->stats.underruns++;
+  double lead_ms = (double)lead / 1e6;
+  a->latency_sum += lead_ms;
+  if (lead_ms > a->stats.latency_ms_max) a->stats.latency_ms_max = lead_ms;
+
+  int tail = SDL_AtomicGet(&a->tail);
+  int head = SDL_AtomicGet(&a->head);
   for (int i = 0; i < frames; ++i) {
-    int16_t sample = (phase < period / 2) ? 12000 : -12000;
-    out[i] = sample;
-    phase = (phase + 1) % period;
+    uint64_t t = play_ns(a);
+    while (tail != head && a->ring[tail & (AUDIO_RING_SIZE - 1)].time_ns <= t) {
+      AudioEdge e = a->ring[tail & (AUDIO_RING_SIZE - 1)];
+      if (e.time_ns < start_ns) a->stats.late_edges++;
+      if (e.on && !a->on) a->phase = 0; // start on the wave's zero crossing
+      a->on = e.on;
+      tail = (tail + 1) & (2 * AUDIO_RING_SIZE - 1);
+    }
+    if (a->on) {
+      out[i] = a->table[a->phase >> (32 - AUDIO_TABLE_BITS)];
+      a->phase += a->phase_step;
+    } else {
+      out[i] = 0;
+    }
+    a->pos++;
   }
+  SDL_AtomicSet(&a->tail, tail);
+}
+
+bool platform_sdl_audio_stats(PlatformSDL* p, AudioStats* out) {
+  if (!p || !p->audio_device) return false;
+  SDL_LockAudioDevice(p->audio_device);
+  *out = p->audio.stats;
+  out->dropped_edges = (uint64_t)SDL_AtomicGet(&p->audio.dropped);
+  out->latency_ms_avg = out->callbacks ? p->audio.latency_sum / (double)out->callbacks : 0.0;
+  SDL_UnlockAudioDevice(p->audio_device);
+  return true;
 }
 
-bool platform_sdl_init(PlatformSDL* p, const char* title, int scale, bool vsync, struct Chip8* c8) {
+bool platform_sdl_init(PlatformSDL* p, const char* title, int scale, bool vsync, const uint32_t palette[4],
+                       RenderFilter filter) {
   if (!p) return false;
   memset(p, 0, sizeof(*p));
   p->scale = (scale > 0) ? scale : 10;
   p->vsync = vsync;
-  p->chip8 = c8;
+  render_init(&p->render, palette, filter);
 
-  if (SDL_Init(SDL_INIT_VIDEO | SDL_INIT_AUDIO | SDL_INIT_TIMER) != 0) {
+  if (SDL_Init(SDL_INIT_VIDEO | SDL_INIT_AUDIO) != 0) {
     return false;
   }
 
@@ -51,7 +142,8 @@ bool platform_sdl_init(PlatformSDL* p, const char* title, int scale, bool vsync,
   p->renderer = SDL_CreateRenderer(p->window, -1, renderer_flags);
   if (!p->renderer) return false;
 
-  p->texture = SDL_CreateTexture(p->renderer, SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_STREAMING, FB_WIDTH, FB_HEIGHT);
+  p->texture = SDL_CreateTexture(p->renderer, SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_STREAMING,
+                                 RENDER_MAX_WIDTH * RENDER_MAX_FACTOR, RENDER_MAX_HEIGHT * RENDER_MAX_FACTOR);
   if (!p->texture) return false;
 
   // Setup audio
@@ -60,11 +152,14 @@ bool platform_sdl_init(PlatformSDL* p, const char* title, int scale, bool vsync,
   want.freq = 48000;
   want.format = AUDIO_S16SYS;
   want.channels = 1;
-  want.samples = 1024;
+  want.samples = 512; // ~11 ms per buffer
   want.callback = audio_callback;
-  want.userdata = p;
+  want.userdata = &p->audio;
   p->audio_device = SDL_OpenAudioDevice(NULL, 0, &want, &have, 0);
-  if (p->audio_device != 0) SDL_PauseAudioDevice(p->audio_device, 0);
+  if (p->audio_device != 0) {
+    build_wavetable(&p->audio, have.freq);
+    SDL_PauseAudioDevice(p->audio_device, 0);
+  }
 
   return true;
 }
@@ -78,35 +173,75 @@ void platform_sdl_shutdown(PlatformSDL* p) {
   SDL_Quit();
 }
 
-void platform_sdl_render(PlatformSDL* p, const uint8_t* framebuffer) {
-  if (!p || !p->renderer || !p->texture || !framebuffer) return;
-
-  // Convert 64x32 1bpp to RGBA8888 grayscale
-  uint32_t pixels[FB_WIDTH * FB_HEIGHT];
-  for (int i = 0; i < FB_WIDTH * FB_HEIGHT; ++i) {
-    uint8_t v = framebuffer[i] ? 0xFF : 0x00;
-    pixels[i] = (0xFFu << 24) | (v << 16) | (v << 8) | v;
+// Frame rows (bit y = row y) covered by chip8_consume_dirty_rows() bits,
+// which stand for row pairs in 128x64
+static uint64_t frame_rows(uint32_t dirty_rows, int height) {
+  if (height <= 32) return dirty_rows;
+  uint64_t rows = 0;
+  for (int y = 0; y < 32; ++y) {
+    if (dirty_rows >> y & 1) rows |= 3ull << (2 * y);
   }
-  SDL_UpdateTexture(p->texture, NULL, pixels, FB_WIDTH * (int)sizeof(uint32_t));
+  return rows;
+}
 
+void platform_sdl_render(PlatformSDL* p, const uint64_t planes[2][2][64], int width, int height,
+                         uint32_t generation, uint32_t dirty_rows) {
+  if (!p || !p->renderer || !p->texture || !planes) return;
+  if (width <= 0 || width > PLATFORM_MAX_WIDTH || height <= 0 || height > PLATFORM_MAX_HEIGHT) return;
+  if (width != p->shown_width || height != p->shown_height) {
+    p->shown_width = width;
+    p->shown_height = height;
+    p->frame_valid = false;
+  }
+  if (p->frame_valid && generation == p->frame_generation) return; // nothing changed
+
+  // Rows the core changed since the texture was written (all of them after
+  // an expose, resize or failed lock), widened by the rows the filter reads
+  // them from (bit y = row y)
+  uint64_t start = SDL_GetPerformanceCounter();
+  uint64_t dirty = p->frame_valid ? frame_rows(dirty_rows, height) : UINT64_MAX;
+  for (int i = render_reach(p->render.filter); i > 0; --i) dirty |= dirty << 1 | dirty >> 1;
+  if (height < 64) dirty &= (1ull << height) - 1;
+
+  // Convert each run of those rows straight into the locked texture
+  int sx = render_scale_x(p->render.filter), sy = render_scale_y(p->render.filter);
+  bool ok = true;
+  int y = 0;
+  while (y < height) {
+    if (!(dirty >> y & 1)) { ++y; continue; }
+    int first = y;
+    while (y < height && (dirty >> y & 1)) ++y;
+    SDL_Rect rect = {0, first * sy, width * sx, (y - first) * sy};
+    void* texels;
+    int pitch;
+    if (SDL_LockTexture(p->texture, &rect, &texels, &pitch) != 0) { ok = false; continue; }
+    render_rows(&p->render, planes, width, height, first, y, texels, pitch);
+    SDL_UnlockTexture(p->texture);
+    p->rows_converted += (uint64_t)(y - first);
+  }
+  p->frame_generation = generation;
+  p->frame_valid = ok; // a failed lock converts everything again next time
+  uint64_t ticks = SDL_GetPerformanceCounter() - start;
+  p->update_ticks += ticks;
+  if (ticks > p->update_ticks_max) p->update_ticks_max = ticks;
+  p->frames_presented++;
+
+  // Either resolution fills the window
   SDL_RenderClear(p->renderer);
+  SDL_Rect src = {0, 0, width * sx, height * sy};
   SDL_Rect dst = {0, 0, FB_WIDTH * p->scale, FB_HEIGHT * p->scale};
-  SDL_RenderCopy(p->renderer, p->texture, NULL, &dst);
+  SDL_RenderCopy(p->renderer, p->texture, &src, &dst);
   SDL_RenderPresent(p->renderer);
 }
 
-static Uint32 timer_60hz_cb(Uint32 interval, void* userdata) {
-  SDL_Event e;
-  SDL_zero(e);
-  e.type = SDL_USEREVENT;
-  e.user.code = 1; // 60Hz tick code
-  e.user.data1 = userdata;
-  SDL_PushEvent(&e);
-  return interval; // reschedule
+void platform_sdl_render_stats(const PlatformSDL* p, RenderStats* out) {
+  double us_per_tick = 1e6 / (double)SDL_GetPerformanceFrequency();
+  out->frames = p->frames_presented;
+  out->rows = p->rows_converted;
+  out->update_us_avg = out->frames ? (double)p->update_ticks * us_per_tick / (double)out->frames : 0.0;
+  out->update_us_max = (double)p->update_ticks_max * us_per_tick;
 }
 
-Uint32 platform_sdl_add_60hz_timer(void* userdata) {
-  return SDL_AddTimer(1000 / 60, timer_60hz_cb, userdata);
+void platform_sdl_invalidate(PlatformSDL* p) {
+  if (p) p->frame_valid = false;
 }
-
-
@@ -5,26 +5,106 @@
 #include <stdbool.h>
 #include <stdint.h>
 
-struct Chip8;
+#include "render.h"
+
+// Sound pipeline. The emulation thread pushes the core's sound edges and the
+// emulated time it has reached; the audio callback plays the edges a fixed
+// latency behind that time, switching a band-limited square wave on and off
+// at the exact sample. Nothing is shared but the ring and the clock.
+#define AUDIO_RING_SIZE 64        // edges in flight; a power of two
+#define AUDIO_TABLE_BITS 11       // one period of the wave, 2^bits samples
+#define AUDIO_TONE_HZ 440
+#define AUDIO_LATENCY_BUFFERS 2   // play this many device buffers behind emulation
+
+typedef struct AudioEdge {
+  uint64_t time_ns; // chip8_emulated_ns() of the cycle
+  bool on;
+} AudioEdge;
+
+typedef struct AudioStats {
+  uint64_t callbacks;      // device buffers filled
+  uint64_t underruns;      // buffers that ran past the emulated time reached so far
+  uint64_t stalls;         // buffers left silent because emulation stood still (pause, rewind)
+  uint64_t resyncs;        // jumps of the play position after drifting (turbo, start-up)
+  uint64_t late_edges;     // edges that arrived after their sample had been played
+  uint64_t dropped_edges;  // edges lost to a full ring
+  double latency_ms_avg;   // emulated time reached minus play position, per buffer
+  double latency_ms_max;
+} AudioStats;
+
+typedef struct PlatformAudio {
+  // Ring: head is written only by the emulation thread, tail only by the
+  // audio callback. Both count modulo 2 * AUDIO_RING_SIZE.
+  AudioEdge ring[AUDIO_RING_SIZE];
+  SDL_atomic_t head, tail;
+  SDL_atomic_t now_us;  // emulated time reached, in µs modulo 2^32
+  SDL_atomic_t dropped; // edges lost to a full ring
+
+  // Audio thread only
+  int16_t table[1 << AUDIO_TABLE_BITS];
+  int rate;
+  uint32_t phase, phase_step; // position in the table, 32-bit fixed point
+  bool on, started, stalled;
+  uint64_t anchor_ns, pos;    // play position: anchor_ns plus pos samples
+  double latency_sum;
+  AudioStats stats;
+} PlatformAudio;
+
+// Emulation thread side
+void platform_audio_edge(PlatformAudio* a, uint64_t time_ns, bool on);
+void platform_audio_clock(PlatformAudio* a, uint64_t now_ns);
+
+// Largest display the renderer takes (SUPER-CHIP / XO-CHIP high resolution)
+#define PLATFORM_MAX_WIDTH RENDER_MAX_WIDTH
+#define PLATFORM_MAX_HEIGHT RENDER_MAX_HEIGHT
+
+typedef struct RenderStats {
+  uint64_t frames;        // frames presented
+  uint64_t rows;          // frame rows converted into the texture
+  double update_us_avg;   // converting and uploading a frame's changed rows
+  double update_us_max;
+} RenderStats;
 
 typedef struct PlatformSDL {
   SDL_Window* window;
   SDL_Renderer* renderer;
-  SDL_Texture* texture;   // grayscale 64x32
+  SDL_Texture* texture;   // streaming, the largest frame at RENDER_MAX_FACTOR; frames use its top-left
   SDL_AudioDeviceID audio_device;
   int scale;              // integer scale
   bool vsync;
-  struct Chip8* chip8;    // for audio beep state
+  uint32_t frame_generation; // core frame generation last presented
+  bool frame_valid;          // window holds that frame (cleared on expose/resize)
+  int shown_width, shown_height;
+  Render render;          // palette, filter and its 1x copy of the frame
+  uint64_t frames_presented, rows_converted;
+  uint64_t update_ticks, update_ticks_max; // performance counter ticks spent converting
+  PlatformAudio audio;
 } PlatformSDL;
 
-bool platform_sdl_init(PlatformSDL* p, const char* title, int scale, bool vsync, struct Chip8* c8);
+// palette: RGBA8888 by plane bits (off, plane 0, plane 1, both), or NULL for
+// render_default_palette
+bool platform_sdl_init(PlatformSDL* p, const char* title, int scale, bool vsync, const uint32_t palette[4],
+                       RenderFilter filter);
 void platform_sdl_shutdown(PlatformSDL* p);
 
-// Update texture from framebuffer data (64x32 bytes: 0/1), then render
-void platform_sdl_render(PlatformSDL* p, const uint8_t* framebuffer);
+// Copy the audio counters; false if no audio device is open.
+bool platform_sdl_audio_stats(PlatformSDL* p, AudioStats* out);
+
+// Copy the render counters.
+void platform_sdl_render_stats(const PlatformSDL* p, RenderStats* out);
+
+// Present a width x height frame (64x32 or 128x64) given as the core's packed
+// planes (chip8_display_planes(): [plane][word][row], bit 63 = leftmost pixel
+// of the word) and the core frame generation it was taken at, scaled to fill
+// the window. dirty_rows has the chip8_consume_dirty_rows() bits of the rows
+// changed since the previous call. Does nothing if that generation is already
+// shown; otherwise converts only those rows (and the rows the filter reads
+// them from) straight into the locked texture.
+void platform_sdl_render(PlatformSDL* p, const uint64_t planes[2][2][64], int width, int height,
+                         uint32_t generation, uint32_t dirty_rows);
 
-// Install a 60Hz SDL timer that pushes a user event; main loop should handle it to call chip8_tick_60hz
-Uint32 platform_sdl_add_60hz_timer(void* userdata);
+// Force the next platform_sdl_render() to present (e.g. after a window expose).
+void platform_sdl_invalidate(PlatformSDL* p);
 
 #endif // PLATFORM_SDL_H
 
@@ -0,0 +1,238 @@
+#include "render.h"
+
+#include <string.h>
+
+const uint32_t render_default_palette[4] = { 0x000000FFu, 0xFFFFFFFFu, 0xAAAAAAFFu, 0x555555FFu };
+
+// Vectors of VP RGBA8888 pixels. Masks have every bit of a lane set or clear.
+// RENDER_PORTABLE selects the plain loops on any target, so tests cover them.
+#if defined(__AVX2__) && !defined(RENDER_PORTABLE)
+#include <immintrin.h>
+#define VP 8
+typedef __m256i vp;
+typedef __m256i vp_pal; // the 4 colours in lanes 0-3, for one permute per lookup
+static inline vp vp_load(const uint32_t* p) { return _mm256_loadu_si256((const __m256i*)p); }
+static inline void vp_store(uint32_t* p, vp v) { _mm256_storeu_si256((__m256i*)p, v); }
+static inline vp vp_set1(uint32_t v) { return _mm256_set1_epi32((int)v); }
+static inline vp vp_and(vp a, vp b) { return _mm256_and_si256(a, b); }
+static inline vp vp_andnot(vp a, vp b) { return _mm256_andnot_si256(a, b); } // ~a & b
+static inline vp vp_or(vp a, vp b) { return _mm256_or_si256(a, b); }
+static inline vp vp_eq(vp a, vp b) { return _mm256_cmpeq_epi32(a, b); }
+static inline vp vp_srl1(vp a) { return _mm256_srli_epi32(a, 1); }
+// a0 b0 a1 b1 ...; unpack works within 128-bit halves, so put them in order
+static inline void vp_zip(vp a, vp b, vp* lo, vp* hi) {
+  vp l = _mm256_unpacklo_epi32(a, b), h = _mm256_unpackhi_epi32(a, b);
+  *lo = _mm256_permute2x128_si256(l, h, 0x20);
+  *hi = _mm256_permute2x128_si256(l, h, 0x31);
+}
+static inline vp_pal vp_pal_load(const uint32_t palette[4]) {
+  return _mm256_castsi128_si256(_mm_loadu_si128((const __m128i*)palette));
+}
+// Colours of VP pixels by their plane bits (the most significant bit is lane 0)
+static inline vp vp_lookup(vp_pal pal, unsigned bits0, unsigned bits1) {
+  const vp shift = _mm256_setr_epi32(7, 6, 5, 4, 3, 2, 1, 0);
+  vp i0 = _mm256_srlv_epi32(_mm256_set1_epi32((int)bits0), shift);
+  vp i1 = _mm256_srlv_epi32(_mm256_set1_epi32((int)(bits1 << 1)), shift);
+  vp idx = _mm256_or_si256(_mm256_and_si256(i0, _mm256_set1_epi32(1)), _mm256_and_si256(i1, _mm256_set1_epi32(2)));
+  return _mm256_permutevar8x32_epi32(pal, idx);
+}
+#elif (defined(__SSE2__) || defined(_M_X64)) && !defined(RENDER_PORTABLE)
+#include <emmintrin.h>
+#define VP 4
+typedef __m128i vp;
+typedef struct vp_pal { __m128i c[4]; } vp_pal; // each colour broadcast, for mask selects
+static inline vp vp_load(const uint32_t* p) { return _mm_loadu_si128((const __m128i*)p); }
+static inline void vp_store(uint32_t* p, vp v) { _mm_storeu_si128((__m128i*)p, v); }
+static inline vp vp_set1(uint32_t v) { return _mm_set1_epi32((int)v); }
+static inline vp vp_and(vp a, vp b) { return _mm_and_si128(a, b); }
+static inline vp vp_andnot(vp a, vp b) { return _mm_andnot_si128(a, b); }
+static inline vp vp_or(vp a, vp b) { return _mm_or_si128(a, b); }
+static inline vp vp_eq(vp a, vp b) { return _mm_cmpeq_epi32(a, b); }
+static inline vp vp_srl1(vp a) { return _mm_srli_epi32(a, 1); }
+static inline void vp_zip(vp a, vp b, vp* lo, vp* hi) {
+  *lo = _mm_unpacklo_epi32(a, b);
+  *hi = _mm_unpackhi_epi32(a, b);
+}
+static inline vp_pal vp_pal_load(const uint32_t palette[4]) {
+  vp_pal pal;
+  for (int i = 0; i < 4; ++i) pal.c[i] = vp_set1(palette[i]);
+  return pal;
+}
+static inline vp vp_bits(unsigned bits) {
+  const vp lane = _mm_setr_epi32(8, 4, 2, 1);
+  return _mm_cmpeq_epi32(_mm_and_si128(vp_set1(bits), lane), lane);
+}
+#else
+// Portable fallback: plain lane loops the compiler may vectorize on its own
+#define VP 4
+typedef struct vp { uint32_t v[VP]; } vp;
+typedef struct vp_pal { vp c[4]; } vp_pal;
+#define VP_MAP(expr) vp r; for (int i = 0; i < VP; ++i) r.v[i] = (uint32_t)(expr); return r
+static inline vp vp_load(const uint32_t* p) { vp r; memcpy(r.v, p, sizeof(r.v)); return r; }
+static inline void vp_store(uint32_t* p, vp v) { memcpy(p, v.v, sizeof(v.v)); }
+static inline vp vp_set1(uint32_t v) { VP_MAP(v); }
+static inline vp vp_and(vp a, vp b) { VP_MAP(a.v[i] & b.v[i]); }
+static inline vp vp_andnot(vp a, vp b) { VP_MAP(~a.v[i] & b.v[i]); }
+static inline vp vp_or(vp a, vp b) { VP_MAP(a.v[i] | b.v[i]); }
+static inline vp vp_eq(vp a, vp b) { VP_MAP(a.v[i] == b.v[i] ? ~0u : 0u); }
+static inline vp vp_srl1(vp a) { VP_MAP(a.v[i] >> 1); }
+static inline void vp_zip(vp a, vp b, vp* lo, vp* hi) {
+  for (int i = 0; i < VP / 2; ++i) {
+    lo->v[2 * i] = a.v[i], lo->v[2 * i + 1] = b.v[i];
+    hi->v[2 * i] = a.v[VP / 2 + i], hi->v[2 * i + 1] = b.v[VP / 2 + i];
+  }
+}
+static inline vp_pal vp_pal_load(const uint32_t palette[4]) {
+  vp_pal pal;
+  for (int i = 0; i < 4; ++i) pal.c[i] = vp_set1(palette[i]);
+  return pal;
+}
+static inline vp vp_bits(unsigned bits) { VP_MAP(bits >> (VP - 1 - i) & 1u ? ~0u : 0u); }
+#endif
+
+static inline vp vp_sel(vp m, vp a, vp b) { return vp_or(vp_and(m, a), vp_andnot(m, b)); }
+static inline vp vp_ne(vp a, vp b) { return vp_andnot(vp_eq(a, b), vp_set1(~0u)); }
+
+#if VP == 4
+// Without a permute: pick among the colours with the two bit masks
+static inline vp vp_lookup(const vp_pal pal, unsigned bits0, unsigned bits1) {
+  vp m0 = vp_bits(bits0), m1 = vp_bits(bits1);
+  return vp_sel(m1, vp_sel(m0, pal.c[3], pal.c[2]), vp_sel(m0, pal.c[1], pal.c[0]));
+}
+#endif
+
+// a0 b0 c0 a1 b1 c1 ...: no single shuffle does this, so it goes through the stack
+static inline void vp_zip3(uint32_t* out, vp a, vp b, vp c) {
+  uint32_t t[3][VP];
+  vp_store(t[0], a);
+  vp_store(t[1], b);
+  vp_store(t[2], c);
+  for (int i = 0; i < VP; ++i) {
+    out[3 * i] = t[0][i];
+    out[3 * i + 1] = t[1][i];
+    out[3 * i + 2] = t[2][i];
+  }
+}
+
+void render_init(Render* r, const uint32_t palette[4], RenderFilter filter) {
+  memset(r, 0, sizeof(*r));
+  memcpy(r->palette, palette ? palette : render_default_palette, sizeof(r->palette));
+  r->filter = filter;
+}
+
+int render_scale_x(RenderFilter filter) {
+  return filter == RENDER_FILTER_SCALE2X ? 2 : filter == RENDER_FILTER_SCALE3X ? 3 : 1;
+}
+
+int render_scale_y(RenderFilter filter) {
+  return filter == RENDER_FILTER_SCALE3X ? 3 : filter == RENDER_FILTER_NONE ? 1 : 2;
+}
+
+int render_reach(RenderFilter filter) {
+  return filter == RENDER_FILTER_SCALE2X || filter == RENDER_FILTER_SCALE3X ? 1 : 0;
+}
+
+// One frame row as texels, VP pixels per step taken from the packed words
+// most significant bit first
+static void expand_row(vp_pal pal, uint32_t* out, const uint64_t planes[2][2][64], int width, int y) {
+  for (int x = 0; x < width; x += VP) {
+    int w = x >> 6, shift = 64 - VP - (x & 63);
+    unsigned bits0 = (unsigned)(planes[0][w][y] >> shift) & ((1u << VP) - 1);
+    unsigned bits1 = (unsigned)(planes[1][w][y] >> shift) & ((1u << VP) - 1);
+    vp_store(out + x, vp_lookup(pal, bits0, bits1));
+  }
+}
+
+// Scale2x: with B above, D left, F right and H below E, each output corner
+// takes the neighbour on its two sides when they match and the opposite
+// ones do not, which smooths diagonal edges without blurring.
+static void scale2x_row(uint32_t* out0, uint32_t* out1, const uint32_t* up, const uint32_t* row,
+                        const uint32_t* down, int width) {
+  for (int x = 0; x < width; x += VP) {
+    vp B = vp_load(up + x), H = vp_load(down + x);
+    vp D = vp_load(row + x - 1), E = vp_load(row + x), F = vp_load(row + x + 1);
+    vp c = vp_and(vp_ne(B, H), vp_ne(D, F));
+    vp e0 = vp_sel(vp_and(c, vp_eq(D, B)), D, E);
+    vp e1 = vp_sel(vp_and(c, vp_eq(B, F)), F, E);
+    vp e2 = vp_sel(vp_and(c, vp_eq(D, H)), D, E);
+    vp e3 = vp_sel(vp_and(c, vp_eq(H, F)), F, E);
+    vp lo, hi;
+    vp_zip(e0, e1, &lo, &hi);
+    vp_store(out0 + 2 * x, lo);
+    vp_store(out0 + 2 * x + VP, hi);
+    vp_zip(e2, e3, &lo, &hi);
+    vp_store(out1 + 2 * x, lo);
+    vp_store(out1 + 2 * x + VP, hi);
+  }
+}
+
+// Scale3x: the same rule for the corners, and each edge texel also needs the
+// diagonal neighbour next to it to differ from E
+static void scale3x_row(uint32_t* out0, uint32_t* out1, uint32_t* out2, const uint32_t* up, const uint32_t* row,
+                        const uint32_t* down, int width) {
+  for (int x = 0; x < width; x += VP) {
+    vp A = vp_load(up + x - 1), B = vp_load(up + x), C = vp_load(up + x + 1);
+    vp D = vp_load(row + x - 1), E = vp_load(row + x), F = vp_load(row + x + 1);
+    vp G = vp_load(down + x - 1), H = vp_load(down + x), I = vp_load(down + x + 1);
+    vp c = vp_and(vp_ne(B, H), vp_ne(D, F));
+    vp db = vp_and(c, vp_eq(D, B)), bf = vp_and(c, vp_eq(B, F));
+    vp dh = vp_and(c, vp_eq(D, H)), hf = vp_and(c, vp_eq(H, F));
+    vp ea = vp_eq(E, A), ec = vp_eq(E, C), eg = vp_eq(E, G), ei = vp_eq(E, I);
+    vp_zip3(out0 + 3 * x, vp_sel(db, D, E), vp_sel(vp_or(vp_andnot(ec, db), vp_andnot(ea, bf)), B, E),
+            vp_sel(bf, F, E));
+    vp_zip3(out1 + 3 * x, vp_sel(vp_or(vp_andnot(eg, db), vp_andnot(ea, dh)), D, E), E,
+            vp_sel(vp_or(vp_andnot(ei, bf), vp_andnot(ec, hf)), F, E));
+    vp_zip3(out2 + 3 * x, vp_sel(dh, D, E), vp_sel(vp_or(vp_andnot(ei, dh), vp_andnot(eg, hf)), H, E),
+            vp_sel(hf, F, E));
+  }
+}
+
+// The row, then the row again at half brightness (alpha kept)
+static void scanline_rows(uint32_t* out0, uint32_t* out1, const uint32_t* row, int width) {
+  const vp rgb = vp_set1(0x7F7F7F00u), alpha = vp_set1(0x000000FFu);
+  for (int x = 0; x < width; x += VP) {
+    vp E = vp_load(row + x);
+    vp_store(out0 + x, E);
+    vp_store(out1 + x, vp_or(vp_and(vp_srl1(E), rgb), vp_and(E, alpha)));
+  }
+}
+
+void render_rows(Render* r, const uint64_t planes[2][2][64], int width, int height, int first, int last,
+                 void* dst, int pitch) {
+  vp_pal pal = vp_pal_load(r->palette);
+  uint8_t* out = (uint8_t*)dst;
+  if (r->filter == RENDER_FILTER_NONE) { // straight into the texture
+    for (int y = first; y < last; ++y, out += pitch) expand_row(pal, (uint32_t*)(void*)out, planes, width, y);
+    return;
+  }
+
+  // The filters read neighbours: convert at 1x with the edge pixels repeated
+  // beyond both ends of each row, and above and below the frame
+  for (int y = first; y < last; ++y) {
+    uint32_t* row = &r->src[y][RENDER_PAD];
+    expand_row(pal, row, planes, width, y);
+    row[-1] = row[0];
+    row[width] = row[width - 1];
+  }
+  for (int y = first; y < last; ++y) {
+    const uint32_t* up = &r->src[y > 0 ? y - 1 : 0][RENDER_PAD];
+    const uint32_t* row = &r->src[y][RENDER_PAD];
+    const uint32_t* down = &r->src[y + 1 < height ? y + 1 : y][RENDER_PAD];
+    uint32_t* out0 = (uint32_t*)(void*)out;
+    uint32_t* out1 = (uint32_t*)(void*)(out + pitch);
+    switch (r->filter) {
+      case RENDER_FILTER_SCALE2X:
+        scale2x_row(out0, out1, up, row, down, width);
+        out += 2 * pitch;
+        break;
+      case RENDER_FILTER_SCALE3X:
+        scale3x_row(out0, out1, (uint32_t*)(void*)(out + 2 * pitch), up, row, down, width);
+        out += 3 * pitch;
+        break;
+      default:
+        scanline_rows(out0, out1, row, width);
+        out += 2 * pitch;
+        break;
+    }
+  }
+}
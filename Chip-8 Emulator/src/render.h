@@ -0,0 +1,57 @@
+#ifndef RENDER_H
+#define RENDER_H
+
+// CPU side of the SDL renderer, free of SDL: expands the core's packed 1bpp
+// planes to RGBA8888 through a palette and runs the optional pixel-art
+// filters, writing straight into a caller-provided (locked texture) buffer.
+// The kernels use AVX2 when the front-end is compiled for it
+// (-DCHIP8_RENDER_AVX2=ON), SSE2 on other x86-64 builds and plain loops
+// elsewhere (or with RENDER_PORTABLE defined).
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define RENDER_MAX_WIDTH 128 // largest frame taken (SUPER-CHIP / XO-CHIP high resolution)
+#define RENDER_MAX_HEIGHT 64
+#define RENDER_MAX_FACTOR 3  // largest output pixels per frame pixel, on either axis
+#define RENDER_PAD 8         // replicated edge pixels on each side of a source row
+
+typedef enum RenderFilter {
+  RENDER_FILTER_NONE,      // one texel per pixel; the GPU does the scaling
+  RENDER_FILTER_SCALE2X,   // EPX/Scale2x: 2x2 texels, diagonal edges smoothed
+  RENDER_FILTER_SCALE3X,   // AdvMAME3x/Scale3x: 3x3 texels
+  RENDER_FILTER_SCANLINES, // 1x2 texels, the second row at half brightness
+} RenderFilter;
+
+typedef struct Render {
+  uint32_t palette[4]; // RGBA8888 by plane bits: off, plane 0, plane 1, both
+  RenderFilter filter;
+  // The frame at 1x for the filters, which read each pixel's neighbours.
+  // Rows keep what the last render_rows() calls wrote, so a call only has to
+  // convert the rows that changed.
+  uint32_t src[RENDER_MAX_HEIGHT][RENDER_PAD + RENDER_MAX_WIDTH + RENDER_PAD];
+} Render;
+
+// Default palette: black, white, light and dark grey
+extern const uint32_t render_default_palette[4];
+
+void render_init(Render* r, const uint32_t palette[4], RenderFilter filter);
+
+// Output texels per frame pixel horizontally / vertically
+int render_scale_x(RenderFilter filter);
+int render_scale_y(RenderFilter filter);
+
+// Rows on each side of a changed frame row whose output changes with it
+int render_reach(RenderFilter filter);
+
+// Convert frame rows [first, last) of a width x height frame (64x32 or
+// 128x64) given as packed planes (chip8_display_planes(): [plane][word][row],
+// bit 63 = leftmost pixel of the word). Writes output rows
+// first * scale_y .. last * scale_y, each width * scale_x texels, to dst
+// (pointing at output row first * scale_y, `pitch` bytes apart). Filters
+// read the rows just outside the range from earlier calls, so callers widen
+// each run of changed rows by render_reach() on both sides.
+void render_rows(Render* r, const uint64_t planes[2][2][64], int width, int height, int first, int last,
+                 void* dst, int pitch);
+
+#endif // RENDER_H
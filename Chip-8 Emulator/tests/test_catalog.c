@@ -0,0 +1,229 @@
+#define _DEFAULT_SOURCE // mkdtemp
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "unity.h"
+#include "catalog.h"
+
+static char dir[64];
+static char index_path[96];
+
+static const uint8_t rom_a[] = { 0x60, 0x01, 0x12, 0x00 };
+static const uint8_t rom_b[] = { 0x00, 0xFF, 0x12, 0x02 };
+static const uint8_t rom_c[] = { 0xF0, 0x02, 0x12, 0x04, 0x00 };
+
+static void path_in_dir(char* out, size_t size, const char* name) { snprintf(out, size, "%s/%s", dir, name); }
+
+static void write_file(const char* name, const uint8_t* data, size_t size) {
+  char path[128];
+  path_in_dir(path, sizeof(path), name);
+  FILE* f = fopen(path, "wb");
+  TEST_ASSERT_NOT_NULL(f);
+  if (size) TEST_ASSERT_EQUAL(size, fwrite(data, 1, size, f));
+  fclose(f);
+}
+
+static void remove_file(const char* name) {
+  char path[128];
+  path_in_dir(path, sizeof(path), name);
+  remove(path);
+}
+
+void setUp(void) {
+  snprintf(dir, sizeof(dir), "/tmp/chip8_catalog_XXXXXX");
+  TEST_ASSERT_NOT_NULL(mkdtemp(dir));
+  char sub[96];
+  path_in_dir(sub, sizeof(sub), "sub");
+  TEST_ASSERT_EQUAL(0, mkdir(sub, 0755));
+  write_file("a.ch8", rom_a, sizeof(rom_a));
+  write_file("sub/b.sc8", rom_b, sizeof(rom_b));
+  write_file("c.XO8", rom_c, sizeof(rom_c));
+  write_file("copy_of_a.ch8", rom_a, sizeof(rom_a)); // same content as a.ch8
+  write_file("empty.ch8", NULL, 0);
+  write_file("notes.txt", rom_b, sizeof(rom_b));
+  snprintf(index_path, sizeof(index_path), "%s.c8ct", dir);
+}
+
+void tearDown(void) {
+  static const char* const names[] = { "a.ch8", "sub/b.sc8", "c.XO8", "copy_of_a.ch8", "empty.ch8", "notes.txt" };
+  for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); ++i) remove_file(names[i]);
+  char sub[96];
+  path_in_dir(sub, sizeof(sub), "sub");
+  rmdir(sub);
+  rmdir(dir);
+  remove(index_path);
+}
+
+static void assert_entry(const Catalog* c, const uint8_t* rom, size_t size, uint8_t machine, const char* name) {
+  CatalogEntry e;
+  TEST_ASSERT_TRUE(catalog_find(c, catalog_hash(rom, size), &e));
+  TEST_ASSERT_EQUAL_UINT32(size, e.size);
+  TEST_ASSERT_EQUAL_UINT8(machine, e.machine);
+  TEST_ASSERT_EQUAL_UINT8(0, e.quirks);
+  TEST_ASSERT_EQUAL_UINT32(0, e.hz);
+  char path[128];
+  path_in_dir(path, sizeof(path), name);
+  TEST_ASSERT_EQUAL_STRING(path, e.path);
+}
+
+static Catalog* scan_and_save(void) {
+  CatalogScanStats st;
+  Catalog* c = catalog_scan(dir, NULL, &st);
+  TEST_ASSERT_NOT_NULL(c);
+  TEST_ASSERT_EQUAL_UINT32(5, st.files);
+  TEST_ASSERT_EQUAL_UINT32(4, st.hashed);
+  TEST_ASSERT_EQUAL_UINT32(1, st.duplicates);
+  TEST_ASSERT_EQUAL_UINT32(1, st.skipped);
+  TEST_ASSERT_TRUE(catalog_save(c, index_path));
+  return c;
+}
+
+static void test_scan_save_and_open_round_trip(void) {
+  Catalog* scanned = scan_and_save();
+  TEST_ASSERT_EQUAL_UINT32(3, catalog_count(scanned));
+
+  // Machines follow the extension; of two copies the path sorting first stays
+  assert_entry(scanned, rom_a, sizeof(rom_a), CHIP8_MACHINE_CHIP8, "a.ch8");
+  assert_entry(scanned, rom_b, sizeof(rom_b), CHIP8_MACHINE_SCHIP, "sub/b.sc8");
+  assert_entry(scanned, rom_c, sizeof(rom_c), CHIP8_MACHINE_XOCHIP, "c.XO8");
+
+  // Settings survive a save and a reopen, entry for entry
+  CatalogEntry e;
+  TEST_ASSERT_TRUE(catalog_find(scanned, catalog_hash(rom_b, sizeof(rom_b)), &e));
+  e.hz = 1000;
+  e.quirks = CHIP8_QUIRKS_SCHIP + 1;
+  memcpy(e.keymap, "0123456789abcdef", sizeof(e.keymap));
+  TEST_ASSERT_TRUE(catalog_set(scanned, &e));
+  CatalogEntry unknown = e;
+  unknown.hash ^= 1;
+  TEST_ASSERT_FALSE(catalog_set(scanned, &unknown));
+  TEST_ASSERT_TRUE(catalog_save(scanned, index_path));
+
+  Catalog* opened = catalog_open(index_path);
+  TEST_ASSERT_NOT_NULL(opened);
+  TEST_ASSERT_EQUAL_UINT32(catalog_count(scanned), catalog_count(opened));
+  uint64_t last = 0;
+  for (uint32_t i = 0; i < catalog_count(opened); ++i) {
+    CatalogEntry a, b;
+    TEST_ASSERT_TRUE(catalog_get(scanned, i, &a));
+    TEST_ASSERT_TRUE(catalog_get(opened, i, &b));
+    TEST_ASSERT_TRUE(i == 0 || b.hash > last);
+    last = b.hash;
+    TEST_ASSERT_EQUAL_HEX64(a.hash, b.hash);
+    TEST_ASSERT_EQUAL_UINT64(a.mtime, b.mtime);
+    TEST_ASSERT_EQUAL_UINT32(a.size, b.size);
+    TEST_ASSERT_EQUAL_UINT32(a.hz, b.hz);
+    TEST_ASSERT_EQUAL_UINT8(a.machine, b.machine);
+    TEST_ASSERT_EQUAL_UINT8(a.quirks, b.quirks);
+    TEST_ASSERT_EQUAL_MEMORY(a.keymap, b.keymap, sizeof(a.keymap));
+    TEST_ASSERT_EQUAL_STRING(a.path, b.path);
+  }
+  TEST_ASSERT_FALSE(catalog_get(opened, catalog_count(opened), &e));
+  TEST_ASSERT_TRUE(catalog_find(opened, catalog_hash(rom_b, sizeof(rom_b)), &e));
+  TEST_ASSERT_EQUAL_UINT32(1000, e.hz);
+  TEST_ASSERT_EQUAL_MEMORY("0123456789abcdef", e.keymap, sizeof(e.keymap));
+
+  // A rescan reads only the files the index doesn't list (the dropped copy),
+  // keeps the settings, and counts what disappeared
+  remove_file("c.XO8");
+  CatalogScanStats st;
+  Catalog* rescanned = catalog_scan(dir, opened, &st);
+  TEST_ASSERT_NOT_NULL(rescanned);
+  TEST_ASSERT_EQUAL_UINT32(2, st.reused);
+  TEST_ASSERT_EQUAL_UINT32(1, st.hashed);
+  TEST_ASSERT_EQUAL_UINT32(1, st.duplicates);
+  TEST_ASSERT_EQUAL_UINT32(1, st.removed);
+  TEST_ASSERT_EQUAL_UINT32(2, catalog_count(rescanned));
+  TEST_ASSERT_TRUE(catalog_find(rescanned, catalog_hash(rom_b, sizeof(rom_b)), &e));
+  TEST_ASSERT_EQUAL_UINT8(CHIP8_QUIRKS_SCHIP + 1, e.quirks);
+  TEST_ASSERT_FALSE(catalog_find(rescanned, catalog_hash(rom_c, sizeof(rom_c)), &e));
+
+  catalog_close(rescanned);
+  catalog_close(opened);
+  catalog_close(scanned);
+}
+
+static uint8_t* read_index(size_t* size) {
+  CatalogMap m;
+  TEST_ASSERT_TRUE(catalog_map_file(index_path, &m));
+  uint8_t* copy = (uint8_t*)malloc(m.size);
+  TEST_ASSERT_NOT_NULL(copy);
+  memcpy(copy, m.data, m.size);
+  *size = m.size;
+  catalog_unmap(&m);
+  return copy;
+}
+
+static void write_index(const uint8_t* data, size_t size) {
+  FILE* f = fopen(index_path, "wb");
+  TEST_ASSERT_NOT_NULL(f);
+  if (size) TEST_ASSERT_EQUAL(size, fwrite(data, 1, size, f));
+  fclose(f);
+}
+
+static void test_truncated_or_corrupt_index_is_rejected(void) {
+  catalog_close(scan_and_save());
+  size_t size;
+  uint8_t* good = read_index(&size);
+  Catalog* c = catalog_open(index_path);
+  TEST_ASSERT_NOT_NULL(c);
+  catalog_close(c);
+
+  // Every prefix, down to an empty file
+  for (size_t n = 0; n < size; ++n) {
+    write_index(good, n);
+    TEST_ASSERT_NULL(catalog_open(index_path));
+  }
+  // One byte longer
+  uint8_t* longer = (uint8_t*)malloc(size + 1);
+  TEST_ASSERT_NOT_NULL(longer);
+  memcpy(longer, good, size);
+  longer[size] = 0;
+  write_index(longer, size + 1);
+  TEST_ASSERT_NULL(catalog_open(index_path));
+  free(longer);
+
+  // Any flipped bit: the magic, version and sizes are checked, the rest is
+  // covered by the checksum
+  uint8_t* bad = (uint8_t*)malloc(size);
+  TEST_ASSERT_NOT_NULL(bad);
+  for (size_t i = 0; i < size; ++i) {
+    memcpy(bad, good, size);
+    bad[i] ^= (uint8_t)(1u << (i % 8));
+    write_index(bad, size);
+    TEST_ASSERT_NULL(catalog_open(index_path));
+  }
+  free(bad);
+
+  write_index(good, size);
+  c = catalog_open(index_path);
+  TEST_ASSERT_NOT_NULL(c);
+  TEST_ASSERT_EQUAL_UINT32(3, catalog_count(c));
+  catalog_close(c);
+  free(good);
+}
+
+static void test_keymap_clash_finds_control_keys(void) {
+  char none[16] = { 0 };
+  TEST_ASSERT_EQUAL_INT(0, catalog_keymap_clash(none));
+  TEST_ASSERT_EQUAL_INT(0, catalog_keymap_clash(CATALOG_KEYMAP_DEFAULT));
+  TEST_ASSERT_EQUAL_INT(0, catalog_keymap_clash("0123456789abcdef"));
+  TEST_ASSERT_EQUAL_INT('p', catalog_keymap_clash("0123456789abcdep"));
+  TEST_ASSERT_EQUAL_INT('N', catalog_keymap_clash("N123456789abcdef"));
+  TEST_ASSERT_EQUAL_INT('\t', catalog_keymap_clash("0123456\t89abcdef"));
+  TEST_ASSERT_EQUAL_INT('\b', catalog_keymap_clash("0123456789abcde\b"));
+  TEST_ASSERT_EQUAL_INT(27, catalog_keymap_clash("\x1b" "123456789abcdef"));
+}
+
+int main(void) {
+  UNITY_BEGIN();
+  RUN_TEST(test_scan_save_and_open_round_trip);
+  RUN_TEST(test_truncated_or_corrupt_index_is_rejected);
+  RUN_TEST(test_keymap_clash_finds_control_keys);
+  return UNITY_END();
+}
@@ -0,0 +1,1121 @@
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "unity.h"
+#include "../core/chip8.h"
+#include "../core/chip8_movie.h"
+#include "../core/chip8_rewind.h"
+#include "../core/chip8_stats.h"
+#include "../core/chip8_trace.h"
+
+static Chip8* c8;
+
+void setUp(void) { c8 = chip8_create(NULL, NULL); }
+void tearDown(void) { chip8_destroy(c8); }
+
+static void load(const uint8_t* rom, size_t size) {
+  TEST_ASSERT_TRUE(chip8_load_rom(c8, rom, size));
+}
+
+static void assert_same_snapshot(const Chip8Snapshot* a, const Chip8Snapshot* b) {
+  TEST_ASSERT_EQUAL_HEX16(a->pc, b->pc);
+  TEST_ASSERT_EQUAL_HEX16(a->I, b->I);
+  TEST_ASSERT_EQUAL_MEMORY(a->V, b->V, sizeof(a->V));
+  TEST_ASSERT_EQUAL_UINT8(a->delay_timer, b->delay_timer);
+  TEST_ASSERT_EQUAL_UINT8(a->sound_timer, b->sound_timer);
+  TEST_ASSERT_EQUAL_UINT8(a->sp, b->sp);
+  TEST_ASSERT_EQUAL_HEX16(a->stack_top, b->stack_top);
+  TEST_ASSERT_EQUAL_HEX32(a->display_hash, b->display_hash);
+}
+
+static void test_run_cycles_exhausts_budget(void) {
+  static const uint8_t rom[] = { 0x70, 0x01, 0x12, 0x00 }; // ADD V0,1; JP 200
+  load(rom, sizeof(rom));
+  Chip8RunResult r;
+  TEST_ASSERT_EQUAL_UINT32(100, chip8_run_cycles(c8, 100, &r));
+  TEST_ASSERT_EQUAL(CHIP8_EXIT_BUDGET, r.reason);
+  TEST_ASSERT_EQUAL_UINT32(100, r.cycles);
+  Chip8Snapshot s;
+  chip8_get_snapshot(c8, &s);
+  TEST_ASSERT_EQUAL_UINT8(50, s.V[0]);
+}
+
+static void test_run_cycles_stops_on_draw(void) {
+  static const uint8_t rom[] = { 0x60, 0x00, 0xA0, 0x50, 0xD0, 0x05, 0x12, 0x06 };
+  load(rom, sizeof(rom));
+  Chip8RunResult r;
+  TEST_ASSERT_EQUAL_UINT32(3, chip8_run_cycles(c8, 1000, &r));
+  TEST_ASSERT_EQUAL(CHIP8_EXIT_DISPLAY, r.reason);
+  TEST_ASSERT_EQUAL_UINT8(1, chip8_framebuffer(c8)[0]);
+}
+
+static void test_run_cycles_stops_on_key_wait(void) {
+  static const uint8_t rom[] = { 0xF3, 0x0A, 0x12, 0x02 }; // LD V3,K; JP 202
+  load(rom, sizeof(rom));
+  Chip8RunResult r;
+  TEST_ASSERT_EQUAL_UINT32(1, chip8_run_cycles(c8, 10, &r));
+  TEST_ASSERT_EQUAL(CHIP8_EXIT_KEY_WAIT, r.reason);
+  TEST_ASSERT_EQUAL_UINT32(0, chip8_run_cycles(c8, 10, &r));
+  TEST_ASSERT_EQUAL(CHIP8_EXIT_KEY_WAIT, r.reason);
+
+  chip8_key_down(c8, 0xB);
+  TEST_ASSERT_EQUAL_UINT32(10, chip8_run_cycles(c8, 10, &r));
+  Chip8Snapshot s;
+  chip8_get_snapshot(c8, &s);
+  TEST_ASSERT_EQUAL_UINT8(0xB, s.V[3]);
+}
+
+static void test_run_cycles_stops_on_sound_start(void) {
+  static const uint8_t rom[] = { 0x61, 0x05, 0xF1, 0x18, 0xF1, 0x18, 0x12, 0x06 };
+  load(rom, sizeof(rom));
+  Chip8RunResult r;
+  TEST_ASSERT_EQUAL_UINT32(2, chip8_run_cycles(c8, 100, &r));
+  TEST_ASSERT_EQUAL(CHIP8_EXIT_SOUND, r.reason);
+  // Reloading a running timer is not a start
+  TEST_ASSERT_EQUAL_UINT32(100, chip8_run_cycles(c8, 100, &r));
+  TEST_ASSERT_EQUAL(CHIP8_EXIT_BUDGET, r.reason);
+}
+
+static void test_run_cycles_reports_invalid_opcode(void) {
+  static const uint8_t rom[] = { 0x60, 0x01, 0x5A, 0xB1, 0x12, 0x04 };
+  load(rom, sizeof(rom));
+  Chip8RunResult r;
+  TEST_ASSERT_EQUAL_UINT32(2, chip8_run_cycles(c8, 100, &r));
+  TEST_ASSERT_EQUAL(CHIP8_EXIT_INVALID_OPCODE, r.reason);
+  TEST_ASSERT_EQUAL_HEX16(0x5AB1, r.opcode);
+  Chip8Snapshot s;
+  chip8_get_snapshot(c8, &s);
+  TEST_ASSERT_EQUAL_HEX16(0x204, s.pc);
+}
+
+static void test_skip_advances_past_next_instruction(void) {
+  static const uint8_t rom[] = { 0x30, 0x00, 0x60, 0x07, 0x61, 0x01 }; // SE V0,0; LD V0,7; LD V1,1
+  load(rom, sizeof(rom));
+  chip8_step(c8);
+  chip8_step(c8);
+  Chip8Snapshot s;
+  chip8_get_snapshot(c8, &s);
+  TEST_ASSERT_EQUAL_HEX16(0x206, s.pc);
+  TEST_ASSERT_EQUAL_UINT8(0, s.V[0]);
+  TEST_ASSERT_EQUAL_UINT8(1, s.V[1]);
+}
+
+static void test_run_cycles_matches_step(void) {
+  static const uint8_t rom[] = {
+    0x60, 0x03, 0x61, 0x00, 0x71, 0x07, 0x70, 0xFF, 0x30, 0x00, 0x12, 0x04, 0x82, 0x14, 0x12, 0x0C,
+  };
+  Chip8* ref = chip8_create(NULL, NULL);
+  TEST_ASSERT_TRUE(chip8_load_rom(ref, rom, sizeof(rom)));
+  load(rom, sizeof(rom));
+  for (int i = 0; i < 64; ++i) chip8_step(ref);
+  uint32_t left = 64;
+  while (left > 0) left -= chip8_run_cycles(c8, left, NULL);
+
+  Chip8Snapshot a, b;
+  chip8_get_snapshot(ref, &a);
+  chip8_get_snapshot(c8, &b);
+  assert_same_snapshot(&a, &b);
+  chip8_destroy(ref);
+}
+
+static void test_draw_wraps_and_detects_collision(void) {
+  static const uint8_t rom[] = {
+    0x60, 0x3C, 0x61, 0x1F, // V0=60, V1=31
+    0xA2, 0x0E,             // I=20E
+    0xD0, 0x12,             // DRW V0,V1,2 (second row clipped at the bottom)
+    0xD0, 0x11,             // redraw first row: erases it, collision
+    0x00, 0xE0,             // CLS
+    0x12, 0x0C,
+    0xFF, 0x81,
+  };
+  load(rom, sizeof(rom));
+  for (int i = 0; i < 4; ++i) chip8_step(c8);
+
+  const uint64_t* rows = chip8_framebuffer_packed(c8);
+  TEST_ASSERT_EQUAL_HEX64(0xF00000000000000Full, rows[31]);
+  const uint8_t* fb = chip8_framebuffer(c8);
+  TEST_ASSERT_EQUAL_UINT8(1, fb[31 * 64 + 63]);
+  TEST_ASSERT_EQUAL_UINT8(1, fb[31 * 64 + 0]);
+  TEST_ASSERT_EQUAL_UINT8(0, fb[31 * 64 + 4]);
+  Chip8Snapshot s;
+  chip8_get_snapshot(c8, &s);
+  TEST_ASSERT_EQUAL_UINT8(0, s.V[0xF]);
+
+  chip8_step(c8);
+  chip8_get_snapshot(c8, &s);
+  TEST_ASSERT_EQUAL_UINT8(1, s.V[0xF]);
+  TEST_ASSERT_EQUAL_HEX64(0, rows[31]);
+  TEST_ASSERT_EQUAL_UINT8(0, chip8_framebuffer(c8)[31 * 64 + 63]);
+
+  // A cleared screen hashes the same as a fresh machine
+  chip8_step(c8);
+  Chip8Snapshot fresh;
+  Chip8* other = chip8_create(NULL, NULL);
+  chip8_get_snapshot(other, &fresh);
+  chip8_get_snapshot(c8, &s);
+  TEST_ASSERT_EQUAL_HEX32(fresh.display_hash, s.display_hash);
+  chip8_destroy(other);
+}
+
+static uint8_t xorshift_rng(void* user) {
+  uint32_t* s = (uint32_t*)user;
+  *s ^= *s << 13;
+  *s ^= *s >> 17;
+  *s ^= *s << 5;
+  return (uint8_t)*s;
+}
+
+static void test_incremental_hash_and_accessors(void) {
+  // Random sprites from around the font at random places, forever
+  static const uint8_t rom[] = {
+    0xC0, 0xFF, 0xC1, 0xFF, 0xC2, 0xFF, 0xA0, 0x30, 0xF2, 0x1E, 0xD0, 0x1F,
+    0xF0, 0x15, 0xF1, 0x18, 0x12, 0x00,
+  };
+  uint32_t seed = 0x2468ACE1u;
+  Chip8* r = chip8_create(xorshift_rng, &seed);
+  Chip8* copy = chip8_create(NULL, NULL);
+  TEST_ASSERT_TRUE(chip8_load_rom(r, rom, sizeof(rom)));
+  TEST_ASSERT_EQUAL_HEX32(0, chip8_display_hash(r));
+  uint8_t buf[CHIP8_STATE_MAX_SIZE];
+  for (int i = 0; i < 500; ++i) {
+    chip8_step(r);
+    // Loading a state recomputes the hash from the whole frame buffer
+    size_t n = chip8_save_state(r, buf, sizeof(buf), CHIP8_STATE_RAW);
+    TEST_ASSERT_TRUE(chip8_load_state(copy, buf, n));
+    TEST_ASSERT_EQUAL_HEX32(chip8_display_hash(copy), chip8_display_hash(r));
+
+    Chip8Snapshot s;
+    chip8_get_snapshot(r, &s);
+    TEST_ASSERT_EQUAL_HEX32(s.display_hash, chip8_display_hash(r));
+    TEST_ASSERT_EQUAL_HEX16(s.pc, chip8_pc(r));
+    TEST_ASSERT_EQUAL_UINT8(s.delay_timer, chip8_delay_timer(r));
+    TEST_ASSERT_EQUAL_UINT8(s.sound_timer, chip8_sound_timer(r));
+  }
+  TEST_ASSERT_NOT_EQUAL(0, chip8_display_hash(r));
+  chip8_destroy(copy);
+  chip8_destroy(r);
+}
+
+static void test_schip_hires_draw_and_scrolls(void) {
+  static const uint8_t rom[] = {
+    0x00, 0xFF,             // 200: HIGH
+    0x60, 0x78, 0x61, 0x02, // 202: V0=120, V1=2
+    0xA2, 0x10,             // 206: I=210
+    0xD0, 0x10,             // 208: DRW 16x16, wraps past x=127
+    0x00, 0xFB,             // 20A: SCR (4 pixels)
+    0x00, 0xC1,             // 20C: SCD 1
+    0x12, 0x0E,             // 20E: JP 20E
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+  };
+  TEST_ASSERT_TRUE(chip8_set_machine(c8, CHIP8_MACHINE_SCHIP));
+  TEST_ASSERT_FALSE(chip8_set_machine(c8, (Chip8Machine)7));
+  load(rom, sizeof(rom));
+  for (int i = 0; i < 7; ++i) chip8_step(c8);
+
+  unsigned w, h;
+  chip8_display_size(c8, &w, &h);
+  TEST_ASSERT_EQUAL_UINT(128, w);
+  TEST_ASSERT_EQUAL_UINT(64, h);
+  // Columns 120..127 shift to 124..127 (the rest falls off), 0..7 to 4..11
+  static uint8_t expected[128 * 64];
+  for (int y = 3; y < 19; ++y) {
+    memset(expected + y * 128 + 124, 1, 4);
+    memset(expected + y * 128 + 4, 1, 8);
+  }
+  const uint8_t* fb = chip8_framebuffer(c8);
+  TEST_ASSERT_EQUAL_UINT8_ARRAY(expected, fb, sizeof(expected));
+
+  // The incrementally kept hash matches a full recomputation, and the state
+  // carries the machine over to a classic instance
+  Chip8* copy = chip8_create(NULL, NULL);
+  uint8_t buf[CHIP8_STATE_MAX_SIZE];
+  size_t n = chip8_save_state(c8, buf, sizeof(buf), CHIP8_STATE_COMPRESSED);
+  TEST_ASSERT_TRUE(n > 0);
+  TEST_ASSERT_TRUE(chip8_load_state(copy, buf, n));
+  TEST_ASSERT_EQUAL(CHIP8_MACHINE_SCHIP, chip8_get_machine(copy));
+  TEST_ASSERT_EQUAL_HEX32(chip8_display_hash(c8), chip8_display_hash(copy));
+  TEST_ASSERT_EQUAL_MEMORY(fb, chip8_framebuffer(copy), 128 * 64);
+  chip8_destroy(copy);
+}
+
+static void test_xochip_planes_long_load_and_flags(void) {
+  static const uint8_t rom[] = {
+    0x60, 0x80, 0x61, 0xC0, // 200: V0=80, V1=C0
+    0xF0, 0x00, 0x10, 0x00, // 204: LD I,LONG 1000
+    0x50, 0x12,             // 208: SAVE V0-V1
+    0xF3, 0x01,             // 20A: PLANE 3
+    0x62, 0x00, 0x63, 0x00, // 20C: V2=0, V3=0
+    0xD2, 0x31,             // 210: DRW one row into each plane
+    0x32, 0x00,             // 212: SE V2,0 skips all four bytes of F000
+    0xF0, 0x00, 0x12, 0x34, // 214: LD I,LONG 1234
+    0x64, 0x07,             // 218: V4=7
+    0xF1, 0x75,             // 21A: LD R,V1
+    0x00, 0xFD,             // 21C: EXIT
+  };
+  TEST_ASSERT_TRUE(chip8_set_machine(c8, CHIP8_MACHINE_XOCHIP));
+  load(rom, sizeof(rom));
+  for (int i = 0; i < 13; ++i) chip8_step(c8);
+
+  Chip8Snapshot s;
+  chip8_get_snapshot(c8, &s);
+  TEST_ASSERT_EQUAL_HEX16(0x21C, s.pc);
+  TEST_ASSERT_EQUAL_HEX16(0x1000, s.I);
+  TEST_ASSERT_EQUAL_UINT8(7, s.V[4]);
+  TEST_ASSERT_EQUAL_UINT8(0, s.V[0xF]);
+  TEST_ASSERT_EQUAL(CHIP8_IDLE_HALT, chip8_idle_state(c8));
+  const uint8_t* fb = chip8_framebuffer(c8);
+  TEST_ASSERT_EQUAL_UINT8(3, fb[0]); // plane 0 from 1000, plane 1 from 1001
+  TEST_ASSERT_EQUAL_UINT8(2, fb[1]);
+  TEST_ASSERT_EQUAL_UINT8(0, fb[2]);
+
+  Chip8* copy = chip8_create(NULL, NULL);
+  uint8_t buf[CHIP8_STATE_MAX_SIZE];
+  size_t n = chip8_save_state(c8, buf, sizeof(buf), CHIP8_STATE_RAW);
+  TEST_ASSERT_EQUAL_size_t(chip8_state_size(c8, CHIP8_STATE_RAW), n);
+  TEST_ASSERT_TRUE(chip8_load_state(copy, buf, n));
+  Chip8Snapshot t;
+  chip8_get_snapshot(copy, &t);
+  assert_same_snapshot(&s, &t);
+  chip8_destroy(copy);
+
+  // The flag registers survive a reset
+  static const uint8_t reload[] = { 0xF1, 0x85, 0x12, 0x02 }; // LD V1,R; JP 202
+  chip8_reset(c8);
+  TEST_ASSERT_EQUAL(CHIP8_MACHINE_XOCHIP, chip8_get_machine(c8));
+  load(reload, sizeof(reload));
+  chip8_step(c8);
+  chip8_get_snapshot(c8, &s);
+  TEST_ASSERT_EQUAL_UINT8(0x80, s.V[0]);
+  TEST_ASSERT_EQUAL_UINT8(0xC0, s.V[1]);
+}
+
+// Each quirk leaves its mark in a register: V4 the VF after OR, V5 the shift
+// source, I the Fx55 step and V6 the Bnnn target.
+static const uint8_t quirk_rom[] = {
+  0x60, 0x0F, 0x61, 0xF0, // 200: V0=0F, V1=F0
+  0x6F, 0x05,             // 204: VF=5
+  0x80, 0x11,             // 206: V0 |= V1
+  0x84, 0xF0,             // 208: V4=VF
+  0x63, 0x81,             // 20A: V3=81
+  0x82, 0x36,             // 20C: SHR V2,V3
+  0x85, 0x20,             // 20E: V5=V2
+  0xA3, 0x00,             // 210: I=300
+  0xF1, 0x55,             // 212: LD [I],V0..V1
+  0x60, 0x04, 0x62, 0x08, // 214: V0=4, V2=8
+  0xB2, 0x20,             // 218: JP V0/V2,220
+  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+  0x66, 0x01, 0x12, 0x26, // 224: V6=1; JP 226
+  0x66, 0x02, 0x12, 0x2A, // 228: V6=2; JP 22A
+};
+
+static void test_quirk_profiles(void) {
+  static const struct { uint8_t vf, shifted; uint16_t I; uint8_t target; } expect[] = {
+    [CHIP8_QUIRKS_DEFAULT] = { 0, 0x00, 0x302, 1 },
+    [CHIP8_QUIRKS_VIP] = { 0, 0x40, 0x302, 1 },
+    [CHIP8_QUIRKS_CHIP48] = { 5, 0x00, 0x301, 2 },
+    [CHIP8_QUIRKS_SCHIP] = { 5, 0x00, 0x300, 2 },
+    [CHIP8_QUIRKS_XOCHIP] = { 5, 0x40, 0x302, 1 },
+  };
+  Chip8Quirks q, got;
+  TEST_ASSERT_FALSE(chip8_quirk_profile((Chip8QuirkProfile)99, &q));
+  chip8_quirk_profile(CHIP8_QUIRKS_DEFAULT, &q);
+  chip8_get_quirks(c8, &got);
+  TEST_ASSERT_EQUAL_MEMORY(&q, &got, sizeof(q));
+
+  for (unsigned p = 0; p < sizeof(expect) / sizeof(expect[0]); ++p) {
+    TEST_ASSERT_TRUE(chip8_quirk_profile((Chip8QuirkProfile)p, &q));
+    for (Chip8Engine e = CHIP8_ENGINE_SWITCH; e <= CHIP8_ENGINE_JIT; ++e) {
+      Chip8* m = chip8_create(NULL, NULL);
+      if (!chip8_set_engine(m, e)) { chip8_destroy(m); continue; }
+      chip8_set_quirks(m, &q);
+      chip8_get_quirks(m, &got);
+      TEST_ASSERT_EQUAL_MEMORY(&q, &got, sizeof(q));
+      TEST_ASSERT_TRUE(chip8_load_rom(m, quirk_rom, sizeof(quirk_rom)));
+      Chip8RunResult r;
+      chip8_run_cycles(m, 14, &r);
+      Chip8Snapshot s;
+      chip8_get_snapshot(m, &s);
+      TEST_ASSERT_EQUAL_UINT8(expect[p].vf, s.V[4]);
+      TEST_ASSERT_EQUAL_HEX8(expect[p].shifted, s.V[5]);
+      TEST_ASSERT_EQUAL_HEX16(expect[p].I, s.I);
+      TEST_ASSERT_EQUAL_UINT8(expect[p].target, s.V[6]);
+      chip8_destroy(m);
+    }
+  }
+}
+
+static void test_clip_and_display_wait(void) {
+  static const uint8_t rom[] = {
+    0x60, 0x3C, 0x61, 0x00, // 200: V0=60, V1=0
+    0xA2, 0x0C,             // 204: I=20C
+    0xD0, 0x11,             // 206: DRW V0,V1,1 (clipped at the right edge)
+    0x70, 0x01,             // 208: V0 += 1
+    0x12, 0x08,             // 20A: JP 208
+    0xFF,
+  };
+  Chip8Quirks q;
+  chip8_quirk_profile(CHIP8_QUIRKS_VIP, &q);
+  chip8_set_quirks(c8, &q);
+  load(rom, sizeof(rom));
+  Chip8RunResult r;
+  TEST_ASSERT_EQUAL_UINT32(4, chip8_run_cycles(c8, 100, &r));
+  TEST_ASSERT_EQUAL(CHIP8_EXIT_DISPLAY, r.reason);
+  TEST_ASSERT_EQUAL_HEX64(0xF, chip8_framebuffer_packed(c8)[0]);
+
+  // Held until the next tick: run_cycles() burns its budget, step() stalls
+  TEST_ASSERT_EQUAL(CHIP8_IDLE_DISPLAY_WAIT, chip8_idle_state(c8));
+  TEST_ASSERT_EQUAL_UINT32(100, chip8_run_cycles(c8, 100, &r));
+  chip8_step(c8);
+  Chip8Snapshot s;
+  chip8_get_snapshot(c8, &s);
+  TEST_ASSERT_EQUAL_HEX16(0x208, s.pc);
+
+  // The wait and the quirks travel with a saved state
+  uint8_t buf[CHIP8_STATE_MAX_SIZE];
+  size_t n = chip8_save_state(c8, buf, sizeof(buf), CHIP8_STATE_RAW);
+  Chip8* copy = chip8_create(NULL, NULL);
+  TEST_ASSERT_TRUE(chip8_load_state(copy, buf, n));
+  Chip8Quirks got;
+  chip8_get_quirks(copy, &got);
+  TEST_ASSERT_EQUAL_MEMORY(&q, &got, sizeof(q));
+  TEST_ASSERT_EQUAL(CHIP8_IDLE_DISPLAY_WAIT, chip8_idle_state(copy));
+  chip8_destroy(copy);
+
+  chip8_tick_60hz(c8);
+  chip8_step(c8);
+  chip8_get_snapshot(c8, &s);
+  TEST_ASSERT_EQUAL_UINT8(61, s.V[0]);
+
+  // Without the quirk the same sprite wraps to the left edge
+  chip8_quirk_profile(CHIP8_QUIRKS_DEFAULT, &q);
+  chip8_set_quirks(c8, &q);
+  chip8_reset(c8);
+  load(rom, sizeof(rom));
+  for (int i = 0; i < 4; ++i) chip8_step(c8);
+  TEST_ASSERT_EQUAL_HEX64(0xF00000000000000Full, chip8_framebuffer_packed(c8)[0]);
+  TEST_ASSERT_EQUAL(CHIP8_IDLE_NONE, chip8_idle_state(c8));
+}
+
+static void test_run_for_derives_exact_ticks(void) {
+  // LD V0,FF; LD DT,V0; loop: ADD V1,1; JP loop
+  static const uint8_t rom[] = { 0x60, 0xFF, 0xF0, 0x15, 0x71, 0x01, 0x12, 0x04 };
+  load(rom, sizeof(rom));
+  TEST_ASSERT_EQUAL_UINT32(CHIP8_DEFAULT_CPU_HZ, chip8_get_cpu_hz(c8));
+  TEST_ASSERT_EQUAL_UINT32(60, chip8_run_for(c8, 1000000000ull));
+  TEST_ASSERT_EQUAL_UINT8(255 - 60, chip8_delay_timer(c8));
+  Chip8Snapshot whole;
+  chip8_get_snapshot(c8, &whole);
+  TEST_ASSERT_EQUAL_UINT8(349 & 0xFF, whole.V[1]); // 700 cycles: 2 + 2 * 349
+
+  // The same second in uneven slices carries the fractions exactly
+  chip8_reset(c8);
+  load(rom, sizeof(rom));
+  uint32_t ticks = 0;
+  for (int i = 0; i < 3000; ++i) ticks += chip8_run_for(c8, 333333);
+  ticks += chip8_run_for(c8, 1000);
+  TEST_ASSERT_EQUAL_UINT32(60, ticks);
+  Chip8Snapshot sliced;
+  chip8_get_snapshot(c8, &sliced);
+  assert_same_snapshot(&whole, &sliced);
+
+  // Timers keep running while stalled in Fx0A, at any clock
+  static const uint8_t wait[] = { 0x60, 0xFF, 0xF0, 0x15, 0xF3, 0x0A };
+  chip8_reset(c8);
+  load(wait, sizeof(wait));
+  chip8_set_cpu_hz(c8, 1000);
+  TEST_ASSERT_EQUAL_UINT32(120, chip8_run_for(c8, 2000000000ull));
+  TEST_ASSERT_EQUAL_UINT8(255 - 120, chip8_delay_timer(c8));
+}
+
+static void test_idle_loops_fast_forward_exactly(void) {
+  // LD V0,5; LD DT,V0; spin: LD V1,DT; SE V1,0; JP spin; halt: JP halt
+  static const uint8_t rom[] = { 0x60, 0x05, 0xF0, 0x15, 0xF1, 0x07, 0x31, 0x00, 0x12, 0x04, 0x12, 0x0A };
+  Chip8* ref = chip8_create(NULL, NULL);
+  load(rom, sizeof(rom));
+  TEST_ASSERT_TRUE(chip8_load_rom(ref, rom, sizeof(rom)));
+  TEST_ASSERT_EQUAL_UINT32(2, chip8_run_cycles(c8, 2, NULL));
+  for (int i = 0; i < 2; ++i) chip8_step(ref);
+  TEST_ASSERT_EQUAL(CHIP8_IDLE_DELAY_SPIN, chip8_idle_state(c8));
+
+  // Budgets entering at every position of the loop match stepping
+  static const uint32_t budgets[] = { 1, 7, 10000, 2, 5 };
+  Chip8Snapshot a, b;
+  for (size_t n = 0; n < sizeof(budgets) / sizeof(budgets[0]); ++n) {
+    TEST_ASSERT_EQUAL_UINT32(budgets[n], chip8_run_cycles(c8, budgets[n], NULL));
+    for (uint32_t i = 0; i < budgets[n]; ++i) chip8_step(ref);
+    chip8_get_snapshot(c8, &a);
+    chip8_get_snapshot(ref, &b);
+    assert_same_snapshot(&b, &a);
+  }
+
+  // Once the timer runs out the loop exits into the halt
+  for (int i = 0; i < 5; ++i) chip8_tick_60hz(c8);
+  TEST_ASSERT_EQUAL(CHIP8_IDLE_NONE, chip8_idle_state(c8));
+  chip8_run_cycles(c8, 100, NULL);
+  TEST_ASSERT_EQUAL(CHIP8_IDLE_HALT, chip8_idle_state(c8));
+  TEST_ASSERT_EQUAL_HEX16(0x20A, chip8_pc(c8));
+  chip8_destroy(ref);
+
+  static const uint8_t wait[] = { 0xF3, 0x0A };
+  chip8_reset(c8);
+  load(wait, sizeof(wait));
+  chip8_step(c8);
+  TEST_ASSERT_EQUAL(CHIP8_IDLE_KEY_WAIT, chip8_idle_state(c8));
+
+  // A host can sleep exactly until the next tick
+  chip8_reset(c8);
+  uint64_t ns = chip8_ns_until_tick(c8);
+  TEST_ASSERT_EQUAL_UINT32(0, chip8_run_for(c8, ns - 1));
+  TEST_ASSERT_EQUAL_UINT64(1, chip8_ns_until_tick(c8));
+  TEST_ASSERT_EQUAL_UINT32(1, chip8_run_for(c8, 1));
+}
+
+typedef struct SoundLog {
+  uint64_t time_ns[4];
+  bool on[4];
+  int count;
+} SoundLog;
+
+static void log_sound(void* user, uint64_t time_ns, bool on) {
+  SoundLog* log = (SoundLog*)user;
+  if (log->count < 4) {
+    log->time_ns[log->count] = time_ns;
+    log->on[log->count] = on;
+  }
+  log->count++;
+}
+
+static void test_sound_edges_are_stamped_by_cycle(void) {
+  // LD V0,3; LD ST,V0; JP self
+  static const uint8_t rom[] = { 0x60, 0x03, 0xF0, 0x18, 0x12, 0x04 };
+  SoundLog log = { { 0 }, { false }, 0 };
+  chip8_set_sound_callback(c8, log_sound, &log);
+  load(rom, sizeof(rom));
+  chip8_run_for(c8, 1000000000ull);
+  TEST_ASSERT_EQUAL_INT(2, log.count);
+  TEST_ASSERT_TRUE(log.on[0]);
+  TEST_ASSERT_EQUAL_UINT64(2 * 1000000000ull / 700, log.time_ns[0]); // after cycle 2
+  TEST_ASSERT_FALSE(log.on[1]);
+  TEST_ASSERT_EQUAL_UINT64(35 * 1000000000ull / 700, log.time_ns[1]); // third tick, cycle 35
+  TEST_ASSERT_EQUAL_UINT64(1000000000ull, chip8_emulated_ns(c8));
+
+  // A reset while the sound plays stops it
+  chip8_reset(c8);
+  load(rom, sizeof(rom));
+  TEST_ASSERT_EQUAL_UINT32(2, chip8_run_cycles(c8, 10, NULL)); // stops at the sound start
+  chip8_reset(c8);
+  TEST_ASSERT_EQUAL_INT(4, log.count);
+  TEST_ASSERT_TRUE(log.on[2]);
+  TEST_ASSERT_FALSE(log.on[3]);
+  TEST_ASSERT_EQUAL_UINT64(1000000000ull + 2 * 1000000000ull / 700, log.time_ns[3]);
+}
+
+static void test_frame_generation_and_dirty_rows(void) {
+  static const uint8_t rom[] = {
+    0x60, 0x00, 0x61, 0x04, // V0=0, V1=4
+    0xA0, 0x50,             // I=font "0"
+    0xD0, 0x15,             // DRW rows 4..8
+    0xA2, 0x10,             // I=210 (zero bytes)
+    0xD0, 0x13,             // DRW of blank rows changes nothing
+    0x00, 0xE0,             // CLS
+    0x00, 0xE0,             // CLS of an empty screen changes nothing
+  };
+  load(rom, sizeof(rom));
+  chip8_consume_dirty_rows(c8); // drop the initial full-screen set
+  uint32_t gen = chip8_frame_generation(c8);
+
+  for (int i = 0; i < 4; ++i) chip8_step(c8);
+  TEST_ASSERT_EQUAL_UINT32(gen + 1, chip8_frame_generation(c8));
+  TEST_ASSERT_EQUAL_HEX32(0x1Fu << 4, chip8_consume_dirty_rows(c8));
+  TEST_ASSERT_EQUAL_HEX32(0, chip8_consume_dirty_rows(c8));
+
+  chip8_step(c8);
+  chip8_step(c8);
+  TEST_ASSERT_EQUAL_UINT32(gen + 1, chip8_frame_generation(c8));
+  TEST_ASSERT_EQUAL_HEX32(0, chip8_consume_dirty_rows(c8));
+
+  chip8_step(c8);
+  TEST_ASSERT_EQUAL_UINT32(gen + 2, chip8_frame_generation(c8));
+  TEST_ASSERT_EQUAL_HEX32(0x1Fu << 4, chip8_consume_dirty_rows(c8));
+  chip8_step(c8);
+  TEST_ASSERT_EQUAL_UINT32(gen + 2, chip8_frame_generation(c8));
+
+  chip8_reset(c8);
+  TEST_ASSERT_EQUAL_UINT32(gen + 3, chip8_frame_generation(c8));
+  TEST_ASSERT_EQUAL_HEX32(0xFFFFFFFFu, chip8_consume_dirty_rows(c8));
+}
+
+// Draws, sets both timers, calls a subroutine that stores BCD digits and then
+// waits for a key, so a state taken in the wait covers every saved field.
+static const uint8_t state_rom[] = {
+  0x60, 0x2A,             // 200: V0=2A
+  0xF0, 0x15,             // 202: DT=V0
+  0xF0, 0x18,             // 204: ST=V0
+  0xA0, 0x5A,             // 206: I=font "2"
+  0xD0, 0x05,             // 208: DRW V0,V0,5
+  0x22, 0x12,             // 20A: CALL 212
+  0xF5, 0x0A,             // 20C: LD V5,K
+  0x75, 0x01,             // 20E: V5 += 1
+  0x12, 0x0E,             // 210: JP 20E
+  0xA3, 0x00,             // 212: I=300
+  0xF0, 0x33,             // 214: BCD V0
+  0x00, 0xEE,             // 216: RET
+};
+
+static void check_state_round_trip(unsigned flags) {
+  load(state_rom, sizeof(state_rom));
+  for (int i = 0; i < 9; ++i) chip8_step(c8);
+  chip8_key_down(c8, 0x3);
+  chip8_tick_60hz(c8);
+  chip8_step(c8); // enters the Fx0A wait with key 3 held
+
+  uint8_t buf[CHIP8_STATE_MAX_SIZE];
+  size_t size = chip8_state_size(c8, flags);
+  TEST_ASSERT_TRUE(size <= sizeof(buf));
+  TEST_ASSERT_EQUAL_size_t(0, chip8_save_state(c8, buf, size - 1, flags));
+  TEST_ASSERT_EQUAL_size_t(size, chip8_save_state(c8, buf, sizeof(buf), flags));
+
+  Chip8* copy = chip8_create(NULL, NULL);
+  TEST_ASSERT_TRUE(chip8_set_engine(copy, CHIP8_ENGINE_CACHED));
+  TEST_ASSERT_TRUE(chip8_load_state(copy, buf, size));
+  chip8_key_down(c8, 0x7);
+  chip8_key_down(copy, 0x7);
+  for (int i = 0; i < 20; ++i) {
+    chip8_step(c8);
+    chip8_step(copy);
+  }
+  Chip8Snapshot a, b;
+  chip8_get_snapshot(c8, &a);
+  chip8_get_snapshot(copy, &b);
+  assert_same_snapshot(&a, &b);
+  TEST_ASSERT_EQUAL_UINT8(7 + 10, b.V[5]);
+  TEST_ASSERT_EQUAL_MEMORY(chip8_framebuffer(c8), chip8_framebuffer(copy), 64 * 32);
+  TEST_ASSERT_EQUAL(CHIP8_ENGINE_CACHED, chip8_get_engine(copy));
+
+  // Saved byte-for-byte: a second save of the restored copy matches
+  uint8_t again[CHIP8_STATE_MAX_SIZE];
+  TEST_ASSERT_TRUE(chip8_load_state(copy, buf, size));
+  TEST_ASSERT_EQUAL_size_t(size, chip8_save_state(copy, again, sizeof(again), flags));
+  TEST_ASSERT_EQUAL_MEMORY(buf, again, size);
+  chip8_destroy(copy);
+}
+
+static void test_state_round_trip_raw(void) { check_state_round_trip(CHIP8_STATE_RAW); }
+static void test_state_round_trip_compressed(void) { check_state_round_trip(CHIP8_STATE_COMPRESSED); }
+
+static void test_state_header_and_sizes(void) {
+  load(state_rom, sizeof(state_rom));
+  uint8_t buf[CHIP8_STATE_MAX_SIZE];
+  size_t raw = chip8_save_state(c8, buf, sizeof(buf), CHIP8_STATE_RAW);
+  TEST_ASSERT_EQUAL_MEMORY("C8ST", buf, 4);
+  TEST_ASSERT_EQUAL_UINT8(2, buf[4]); // version, little-endian
+  TEST_ASSERT_EQUAL_UINT8(0, buf[5]);
+  TEST_ASSERT_EQUAL_size_t(raw, chip8_state_size(c8, CHIP8_STATE_RAW));
+
+  // Font, zero memory and the blank screen are left out
+  size_t packed = chip8_state_size(c8, CHIP8_STATE_COMPRESSED);
+  TEST_ASSERT_TRUE(packed < 16 + 60 + 36 + 4 + 2 + 4 + sizeof(state_rom) + 8);
+
+  // Worst case for spans: non-zero bytes separated by gaps just too short to skip
+  static uint8_t sparse[4096 - 0x200];
+  for (size_t i = 0; i < sizeof(sparse); i += 5) sparse[i] = 0xA5;
+  load(sparse, sizeof(sparse));
+  TEST_ASSERT_TRUE(chip8_state_size(c8, CHIP8_STATE_COMPRESSED) <= CHIP8_STATE_MAX_SIZE_CHIP8);
+  TEST_ASSERT_TRUE(chip8_state_size(c8, CHIP8_STATE_RAW) <= CHIP8_STATE_MAX_SIZE_CHIP8);
+}
+
+static void test_load_state_rejects_bad_buffers(void) {
+  load(state_rom, sizeof(state_rom));
+  for (int i = 0; i < 5; ++i) chip8_step(c8);
+  uint8_t buf[CHIP8_STATE_MAX_SIZE];
+  size_t size = chip8_save_state(c8, buf, sizeof(buf), CHIP8_STATE_COMPRESSED);
+
+  Chip8* other = chip8_create(NULL, NULL);
+  Chip8Snapshot before, after;
+  chip8_get_snapshot(other, &before);
+
+  TEST_ASSERT_FALSE(chip8_load_state(other, buf, size - 1)); // truncated
+  buf[40] ^= 0x10;
+  TEST_ASSERT_FALSE(chip8_load_state(other, buf, size)); // checksum
+  buf[40] ^= 0x10;
+  buf[4] = 3;
+  TEST_ASSERT_FALSE(chip8_load_state(other, buf, size)); // unknown version
+  buf[4] = 2;
+  buf[0] = 'X';
+  TEST_ASSERT_FALSE(chip8_load_state(other, buf, size)); // magic
+  buf[0] = 'C';
+
+  chip8_get_snapshot(other, &after);
+  assert_same_snapshot(&before, &after);
+  TEST_ASSERT_TRUE(chip8_load_state(other, buf, size));
+  chip8_destroy(other);
+}
+
+static void assert_same_state(Chip8* a, Chip8* b) {
+  static uint8_t sa[CHIP8_STATE_MAX_SIZE], sb[CHIP8_STATE_MAX_SIZE];
+  size_t na = chip8_save_state(a, sa, sizeof(sa), CHIP8_STATE_RAW);
+  size_t nb = chip8_save_state(b, sb, sizeof(sb), CHIP8_STATE_RAW);
+  TEST_ASSERT_EQUAL_size_t(na, nb);
+  TEST_ASSERT_EQUAL_MEMORY(sa, sb, na);
+  TEST_ASSERT_EQUAL_HEX64(chip8_state_hash(a), chip8_state_hash(b));
+}
+
+// Stores far from the ROM, and over the ROM itself
+static const uint8_t dirty_rom[] = {
+  0x6A, 0x2A, // 200: LD VA,2A
+  0xAE, 0x00, // 202: LD I,E00
+  0xFA, 0x33, // 204: BCD VA
+  0xFA, 0x55, // 206: LD [I],V0..VA
+  0xA3, 0x00, // 208: LD I,300
+  0xF2, 0x55, // 20A: LD [I],V0..V2
+  0xA2, 0x00, // 20C: LD I,200
+  0xF0, 0x55, // 20E: LD [I],V0 -> 200 becomes 00 2A
+  0x12, 0x10, // 210: JP 210
+};
+static const uint8_t dirty_rom_xo[] = {
+  0x6A, 0x2A,             // 200: LD VA,2A
+  0xF0, 0x00, 0xE0, 0x10, // 202: LD I,LONG E010
+  0xFA, 0x55,             // 206: LD [I],V0..VA
+  0x50, 0xA2,             // 208: SAVE V0..VA
+  0xA2, 0x00,             // 20A: LD I,200
+  0xF0, 0x55,             // 20C: LD [I],V0
+  0x12, 0x0E,             // 20E: JP 20E
+};
+
+// Resets, restarts and clones visit only the pages written; each must still
+// leave exactly the machine a fresh instance would be
+static void test_reset_restart_and_clone_match_fresh_machines(void) {
+  for (int m = 0; m < 2; ++m) {
+    Chip8Machine machine = m ? CHIP8_MACHINE_XOCHIP : CHIP8_MACHINE_CHIP8;
+    const uint8_t* rom = m ? dirty_rom_xo : dirty_rom;
+    size_t size = m ? sizeof(dirty_rom_xo) : sizeof(dirty_rom);
+    Chip8* loaded = chip8_create(NULL, NULL);
+    Chip8* blank = chip8_create(NULL, NULL);
+    TEST_ASSERT_TRUE(chip8_set_machine(loaded, machine));
+    TEST_ASSERT_TRUE(chip8_set_machine(blank, machine));
+    TEST_ASSERT_TRUE(chip8_load_rom(loaded, rom, size));
+
+    TEST_ASSERT_TRUE(chip8_set_machine(c8, machine));
+    load(rom, size);
+    chip8_run_cycles(c8, 20, NULL);
+    TEST_ASSERT_EQUAL_HEX16(m ? 0x20E : 0x210, chip8_pc(c8));
+    chip8_restart(c8);
+    assert_same_state(c8, loaded);
+
+    chip8_run_cycles(c8, 20, NULL);
+    chip8_reset(c8);
+    assert_same_state(c8, blank);
+    chip8_restart(c8); // the ROM image outlives a reset
+    assert_same_state(c8, loaded);
+
+    // Into an instance of the other machine holding another program
+    Chip8* copy = chip8_create(NULL, NULL);
+    TEST_ASSERT_TRUE(chip8_set_machine(copy, m ? CHIP8_MACHINE_CHIP8 : CHIP8_MACHINE_XOCHIP));
+    TEST_ASSERT_TRUE(chip8_load_rom(copy, m ? dirty_rom : dirty_rom_xo, m ? sizeof(dirty_rom) : sizeof(dirty_rom_xo)));
+    chip8_run_cycles(copy, 20, NULL);
+    chip8_run_cycles(c8, 20, NULL);
+    chip8_clone(copy, c8);
+    assert_same_state(copy, c8);
+    TEST_ASSERT_EQUAL(machine, chip8_get_machine(copy));
+    chip8_restart(copy);
+    assert_same_state(copy, loaded);
+    chip8_reset(copy);
+    assert_same_state(copy, blank);
+
+    chip8_destroy(copy);
+    chip8_destroy(loaded);
+    chip8_destroy(blank);
+  }
+}
+
+// The restart image is sized for the machine that loaded the ROM. After a
+// state of a bigger machine, whose stores reach past it, restart is a reset.
+static void test_restart_after_a_state_of_another_machine_resets(void) {
+  static uint8_t state[CHIP8_STATE_MAX_SIZE];
+  Chip8* xo = chip8_create(NULL, NULL);
+  Chip8* blank = chip8_create(NULL, NULL);
+  TEST_ASSERT_TRUE(chip8_set_machine(xo, CHIP8_MACHINE_XOCHIP));
+  TEST_ASSERT_TRUE(chip8_set_machine(blank, CHIP8_MACHINE_XOCHIP));
+  TEST_ASSERT_TRUE(chip8_load_rom(xo, dirty_rom_xo, sizeof(dirty_rom_xo)));
+  chip8_run_cycles(xo, 20, NULL);
+  size_t size = chip8_save_state(xo, state, sizeof(state), CHIP8_STATE_RAW);
+  TEST_ASSERT_NOT_EQUAL(0, size);
+
+  load(dirty_rom, sizeof(dirty_rom));
+  chip8_run_cycles(c8, 20, NULL);
+  TEST_ASSERT_TRUE(chip8_load_state(c8, state, size));
+  chip8_restart(c8);
+  assert_same_state(c8, blank);
+
+  // A load on the machine it now is gets an image of the new size
+  TEST_ASSERT_TRUE(chip8_load_rom(c8, dirty_rom_xo, sizeof(dirty_rom_xo)));
+  chip8_run_cycles(c8, 20, NULL);
+  chip8_restart(c8);
+  TEST_ASSERT_TRUE(chip8_load_rom(blank, dirty_rom_xo, sizeof(dirty_rom_xo)));
+  assert_same_state(c8, blank);
+
+  chip8_destroy(blank);
+  chip8_destroy(xo);
+}
+
+// The state hash follows memory, registers and keypad, and only depends on
+// what the pages hold, not on which were written
+static void test_state_hash_follows_the_machine(void) {
+  load(dirty_rom, sizeof(dirty_rom));
+  Chip8* other = chip8_create(NULL, NULL);
+  TEST_ASSERT_TRUE(chip8_load_rom(other, dirty_rom, sizeof(dirty_rom)));
+  TEST_ASSERT_EQUAL_HEX64(chip8_state_hash(c8), chip8_state_hash(other));
+
+  chip8_run_cycles(c8, 3, NULL); // VA = 2A, I = E00, BCD into E00-E02
+  uint64_t h = chip8_state_hash(c8);
+  size_t size;
+  const uint8_t* mem = chip8_memory(c8, &size);
+  TEST_ASSERT_EQUAL_size_t(4096, size);
+  TEST_ASSERT_EQUAL_HEX8(0x04, mem[0xE01]);
+  chip8_run_cycles(other, 3, NULL);
+  TEST_ASSERT_EQUAL_HEX64(h, chip8_state_hash(other));
+  chip8_key_down(other, 5);
+  TEST_ASSERT_NOT_EQUAL(h, chip8_state_hash(other));
+  chip8_key_up(other, 5);
+  TEST_ASSERT_EQUAL_HEX64(h, chip8_state_hash(other));
+
+  chip8_run_cycles(c8, 1, NULL); // LD [I],V0..VA over E00-E0A
+  TEST_ASSERT_NOT_EQUAL(h, chip8_state_hash(c8));
+
+  // A loaded state counts every page as used, zero or not
+  static uint8_t buf[CHIP8_STATE_MAX_SIZE];
+  size_t n = chip8_save_state(c8, buf, sizeof(buf), CHIP8_STATE_RAW);
+  TEST_ASSERT_TRUE(chip8_load_state(other, buf, n));
+  TEST_ASSERT_EQUAL_HEX64(chip8_state_hash(c8), chip8_state_hash(other));
+  chip8_destroy(other);
+}
+
+// Every frame changes memory (BCD), registers and the display
+static const uint8_t rewind_rom[] = {
+  0xA3, 0x00, // 200: I=300
+  0xF1, 0x33, // 202: BCD V1
+  0xF1, 0x29, // 204: I=font V1
+  0xD2, 0x35, // 206: DRW V2,V3,5
+  0x71, 0x01, // 208: V1 += 1
+  0x72, 0x03, // 20A: V2 += 3
+  0x12, 0x00, // 20C: JP 200
+};
+
+// Raw states in capture order, mirroring what the rewind history holds
+typedef struct RewindModel {
+  uint8_t (*states)[CHIP8_STATE_MAX_SIZE];
+  size_t count, size;
+} RewindModel;
+
+static void run_and_capture(Chip8Rewind* r, RewindModel* m, int frames) {
+  for (int f = 0; f < frames; ++f) {
+    for (int i = 0; i < 7; ++i) chip8_step(c8);
+    chip8_tick_60hz(c8);
+    chip8_rewind_capture(r, c8);
+    m->size = chip8_save_state(c8, m->states[m->count++], CHIP8_STATE_MAX_SIZE, CHIP8_STATE_RAW);
+  }
+}
+
+static void step_back_and_check(Chip8Rewind* r, RewindModel* m, int frames) {
+  uint8_t now[CHIP8_STATE_MAX_SIZE];
+  for (int f = 0; f < frames; ++f) {
+    TEST_ASSERT_TRUE(chip8_rewind_step_back(r, c8));
+    TEST_ASSERT_EQUAL_size_t(m->size, chip8_save_state(c8, now, sizeof(now), CHIP8_STATE_RAW));
+    TEST_ASSERT_EQUAL_MEMORY(m->states[--m->count], now, m->size);
+  }
+}
+
+static void test_rewind_restores_every_frame(void) {
+  load(rewind_rom, sizeof(rewind_rom));
+  chip8_tick_60hz(c8);
+  Chip8Rewind* r = chip8_rewind_create(1 << 20, 1000, 16);
+  RewindModel m = { malloc(200 * CHIP8_STATE_MAX_SIZE), 0, 0 };
+
+  run_and_capture(r, &m, 150);
+  Chip8RewindStats st;
+  chip8_rewind_get_stats(r, &st);
+  TEST_ASSERT_EQUAL_UINT32(150, st.frames);
+  TEST_ASSERT_EQUAL_UINT32(10, st.keyframes);
+  TEST_ASSERT_EQUAL_UINT64(0, st.evicted);
+  TEST_ASSERT_TRUE(st.data_used < 150 * 200); // deltas, not 4 KB states
+
+  // Rewind into the middle of a group, play a different future, rewind through both
+  step_back_and_check(r, &m, 70);
+  chip8_key_down(c8, 0x1);
+  run_and_capture(r, &m, 40);
+  TEST_ASSERT_EQUAL_UINT32(120, chip8_rewind_frames(r));
+  step_back_and_check(r, &m, 120);
+  TEST_ASSERT_FALSE(chip8_rewind_step_back(r, c8));
+
+  chip8_rewind_get_stats(r, &st);
+  TEST_ASSERT_EQUAL_UINT32(0, st.keyframes);
+  TEST_ASSERT_EQUAL_size_t(0, st.data_used);
+  free(m.states);
+  chip8_rewind_destroy(r);
+}
+
+static void test_rewind_evicts_oldest_groups_within_budget(void) {
+  load(rewind_rom, sizeof(rewind_rom));
+  TEST_ASSERT_NULL(chip8_rewind_create(1024, 100, 8)); // smaller than one keyframe
+  Chip8Rewind* r = chip8_rewind_create(8192, 1000, 8);
+  RewindModel m = { malloc(400 * CHIP8_STATE_MAX_SIZE), 0, 0 };
+
+  run_and_capture(r, &m, 400);
+  Chip8RewindStats st;
+  chip8_rewind_get_stats(r, &st);
+  TEST_ASSERT_TRUE(st.frames > 8 && st.frames < 400);
+  TEST_ASSERT_TRUE(st.data_used <= st.data_capacity);
+  TEST_ASSERT_EQUAL_UINT64(400, st.captures);
+  TEST_ASSERT_EQUAL_UINT64(400 - st.frames, st.evicted);
+
+  // Everything still held decodes, oldest first is a keyframe
+  memmove(m.states, m.states + (400 - st.frames), st.frames * sizeof(*m.states));
+  m.count = st.frames;
+  step_back_and_check(r, &m, (int)st.frames);
+  TEST_ASSERT_FALSE(chip8_rewind_step_back(r, c8));
+  chip8_rewind_destroy(r);
+
+  // The frame limit also evicts whole groups
+  r = chip8_rewind_create(1 << 20, 20, 8);
+  m.count = 0;
+  run_and_capture(r, &m, 100);
+  TEST_ASSERT_TRUE(chip8_rewind_frames(r) <= 20 && chip8_rewind_frames(r) > 12);
+  chip8_rewind_clear(r);
+  TEST_ASSERT_EQUAL_UINT32(0, chip8_rewind_frames(r));
+  TEST_ASSERT_FALSE(chip8_rewind_step_back(r, c8));
+  free(m.states);
+  chip8_rewind_destroy(r);
+}
+
+static void test_stats_classify_opcodes(void) {
+  TEST_ASSERT_EQUAL(CHIP8_OP_CLS, chip8_stats_classify(0x00E0));
+  TEST_ASSERT_EQUAL(CHIP8_OP_SYS, chip8_stats_classify(0x0123));
+  TEST_ASSERT_EQUAL(CHIP8_OP_SHL, chip8_stats_classify(0x812E));
+  TEST_ASSERT_EQUAL(CHIP8_OP_INVALID, chip8_stats_classify(0x8128));
+  TEST_ASSERT_EQUAL(CHIP8_OP_INVALID, chip8_stats_classify(0x5121));
+  TEST_ASSERT_EQUAL(CHIP8_OP_SKNP, chip8_stats_classify(0xE3A1));
+  TEST_ASSERT_EQUAL(CHIP8_OP_LOAD, chip8_stats_classify(0xF265));
+  TEST_ASSERT_EQUAL_STRING("DRW", chip8_stats_class_name(chip8_stats_classify(0xD125)));
+  TEST_ASSERT_EQUAL_STRING("LD_K", chip8_stats_class_name(CHIP8_OP_LD_K));
+}
+
+// Runs state_rom into its key wait; every engine must count the same
+static void check_stats(Chip8Engine engine) {
+  chip8_stats_reset(c8);
+  TEST_ASSERT_TRUE(chip8_set_engine(c8, engine));
+  load(state_rom, sizeof(state_rom));
+  chip8_tick_60hz(c8);
+  for (int i = 0; i < 4; ++i) chip8_step(c8); // LD, DT, ST, I
+  chip8_tick_60hz(c8);
+  while (chip8_run_cycles(c8, 100, NULL) > 0) {} // draw, call, BCD, return, Fx0A
+  chip8_step(c8); // stalled
+  chip8_tick_60hz(c8);
+
+  Chip8Stats st;
+  TEST_ASSERT_TRUE(chip8_stats_get(c8, &st));
+  TEST_ASSERT_EQUAL_UINT64(10, st.instructions);
+  TEST_ASSERT_EQUAL_UINT64(1, st.op_class[CHIP8_OP_DRW]);
+  TEST_ASSERT_EQUAL_UINT64(2, st.op_class[CHIP8_OP_LD_I]);
+  TEST_ASSERT_EQUAL_UINT64(1, st.op_class[CHIP8_OP_CALL]);
+  TEST_ASSERT_EQUAL_UINT64(1, st.op_class[CHIP8_OP_RET]);
+  TEST_ASSERT_EQUAL_UINT64(1, st.pc_heat[0x208]);
+  TEST_ASSERT_EQUAL_UINT64(1, st.pc_heat[0x216]);
+  TEST_ASSERT_EQUAL_UINT64(0, st.pc_heat[0x20E]);
+  TEST_ASSERT_EQUAL_UINT64(1, st.draws);
+  TEST_ASSERT_EQUAL_UINT64(0, st.collisions);
+  TEST_ASSERT_EQUAL_UINT64(5, st.sprite_rows);
+  TEST_ASSERT_EQUAL_UINT64(3, st.frames);
+  TEST_ASSERT_EQUAL_UINT64(0, st.frame_cycles_min);
+  TEST_ASSERT_EQUAL_UINT64(6, st.frame_cycles_max);
+  TEST_ASSERT_EQUAL_UINT64(1, st.key_waits);
+  TEST_ASSERT_EQUAL_UINT64(1, st.key_wait_frames);
+  TEST_ASSERT_EQUAL_UINT64(1, st.key_wait_steps);
+}
+
+static void test_stats_count_execution(void) {
+  if (!chip8_stats_available()) TEST_IGNORE_MESSAGE("core built without CHIP8_STATS");
+  check_stats(CHIP8_ENGINE_SWITCH);
+  chip8_reset(c8);
+  check_stats(CHIP8_ENGINE_CACHED);
+}
+
+static void test_trace_records_ring_and_checkpoints(void) {
+  static const uint8_t rom[] = { 0x70, 0x01, 0x12, 0x00 }; // ADD V0,1; JP 200
+  load(rom, sizeof(rom));
+  TEST_ASSERT_EQUAL(0, chip8_trace_size(6, 2));
+  size_t size = chip8_trace_size(8, 2);
+  uint64_t* buf = (uint64_t*)calloc(1, size);
+  TEST_ASSERT_TRUE(chip8_trace_init(buf, size, 8, 2, 5));
+  TEST_ASSERT_TRUE(chip8_trace_valid(buf, size));
+  TEST_ASSERT_FALSE(chip8_trace_valid(buf, size - 1));
+  // A buffer cut short of its checkpoints, or of its header, is refused
+  TEST_ASSERT_FALSE(chip8_trace_attach(c8, buf, size - sizeof(Chip8TraceCheckpoint)));
+  TEST_ASSERT_FALSE(chip8_trace_attach(c8, buf, sizeof(Chip8TraceHeader) - 1));
+  // So is a damaged header asking for checkpoints with nowhere to keep them
+  Chip8TraceHeader* damaged = (Chip8TraceHeader*)buf;
+  damaged->checkpoint_capacity = 0;
+  TEST_ASSERT_FALSE(chip8_trace_valid(buf, size));
+  TEST_ASSERT_FALSE(chip8_trace_attach(c8, buf, size));
+  damaged->checkpoint_capacity = 2;
+  TEST_ASSERT_TRUE(chip8_trace_attach(c8, buf, size));
+
+  // Tracing overrides the selected engine; every instruction is recorded
+  TEST_ASSERT_TRUE(chip8_set_engine(c8, CHIP8_ENGINE_CACHED));
+  TEST_ASSERT_EQUAL_UINT32(19, chip8_run_cycles(c8, 19, NULL));
+  chip8_step(c8);
+  chip8_trace_detach(c8);
+  chip8_run_cycles(c8, 10, NULL);
+
+  const Chip8TraceHeader* h = (const Chip8TraceHeader*)buf;
+  TEST_ASSERT_EQUAL_UINT64(20, h->cycle);
+  TEST_ASSERT_NULL(chip8_trace_record(buf, 11));
+  TEST_ASSERT_NULL(chip8_trace_record(buf, 20));
+  for (uint64_t c = 12; c < 20; ++c) {
+    const Chip8TraceRecord* r = chip8_trace_record(buf, c);
+    TEST_ASSERT_NOT_NULL(r);
+    TEST_ASSERT_EQUAL_UINT32(c, r->cycle);
+    if (c % 2 == 0) {
+      TEST_ASSERT_EQUAL_HEX16(0x200, r->pc);
+      TEST_ASSERT_EQUAL_HEX16(0x7001, r->opcode);
+      TEST_ASSERT_EQUAL_UINT8(0, r->reg);
+      TEST_ASSERT_EQUAL_UINT8(c / 2 + 1, r->value);
+    } else {
+      TEST_ASSERT_EQUAL_HEX16(0x202, r->pc);
+      TEST_ASSERT_EQUAL_UINT8(CHIP8_TRACE_NO_REG, r->reg);
+    }
+  }
+
+  // Checkpoints at attach and every 5 instructions; only the last two are kept
+  TEST_ASSERT_EQUAL_UINT64(5, h->checkpoints);
+  TEST_ASSERT_NULL(chip8_trace_checkpoint(buf, 2));
+  const Chip8TraceCheckpoint* cp = chip8_trace_checkpoint(buf, 3);
+  TEST_ASSERT_NOT_NULL(cp);
+  TEST_ASSERT_EQUAL_UINT64(15, cp->cycle);
+  Chip8* replay = chip8_create(NULL, NULL);
+  TEST_ASSERT_TRUE(chip8_load_state(replay, cp->state, cp->size));
+  Chip8Snapshot s;
+  chip8_get_snapshot(replay, &s);
+  TEST_ASSERT_EQUAL_HEX16(0x202, s.pc);
+  TEST_ASSERT_EQUAL_UINT8(8, s.V[0]);
+  chip8_destroy(replay);
+  free(buf);
+}
+
+// Random digits at random places; holding key 5 waits in Fx0A, then clears
+static const uint8_t movie_rom[] = {
+  0x62, 0x05, 0xC0, 0x3F, 0xC1, 0x1F, 0xC3, 0x0F, 0xF3, 0x29, 0xD0, 0x15,
+  0xE2, 0x9E, 0x12, 0x02, 0xF4, 0x0A, 0x00, 0xE0, 0x12, 0x02,
+};
+
+// Record 600 frames of 11 instructions with key presses, a key wait and a reset
+static Chip8Movie* record_movie(Chip8Snapshot* end) {
+  Chip8Movie* m = chip8_movie_create(0xC0FFEE);
+  Chip8* rec = chip8_create(chip8_movie_rng, m);
+  TEST_ASSERT_TRUE(chip8_movie_record_begin(m, rec, movie_rom, sizeof(movie_rom)));
+  for (int frame = 0; frame < 600; ++frame) {
+    if (frame == 100) chip8_movie_key_down(m, rec, 5);
+    if (frame == 110) chip8_movie_key_up(m, rec, 5);
+    if (frame == 150) chip8_movie_key_down(m, rec, 7);
+    if (frame == 151) chip8_movie_key_up(m, rec, 7);
+    if (frame == 300) chip8_movie_reset(m, rec);
+    uint32_t budget = 11;
+    Chip8RunResult r;
+    while (budget > 0) {
+      budget -= chip8_movie_run_cycles(m, rec, budget, &r);
+      if (r.reason == CHIP8_EXIT_KEY_WAIT) break;
+    }
+    chip8_movie_tick_60hz(m, rec);
+  }
+  chip8_movie_run_cycles(m, rec, 5, NULL); // after the last tick
+  chip8_get_snapshot(rec, end);
+  chip8_destroy(rec);
+  return m;
+}
+
+static void test_movie_replays_every_frame(void) {
+  Chip8Snapshot recorded, replayed;
+  Chip8Movie* m = record_movie(&recorded);
+  size_t size = chip8_movie_size(m);
+  uint8_t* buf = (uint8_t*)malloc(size);
+  TEST_ASSERT_EQUAL(0, chip8_movie_save(m, buf, size - 1));
+  TEST_ASSERT_EQUAL(size, chip8_movie_save(m, buf, size));
+  chip8_movie_destroy(m);
+  TEST_ASSERT_TRUE(size < 600 * 8); // a few bytes per frame
+
+  // Round trip through the serialized form, played on another engine
+  m = chip8_movie_load(buf, size);
+  TEST_ASSERT_NOT_NULL(m);
+  Chip8* play = chip8_create(chip8_movie_rng, m);
+  TEST_ASSERT_TRUE(chip8_set_engine(play, CHIP8_ENGINE_CACHED));
+  TEST_ASSERT_FALSE(chip8_movie_play_begin(m, play, movie_rom, sizeof(movie_rom) - 1));
+  TEST_ASSERT_TRUE(chip8_movie_play_begin(m, play, movie_rom, sizeof(movie_rom)));
+  TEST_ASSERT_TRUE(chip8_movie_play(m, play, 250));
+  Chip8MovieStatus st;
+  chip8_movie_get_status(m, &st);
+  TEST_ASSERT_EQUAL_UINT64(250, st.frames);
+  TEST_ASSERT_FALSE(chip8_movie_play(m, play, UINT64_MAX));
+  chip8_movie_get_status(m, &st);
+  TEST_ASSERT_TRUE(st.done);
+  TEST_ASSERT_FALSE(st.stalled);
+  TEST_ASSERT_EQUAL_UINT64(600, st.frames);
+  TEST_ASSERT_EQUAL_UINT64(600, st.total_frames);
+  TEST_ASSERT_EQUAL_UINT64(0, st.mismatches);
+  chip8_get_snapshot(play, &replayed);
+  assert_same_snapshot(&recorded, &replayed);
+  chip8_destroy(play);
+
+  // A machine that ignores the movie's RNG diverges on the first drawn frame
+  play = chip8_create(NULL, NULL);
+  TEST_ASSERT_TRUE(chip8_movie_play_begin(m, play, movie_rom, sizeof(movie_rom)));
+  chip8_movie_play(m, play, UINT64_MAX);
+  chip8_movie_get_status(m, &st);
+  TEST_ASSERT_TRUE(st.mismatches > 0);
+  TEST_ASSERT_EQUAL_UINT64(0, st.first_mismatch);
+  TEST_ASSERT_NOT_EQUAL(st.expected_hash, st.actual_hash);
+  chip8_destroy(play);
+  chip8_movie_destroy(m);
+
+  buf[size - 1] ^= 1;
+  TEST_ASSERT_NULL(chip8_movie_load(buf, size));
+  buf[size - 1] ^= 1;
+  TEST_ASSERT_NULL(chip8_movie_load(buf, size - 1));
+  free(buf);
+}
+
+int main(void) {
+  UNITY_BEGIN();
+  RUN_TEST(test_run_cycles_exhausts_budget);
+  RUN_TEST(test_run_cycles_stops_on_draw);
+  RUN_TEST(test_run_cycles_stops_on_key_wait);
+  RUN_TEST(test_run_cycles_stops_on_sound_start);
+  RUN_TEST(test_run_cycles_reports_invalid_opcode);
+  RUN_TEST(test_skip_advances_past_next_instruction);
+  RUN_TEST(test_run_cycles_matches_step);
+  RUN_TEST(test_draw_wraps_and_detects_collision);
+  RUN_TEST(test_incremental_hash_and_accessors);
+  RUN_TEST(test_schip_hires_draw_and_scrolls);
+  RUN_TEST(test_xochip_planes_long_load_and_flags);
+  RUN_TEST(test_quirk_profiles);
+  RUN_TEST(test_clip_and_display_wait);
+  RUN_TEST(test_run_for_derives_exact_ticks);
+  RUN_TEST(test_idle_loops_fast_forward_exactly);
+  RUN_TEST(test_sound_edges_are_stamped_by_cycle);
+  RUN_TEST(test_frame_generation_and_dirty_rows);
+  RUN_TEST(test_state_round_trip_raw);
+  RUN_TEST(test_state_round_trip_compressed);
+  RUN_TEST(test_state_header_and_sizes);
+  RUN_TEST(test_load_state_rejects_bad_buffers);
+  RUN_TEST(test_reset_restart_and_clone_match_fresh_machines);
+  RUN_TEST(test_restart_after_a_state_of_another_machine_resets);
+  RUN_TEST(test_state_hash_follows_the_machine);
+  RUN_TEST(test_rewind_restores_every_frame);
+  RUN_TEST(test_rewind_evicts_oldest_groups_within_budget);
+  RUN_TEST(test_stats_classify_opcodes);
+  RUN_TEST(test_stats_count_execution);
+  RUN_TEST(test_trace_records_ring_and_checkpoints);
+  RUN_TEST(test_movie_replays_every_frame);
+  return UNITY_END();
+}
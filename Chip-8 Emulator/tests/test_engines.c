@@ -0,0 +1,479 @@
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "unity.h"
+#include "../core/chip8.h"
+#include "../core/chip8_batch.h"
+
+typedef struct Rng {
+  uint32_t s;
+} Rng;
+
+static uint8_t xorshift(void* user) {
+  Rng* r = (Rng*)user;
+  r->s ^= r->s << 13;
+  r->s ^= r->s >> 17;
+  r->s ^= r->s << 5;
+  return (uint8_t)r->s;
+}
+
+void setUp(void) {}
+void tearDown(void) {}
+
+static void assert_same_machine(const Chip8* a, const Chip8* b) {
+  Chip8Snapshot sa, sb;
+  chip8_get_snapshot(a, &sa);
+  chip8_get_snapshot(b, &sb);
+  TEST_ASSERT_EQUAL_HEX16(sa.pc, sb.pc);
+  TEST_ASSERT_EQUAL_HEX16(sa.I, sb.I);
+  TEST_ASSERT_EQUAL_MEMORY(sa.V, sb.V, sizeof(sa.V));
+  TEST_ASSERT_EQUAL_UINT8(sa.delay_timer, sb.delay_timer);
+  TEST_ASSERT_EQUAL_UINT8(sa.sound_timer, sb.sound_timer);
+  TEST_ASSERT_EQUAL_UINT8(sa.sp, sb.sp);
+  TEST_ASSERT_EQUAL_HEX16(sa.stack_top, sb.stack_top);
+  TEST_ASSERT_EQUAL_HEX32(sa.display_hash, sb.display_hash);
+}
+
+// Random bytes mostly decode to 0nnn and far jumps, so odd seeds build opcodes
+// from a weighted set instead, with jump targets and I kept inside the ROM so
+// long straight-line runs and self-modifying stores get exercised.
+static void fill_random_rom(uint8_t* rom, size_t size, Rng* rng, bool structured) {
+  static const uint8_t families[16] = { 0x6, 0x7, 0x8, 0x8, 0x8, 0x3, 0x4, 0xA,
+                                        0xF, 0xF, 0x1, 0x2, 0xC, 0xD, 0x5, 0x0 };
+  static const uint8_t alu[9] = { 0x0, 0x1, 0x2, 0x3, 0x4, 0x5, 0x6, 0x7, 0xE };
+  static const uint8_t fx[9] = { 0x07, 0x15, 0x18, 0x1E, 0x29, 0x33, 0x55, 0x65, 0x65 };
+  for (size_t i = 0; i < size; i += 2) {
+    uint16_t op = (uint16_t)(xorshift(rng) << 8 | xorshift(rng));
+    if (structured) {
+      uint16_t target = (uint16_t)(0x200 + ((op * 7u) % size & ~1u));
+      switch (families[op >> 12]) {
+        case 0x0: op = (op & 1) ? 0x00EE : 0x00E0; break;
+        case 0x1: op = (uint16_t)(0x1000 | target); break;
+        case 0x2: op = (uint16_t)(0x2000 | target); break;
+        case 0x5: op = (uint16_t)(op & 0x0FF0) | ((op & 0x10) ? 0x9000 : 0x5000); break;
+        case 0x8: op = (uint16_t)(0x8000 | (op & 0x0FF0) | alu[(op & 0xF) % 9]); break;
+        case 0xA: op = (uint16_t)(0xA000 | target); break;
+        case 0xF: op = (uint16_t)(0xF000 | (op & 0x0F00) | fx[(op & 0xFF) % 9]); break;
+        default: op = (uint16_t)(families[op >> 12] << 12 | (op & 0x0FFF)); break;
+      }
+    }
+    rom[i] = (uint8_t)(op >> 8);
+    rom[i + 1] = (uint8_t)op;
+  }
+}
+
+// Run random ROMs on the reference and `engine` side by side, comparing state
+// after every run_cycles() call. Key waits are released on both machines.
+static void check_engine_matches_reference(Chip8Engine engine, uint32_t seed, Chip8QuirkProfile profile) {
+  Rng rom_rng = { seed };
+  uint8_t rom[0x400];
+  fill_random_rom(rom, sizeof(rom), &rom_rng, seed & 1);
+
+  Rng ra = { seed ^ 0x9E3779B9u }, rb = ra;
+  Chip8* ref = chip8_create(xorshift, &ra);
+  Chip8* fast = chip8_create(xorshift, &rb);
+  TEST_ASSERT_TRUE(chip8_set_engine(fast, engine));
+  Chip8Quirks quirks;
+  TEST_ASSERT_TRUE(chip8_quirk_profile(profile, &quirks));
+  chip8_set_quirks(ref, &quirks);
+  chip8_set_quirks(fast, &quirks);
+  TEST_ASSERT_TRUE(chip8_load_rom(ref, rom, sizeof(rom)));
+  TEST_ASSERT_TRUE(chip8_load_rom(fast, rom, sizeof(rom)));
+
+  for (int slice = 0; slice < 2000; ++slice) {
+    uint32_t budget = 1 + (uint32_t)(xorshift(&rom_rng) % 40);
+    Chip8RunResult r1, r2;
+    chip8_run_cycles(ref, budget, &r1);
+    chip8_run_cycles(fast, budget, &r2);
+    TEST_ASSERT_EQUAL(r1.reason, r2.reason);
+    TEST_ASSERT_EQUAL_UINT32(r1.cycles, r2.cycles);
+    assert_same_machine(ref, fast);
+    TEST_ASSERT_EQUAL_MEMORY(chip8_framebuffer(ref), chip8_framebuffer(fast), 64 * 32);
+    if (r1.reason == CHIP8_EXIT_KEY_WAIT) {
+      chip8_key_down(ref, (uint8_t)(slice & 0xF));
+      chip8_key_down(fast, (uint8_t)(slice & 0xF));
+    }
+    if (slice % 8 == 0) {
+      chip8_tick_60hz(ref);
+      chip8_tick_60hz(fast);
+    }
+  }
+  chip8_destroy(ref);
+  chip8_destroy(fast);
+}
+
+static void test_cached_engine_matches_reference(void) {
+  for (uint32_t seed = 1; seed <= 32; ++seed) {
+    check_engine_matches_reference(CHIP8_ENGINE_CACHED, seed * 2654435761u, (Chip8QuirkProfile)(seed % 5));
+  }
+}
+
+static void test_jit_engine_matches_reference(void) {
+  Chip8* probe = chip8_create(NULL, NULL);
+  bool available = chip8_set_engine(probe, CHIP8_ENGINE_JIT);
+  chip8_destroy(probe);
+  if (!available) TEST_IGNORE_MESSAGE("engine not available on this build");
+  for (uint32_t seed = 1; seed <= 32; ++seed) {
+    check_engine_matches_reference(CHIP8_ENGINE_JIT, seed * 2246822519u, (Chip8QuirkProfile)(seed % 5));
+  }
+}
+
+static void check_self_modifying_code(Chip8Engine engine) {
+  static const uint8_t rom[] = {
+    0x60, 0x63, // 200: LD V0,63
+    0x61, 0x07, // 202: LD V1,07
+    0x22, 0x0E, // 204: CALL 20E
+    0xA2, 0x0E, // 206: LD I,20E
+    0xF1, 0x55, // 208: LD [I],V0..V1  -> 20E becomes LD V3,07
+    0x22, 0x0E, // 20A: CALL 20E
+    0x12, 0x0C, // 20C: JP 20C
+    0x62, 0x01, // 20E: LD V2,01
+    0x00, 0xEE, // 210: RET
+  };
+  Chip8* c8 = chip8_create(NULL, NULL);
+  if (!chip8_set_engine(c8, engine)) {
+    chip8_destroy(c8);
+    TEST_IGNORE_MESSAGE("engine not available on this build");
+  }
+  TEST_ASSERT_EQUAL(engine, chip8_get_engine(c8));
+  TEST_ASSERT_TRUE(chip8_load_rom(c8, rom, sizeof(rom)));
+  chip8_run_cycles(c8, 50, NULL);
+
+  Chip8Snapshot s;
+  chip8_get_snapshot(c8, &s);
+  TEST_ASSERT_EQUAL_HEX16(0x20C, s.pc);
+  TEST_ASSERT_EQUAL_UINT8(1, s.V[2]);
+  TEST_ASSERT_EQUAL_UINT8(7, s.V[3]);
+  TEST_ASSERT_EQUAL_UINT8(0, s.sp);
+
+  // Reloading a different ROM must not run stale decoded code
+  static const uint8_t rom2[] = { 0x64, 0x42, 0x12, 0x02 };
+  chip8_reset(c8);
+  TEST_ASSERT_TRUE(chip8_load_rom(c8, rom2, sizeof(rom2)));
+  chip8_run_cycles(c8, 10, NULL);
+  chip8_get_snapshot(c8, &s);
+  TEST_ASSERT_EQUAL_UINT8(0x42, s.V[4]);
+  TEST_ASSERT_EQUAL_UINT8(0, s.V[0]);
+
+  // A store into the running block takes effect before execution reaches it
+  static const uint8_t rom3[] = {
+    0x60, 0x63, // 200: LD V0,63
+    0x61, 0x07, // 202: LD V1,07
+    0xA2, 0x0A, // 204: LD I,20A
+    0xF1, 0x55, // 206: LD [I],V0..V1  -> 20A becomes LD V3,07
+    0x65, 0x05, // 208: LD V5,05
+    0x62, 0x01, // 20A: LD V2,01
+    0x12, 0x0C, // 20C: JP 20C
+  };
+  chip8_reset(c8);
+  TEST_ASSERT_TRUE(chip8_load_rom(c8, rom3, sizeof(rom3)));
+  Chip8RunResult r;
+  TEST_ASSERT_EQUAL_UINT32(7, chip8_run_cycles(c8, 7, &r));
+  chip8_get_snapshot(c8, &s);
+  TEST_ASSERT_EQUAL_HEX16(0x20C, s.pc);
+  TEST_ASSERT_EQUAL_UINT8(5, s.V[5]);
+  TEST_ASSERT_EQUAL_UINT8(0, s.V[2]);
+  TEST_ASSERT_EQUAL_UINT8(7, s.V[3]);
+  chip8_destroy(c8);
+}
+
+static void test_cached_engine_sees_self_modifying_code(void) {
+  check_self_modifying_code(CHIP8_ENGINE_CACHED);
+}
+
+static void test_jit_engine_sees_self_modifying_code(void) {
+  check_self_modifying_code(CHIP8_ENGINE_JIT);
+}
+
+// Generated code is never writable and executable at once: between runs the
+// arena stays executable, and no mapping of the process is rwx
+static void test_jit_arena_is_never_writable_and_executable(void) {
+#ifdef __linux__
+  static const uint8_t rom[] = {
+    0x60, 0x01, // 200: LD V0,01
+    0x22, 0x08, // 202: CALL 208
+    0x70, 0x01, // 204: ADD V0,01
+    0x12, 0x02, // 206: JP 202
+    0x61, 0x02, // 208: LD V1,02
+    0x00, 0xEE, // 20A: RET
+  };
+  Chip8* c8 = chip8_create(NULL, NULL);
+  if (!chip8_set_engine(c8, CHIP8_ENGINE_JIT)) {
+    chip8_destroy(c8);
+    TEST_IGNORE_MESSAGE("engine not available on this build");
+  }
+  TEST_ASSERT_TRUE(chip8_load_rom(c8, rom, sizeof(rom)));
+  chip8_run_cycles(c8, 1000, NULL);
+
+  FILE* maps = fopen("/proc/self/maps", "r");
+  if (!maps) {
+    chip8_destroy(c8);
+    TEST_IGNORE_MESSAGE("/proc/self/maps not readable");
+  }
+  char line[512];
+  while (fgets(line, sizeof(line), maps)) {
+    char perms[5] = "";
+    if (sscanf(line, "%*s %4s", perms) == 1) TEST_ASSERT_TRUE_MESSAGE(strncmp(perms, "rwx", 3) != 0, line);
+  }
+  fclose(maps);
+  chip8_destroy(c8);
+#else
+  TEST_IGNORE_MESSAGE("needs /proc/self/maps");
+#endif
+}
+
+// Run a and b side by side for `slices` random budgets, comparing after each
+static void run_lockstep(Chip8* a, Chip8* b, Rng* budgets, int slices) {
+  for (int slice = 0; slice < slices; ++slice) {
+    uint32_t budget = 1 + (uint32_t)(xorshift(budgets) % 40);
+    Chip8RunResult r1, r2;
+    chip8_run_cycles(a, budget, &r1);
+    chip8_run_cycles(b, budget, &r2);
+    TEST_ASSERT_EQUAL(r1.reason, r2.reason);
+    TEST_ASSERT_EQUAL_UINT32(r1.cycles, r2.cycles);
+    assert_same_machine(a, b);
+    if (r1.reason == CHIP8_EXIT_KEY_WAIT) {
+      chip8_key_down(a, (uint8_t)(slice & 0xF));
+      chip8_key_down(b, (uint8_t)(slice & 0xF));
+    }
+    if (slice % 8 == 0) {
+      chip8_tick_60hz(a);
+      chip8_tick_60hz(b);
+    }
+  }
+}
+
+// A clone taken mid-run, into an instance whose engine has other code
+// decoded, continues exactly like its source, and so does a restart of both
+static void check_clone_runs_like_source(Chip8Engine engine, uint32_t seed) {
+  Rng rom_rng = { seed };
+  uint8_t rom[0x400], other[0x400];
+  fill_random_rom(rom, sizeof(rom), &rom_rng, true);
+  fill_random_rom(other, sizeof(other), &rom_rng, true);
+
+  Rng ra = { seed ^ 0x9E3779B9u }, rb = { seed };
+  Chip8* src = chip8_create(xorshift, &ra);
+  Chip8* dst = chip8_create(xorshift, &rb);
+  TEST_ASSERT_TRUE(chip8_set_engine(dst, engine));
+  TEST_ASSERT_TRUE(chip8_load_rom(src, rom, sizeof(rom)));
+  TEST_ASSERT_TRUE(chip8_load_rom(dst, other, sizeof(other)));
+  Rng budgets = { seed * 3u + 1u };
+  for (int i = 0; i < 300; ++i) {
+    chip8_run_cycles(src, 1 + (uint32_t)(xorshift(&budgets) % 40), NULL);
+    chip8_run_cycles(dst, 1 + (uint32_t)(xorshift(&budgets) % 40), NULL);
+    chip8_key_down(src, (uint8_t)(i & 0xF));
+    chip8_key_down(dst, (uint8_t)(i & 0xF));
+    chip8_tick_60hz(src);
+    chip8_tick_60hz(dst);
+  }
+
+  chip8_clone(dst, src);
+  rb = ra;
+  assert_same_machine(src, dst);
+  run_lockstep(src, dst, &budgets, 1000);
+  chip8_restart(src);
+  chip8_restart(dst);
+  run_lockstep(src, dst, &budgets, 1000);
+  chip8_destroy(src);
+  chip8_destroy(dst);
+}
+
+static void test_clones_run_like_their_source(void) {
+  Chip8* probe = chip8_create(NULL, NULL);
+  bool jit = chip8_set_engine(probe, CHIP8_ENGINE_JIT);
+  chip8_destroy(probe);
+  for (uint32_t seed = 1; seed <= 24; ++seed) {
+    Chip8Engine engine = (Chip8Engine)(seed % 3);
+    if (engine == CHIP8_ENGINE_JIT && !jit) engine = CHIP8_ENGINE_CACHED;
+    check_clone_runs_like_source(engine, seed * 2654435761u);
+  }
+}
+
+static void assert_lane_matches(const Chip8Batch* batch, unsigned lane, const Chip8* ref) {
+  Chip8Snapshot sa, sb;
+  chip8_get_snapshot(ref, &sa);
+  chip8_batch_get_snapshot(batch, lane, &sb);
+  TEST_ASSERT_EQUAL_HEX16(sa.pc, sb.pc);
+  TEST_ASSERT_EQUAL_HEX16(sa.I, sb.I);
+  TEST_ASSERT_EQUAL_MEMORY(sa.V, sb.V, sizeof(sa.V));
+  TEST_ASSERT_EQUAL_UINT8(sa.delay_timer, sb.delay_timer);
+  TEST_ASSERT_EQUAL_UINT8(sa.sound_timer, sb.sound_timer);
+  TEST_ASSERT_EQUAL_UINT8(sa.sp, sb.sp);
+  TEST_ASSERT_EQUAL_HEX16(sa.stack_top, sb.stack_top);
+  TEST_ASSERT_EQUAL_MEMORY(chip8_framebuffer_packed(ref), chip8_batch_framebuffer_packed(batch, lane),
+                           32 * sizeof(uint64_t));
+}
+
+// A main loop of random data instructions with forward skips and jumps, calls
+// into four short subroutines, and I pointed at a scratch area (Fx1E can
+// still walk it into code). Keeps lanes running without getting stuck.
+static void fill_loop_rom(uint8_t* rom, size_t size, Rng* rng) {
+  static const uint8_t fx[12] = { 0x07, 0x07, 0x15, 0x18, 0x1E, 0x29, 0x33, 0x55, 0x65, 0x65, 0x1E, 0x0A };
+  const size_t subs = 4, sub_len = 8, body = size / 2 - subs * sub_len - 1;
+  for (size_t i = 0; i < size / 2; ++i) {
+    uint16_t r = (uint16_t)(xorshift(rng) << 8 | xorshift(rng));
+    uint8_t x = (r >> 8) & 0xF, y = (r >> 4) & 0xF;
+    uint16_t op;
+    bool in_body = i < body;
+    switch ((r ^ xorshift(rng)) % (in_body ? 20 : 14)) {
+      case 0: case 1: op = (uint16_t)(0x6000 | (r & 0x0FFF)); break;
+      case 2: case 3: op = (uint16_t)(0x7000 | (r & 0x0FFF)); break;
+      case 4: case 5: case 6: op = (uint16_t)(0x8000 | x << 8 | y << 4 | "\x0\x1\x2\x3\x4\x5\x6\x7\xE"[r % 9]); break;
+      case 7: op = (uint16_t)(0x3000 | (r & 0x0F03)); break;
+      case 8: op = (uint16_t)(0x4000 | (r & 0x0F03)); break;
+      case 9: op = (uint16_t)((r & 1 ? 0x9000 : 0x5000) | x << 8 | y << 4); break;
+      case 10: op = (uint16_t)(0xA600 | (r & 0xFF)); break;
+      case 11: op = (uint16_t)(0xC000 | (r & 0x0FFF)); break;
+      case 12: op = (uint16_t)(0xF000 | x << 8 | fx[r % (in_body ? 12 : 11)]); break;
+      case 13: op = (uint16_t)(0xD000 | (r & 0x0FF7)); break;
+      case 14: op = (uint16_t)(0xE000 | x << 8 | (r & 1 ? 0x9E : 0xA1)); break;
+      case 15: case 16:
+        op = (uint16_t)(0x2000 | (0x200 + 2 * (body + 1 + (r % subs) * sub_len)));
+        break;
+      case 17: op = 0x00E0; break;
+      default: op = (uint16_t)(0x1000 | (0x200 + 2 * (i + 1 + r % 4 < body ? i + 1 + r % 4 : body))); break;
+    }
+    if (i == body) op = 0x1200;                                  // loop back
+    if (i > body && (i - body) % sub_len == 0) op = 0x00EE;      // end of a subroutine
+    rom[2 * i] = (uint8_t)(op >> 8);
+    rom[2 * i + 1] = (uint8_t)op;
+  }
+}
+
+// Every batch lane runs the ROM with its own RNG stream and key timing next to
+// a Chip8 driven by chip8_step(); lanes start in lockstep and split on Cxkk
+// results, key presses and self-modified code. Seeds with bit 1 set give all
+// lanes the same RNG stream.
+static void check_batch_matches_step(unsigned lanes, uint32_t seed, Chip8QuirkProfile profile) {
+  Rng rom_rng = { seed };
+  uint8_t rom[0x400];
+  fill_loop_rom(rom, sizeof(rom), &rom_rng);
+
+  Rng ref_rng[CHIP8_BATCH_MAX_LANES], lane_rng[CHIP8_BATCH_MAX_LANES];
+  Chip8* ref[CHIP8_BATCH_MAX_LANES];
+  Chip8Quirks quirks;
+  TEST_ASSERT_TRUE(chip8_quirk_profile(profile, &quirks));
+  Chip8Batch* batch = chip8_batch_create(lanes);
+  TEST_ASSERT_NOT_NULL(batch);
+  chip8_batch_set_quirks(batch, &quirks);
+  TEST_ASSERT_TRUE(chip8_batch_load_rom(batch, rom, sizeof(rom)));
+  for (unsigned l = 0; l < lanes; ++l) {
+    ref_rng[l].s = lane_rng[l].s = (seed & 2) ? 0x1234567u : 0x9E3779B9u * (l + 1);
+    ref[l] = chip8_create(xorshift, &ref_rng[l]);
+    chip8_set_quirks(ref[l], &quirks);
+    TEST_ASSERT_TRUE(chip8_load_rom(ref[l], rom, sizeof(rom)));
+    chip8_batch_set_rng(batch, l, xorshift, &lane_rng[l]);
+  }
+
+  for (unsigned step = 1; step <= 1500; ++step) {
+    chip8_batch_step(batch);
+    for (unsigned l = 0; l < lanes; ++l) chip8_step(ref[l]);
+    if (step % 10 == 0) {
+      chip8_batch_tick_60hz(batch);
+      for (unsigned l = 0; l < lanes; ++l) chip8_tick_60hz(ref[l]);
+    }
+    for (unsigned l = 0; l < lanes; ++l) {
+      uint8_t key = (uint8_t)((l + step / 64) & 0xF);
+      if (step % (40 + l) == 0) {
+        chip8_batch_key_down(batch, l, key);
+        chip8_key_down(ref[l], key);
+      } else if (step % (40 + l) == 20) {
+        chip8_batch_key_up(batch, l, key);
+        chip8_key_up(ref[l], key);
+      }
+    }
+    if (step % 50 == 0) {
+      for (unsigned l = 0; l < lanes; ++l) assert_lane_matches(batch, l, ref[l]);
+    }
+  }
+
+  for (unsigned l = 0; l < lanes; ++l) chip8_destroy(ref[l]);
+  chip8_batch_destroy(batch);
+}
+
+static void test_batch_lanes_match_step(void) {
+  static const unsigned lane_counts[] = { 64, 13, 8, 2, 1 };
+  for (uint32_t seed = 1; seed <= 20; ++seed) {
+    check_batch_matches_step(lane_counts[seed % 5], seed * 2654435761u, (Chip8QuirkProfile)(seed / 2 % 5));
+  }
+}
+
+static void test_batch_runs_converged_lanes_as_vectors(void) {
+  static const uint8_t rom[] = {
+    0x60, 0x05, // 200: LD V0,05
+    0x61, 0x03, // 202: LD V1,03
+    0x80, 0x14, // 204: ADD V0,V1
+    0x81, 0x05, // 206: SUB V1,V0
+    0x82, 0x0E, // 208: SHL V2,V0
+    0x30, 0x40, // 20A: SE V0,40
+    0x12, 0x04, // 20C: JP 204
+    0x12, 0x0E, // 20E: JP 20E
+  };
+  Chip8Batch* batch = chip8_batch_create(40);
+  Chip8* ref = chip8_create(NULL, NULL);
+  TEST_ASSERT_TRUE(chip8_batch_load_rom(batch, rom, sizeof(rom)));
+  TEST_ASSERT_TRUE(chip8_load_rom(ref, rom, sizeof(rom)));
+  for (int i = 0; i < 500; ++i) {
+    chip8_batch_step(batch);
+    chip8_step(ref);
+  }
+  for (unsigned l = 0; l < 40; ++l) assert_lane_matches(batch, l, ref);
+
+  Chip8BatchStats stats;
+  chip8_batch_get_stats(batch, &stats);
+  TEST_ASSERT_EQUAL_UINT64(500u * 40u, stats.vector_lane_steps);
+  TEST_ASSERT_EQUAL_UINT64(0, stats.scalar_lane_steps);
+  TEST_ASSERT_EQUAL_UINT64(500, stats.groups);
+  chip8_destroy(ref);
+  chip8_batch_destroy(batch);
+}
+
+// Each lane stores its own random byte into the next instruction, so lanes
+// reach 20A together but must each run the code in their own memory.
+static void test_batch_splits_lanes_with_different_code(void) {
+  static const uint8_t rom[] = {
+    0x60, 0x62, // 200: LD V0,62
+    0xC1, 0xFF, // 202: RND V1,FF
+    0xA2, 0x0A, // 204: LD I,20A
+    0xF1, 0x55, // 206: LD [I],V0..V1  -> 20A becomes LD V2,<random>
+    0x00, 0xE0, // 208: CLS
+    0x00, 0x00, // 20A: rewritten
+    0x12, 0x0C, // 20C: JP 20C
+  };
+  enum { LANES = 16 };
+  Rng ref_rng[LANES], lane_rng[LANES];
+  Chip8* ref[LANES];
+  Chip8Batch* batch = chip8_batch_create(LANES);
+  TEST_ASSERT_TRUE(chip8_batch_load_rom(batch, rom, sizeof(rom)));
+  for (unsigned l = 0; l < LANES; ++l) {
+    ref_rng[l].s = lane_rng[l].s = 0x2545F491u * (l + 1);
+    ref[l] = chip8_create(xorshift, &ref_rng[l]);
+    TEST_ASSERT_TRUE(chip8_load_rom(ref[l], rom, sizeof(rom)));
+    chip8_batch_set_rng(batch, l, xorshift, &lane_rng[l]);
+  }
+  for (int i = 0; i < 10; ++i) {
+    chip8_batch_step(batch);
+    for (unsigned l = 0; l < LANES; ++l) chip8_step(ref[l]);
+  }
+  for (unsigned l = 0; l < LANES; ++l) {
+    assert_lane_matches(batch, l, ref[l]);
+    chip8_destroy(ref[l]);
+  }
+  chip8_batch_destroy(batch);
+}
+
+int main(void) {
+  UNITY_BEGIN();
+  RUN_TEST(test_cached_engine_matches_reference);
+  RUN_TEST(test_jit_engine_matches_reference);
+  RUN_TEST(test_cached_engine_sees_self_modifying_code);
+  RUN_TEST(test_jit_engine_sees_self_modifying_code);
+  RUN_TEST(test_jit_arena_is_never_writable_and_executable);
+  RUN_TEST(test_clones_run_like_their_source);
+  RUN_TEST(test_batch_lanes_match_step);
+  RUN_TEST(test_batch_runs_converged_lanes_as_vectors);
+  RUN_TEST(test_batch_splits_lanes_with_different_code);
+  return UNITY_END();
+}
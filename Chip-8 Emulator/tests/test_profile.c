@@ -0,0 +1,142 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "unity.h"
+#include "chip8_trace.h"
+#include "headless.h"
+#include "profile.h"
+
+// chip8_prof's counting on a ROM whose execution is known instruction by
+// instruction: main calls sub_210 three times, which calls sub_216, then
+// spins on a self-jump.
+//
+//   200 6000  LD V0, 0
+//   202 2210  CALL 210      <- loop
+//   204 7001  ADD V0, 1
+//   206 3003  SE V0, 3
+//   208 1202  JP 202
+//   20A 120A  JP 20A        <- spin
+//   20C 0000
+//   20E 0000
+//   210 6105  LD V1, 5      sub_210
+//   212 2216  CALL 216
+//   214 00EE  RET
+//   216 00EE  RET           sub_216
+static const uint8_t rom[] = {
+  0x60, 0x00, 0x22, 0x10, 0x70, 0x01, 0x30, 0x03, 0x12, 0x02, 0x12, 0x0A, 0x00, 0x00, 0x00, 0x00,
+  0x61, 0x05, 0x22, 0x16, 0x00, 0xEE, 0x00, 0xEE,
+};
+
+// 1 + three passes of 8, 8 and 7 instructions, then the spin
+#define RUN_CYCLES 40u
+#define SPIN_COUNT (RUN_CYCLES - 24u)
+
+// A ring much shorter than the run, drained after every span
+#define RING 16u
+
+static Profile prof;
+static Cfg cfg;
+static Chip8* c8;
+static void* trace;
+static uint32_t seed;
+
+void setUp(void) {
+  seed = 0x12345678u;
+  c8 = chip8_create(headless_xorshift, &seed);
+  TEST_ASSERT_NOT_NULL(c8);
+  TEST_ASSERT_TRUE(chip8_load_rom(c8, rom, sizeof(rom)));
+  size_t size = chip8_trace_size(RING, 0);
+  trace = malloc(size);
+  TEST_ASSERT_NOT_NULL(trace);
+  TEST_ASSERT_TRUE(chip8_trace_init(trace, size, RING, 0, 0));
+  TEST_ASSERT_TRUE(chip8_trace_attach(c8, trace, size));
+  TEST_ASSERT_TRUE(profile_init(&prof, trace));
+
+  HeadlessRun run = { RUN_CYCLES, 700, NULL, 0, NULL, profile_drain, &prof, RING };
+  TEST_ASSERT_EQUAL_UINT64(RUN_CYCLES, headless_run(c8, &run));
+  chip8_trace_detach(c8);
+  TEST_ASSERT_TRUE(cfg_build(&cfg, &prof, rom, sizeof(rom), CHIP8_MACHINE_CHIP8));
+}
+
+void tearDown(void) {
+  free(cfg.blocks);
+  cfg.blocks = NULL;
+  profile_free(&prof);
+  chip8_destroy(c8);
+  free(trace);
+}
+
+static void test_every_instruction_is_counted_by_address(void) {
+  TEST_ASSERT_EQUAL_UINT64(RUN_CYCLES, prof.instructions);
+  TEST_ASSERT_FALSE(prof.overflow);
+  static const struct { uint16_t pc; uint64_t count; } expect[] = {
+    { 0x200, 1 }, { 0x202, 3 }, { 0x204, 3 }, { 0x206, 3 }, { 0x208, 2 }, { 0x20A, SPIN_COUNT },
+    { 0x20C, 0 }, { 0x210, 3 }, { 0x212, 3 }, { 0x214, 3 }, { 0x216, 3 },
+  };
+  for (size_t i = 0; i < sizeof(expect) / sizeof(expect[0]); ++i) {
+    TEST_ASSERT_EQUAL_UINT64(expect[i].count, prof.pc_count[expect[i].pc]);
+  }
+}
+
+static void test_subroutine_calls_and_instructions(void) {
+  // main, main;sub_210, main;sub_210;sub_216
+  TEST_ASSERT_EQUAL_UINT32(3, prof.node_count);
+  TEST_ASSERT_EQUAL_UINT64(3, prof.calls[0x210]);
+  TEST_ASSERT_EQUAL_UINT64(3, prof.calls[0x216]);
+
+  uint64_t* self = (uint64_t*)calloc(PROF_ADDRS, sizeof(uint64_t));
+  uint64_t* total = (uint64_t*)calloc(PROF_ADDRS, sizeof(uint64_t));
+  TEST_ASSERT_NOT_NULL(self);
+  TEST_ASSERT_NOT_NULL(total);
+  profile_subroutines(&prof, self, total);
+  TEST_ASSERT_EQUAL_UINT64(1 + 3 + 6 + 2 + SPIN_COUNT, self[0x200]);
+  TEST_ASSERT_EQUAL_UINT64(9, self[0x210]);
+  TEST_ASSERT_EQUAL_UINT64(3, self[0x216]);
+  TEST_ASSERT_EQUAL_UINT64(RUN_CYCLES, total[0x200]);
+  TEST_ASSERT_EQUAL_UINT64(12, total[0x210]);
+  TEST_ASSERT_EQUAL_UINT64(3, total[0x216]);
+  uint64_t sum = 0;
+  for (uint32_t e = 0; e < PROF_ADDRS; ++e) sum += self[e];
+  TEST_ASSERT_EQUAL_UINT64(RUN_CYCLES, sum);
+  free(self);
+  free(total);
+}
+
+static void test_basic_blocks_and_their_counts(void) {
+  static const struct {
+    uint16_t start, end;
+    uint64_t instructions, entries;
+    bool loop;
+  } expect[] = {
+    { 0x200, 0x202, 1, 1, false },                  // falls into the loop head
+    { 0x202, 0x204, 3, 3, true },                   // CALL ends it
+    { 0x204, 0x208, 6, 3, false },                  // the return point, to the skip
+    { 0x208, 0x20A, 2, 2, false },                  // not skipped twice
+    { 0x20A, 0x20C, SPIN_COUNT, SPIN_COUNT, true }, // skipped to, jumps to itself
+    { 0x210, 0x214, 6, 3, false },
+    { 0x214, 0x216, 3, 3, false },
+    { 0x216, 0x218, 3, 3, false },
+  };
+  TEST_ASSERT_EQUAL_UINT32(sizeof(expect) / sizeof(expect[0]), cfg.block_count);
+  for (uint32_t i = 0; i < cfg.block_count; ++i) {
+    const Block* b = &cfg.blocks[i];
+    TEST_ASSERT_EQUAL_HEX16(expect[i].start, b->start);
+    TEST_ASSERT_EQUAL_HEX16(expect[i].end, b->end);
+    TEST_ASSERT_EQUAL_UINT64(expect[i].instructions, b->instructions);
+    TEST_ASSERT_EQUAL_UINT64(expect[i].entries, b->entries);
+    TEST_ASSERT_EQUAL_INT(expect[i].loop, (cfg.flags[b->start] & CFG_LOOP) != 0);
+    for (uint32_t pc = b->start; pc < b->end; pc += 2) TEST_ASSERT_EQUAL_UINT32(i, cfg.block_of[pc]);
+  }
+  TEST_ASSERT_TRUE(cfg.flags[0x210] & CFG_ENTRY);
+  TEST_ASSERT_TRUE(cfg.flags[0x216] & CFG_ENTRY);
+  TEST_ASSERT_FALSE(cfg.flags[0x20C] & CFG_CODE);
+}
+
+int main(void) {
+  UNITY_BEGIN();
+  RUN_TEST(test_every_instruction_is_counted_by_address);
+  RUN_TEST(test_subroutine_calls_and_instructions);
+  RUN_TEST(test_basic_blocks_and_their_counts);
+  return UNITY_END();
+}
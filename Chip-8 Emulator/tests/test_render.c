@@ -0,0 +1,183 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "unity.h"
+#include "../src/render.h"
+
+// The kernels in render.c against straightforward per-pixel versions of the
+// same filters. This file is built once per kernel set (see CMakeLists.txt).
+
+#define OUT_W (RENDER_MAX_WIDTH * RENDER_MAX_FACTOR)
+#define OUT_H (RENDER_MAX_HEIGHT * RENDER_MAX_FACTOR)
+#define PITCH_TEXELS (OUT_W + 5) // rows wider than the frame, as in a texture
+#define SENTINEL 0xDEADBEEFu
+
+static const uint32_t palette[4] = { 0x102030FFu, 0xFFFFFFFFu, 0x80FF4080u, 0x01020300u };
+
+static uint64_t planes[2][2][64];
+static uint32_t got[OUT_H][PITCH_TEXELS];
+static uint32_t want[OUT_H][PITCH_TEXELS];
+static Render render;
+
+void setUp(void) {}
+void tearDown(void) {}
+
+static uint32_t rng_state;
+
+static uint32_t next_random(void) {
+  rng_state ^= rng_state << 13;
+  rng_state ^= rng_state >> 17;
+  rng_state ^= rng_state << 5;
+  return rng_state;
+}
+
+static uint64_t random_word(void) { return (uint64_t)next_random() << 32 | next_random(); }
+
+// Sparse noise plus solid runs, so the filters' equality tests go both ways
+static void random_row(int width, int y) {
+  for (int pl = 0; pl < 2; ++pl) {
+    for (int w = 0; w < width / 64; ++w) {
+      uint64_t v;
+      switch (next_random() % 4) {
+        case 0: v = 0; break;
+        case 1: v = random_word() & random_word(); break;
+        case 2: v = ~0ull << (next_random() % 64); break;
+        default: v = random_word(); break;
+      }
+      planes[pl][w][y] = v;
+    }
+  }
+}
+
+// Scalar reference: the frame at 1x with coordinates clamped to the edges
+static uint32_t pixel(int width, int height, int x, int y) {
+  x = x < 0 ? 0 : x >= width ? width - 1 : x;
+  y = y < 0 ? 0 : y >= height ? height - 1 : y;
+  unsigned shift = 63 - (unsigned)(x & 63);
+  unsigned b0 = (unsigned)(planes[0][x >> 6][y] >> shift) & 1;
+  unsigned b1 = (unsigned)(planes[1][x >> 6][y] >> shift) & 1;
+  return palette[b0 | b1 << 1];
+}
+
+static void reference(RenderFilter filter, int width, int height) {
+  for (int y = 0; y < height; ++y) {
+    for (int x = 0; x < width; ++x) {
+      uint32_t A = pixel(width, height, x - 1, y - 1), B = pixel(width, height, x, y - 1);
+      uint32_t C = pixel(width, height, x + 1, y - 1), D = pixel(width, height, x - 1, y);
+      uint32_t E = pixel(width, height, x, y), F = pixel(width, height, x + 1, y);
+      uint32_t G = pixel(width, height, x - 1, y + 1), H = pixel(width, height, x, y + 1);
+      uint32_t I = pixel(width, height, x + 1, y + 1);
+      bool c = B != H && D != F;
+      switch (filter) {
+        case RENDER_FILTER_NONE:
+          want[y][x] = E;
+          break;
+        case RENDER_FILTER_SCALE2X:
+          want[2 * y][2 * x] = c && D == B ? D : E;
+          want[2 * y][2 * x + 1] = c && B == F ? F : E;
+          want[2 * y + 1][2 * x] = c && D == H ? D : E;
+          want[2 * y + 1][2 * x + 1] = c && H == F ? F : E;
+          break;
+        case RENDER_FILTER_SCALE3X: {
+          uint32_t e[9] = { E, E, E, E, E, E, E, E, E };
+          if (c) {
+            e[0] = D == B ? D : E;
+            e[1] = (D == B && E != C) || (B == F && E != A) ? B : E;
+            e[2] = B == F ? F : E;
+            e[3] = (D == B && E != G) || (D == H && E != A) ? D : E;
+            e[5] = (B == F && E != I) || (H == F && E != C) ? F : E;
+            e[6] = D == H ? D : E;
+            e[7] = (D == H && E != I) || (H == F && E != G) ? H : E;
+            e[8] = H == F ? F : E;
+          }
+          for (int i = 0; i < 9; ++i) want[3 * y + i / 3][3 * x + i % 3] = e[i];
+          break;
+        }
+        case RENDER_FILTER_SCANLINES:
+          want[2 * y][x] = E;
+          want[2 * y + 1][x] = (E >> 1 & 0x7F7F7F00u) | (E & 0xFFu);
+          break;
+      }
+    }
+  }
+}
+
+// Convert the rows in `rows` the way platform_sdl_render() does: each run
+// widened by the filter's reach, written at its place in `got`
+static void render_runs(RenderFilter filter, int width, int height, uint64_t rows) {
+  for (int i = render_reach(filter); i > 0; --i) rows |= rows << 1 | rows >> 1;
+  if (height < 64) rows &= (1ull << height) - 1;
+  int sy = render_scale_y(filter);
+  int y = 0;
+  while (y < height) {
+    if (!(rows >> y & 1)) { ++y; continue; }
+    int first = y;
+    while (y < height && (rows >> y & 1)) ++y;
+    render_rows(&render, (const uint64_t(*)[2][64])planes, width, height, first, y, &got[first * sy][0],
+                PITCH_TEXELS * 4);
+  }
+}
+
+static void assert_frame(RenderFilter filter, int width, int height) {
+  reference(filter, width, height);
+  int ow = width * render_scale_x(filter), oh = height * render_scale_y(filter);
+  char msg[96];
+  for (int y = 0; y < oh; ++y) {
+    for (int x = 0; x < PITCH_TEXELS; ++x) {
+      // Nothing past the frame's texels is written
+      uint32_t expect = x < ow ? want[y][x] : SENTINEL;
+      if (got[y][x] == expect) continue;
+      snprintf(msg, sizeof(msg), "filter %d, %dx%d: texel (%d, %d) is %08X, want %08X", (int)filter, width,
+               height, x, y, (unsigned)got[y][x], (unsigned)expect);
+      TEST_FAIL_MESSAGE(msg);
+    }
+  }
+}
+
+static void check_filter(RenderFilter filter) {
+  static const int sizes[2][2] = { { 64, 32 }, { 128, 64 } };
+  for (int s = 0; s < 2; ++s) {
+    int width = sizes[s][0], height = sizes[s][1];
+    rng_state = 0x9E3779B9u + (uint32_t)filter * 31u + (uint32_t)s;
+    render_init(&render, palette, filter);
+    for (size_t i = 0; i < sizeof(got) / sizeof(got[0][0]); ++i) (&got[0][0])[i] = SENTINEL;
+    memset(planes, 0, sizeof(planes));
+    for (int y = 0; y < height; ++y) random_row(width, y);
+    render_runs(filter, width, height, UINT64_MAX);
+    assert_frame(filter, width, height);
+
+    // Frames that change a few rows: converting only those keeps the output
+    // equal to a full conversion
+    for (int frame = 0; frame < 50; ++frame) {
+      uint64_t rows = 0;
+      for (int n = (int)(next_random() % 4); n >= 0; --n) {
+        int y = (int)(next_random() % (uint32_t)height);
+        random_row(width, y);
+        rows |= 1ull << y;
+      }
+      render_runs(filter, width, height, rows);
+      assert_frame(filter, width, height);
+    }
+  }
+}
+
+static void test_unfiltered_matches_reference(void) { check_filter(RENDER_FILTER_NONE); }
+static void test_scale2x_matches_reference(void) { check_filter(RENDER_FILTER_SCALE2X); }
+static void test_scale3x_matches_reference(void) { check_filter(RENDER_FILTER_SCALE3X); }
+static void test_scanlines_match_reference(void) { check_filter(RENDER_FILTER_SCANLINES); }
+
+int main(void) {
+#ifdef RENDER_TEST_AVX2
+  if (!__builtin_cpu_supports("avx2")) {
+    printf("AVX2 kernels: skipped, the CPU has no AVX2\n");
+    return 0;
+  }
+#endif
+  UNITY_BEGIN();
+  RUN_TEST(test_unfiltered_matches_reference);
+  RUN_TEST(test_scale2x_matches_reference);
+  RUN_TEST(test_scale3x_matches_reference);
+  RUN_TEST(test_scanlines_match_reference);
+  return UNITY_END();
+}
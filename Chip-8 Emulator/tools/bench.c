@@ -0,0 +1,390 @@
+// chip8_bench: synthetic microbenchmarks for the core, one JSON report per run.
+//
+// Each ROM is generated in code and exercises one opcode class in a tight loop
+// (plus a mixed "macro" ROM shaped like a game frame). Every ROM runs for a
+// fixed number of cycles through chip8_step() and through chip8_run_cycles()
+// on every available engine; the best of --reps runs is reported. With --perf
+// (Linux) user-space hardware counters are read around each timed run.
+//
+// The final machine state of every engine is compared with chip8_step(), so a
+// bench run doubles as a smoke test: the exit status is 1 on any mismatch.
+#define _DEFAULT_SOURCE
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include "headless.h"
+
+#define ROM_BASE 0x200
+#define ROM_MAX (4096 - ROM_BASE)
+
+typedef struct RomBuf {
+  uint8_t bytes[ROM_MAX];
+  size_t size;
+} RomBuf;
+
+static void emit(RomBuf* r, uint16_t op) {
+  r->bytes[r->size++] = (uint8_t)(op >> 8);
+  r->bytes[r->size++] = (uint8_t)op;
+}
+
+static uint16_t here(const RomBuf* r) { return (uint16_t)(ROM_BASE + r->size); }
+
+// 8xyN arithmetic over rotating register pairs; VF is only ever a destination
+static void gen_alu(RomBuf* r) {
+  for (int x = 0; x < 15; ++x) emit(r, (uint16_t)(0x6000 | x << 8 | (x * 37 + 11)));
+  uint16_t loop = here(r);
+  static const uint8_t ops[] = { 0x0, 0x1, 0x2, 0x3, 0x4, 0x5, 0x6, 0x7, 0xE };
+  for (int i = 0; i < 144; ++i) {
+    int x = i % 15, y = (i * 7 + 3) % 15;
+    emit(r, (uint16_t)(0x8000 | x << 8 | y << 4 | ops[i % 9]));
+    if (i % 9 == 8) emit(r, (uint16_t)(0x7000 | x << 8 | 0x5B));
+  }
+  emit(r, (uint16_t)(0x1000 | loop));
+}
+
+// 3xkk/4xkk/5xy0/9xy0 on counter bits, so outcomes follow short periodic patterns
+static void gen_branch(RomBuf* r) {
+  emit(r, 0x6201); // V2 = 1
+  emit(r, 0x6302); // V3 = 2
+  emit(r, 0x6600); // V6 = 0
+  uint16_t loop = here(r);
+  emit(r, 0x7001); // V0 += 1
+  for (int i = 0; i < 16; ++i) {
+    emit(r, 0x8100);                            // V1 = V0
+    emit(r, i & 1 ? 0x8132 : 0x8122);           // V1 &= V3 or V2
+    emit(r, (uint16_t)(0x8810 | (i & 3) << 8)); // V8..VB = V1
+    switch (i % 4) {
+      case 0: emit(r, 0x3100); break;  // SE V1, 0
+      case 1: emit(r, 0x4100); break;  // SNE V1, 0
+      case 2: emit(r, 0x5160); break;  // SE V1, V6
+      default: emit(r, 0x9160); break; // SNE V1, V6
+    }
+    emit(r, 0x7501); // skipped or not
+  }
+  emit(r, (uint16_t)(0x1000 | loop));
+}
+
+// Four calls per loop, each three subroutines deep
+static void gen_call(RomBuf* r) {
+  uint16_t loop = here(r);
+  uint16_t sub_a = (uint16_t)(loop + 5 * 2);
+  for (int i = 0; i < 4; ++i) emit(r, (uint16_t)(0x2000 | sub_a));
+  emit(r, (uint16_t)(0x1000 | loop));
+  uint16_t sub_b = (uint16_t)(sub_a + 3 * 2), sub_c = (uint16_t)(sub_b + 3 * 2);
+  emit(r, 0x7001); emit(r, (uint16_t)(0x2000 | sub_b)); emit(r, 0x00EE);
+  emit(r, 0x7101); emit(r, (uint16_t)(0x2000 | sub_c)); emit(r, 0x00EE);
+  emit(r, 0x7201); emit(r, 0x00EE);
+}
+
+// Dxyn with moving, wrapping positions; the screen is cleared every 16 draws
+static void gen_draw(RomBuf* r) {
+  uint16_t loop = here(r);
+  emit(r, 0x00E0);
+  for (int i = 0; i < 16; ++i) {
+    emit(r, (uint16_t)(0xF229));   // I = font digit V2
+    emit(r, 0xD015);               // DRW V0, V1, 5
+    emit(r, 0x7005);               // V0 += 5
+    emit(r, 0x7103);               // V1 += 3
+    emit(r, i & 1 ? 0xD10F : 0xD018); // taller sprites from the same I
+    emit(r, 0x7201);
+  }
+  emit(r, (uint16_t)(0x1000 | loop));
+}
+
+// Fx55/Fx65 of varying width plus Fx33 into a scratch area
+static void gen_mem(RomBuf* r) {
+  uint16_t loop = here(r);
+  for (int i = 0; i < 16; ++i) {
+    uint16_t addr = (uint16_t)(0x800 + i * 16);
+    emit(r, (uint16_t)(0xA000 | addr));
+    emit(r, (uint16_t)(0xF055 | (i & 0xF) << 8)); // store V0..Vi
+    emit(r, (uint16_t)(0xA000 | addr));
+    emit(r, (uint16_t)(0xF065 | (15 - i) << 8));  // load V0..V(15-i)
+    emit(r, (uint16_t)(0xF033 | (i & 7) << 8));   // BCD
+    emit(r, 0x7007);
+  }
+  emit(r, (uint16_t)(0x1000 | loop));
+}
+
+// Game-like frame: timer poll, random, key test, arithmetic, bounds checks and
+// an erase/redraw subroutine
+static void gen_mix(RomBuf* r) {
+  emit(r, 0x6A08); // VA = 8 (speed)
+  uint16_t loop = here(r);
+  uint16_t sub = (uint16_t)(loop + 22 * 2);
+  emit(r, 0xF307);                            // V3 = DT
+  emit(r, 0x3300);                            // SE V3, 0
+  emit(r, 0x7401);                            //   V4 += 1 (timer still running)
+  emit(r, 0xF515);                            // DT = V5
+  emit(r, 0xC70F);                            // V7 = rnd & 0F
+  emit(r, 0x6B05);                            // VB = 5
+  emit(r, 0xEBA1);                            // SKNP VB
+  emit(r, 0x7801);                            //   V8 += 1 (key up)
+  emit(r, (uint16_t)(0x2000 | sub));          // erase
+  emit(r, 0x8074);                            // V0 += V7
+  emit(r, 0x81A4);                            // V1 += VA
+  emit(r, 0x4F00);                            // SNE VF, 0
+  emit(r, 0x6A01);                            //   VA = 1 on carry
+  emit(r, 0x823E);                            // V2 = V3 << 1
+  emit(r, 0x9120);                            // SNE V1, V2
+  emit(r, 0x7901);
+  emit(r, (uint16_t)(0x2000 | sub));          // redraw
+  emit(r, 0xA900);                            // I = 900
+  emit(r, 0xF133);                            // BCD V1
+  emit(r, 0xF265);                            // load V0..V2
+  emit(r, 0x7501);
+  emit(r, (uint16_t)(0x1000 | loop));
+  emit(r, 0xF029);                            // sub: I = font V0
+  emit(r, 0xD125);                            // DRW V1, V2, 5
+  emit(r, 0x00EE);
+}
+
+typedef struct Bench {
+  const char* name;
+  void (*gen)(RomBuf*);
+} Bench;
+
+static const Bench benches[] = {
+  { "alu", gen_alu },   { "branch", gen_branch }, { "call", gen_call },
+  { "draw", gen_draw }, { "mem", gen_mem },       { "mix", gen_mix },
+};
+
+typedef struct EngineRun {
+  const char* name;
+  Chip8Engine engine;
+  bool via_step; // chip8_step() loop instead of chip8_run_cycles()
+} EngineRun;
+
+static const EngineRun engines[] = {
+  { "step", CHIP8_ENGINE_SWITCH, true },
+  { "switch", CHIP8_ENGINE_SWITCH, false },
+  { "cached", CHIP8_ENGINE_CACHED, false },
+  { "jit", CHIP8_ENGINE_JIT, false },
+};
+
+#define BENCH_SEED 0x2545F491u
+
+static double now_seconds(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+// Hardware counters: instructions, branch misses, cache misses (user space only)
+#define COUNTERS 3
+
+typedef struct Counters {
+  int fd[COUNTERS];
+  uint64_t value[COUNTERS];
+  bool ok;
+} Counters;
+
+static void counters_open(Counters* c) {
+  c->ok = false;
+  for (int i = 0; i < COUNTERS; ++i) c->fd[i] = -1;
+#ifdef __linux__
+  static const uint64_t configs[COUNTERS] = {
+    PERF_COUNT_HW_INSTRUCTIONS, PERF_COUNT_HW_BRANCH_MISSES, PERF_COUNT_HW_CACHE_MISSES,
+  };
+  for (int i = 0; i < COUNTERS; ++i) {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = configs[i];
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    c->fd[i] = (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+    if (c->fd[i] < 0) return;
+  }
+  c->ok = true;
+#endif
+}
+
+static void counters_close(Counters* c) {
+#ifdef __linux__
+  for (int i = 0; i < COUNTERS; ++i) if (c->fd[i] >= 0) close(c->fd[i]);
+#endif
+  c->ok = false;
+}
+
+static void counters_start(Counters* c) {
+#ifdef __linux__
+  for (int i = 0; c->ok && i < COUNTERS; ++i) {
+    ioctl(c->fd[i], PERF_EVENT_IOC_RESET, 0);
+    ioctl(c->fd[i], PERF_EVENT_IOC_ENABLE, 0);
+  }
+#else
+  (void)c;
+#endif
+}
+
+static void counters_stop(Counters* c) {
+#ifdef __linux__
+  for (int i = 0; c->ok && i < COUNTERS; ++i) {
+    ioctl(c->fd[i], PERF_EVENT_IOC_DISABLE, 0);
+    if (read(c->fd[i], &c->value[i], sizeof(uint64_t)) != (ssize_t)sizeof(uint64_t)) c->ok = false;
+  }
+#else
+  (void)c;
+#endif
+}
+
+static void run_engine(Chip8* c8, const EngineRun* e, uint64_t cycles) {
+  if (e->via_step) {
+    for (uint64_t i = 0; i < cycles; ++i) chip8_step(c8);
+    return;
+  }
+  while (cycles > 0) {
+    uint32_t budget = cycles > UINT32_MAX ? UINT32_MAX : (uint32_t)cycles;
+    uint32_t ran = chip8_run_cycles(c8, budget, NULL);
+    if (ran == 0) break; // stalled in Fx0A; none of the ROMs wait for keys
+    cycles -= ran;
+  }
+}
+
+typedef struct Result {
+  double seconds; // best of the reps
+  uint64_t counters[COUNTERS];
+  bool have_counters;
+  Chip8Snapshot snap;
+} Result;
+
+// Returns false if the engine is unavailable in this build
+static bool measure(const RomBuf* rom, const EngineRun* e, uint64_t cycles, int reps, bool perf, Result* out) {
+  uint32_t seed = BENCH_SEED;
+  Chip8* c8 = chip8_create(headless_xorshift, &seed);
+  if (!c8) return false;
+  if (!chip8_set_engine(c8, e->engine)) { chip8_destroy(c8); return false; }
+
+  Counters ctr;
+  if (perf) counters_open(&ctr);
+  out->seconds = 0;
+  out->have_counters = false;
+  for (int rep = -1; rep < reps; ++rep) {
+    // rep -1 is an untimed warm-up (caches, JIT translation, page faults)
+    seed = BENCH_SEED;
+    chip8_reset(c8);
+    chip8_load_rom(c8, rom->bytes, rom->size);
+    uint64_t n = rep < 0 ? cycles / 10 + 1 : cycles;
+    if (perf) counters_start(&ctr);
+    double t0 = now_seconds();
+    run_engine(c8, e, n);
+    double t = now_seconds() - t0;
+    if (perf) counters_stop(&ctr);
+    if (rep < 0) continue;
+    if (rep == 0 || t < out->seconds) {
+      out->seconds = t;
+      if (perf && ctr.ok) {
+        memcpy(out->counters, ctr.value, sizeof(out->counters));
+        out->have_counters = true;
+      }
+    }
+  }
+  chip8_get_snapshot(c8, &out->snap);
+  if (perf) counters_close(&ctr);
+  chip8_destroy(c8);
+  return true;
+}
+
+static void reference_state(const RomBuf* rom, uint64_t cycles, Chip8Snapshot* out) {
+  uint32_t seed = BENCH_SEED;
+  Chip8* c8 = chip8_create(headless_xorshift, &seed);
+  chip8_load_rom(c8, rom->bytes, rom->size);
+  for (uint64_t i = 0; i < cycles; ++i) chip8_step(c8);
+  chip8_get_snapshot(c8, out);
+  chip8_destroy(c8);
+}
+
+static bool same_state(const Chip8Snapshot* a, const Chip8Snapshot* b) {
+  return a->pc == b->pc && a->I == b->I && memcmp(a->V, b->V, sizeof(a->V)) == 0 && a->sp == b->sp &&
+         a->delay_timer == b->delay_timer && a->sound_timer == b->sound_timer &&
+         a->stack_top == b->stack_top && a->display_hash == b->display_hash;
+}
+
+static void print_usage(const char* prog) {
+  fprintf(stderr, "Usage: %s [--cycles N] [--reps N] [--rom alu|branch|call|draw|mem|mix] "
+                  "[--engine step|switch|cached|jit] [--perf]\n", prog);
+}
+
+int main(int argc, char** argv) {
+  uint64_t cycles = 20000000;
+  int reps = 3;
+  const char* only_rom = NULL;
+  const char* only_engine = NULL;
+  bool perf = false;
+  for (int i = 1; i < argc; ++i) {
+    if (strcmp(argv[i], "--cycles") == 0 && i + 1 < argc) { cycles = strtoull(argv[++i], NULL, 0); }
+    else if (strcmp(argv[i], "--reps") == 0 && i + 1 < argc) { reps = atoi(argv[++i]); }
+    else if (strcmp(argv[i], "--rom") == 0 && i + 1 < argc) { only_rom = argv[++i]; }
+    else if (strcmp(argv[i], "--engine") == 0 && i + 1 < argc) { only_engine = argv[++i]; }
+    else if (strcmp(argv[i], "--perf") == 0) { perf = true; }
+    else {
+      fprintf(stderr, "Unknown option: %s\n", argv[i]);
+      print_usage(argv[0]);
+      return 1;
+    }
+  }
+  if (cycles == 0) cycles = 1;
+  if (reps < 1) reps = 1;
+
+  if (perf) {
+    Counters probe;
+    counters_open(&probe);
+    if (!probe.ok) fprintf(stderr, "perf_event_open unavailable, counters reported as null\n");
+    perf = probe.ok;
+    counters_close(&probe);
+  }
+
+  printf("{\n  \"core_version\": \"%s\",\n  \"cycles\": %llu,\n  \"reps\": %d,\n  \"results\": [",
+         chip8_core_version(), (unsigned long long)cycles, reps);
+  bool first = true, all_match = true;
+  for (size_t b = 0; b < sizeof(benches) / sizeof(benches[0]); ++b) {
+    if (only_rom && strcmp(only_rom, benches[b].name) != 0) continue;
+    RomBuf rom = { { 0 }, 0 };
+    benches[b].gen(&rom);
+
+    // chip8_step() is the reference for every engine's final state
+    Chip8Snapshot ref;
+    reference_state(&rom, cycles, &ref);
+    for (size_t e = 0; e < sizeof(engines) / sizeof(engines[0]); ++e) {
+      if (only_engine && strcmp(only_engine, engines[e].name) != 0) continue;
+      Result res;
+      if (!measure(&rom, &engines[e], cycles, reps, perf, &res)) {
+        fprintf(stderr, "%s: engine %s unavailable, skipped\n", benches[b].name, engines[e].name);
+        continue;
+      }
+      bool match = same_state(&ref, &res.snap);
+      all_match &= match;
+      double secs = res.seconds > 0 ? res.seconds : 1e-9;
+      printf("%s\n    {\"rom\": \"%s\", \"engine\": \"%s\", \"rom_bytes\": %zu, \"seconds\": %.6f, "
+             "\"cycles_per_sec\": %.0f, \"ns_per_op\": %.3f, \"matches_step\": %s, \"counters\": ",
+             first ? "" : ",", benches[b].name, engines[e].name, rom.size, res.seconds,
+             (double)cycles / secs, secs * 1e9 / (double)cycles, match ? "true" : "false");
+      if (res.have_counters) {
+        printf("{\"instructions\": %llu, \"branch_misses\": %llu, \"cache_misses\": %llu, "
+               "\"instructions_per_op\": %.2f}}",
+               (unsigned long long)res.counters[0], (unsigned long long)res.counters[1],
+               (unsigned long long)res.counters[2], (double)res.counters[0] / (double)cycles);
+      } else {
+        printf("null}");
+      }
+      first = false;
+    }
+  }
+  printf("\n  ]\n}\n");
+  return all_match ? 0 : 1;
+}
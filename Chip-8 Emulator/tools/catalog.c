@@ -0,0 +1,490 @@
+#define _DEFAULT_SOURCE
+
+#include "catalog.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+// Index file, little-endian:
+//   magic "C8CT", u16 version, u16 record size, u32 record count,
+//   u32 string table size, u32 FNV-1a checksum of everything after the
+//   header, u32 0
+//   records, strictly ascending by hash:
+//     u64 hash, u64 mtime, u32 size, u32 path offset, u32 hz, u8 machine,
+//     u8 quirks, u8[2] 0, char[16] keymap
+//   string table: the NUL-terminated paths
+#define CATALOG_VERSION 1
+#define HEADER_SIZE 24
+#define RECORD_SIZE 48
+#define ROM_MAX_SIZE (65536 - 0x200) // XO-CHIP memory above the interpreter area
+#define SCAN_MAX_DEPTH 16
+
+struct Catalog {
+  CatalogMap file;        // the index as opened; records and strings point into it until an edit
+  const uint8_t* records; // count * RECORD_SIZE bytes
+  const char* strings;
+  uint32_t count, strings_size;
+  uint8_t* heap;          // records then strings, after a scan or an edit
+};
+
+static void put16(uint8_t* p, uint16_t v) { p[0] = (uint8_t)v; p[1] = (uint8_t)(v >> 8); }
+static void put32(uint8_t* p, uint32_t v) { for (int i = 0; i < 4; ++i) p[i] = (uint8_t)(v >> 8 * i); }
+static void put64(uint8_t* p, uint64_t v) { for (int i = 0; i < 8; ++i) p[i] = (uint8_t)(v >> 8 * i); }
+static uint16_t get16(const uint8_t* p) { return (uint16_t)(p[0] | p[1] << 8); }
+static uint32_t get32(const uint8_t* p) {
+  return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+static uint64_t get64(const uint8_t* p) { return (uint64_t)get32(p) | (uint64_t)get32(p + 4) << 32; }
+
+static uint32_t fnv1a32(const uint8_t* p, size_t len) {
+  uint32_t h = 2166136261u;
+  for (size_t i = 0; i < len; ++i) { h ^= p[i]; h *= 16777619u; }
+  return h;
+}
+
+uint64_t catalog_hash(const uint8_t* data, size_t size) {
+  uint64_t h = 0xCBF29CE484222325ull;
+  for (size_t i = 0; i < size; ++i) { h ^= data[i]; h *= 0x100000001B3ull; }
+  return h;
+}
+
+bool catalog_map_file(const char* path, CatalogMap* out) {
+  memset(out, 0, sizeof(*out));
+#if defined(_WIN32)
+  FILE* f = fopen(path, "rb");
+  if (!f) return false;
+  fseek(f, 0, SEEK_END);
+  long sz = ftell(f);
+  fseek(f, 0, SEEK_SET);
+  uint8_t* buf = sz > 0 ? (uint8_t*)malloc((size_t)sz) : NULL;
+  bool ok = buf && fread(buf, 1, (size_t)sz, f) == (size_t)sz;
+  fclose(f);
+  if (!ok) { free(buf); return false; }
+  out->data = buf;
+  out->size = (size_t)sz;
+  return true;
+#else
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) return false;
+  struct stat st;
+  if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size <= 0) { close(fd); return false; }
+  void* p = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd); // the mapping keeps the file
+  if (p == MAP_FAILED) return false;
+  out->data = (const uint8_t*)p;
+  out->size = (size_t)st.st_size;
+  out->mapped = true;
+  return true;
+#endif
+}
+
+void catalog_unmap(CatalogMap* map) {
+  if (!map || !map->data) return;
+#if !defined(_WIN32)
+  if (map->mapped) munmap((void*)map->data, map->size);
+  else
+#endif
+    free((void*)map->data);
+  memset(map, 0, sizeof(*map));
+}
+
+// Point c at a serialized index once all of it checks out
+static bool attach(Catalog* c, const uint8_t* p, size_t size) {
+  if (size < HEADER_SIZE || memcmp(p, "C8CT", 4) != 0) return false;
+  if (get16(p + 4) != CATALOG_VERSION || get16(p + 6) != RECORD_SIZE || get32(p + 20) != 0) return false;
+  uint32_t count = get32(p + 8), strings_size = get32(p + 12);
+  if (HEADER_SIZE + (uint64_t)count * RECORD_SIZE + strings_size != size) return false;
+  if (fnv1a32(p + HEADER_SIZE, size - HEADER_SIZE) != get32(p + 16)) return false;
+  const uint8_t* records = p + HEADER_SIZE;
+  const char* strings = (const char*)(records + (size_t)count * RECORD_SIZE);
+  if (count && (!strings_size || strings[strings_size - 1] != '\0')) return false;
+  for (uint32_t i = 0; i < count; ++i) {
+    const uint8_t* r = records + (size_t)i * RECORD_SIZE;
+    if (get32(r + 20) >= strings_size || r[28] > CHIP8_MACHINE_XOCHIP || r[29] > CHIP8_QUIRKS_XOCHIP + 1) return false;
+    if (i && get64(r) <= get64(r - RECORD_SIZE)) return false;
+  }
+  c->records = records;
+  c->strings = strings;
+  c->count = count;
+  c->strings_size = strings_size;
+  return true;
+}
+
+Catalog* catalog_open(const char* path) {
+  Catalog* c = (Catalog*)calloc(1, sizeof(*c));
+  if (!c) return NULL;
+  if (!catalog_map_file(path, &c->file) || !attach(c, c->file.data, c->file.size)) {
+    catalog_close(c);
+    return NULL;
+  }
+  return c;
+}
+
+void catalog_close(Catalog* c) {
+  if (!c) return;
+  catalog_unmap(&c->file);
+  free(c->heap);
+  free(c);
+}
+
+uint32_t catalog_count(const Catalog* c) { return c ? c->count : 0; }
+
+static void decode(const Catalog* c, uint32_t index, CatalogEntry* out) {
+  const uint8_t* r = c->records + (size_t)index * RECORD_SIZE;
+  out->hash = get64(r);
+  out->mtime = get64(r + 8);
+  out->size = get32(r + 16);
+  out->path = c->strings + get32(r + 20);
+  out->hz = get32(r + 24);
+  out->machine = r[28];
+  out->quirks = r[29];
+  memcpy(out->keymap, r + 32, sizeof(out->keymap));
+}
+
+bool catalog_get(const Catalog* c, uint32_t index, CatalogEntry* out) {
+  if (!c || index >= c->count) return false;
+  decode(c, index, out);
+  return true;
+}
+
+// Index of the record with this hash, or c->count
+static uint32_t find_index(const Catalog* c, uint64_t hash) {
+  uint32_t lo = 0, hi = c->count;
+  while (lo < hi) {
+    uint32_t mid = lo + (hi - lo) / 2;
+    uint64_t h = get64(c->records + (size_t)mid * RECORD_SIZE);
+    if (h == hash) return mid;
+    if (h < hash) lo = mid + 1;
+    else hi = mid;
+  }
+  return c->count;
+}
+
+bool catalog_find(const Catalog* c, uint64_t hash, CatalogEntry* out) {
+  if (!c) return false;
+  uint32_t i = find_index(c, hash);
+  if (i == c->count) return false;
+  decode(c, i, out);
+  return true;
+}
+
+static void encode_settings(uint8_t* r, const CatalogEntry* e) {
+  put32(r + 24, e->hz);
+  r[28] = e->machine;
+  r[29] = e->quirks;
+  memcpy(r + 32, e->keymap, sizeof(e->keymap));
+}
+
+bool catalog_set(Catalog* c, const CatalogEntry* settings) {
+  if (!c || settings->machine > CHIP8_MACHINE_XOCHIP || settings->quirks > CHIP8_QUIRKS_XOCHIP + 1) return false;
+  uint32_t i = find_index(c, settings->hash);
+  if (i == c->count) return false;
+  if (!c->heap) { // copy the mapped index before the first edit
+    size_t records = (size_t)c->count * RECORD_SIZE;
+    uint8_t* heap = (uint8_t*)malloc(records + c->strings_size);
+    if (!heap) return false;
+    memcpy(heap, c->records, records);
+    memcpy(heap + records, c->strings, c->strings_size);
+    c->heap = heap;
+    c->records = heap;
+    c->strings = (const char*)heap + records;
+    catalog_unmap(&c->file);
+  }
+  encode_settings(c->heap + (size_t)i * RECORD_SIZE, settings);
+  return true;
+}
+
+bool catalog_save(const Catalog* c, const char* path) {
+  size_t records = (size_t)c->count * RECORD_SIZE, size = HEADER_SIZE + records + c->strings_size;
+  uint8_t* buf = (uint8_t*)malloc(size);
+  size_t tmp_len = strlen(path) + 5;
+  char* tmp = (char*)malloc(tmp_len);
+  bool ok = buf && tmp;
+  if (ok) {
+    memcpy(buf, "C8CT", 4);
+    put16(buf + 4, CATALOG_VERSION);
+    put16(buf + 6, RECORD_SIZE);
+    put32(buf + 8, c->count);
+    put32(buf + 12, c->strings_size);
+    put32(buf + 20, 0);
+    if (records) memcpy(buf + HEADER_SIZE, c->records, records);
+    if (c->strings_size) memcpy(buf + HEADER_SIZE + records, c->strings, c->strings_size);
+    put32(buf + 16, fnv1a32(buf + HEADER_SIZE, size - HEADER_SIZE));
+
+    // Write beside the index and rename over it, so readers never see half a file
+    snprintf(tmp, tmp_len, "%s.tmp", path);
+    FILE* f = fopen(tmp, "wb");
+    ok = f && fwrite(buf, 1, size, f) == size;
+    if (f && fclose(f) != 0) ok = false;
+#if defined(_WIN32)
+    if (ok) remove(path);
+#endif
+    if (ok) ok = rename(tmp, path) == 0;
+    if (!ok) remove(tmp);
+  }
+  free(tmp);
+  free(buf);
+  return ok;
+}
+
+// Scanning
+
+typedef struct ScanItem {
+  CatalogEntry e;
+  char* path; // owned
+} ScanItem;
+
+typedef struct PathIndex {
+  const char* path;
+  uint32_t index;
+} PathIndex;
+
+typedef struct Scan {
+  ScanItem* items;
+  size_t count, capacity;
+  const Catalog* prev;
+  PathIndex* prev_paths; // previous entries sorted by path
+  CatalogScanStats* stats;
+  bool failed;           // out of memory
+} Scan;
+
+static int cmp_path(const void* a, const void* b) {
+  return strcmp(((const PathIndex*)a)->path, ((const PathIndex*)b)->path);
+}
+
+static int cmp_item(const void* a, const void* b) {
+  const ScanItem* x = (const ScanItem*)a;
+  const ScanItem* y = (const ScanItem*)b;
+  if (x->e.hash != y->e.hash) return x->e.hash < y->e.hash ? -1 : 1;
+  return strcmp(x->path, y->path);
+}
+
+static bool rom_extension(const char* name) {
+  static const char* const exts[] = { ".ch8", ".c8", ".sc8", ".xo8", ".rom" };
+  const char* dot = strrchr(name, '.');
+  if (!dot) return false;
+  for (size_t i = 0; i < sizeof(exts) / sizeof(exts[0]); ++i) {
+    const char *a = dot, *b = exts[i];
+    while (*a && *b && (*a | 0x20) == *b) ++a, ++b; // ASCII case-insensitive
+    if (!*a && !*b) return true;
+  }
+  return false;
+}
+
+static uint8_t machine_for_extension(const char* path) {
+  const char* dot = strrchr(path, '.');
+  if (dot && rom_extension(dot) && (dot[1] | 0x20) == 's') return CHIP8_MACHINE_SCHIP;
+  if (dot && rom_extension(dot) && (dot[1] | 0x20) == 'x') return CHIP8_MACHINE_XOCHIP;
+  return CHIP8_MACHINE_CHIP8;
+}
+
+static void add_file(Scan* s, const char* path, uint64_t size, uint64_t mtime) {
+  s->stats->files++;
+  if (size == 0 || size > ROM_MAX_SIZE) { s->stats->skipped++; return; }
+
+  CatalogEntry e;
+  memset(&e, 0, sizeof(e));
+  PathIndex key = { path, 0 };
+  const PathIndex* old = s->prev_paths ? (const PathIndex*)bsearch(&key, s->prev_paths, s->prev->count,
+                                                                    sizeof(PathIndex), cmp_path)
+                                       : NULL;
+  if (old) decode(s->prev, old->index, &e);
+  if (old && e.size == size && e.mtime == mtime) {
+    s->stats->reused++;
+  } else {
+    CatalogMap m;
+    if (!catalog_map_file(path, &m)) { s->stats->skipped++; return; }
+    memset(&e, 0, sizeof(e));
+    e.hash = catalog_hash(m.data, m.size);
+    catalog_unmap(&m);
+    s->stats->hashed++;
+    CatalogEntry known;
+    if (catalog_find(s->prev, e.hash, &known)) e = known; // moved or touched: keep its settings
+    else e.machine = machine_for_extension(path);
+    e.size = (uint32_t)size;
+    e.mtime = mtime;
+  }
+
+  if (s->count == s->capacity) {
+    size_t capacity = s->capacity ? s->capacity * 2 : 256;
+    ScanItem* items = (ScanItem*)realloc(s->items, capacity * sizeof(ScanItem));
+    if (!items) { s->failed = true; return; }
+    s->items = items;
+    s->capacity = capacity;
+  }
+  char* copy = (char*)malloc(strlen(path) + 1);
+  if (!copy) { s->failed = true; return; }
+  strcpy(copy, path);
+  s->items[s->count++] = (ScanItem){ e, copy };
+}
+
+static char* join_path(const char* dir, const char* name) {
+  size_t n = strlen(dir), m = strlen(name);
+  char* p = (char*)malloc(n + m + 2);
+  if (!p) return NULL;
+  memcpy(p, dir, n);
+  size_t at = n;
+  if (n && dir[n - 1] != '/' && dir[n - 1] != '\\') p[at++] = '/';
+  memcpy(p + at, name, m + 1);
+  return p;
+}
+
+// Every ROM file under dir; hidden entries are skipped
+static bool walk(Scan* s, const char* dir, int depth) {
+#if defined(_WIN32)
+  char* pattern = join_path(dir, "*");
+  if (!pattern) return false;
+  WIN32_FIND_DATAA fd;
+  HANDLE h = FindFirstFileA(pattern, &fd);
+  free(pattern);
+  if (h == INVALID_HANDLE_VALUE) return false;
+  do {
+    if (fd.cFileName[0] == '.') continue;
+    char* path = join_path(dir, fd.cFileName);
+    if (!path) { s->failed = true; break; }
+    if (fd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) {
+      if (depth < SCAN_MAX_DEPTH) walk(s, path, depth + 1);
+    } else if (rom_extension(fd.cFileName)) {
+      uint64_t size = (uint64_t)fd.nFileSizeHigh << 32 | fd.nFileSizeLow;
+      uint64_t ft = (uint64_t)fd.ftLastWriteTime.dwHighDateTime << 32 | fd.ftLastWriteTime.dwLowDateTime;
+      add_file(s, path, size, ft / 10000000u - 11644473600ull); // 100 ns ticks since 1601
+    }
+    free(path);
+  } while (!s->failed && FindNextFileA(h, &fd));
+  FindClose(h);
+  return true;
+#else
+  DIR* d = opendir(dir);
+  if (!d) return false;
+  struct dirent* de;
+  while (!s->failed && (de = readdir(d)) != NULL) {
+    if (de->d_name[0] == '.') continue;
+    char* path = join_path(dir, de->d_name);
+    if (!path) { s->failed = true; break; }
+    struct stat st;
+    if (stat(path, &st) == 0) {
+      if (S_ISDIR(st.st_mode)) {
+        if (depth < SCAN_MAX_DEPTH) walk(s, path, depth + 1);
+      } else if (S_ISREG(st.st_mode) && rom_extension(de->d_name)) {
+        add_file(s, path, (uint64_t)st.st_size, (uint64_t)st.st_mtime);
+      }
+    }
+    free(path);
+  }
+  closedir(d);
+  return true;
+#endif
+}
+
+Catalog* catalog_scan(const char* dir, const Catalog* previous, CatalogScanStats* stats) {
+  CatalogScanStats local;
+  if (!stats) stats = &local;
+  memset(stats, 0, sizeof(*stats));
+  Scan s = { NULL, 0, 0, previous, NULL, stats, false };
+  Catalog* c = NULL;
+
+  if (previous && previous->count) {
+    s.prev_paths = (PathIndex*)malloc(previous->count * sizeof(PathIndex));
+    if (!s.prev_paths) goto done;
+    for (uint32_t i = 0; i < previous->count; ++i) {
+      s.prev_paths[i].path = previous->strings + get32(previous->records + (size_t)i * RECORD_SIZE + 20);
+      s.prev_paths[i].index = i;
+    }
+    qsort(s.prev_paths, previous->count, sizeof(PathIndex), cmp_path);
+  }
+  if (!walk(&s, dir, 0) || s.failed) goto done;
+
+  // Hash order; of several files with the same content the path sorting first stays
+  if (s.count) qsort(s.items, s.count, sizeof(ScanItem), cmp_item);
+  size_t kept = 0, strings_size = 0;
+  for (size_t i = 0; i < s.count; ++i) {
+    if (kept && s.items[kept - 1].e.hash == s.items[i].e.hash) {
+      stats->duplicates++;
+      free(s.items[i].path);
+      continue;
+    }
+    s.items[kept++] = s.items[i];
+    strings_size += strlen(s.items[i].path) + 1;
+  }
+  s.count = kept;
+  if (strings_size > UINT32_MAX || s.count > UINT32_MAX / RECORD_SIZE) goto done;
+
+  c = (Catalog*)calloc(1, sizeof(*c));
+  size_t records = s.count * RECORD_SIZE;
+  uint8_t* heap = c ? (uint8_t*)calloc(1, records + strings_size + 1) : NULL;
+  if (!heap) { free(c); c = NULL; goto done; }
+  c->heap = heap;
+  c->records = heap;
+  c->strings = (const char*)heap + records;
+  c->count = (uint32_t)s.count;
+  c->strings_size = (uint32_t)strings_size;
+  size_t at = 0;
+  for (size_t i = 0; i < s.count; ++i) {
+    const CatalogEntry* e = &s.items[i].e;
+    uint8_t* r = heap + i * RECORD_SIZE;
+    put64(r, e->hash);
+    put64(r + 8, e->mtime);
+    put32(r + 16, e->size);
+    put32(r + 20, (uint32_t)at);
+    encode_settings(r, e);
+    size_t len = strlen(s.items[i].path) + 1;
+    memcpy(heap + records + at, s.items[i].path, len);
+    at += len;
+  }
+  for (uint32_t i = 0; previous && i < previous->count; ++i) {
+    if (find_index(c, get64(previous->records + (size_t)i * RECORD_SIZE)) == c->count) stats->removed++;
+  }
+
+done:
+  for (size_t i = 0; i < s.count; ++i) free(s.items[i].path);
+  free(s.items);
+  free(s.prev_paths);
+  return c;
+}
+
+// Names
+
+static const char* const machine_names[] = { "chip8", "schip", "xochip" };
+static const char* const quirks_names[] = { "auto", "default", "vip", "chip48", "schip", "xochip" };
+
+const char* catalog_machine_name(uint8_t machine) {
+  return machine < sizeof(machine_names) / sizeof(machine_names[0]) ? machine_names[machine] : "?";
+}
+
+const char* catalog_quirks_name(uint8_t quirks) {
+  return quirks < sizeof(quirks_names) / sizeof(quirks_names[0]) ? quirks_names[quirks] : "?";
+}
+
+bool catalog_parse_machine(const char* name, uint8_t* out) {
+  for (uint8_t i = 0; i < sizeof(machine_names) / sizeof(machine_names[0]); ++i) {
+    if (strcmp(name, machine_names[i]) == 0) { *out = i; return true; }
+  }
+  return false;
+}
+
+bool catalog_parse_quirks(const char* name, uint8_t* out) {
+  for (uint8_t i = 0; i < sizeof(quirks_names) / sizeof(quirks_names[0]); ++i) {
+    if (strcmp(name, quirks_names[i]) == 0) { *out = i; return true; }
+  }
+  return false;
+}
+
+char catalog_keymap_clash(const char keymap[16]) {
+  if (!keymap[0]) return 0;
+  for (int i = 0; i < 16; ++i) {
+    unsigned char k = (unsigned char)keymap[i];
+    if (k < 0x20 || k == 0x7F || (k | 0x20) == 'p' || (k | 0x20) == 'n') return keymap[i];
+  }
+  return 0;
+}
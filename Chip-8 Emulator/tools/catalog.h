@@ -0,0 +1,95 @@
+#ifndef CHIP8_CATALOG_H
+#define CHIP8_CATALOG_H
+
+// ROM catalog: an on-disk index of a ROM directory keyed by content hash,
+// with the settings each ROM needs (machine, quirk profile, CPU clock, key
+// layout). The index is a sorted array of fixed-size little-endian records
+// plus a string table of paths. Opening maps it read-only and checks it, so
+// listing or looking up a ROM never touches the ROMs themselves. Rescans only
+// read files whose size or modification time changed, and keep the settings
+// of every ROM whose content is still present.
+//
+// ROMs are mapped with mmap (read into memory on Windows). Shared by the SDL
+// front-end and chip8_roms; nothing here touches SDL.
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "chip8.h"
+
+#define CATALOG_KEYMAP_DEFAULT "x123qweasdzc4rfv" // host key for CHIP-8 keys 0-F
+
+// A read-only view of a whole file.
+typedef struct CatalogMap {
+  const uint8_t* data;
+  size_t size;
+  bool mapped; // false: data is a malloc'd copy
+} CatalogMap;
+
+// Map the file at path; false if it cannot be opened or is empty.
+bool catalog_map_file(const char* path, CatalogMap* out);
+void catalog_unmap(CatalogMap* map);
+
+// 64-bit FNV-1a of a ROM image, the catalog key
+uint64_t catalog_hash(const uint8_t* data, size_t size);
+
+typedef struct CatalogEntry {
+  uint64_t hash;    // catalog_hash() of the ROM
+  uint64_t mtime;   // modification time when scanned, seconds since the epoch
+  uint32_t size;    // bytes
+  uint32_t hz;      // CPU cycles per second, 0 = the front-end's default
+  uint8_t machine;  // Chip8Machine
+  uint8_t quirks;   // Chip8QuirkProfile + 1, 0 = the machine's own
+  char keymap[16];  // host key (ASCII) for each CHIP-8 key 0-F, all 0 = CATALOG_KEYMAP_DEFAULT
+  const char* path; // as scanned; valid while the catalog is unchanged
+} CatalogEntry;
+
+typedef struct Catalog Catalog; // Opaque state
+
+// Map an index file; NULL if it is missing, malformed or from an
+// unsupported version.
+Catalog* catalog_open(const char* path);
+void catalog_close(Catalog*);
+
+uint32_t catalog_count(const Catalog*);
+// Entries in hash order; false past the end.
+bool catalog_get(const Catalog*, uint32_t index, CatalogEntry* out);
+// Binary search by content hash.
+bool catalog_find(const Catalog*, uint64_t hash, CatalogEntry* out);
+
+typedef struct CatalogScanStats {
+  uint32_t files;      // ROM files found
+  uint32_t hashed;     // read and hashed: new or changed since the previous index
+  uint32_t reused;     // taken from the previous index without reading
+  uint32_t duplicates; // same content as another file (the path sorting first is kept)
+  uint32_t skipped;    // unreadable, empty or larger than CHIP8 memory allows
+  uint32_t removed;    // previous entries whose content is gone
+} CatalogScanStats;
+
+// Index the ROMs (.ch8, .c8, .sc8, .xo8, .rom) under dir and its
+// subdirectories. Entries of `previous` (may be NULL) are reused for files of
+// the same path, size and modification time, and settings carry over to any
+// file with a known hash. New .sc8 and .xo8 files get their machine. Returns
+// NULL if dir cannot be read.
+Catalog* catalog_scan(const char* dir, const Catalog* previous, CatalogScanStats* stats);
+
+// Replace the settings (hz, machine, quirks, keymap) of the entry with
+// settings->hash; false if there is none.
+bool catalog_set(Catalog*, const CatalogEntry* settings);
+
+// Write the index, replacing path atomically.
+bool catalog_save(const Catalog*, const char* path);
+
+// Names used on command lines and in listings
+const char* catalog_machine_name(uint8_t machine);
+const char* catalog_quirks_name(uint8_t quirks); // CatalogEntry.quirks; "auto" for 0
+bool catalog_parse_machine(const char* name, uint8_t* out);
+bool catalog_parse_quirks(const char* name, uint8_t* out);
+
+// The first key of a keymap that the SDL front-end keeps for itself (p, n,
+// or a control character such as Escape, Backspace or Tab, in either case),
+// or 0 if the keymap leaves all of them free. An all-0 keymap is free.
+char catalog_keymap_clash(const char keymap[16]);
+
+#endif // CHIP8_CATALOG_H
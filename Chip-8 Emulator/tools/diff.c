@@ -0,0 +1,417 @@
+// chip8_diff: run two execution engines in lockstep and find where they part.
+//
+//   chip8_diff ROM [--cycles N] [--inputs SCRIPT] [--seed S] [--hz N]
+//   chip8_diff [--random N] [--seconds S] [--rom-size N] [--cycles N] [--seed S]
+//   options:   [--a ENGINE] [--b ENGINE] [--every N] [--quirks PROFILE]
+//              [--fault CYCLE] [--dump PREFIX]
+//
+// Machine A (default the switch interpreter) and B (default the cached
+// engine) run the same ROM, RNG seed and input script (as for the farm) in
+// spans of --every cycles, after which their state hashes (chip8_state_hash),
+// RNGs and clocks are compared. At the start of each span the state of A is
+// cloned aside. When a span ends with different machines, both are rerun from
+// that clone, bisecting the span down to the first cycle after which they
+// differ. The instruction A ran there and both machines are printed, and
+// --dump PREFIX writes both as raw save states (PREFIX-a.state,
+// PREFIX-b.state) for chip8_load_state().
+//
+// Without a ROM, structured random ROMs of --rom-size bytes are generated
+// until --random ROMs or --seconds have run, each under the next quirk
+// profile (or --quirks). Fx0A waits are answered with a key press and
+// release; with a ROM they only end by --inputs. --fault presses key F on
+// machine B only at that cycle, to see a divergence found.
+//
+// Exits with 1 at the first divergence.
+#define _DEFAULT_SOURCE
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "disasm.h"
+#include "headless.h"
+
+#define DIFF_NO_FAULT UINT64_MAX
+
+static const char* const engine_names[] = { "switch", "cached", "jit" };
+static const char* const quirk_names[] = { "default", "vip", "chip48", "schip", "xochip" };
+
+// Everything outside the machine that decides its next state
+typedef struct Drive {
+  uint64_t clock;      // emulated cycles, executed or stalled in Fx0A
+  uint64_t ticks;      // 60 Hz ticks applied
+  size_t next_input;   // first script input not yet applied
+  uint32_t rng;        // xorshift state behind Cxkk
+  uint64_t fault;      // cycle of the injected key press, DIFF_NO_FAULT for none
+} Drive;
+
+typedef struct Session {
+  Chip8Engine engines[2];
+  const HeadlessInput* inputs;
+  size_t input_count;
+  bool answer_waits; // press and release a key in every Fx0A wait
+  uint32_t hz;
+  uint32_t every;
+  uint64_t fault;
+  const char* dump;
+  Chip8* m[2];
+  Drive d[2];
+  Chip8* start; // A at the start of the current span
+  Drive start_d;
+  Chip8* probe[2];
+  Drive probe_d[2];
+  uint64_t executed; // instructions run by A
+} Session;
+
+static double now_seconds(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+static void print_usage(const char* prog) {
+  fprintf(stderr,
+          "Usage: %s ROM [--cycles N] [--inputs SCRIPT] [--seed S] [--hz N]\n"
+          "       %s [--random N] [--seconds S] [--rom-size N] [--cycles N] [--seed S]\n"
+          "options: [--a switch|cached|jit] [--b switch|cached|jit] [--every N]\n"
+          "         [--quirks default|vip|chip48|schip|xochip] [--fault CYCLE] [--dump PREFIX]\n",
+          prog, prog);
+}
+
+// Advance c8 to cycle `until` the same way whatever the engine: ticks at
+// multiples of hz/60 cycles and inputs at their cycles, as headless_run().
+static void drive(Session* s, Chip8* c8, Drive* d, uint64_t until) {
+  while (d->clock < until) {
+    while (d->next_input < s->input_count && s->inputs[d->next_input].cycle <= d->clock) {
+      const HeadlessInput* in = &s->inputs[d->next_input++];
+      if (in->down) chip8_key_down(c8, in->key);
+      else chip8_key_up(c8, in->key);
+    }
+    if (d->fault == d->clock) {
+      chip8_key_down(c8, 0xF);
+      d->fault = DIFF_NO_FAULT;
+    }
+    uint64_t next_tick = (d->ticks + 1) * s->hz / 60;
+    if (next_tick <= d->clock) {
+      chip8_tick_60hz(c8);
+      ++d->ticks;
+      continue;
+    }
+
+    uint64_t stop = until < next_tick ? until : next_tick;
+    if (d->next_input < s->input_count && s->inputs[d->next_input].cycle < stop) {
+      stop = s->inputs[d->next_input].cycle;
+    }
+    if (d->fault > d->clock && d->fault < stop) stop = d->fault;
+    uint32_t budget = (uint32_t)(stop - d->clock);
+    Chip8RunResult r;
+    chip8_run_cycles(c8, budget, &r);
+    if (c8 == s->m[0]) s->executed += r.cycles;
+    if (r.reason == CHIP8_EXIT_KEY_WAIT) {
+      // Stalled cycles still pass
+      d->clock += budget;
+      if (s->answer_waits) {
+        chip8_key_down(c8, (uint8_t)(d->clock & 0xF));
+        chip8_key_up(c8, (uint8_t)(d->clock & 0xF));
+      }
+    } else {
+      d->clock += r.cycles ? r.cycles : budget;
+    }
+  }
+}
+
+static bool same(const Chip8* a, const Drive* da, const Chip8* b, const Drive* db) {
+  return da->clock == db->clock && da->ticks == db->ticks && da->next_input == db->next_input &&
+         da->rng == db->rng && chip8_state_hash(a) == chip8_state_hash(b);
+}
+
+// Rerun both engines from the span start for `cycles`; true if they differ
+static bool probe_differs(Session* s, uint64_t cycles) {
+  for (int i = 0; i < 2; ++i) {
+    chip8_clone(s->probe[i], s->start);
+    s->probe_d[i] = s->start_d;
+    s->probe_d[i].fault = i == 1 && s->fault >= s->start_d.clock ? s->fault : DIFF_NO_FAULT;
+    drive(s, s->probe[i], &s->probe_d[i], s->start_d.clock + cycles);
+  }
+  return !same(s->probe[0], &s->probe_d[0], s->probe[1], &s->probe_d[1]);
+}
+
+static void print_row(const char* name, unsigned a, unsigned b, int width) {
+  printf("  %-12s %0*X%*s %0*X%s\n", name, width, a, 8 - width, "", width, b, a != b ? "  <--" : "");
+}
+
+static void print_machines(const Session* s, Chip8* a, const Drive* da, Chip8* b, const Drive* db) {
+  Chip8Snapshot x, y;
+  chip8_get_snapshot(a, &x);
+  chip8_get_snapshot(b, &y);
+  printf("  %-12s %-9s%s\n", "", engine_names[s->engines[0]], engine_names[s->engines[1]]);
+  print_row("PC", x.pc, y.pc, 4);
+  print_row("I", x.I, y.I, 4);
+  for (int i = 0; i < 16; ++i) {
+    char name[4];
+    snprintf(name, sizeof(name), "V%X", i);
+    print_row(name, x.V[i], y.V[i], 2);
+  }
+  print_row("SP", x.sp, y.sp, 2);
+  print_row("stack top", x.stack_top, y.stack_top, 4);
+  print_row("DT", x.delay_timer, y.delay_timer, 2);
+  print_row("ST", x.sound_timer, y.sound_timer, 2);
+  print_row("display", x.display_hash, y.display_hash, 8);
+  print_row("RNG", da->rng, db->rng, 8);
+  uint64_t ha = chip8_state_hash(a), hb = chip8_state_hash(b);
+  printf("  %-12s %016llx %016llx%s\n", "state hash", (unsigned long long)ha, (unsigned long long)hb,
+         ha != hb ? "  <--" : "");
+  if (da->clock != db->clock || da->ticks != db->ticks) {
+    printf("  clock        %llu cycles, %llu ticks vs %llu cycles, %llu ticks\n", (unsigned long long)da->clock,
+           (unsigned long long)da->ticks, (unsigned long long)db->clock, (unsigned long long)db->ticks);
+  }
+
+  size_t na, nb, shown = 0, differ = 0;
+  const uint8_t* ma = chip8_memory(a, &na);
+  const uint8_t* mb = chip8_memory(b, &nb);
+  for (size_t addr = 0; addr < na && addr < nb; ++addr) {
+    if (ma[addr] == mb[addr]) continue;
+    if (shown < 16) {
+      printf("  mem[%03zX]     %02X       %02X  <--\n", addr, ma[addr], mb[addr]);
+      ++shown;
+    }
+    ++differ;
+  }
+  if (differ > shown) printf("  ... %zu bytes of memory differ\n", differ);
+  if (na != nb) printf("  memory sizes differ: %zu vs %zu\n", na, nb);
+  if (x.pc == y.pc && x.I == y.I && !memcmp(x.V, y.V, 16) && x.display_hash == y.display_hash && !differ &&
+      ha != hb) {
+    printf("  (the difference is in the keypad, stack, key or display wait, or machine registers)\n");
+  }
+}
+
+static void dump_states(const Session* s, Chip8* a, Chip8* b) {
+  static uint8_t buf[CHIP8_STATE_MAX_SIZE];
+  char path[1024];
+  Chip8* machines[2] = { a, b };
+  for (int i = 0; i < 2; ++i) {
+    size_t n = chip8_save_state(machines[i], buf, sizeof(buf), CHIP8_STATE_RAW);
+    snprintf(path, sizeof(path), "%s-%c.state", s->dump, 'a' + i);
+    if (n && headless_save_file(path, buf, n)) printf("Wrote %s\n", path);
+    else fprintf(stderr, "Failed to write %s\n", path);
+  }
+}
+
+// The span that just ended differs: find its first divergent cycle
+static void report(Session* s) {
+  uint64_t span = s->d[0].clock - s->start_d.clock;
+  printf("Divergence in cycles %llu-%llu (%s vs %s)\n", (unsigned long long)s->start_d.clock,
+         (unsigned long long)s->d[0].clock, engine_names[s->engines[0]], engine_names[s->engines[1]]);
+  if (!probe_differs(s, span)) {
+    // Same machines from the same start: how the run was cut into
+    // chip8_run_cycles() calls mattered
+    printf("Rerunning the span from its start does not diverge; the engines differ across call boundaries.\n");
+    print_machines(s, s->m[0], &s->d[0], s->m[1], &s->d[1]);
+    if (s->dump) dump_states(s, s->m[0], s->m[1]);
+    return;
+  }
+
+  uint64_t lo = 0, hi = span; // same after lo cycles, different after hi
+  while (hi - lo > 1) {
+    uint64_t mid = lo + (hi - lo) / 2;
+    if (probe_differs(s, mid)) hi = mid;
+    else lo = mid;
+  }
+  probe_differs(s, lo);
+  uint16_t pc = chip8_pc(s->probe[0]);
+  size_t size;
+  const uint8_t* mem = chip8_memory(s->probe[0], &size);
+  uint16_t opcode = (uint16_t)(mem[pc % size] << 8 | mem[(pc + 1u) % size]);
+  char text[64];
+  disasm_opcode(opcode, text, sizeof(text));
+  printf("First divergent cycle %llu: %03X  %04X  %s\n", (unsigned long long)(s->start_d.clock + lo), pc, opcode,
+         text);
+  probe_differs(s, hi);
+  print_machines(s, s->probe[0], &s->probe_d[0], s->probe[1], &s->probe_d[1]);
+  if (s->dump) dump_states(s, s->probe[0], s->probe[1]);
+}
+
+// Run one ROM on both machines; false at a divergence
+static bool run_rom(Session* s, const uint8_t* rom, size_t size, uint64_t cycles, uint32_t seed,
+                    const Chip8Quirks* quirks) {
+  for (int i = 0; i < 2; ++i) {
+    chip8_reset(s->m[i]);
+    chip8_set_quirks(s->m[i], quirks);
+    if (!chip8_load_rom(s->m[i], rom, size)) {
+      fprintf(stderr, "ROM too large (%zu bytes)\n", size);
+      return false;
+    }
+    s->d[i] = (Drive){ 0, 0, 0, seed ? seed : 1, i == 1 ? s->fault : DIFF_NO_FAULT };
+  }
+  chip8_set_quirks(s->start, quirks);
+  chip8_set_quirks(s->probe[0], quirks);
+  chip8_set_quirks(s->probe[1], quirks);
+  while (s->d[0].clock < cycles) {
+    chip8_clone(s->start, s->m[0]);
+    s->start_d = s->d[0];
+    uint64_t until = cycles - s->d[0].clock < s->every ? cycles : s->d[0].clock + s->every;
+    drive(s, s->m[0], &s->d[0], until);
+    drive(s, s->m[1], &s->d[1], until);
+    if (!same(s->m[0], &s->d[0], s->m[1], &s->d[1])) {
+      report(s);
+      return false;
+    }
+  }
+  return true;
+}
+
+// Random ROM whose jumps, calls and I loads stay inside it, biased to the
+// ALU, skips and memory instructions (as the engine tests generate)
+static void random_rom(uint8_t* rom, size_t size, uint32_t* rng) {
+  static const uint8_t families[16] = { 0x6, 0x7, 0x8, 0x8, 0x8, 0x3, 0x4, 0xA,
+                                        0xF, 0xF, 0x1, 0x2, 0xC, 0xD, 0x5, 0x0 };
+  static const uint8_t alu[9] = { 0x0, 0x1, 0x2, 0x3, 0x4, 0x5, 0x6, 0x7, 0xE };
+  static const uint8_t fx[10] = { 0x07, 0x15, 0x18, 0x1E, 0x29, 0x33, 0x55, 0x65, 0x65, 0x0A };
+  for (size_t i = 0; i + 1 < size; i += 2) {
+    uint16_t op = (uint16_t)(headless_xorshift(rng) << 8 | headless_xorshift(rng));
+    uint16_t target = (uint16_t)(0x200 + ((op * 7u) % size & ~1u));
+    switch (families[op >> 12]) {
+      case 0x0: op = (op & 1) ? 0x00EE : 0x00E0; break;
+      case 0x1: op = (uint16_t)(0x1000 | target); break;
+      case 0x2: op = (uint16_t)(0x2000 | target); break;
+      case 0x5: op = (uint16_t)(op & 0x0FF0) | ((op & 0x10) ? 0x9000 : 0x5000); break;
+      case 0x8: op = (uint16_t)(0x8000 | (op & 0x0FF0) | alu[(op & 0xF) % 9]); break;
+      case 0xA: op = (uint16_t)(0xA000 | target); break;
+      case 0xF: op = (uint16_t)(0xF000 | (op & 0x0F00) | fx[(op & 0xFF) % 10]); break;
+      default: op = (uint16_t)(families[op >> 12] << 12 | (op & 0x0FFF)); break;
+    }
+    rom[i] = (uint8_t)(op >> 8);
+    rom[i + 1] = (uint8_t)op;
+  }
+}
+
+static bool parse_engine(const char* v, Chip8Engine* out) {
+  for (int i = 0; i < 3; ++i) {
+    if (strcmp(v, engine_names[i]) == 0) {
+      *out = (Chip8Engine)i;
+      return true;
+    }
+  }
+  return false;
+}
+
+int main(int argc, char** argv) {
+  Session s;
+  memset(&s, 0, sizeof(s));
+  s.engines[0] = CHIP8_ENGINE_SWITCH;
+  s.engines[1] = CHIP8_ENGINE_CACHED;
+  s.hz = 700;
+  s.every = 1000;
+  s.fault = DIFF_NO_FAULT;
+  const char* rom_path = NULL;
+  const char* inputs_text = NULL;
+  uint64_t cycles = 0, random_roms = 0;
+  double seconds = 0;
+  size_t rom_size = 1024;
+  uint32_t seed = 1;
+  int quirks = -1;
+
+  for (int i = 1; i < argc; ++i) {
+    const char* v = i + 1 < argc ? argv[i + 1] : NULL;
+    if (argv[i][0] != '-') {
+      if (rom_path) { print_usage(argv[0]); return 1; }
+      rom_path = argv[i];
+      continue;
+    }
+    if (!v) { print_usage(argv[0]); return 1; }
+    ++i;
+    if (strcmp(argv[i - 1], "--cycles") == 0) cycles = strtoull(v, NULL, 0);
+    else if (strcmp(argv[i - 1], "--inputs") == 0) inputs_text = v;
+    else if (strcmp(argv[i - 1], "--seed") == 0) seed = (uint32_t)strtoul(v, NULL, 0);
+    else if (strcmp(argv[i - 1], "--hz") == 0) s.hz = (uint32_t)strtoul(v, NULL, 0);
+    else if (strcmp(argv[i - 1], "--random") == 0) random_roms = strtoull(v, NULL, 0);
+    else if (strcmp(argv[i - 1], "--seconds") == 0) seconds = strtod(v, NULL);
+    else if (strcmp(argv[i - 1], "--rom-size") == 0) rom_size = strtoul(v, NULL, 0);
+    else if (strcmp(argv[i - 1], "--every") == 0) s.every = (uint32_t)strtoul(v, NULL, 0);
+    else if (strcmp(argv[i - 1], "--fault") == 0) s.fault = strtoull(v, NULL, 0);
+    else if (strcmp(argv[i - 1], "--dump") == 0) s.dump = v;
+    else if (strcmp(argv[i - 1], "--a") == 0 || strcmp(argv[i - 1], "--b") == 0) {
+      if (!parse_engine(v, &s.engines[argv[i - 1][2] == 'b'])) { fprintf(stderr, "Unknown engine: %s\n", v); return 1; }
+    } else if (strcmp(argv[i - 1], "--quirks") == 0) {
+      for (int q = 0; q < 5; ++q) if (strcmp(v, quirk_names[q]) == 0) quirks = q;
+      if (quirks < 0) { fprintf(stderr, "Unknown quirk profile: %s\n", v); return 1; }
+    } else {
+      print_usage(argv[0]);
+      return 1;
+    }
+  }
+  if (!s.hz || !s.every || rom_size < 2 || rom_size > 4096 - 0x200) { print_usage(argv[0]); return 1; }
+  if (!rom_path && !random_roms && seconds <= 0) seconds = 5;
+  if (!cycles) cycles = rom_path ? 1000000 : 100000;
+
+  HeadlessInput* inputs = NULL;
+  if (inputs_text && !headless_parse_inputs(inputs_text, &inputs, &s.input_count)) {
+    fprintf(stderr, "Bad input script: %s\n", inputs_text);
+    return 1;
+  }
+  s.inputs = inputs;
+  s.answer_waits = !rom_path;
+
+  for (int i = 0; i < 2; ++i) {
+    s.m[i] = chip8_create(headless_xorshift, &s.d[i].rng);
+    s.probe[i] = chip8_create(headless_xorshift, &s.probe_d[i].rng);
+    if (!s.m[i] || !s.probe[i]) return 1;
+    if (!chip8_set_engine(s.m[i], s.engines[i]) || !chip8_set_engine(s.probe[i], s.engines[i])) {
+      fprintf(stderr, "The %s engine is not available in this build\n", engine_names[s.engines[i]]);
+      return 1;
+    }
+  }
+  s.start = chip8_create(NULL, NULL);
+  if (!s.start) return 1;
+
+  bool ok = true;
+  uint64_t roms = 0, compared = 0;
+  double t0 = now_seconds(), t = 0;
+  Chip8Quirks q;
+  if (rom_path) {
+    uint8_t* rom;
+    size_t size;
+    if (!headless_load_file(rom_path, &rom, &size)) {
+      fprintf(stderr, "Failed to read ROM: %s\n", rom_path);
+      return 1;
+    }
+    chip8_quirk_profile(quirks >= 0 ? (Chip8QuirkProfile)quirks : CHIP8_QUIRKS_DEFAULT, &q);
+    ok = run_rom(&s, rom, size, cycles, seed, &q);
+    compared = s.d[0].clock;
+    roms = 1;
+    free(rom);
+    t = now_seconds() - t0;
+  } else {
+    uint8_t* rom = malloc(rom_size);
+    if (!rom) return 1;
+    uint32_t rom_rng = seed;
+    while (ok && (random_roms ? roms < random_roms : t < seconds)) {
+      random_rom(rom, rom_size, &rom_rng);
+      chip8_quirk_profile(quirks >= 0 ? (Chip8QuirkProfile)quirks : (Chip8QuirkProfile)(roms % 5), &q);
+      uint32_t rom_seed = rom_rng;
+      ok = run_rom(&s, rom, rom_size, cycles, rom_seed, &q);
+      if (!ok) {
+        printf("Random ROM %llu (--seed %u), quirks %s, RNG seed %08X\n", (unsigned long long)roms, seed,
+               quirk_names[quirks >= 0 ? quirks : (int)(roms % 5)], rom_seed);
+      }
+      compared += s.d[0].clock;
+      ++roms;
+      t = now_seconds() - t0;
+    }
+    free(rom);
+  }
+
+  printf("%s: %llu ROM%s, %.1f M cycles (%.1f M instructions) compared every %u in %.2f s: %.1f M cycles/s\n",
+         ok ? "Identical" : "Diverged", (unsigned long long)roms, roms == 1 ? "" : "s", (double)compared * 1e-6,
+         (double)s.executed * 1e-6, s.every, t, t > 0 ? (double)compared / t * 1e-6 : 0.0);
+  free(inputs);
+  for (int i = 0; i < 2; ++i) {
+    chip8_destroy(s.m[i]);
+    chip8_destroy(s.probe[i]);
+  }
+  chip8_destroy(s.start);
+  return ok ? 0 : 1;
+}
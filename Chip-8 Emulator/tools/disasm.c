@@ -0,0 +1,80 @@
+#include "disasm.h"
+
+#include <stdio.h>
+
+#include "chip8_stats.h"
+
+// SUPER-CHIP additions in the SUPER-CHIP manual's mnemonics; XO-CHIP ones in kind
+static int disasm_ext(uint16_t opcode, char* out, size_t size) {
+  unsigned x = (opcode >> 8) & 0xF, y = (opcode >> 4) & 0xF, n = opcode & 0xF;
+  switch (opcode >> 12) {
+    case 0x0:
+      if ((opcode & 0xFFF0) == 0x00C0) return snprintf(out, size, "SCD %u", n);
+      if ((opcode & 0xFFF0) == 0x00D0) return snprintf(out, size, "SCU %u", n);
+      switch (opcode) {
+        case 0x00FB: return snprintf(out, size, "SCR");
+        case 0x00FC: return snprintf(out, size, "SCL");
+        case 0x00FD: return snprintf(out, size, "EXIT");
+        case 0x00FE: return snprintf(out, size, "LOW");
+        default: return snprintf(out, size, "HIGH");
+      }
+    case 0x5: return snprintf(out, size, n == 2 ? "SAVE V%X - V%X" : "LOAD V%X - V%X", x, y);
+    default:
+      switch (opcode & 0xFF) {
+        case 0x00: return snprintf(out, size, "LD I, LONG");
+        case 0x01: return snprintf(out, size, "PLANE %u", x);
+        case 0x02: return snprintf(out, size, "AUDIO");
+        case 0x30: return snprintf(out, size, "LD HF, V%X", x);
+        case 0x3A: return snprintf(out, size, "PITCH V%X", x);
+        case 0x75: return snprintf(out, size, "LD R, V%X", x);
+        default: return snprintf(out, size, "LD V%X, R", x);
+      }
+  }
+}
+
+size_t disasm_opcode(uint16_t opcode, char* out, size_t size) {
+  unsigned x = (opcode >> 8) & 0xF, y = (opcode >> 4) & 0xF, n = opcode & 0xF;
+  unsigned kk = opcode & 0xFF, nnn = opcode & 0xFFF;
+  int len;
+  switch (chip8_stats_classify(opcode)) {
+    case CHIP8_OP_SYS: len = snprintf(out, size, "SYS 0x%03X", nnn); break;
+    case CHIP8_OP_CLS: len = snprintf(out, size, "CLS"); break;
+    case CHIP8_OP_RET: len = snprintf(out, size, "RET"); break;
+    case CHIP8_OP_JP: len = snprintf(out, size, "JP 0x%03X", nnn); break;
+    case CHIP8_OP_CALL: len = snprintf(out, size, "CALL 0x%03X", nnn); break;
+    case CHIP8_OP_SE_B: len = snprintf(out, size, "SE V%X, 0x%02X", x, kk); break;
+    case CHIP8_OP_SNE_B: len = snprintf(out, size, "SNE V%X, 0x%02X", x, kk); break;
+    case CHIP8_OP_SE_R: len = snprintf(out, size, "SE V%X, V%X", x, y); break;
+    case CHIP8_OP_LD_B: len = snprintf(out, size, "LD V%X, 0x%02X", x, kk); break;
+    case CHIP8_OP_ADD_B: len = snprintf(out, size, "ADD V%X, 0x%02X", x, kk); break;
+    case CHIP8_OP_LD_R: len = snprintf(out, size, "LD V%X, V%X", x, y); break;
+    case CHIP8_OP_OR: len = snprintf(out, size, "OR V%X, V%X", x, y); break;
+    case CHIP8_OP_AND: len = snprintf(out, size, "AND V%X, V%X", x, y); break;
+    case CHIP8_OP_XOR: len = snprintf(out, size, "XOR V%X, V%X", x, y); break;
+    case CHIP8_OP_ADD_R: len = snprintf(out, size, "ADD V%X, V%X", x, y); break;
+    case CHIP8_OP_SUB: len = snprintf(out, size, "SUB V%X, V%X", x, y); break;
+    case CHIP8_OP_SHR: len = snprintf(out, size, "SHR V%X, V%X", x, y); break;
+    case CHIP8_OP_SUBN: len = snprintf(out, size, "SUBN V%X, V%X", x, y); break;
+    case CHIP8_OP_SHL: len = snprintf(out, size, "SHL V%X, V%X", x, y); break;
+    case CHIP8_OP_SNE_R: len = snprintf(out, size, "SNE V%X, V%X", x, y); break;
+    case CHIP8_OP_LD_I: len = snprintf(out, size, "LD I, 0x%03X", nnn); break;
+    case CHIP8_OP_JP_V0: len = snprintf(out, size, "JP V0, 0x%03X", nnn); break;
+    case CHIP8_OP_RND: len = snprintf(out, size, "RND V%X, 0x%02X", x, kk); break;
+    case CHIP8_OP_DRW: len = snprintf(out, size, "DRW V%X, V%X, %u", x, y, n); break;
+    case CHIP8_OP_SKP: len = snprintf(out, size, "SKP V%X", x); break;
+    case CHIP8_OP_SKNP: len = snprintf(out, size, "SKNP V%X", x); break;
+    case CHIP8_OP_LD_VDT: len = snprintf(out, size, "LD V%X, DT", x); break;
+    case CHIP8_OP_LD_K: len = snprintf(out, size, "LD V%X, K", x); break;
+    case CHIP8_OP_LD_DT: len = snprintf(out, size, "LD DT, V%X", x); break;
+    case CHIP8_OP_LD_ST: len = snprintf(out, size, "LD ST, V%X", x); break;
+    case CHIP8_OP_ADD_I: len = snprintf(out, size, "ADD I, V%X", x); break;
+    case CHIP8_OP_LD_F: len = snprintf(out, size, "LD F, V%X", x); break;
+    case CHIP8_OP_BCD: len = snprintf(out, size, "LD B, V%X", x); break;
+    case CHIP8_OP_STORE: len = snprintf(out, size, "LD [I], V%X", x); break;
+    case CHIP8_OP_LOAD: len = snprintf(out, size, "LD V%X, [I]", x); break;
+    case CHIP8_OP_EXT: len = disasm_ext(opcode, out, size); break;
+    default: len = snprintf(out, size, "DW 0x%04X", opcode); break;
+  }
+  if (len < 0) len = 0;
+  return size && (size_t)len >= size ? size - 1 : (size_t)len;
+}
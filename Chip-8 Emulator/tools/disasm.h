@@ -0,0 +1,16 @@
+
+#ifndef CHIP8_DISASM_H
+#define CHIP8_DISASM_H
+
+// CHIP-8 disassembler shared by the headless tools, in Cowgod's mnemonics
+// ("LD V1, 0x2A", "DRW V0, V1, 5", "JP 0x20E").
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Write the mnemonic for `opcode` into out (NUL-terminated, truncated to size).
+// SUPER-CHIP and XO-CHIP opcodes are named whatever the machine; invalid
+// opcodes come out as "DW 0xNNNN". Returns the length written.
+size_t disasm_opcode(uint16_t opcode, char* out, size_t size);
+
+#endif // CHIP8_DISASM_H
@@ -0,0 +1,350 @@
+// chip8_farm: run a manifest of headless ROM jobs across all cores.
+//
+// Each worker owns one Chip8 (reused between jobs via chip8_reset()) and a
+// Chase-Lev work-stealing deque. Jobs are dealt round-robin up front; a worker
+// pops from the bottom of its own deque and steals from the top of others
+// once it runs dry. Results are printed in manifest order.
+#define _DEFAULT_SOURCE
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "headless.h"
+
+// Manifest line: rom_path cycles [seed [inputs]]
+//   cycles  emulated CPU cycles to run
+//   seed    RNG seed for Cxkk (decimal or 0x hex, default 1)
+//   inputs  "+K@cycle,-K@cycle,..." or "-" (see headless_parse_inputs)
+// Blank lines and lines starting with '#' are skipped.
+typedef struct Job {
+  char* rom_path;
+  size_t rom_index;
+  uint64_t cycles;
+  uint32_t seed;
+  HeadlessInput* inputs;
+  size_t input_count;
+} Job;
+
+typedef struct Rom {
+  char* path;
+  uint8_t* data;
+  size_t size;
+} Rom;
+
+typedef struct JobResult {
+  Chip8Snapshot snap;
+  uint64_t executed;
+  bool ok;
+} JobResult;
+
+// Chase-Lev deque over job indices (Le et al., "Correct and Efficient
+// Work-Stealing for Weak Memory Models"). The buffer never grows: every job is
+// pushed before the workers start.
+typedef struct Deque {
+  _Atomic int64_t top;
+  _Atomic int64_t bottom;
+  uint32_t* items;
+  int64_t capacity;
+} Deque;
+
+#define DEQUE_EMPTY UINT32_MAX
+#define DEQUE_ABORT (UINT32_MAX - 1)
+
+static void deque_push(Deque* d, uint32_t job) {
+  int64_t b = atomic_load_explicit(&d->bottom, memory_order_relaxed);
+  d->items[b % d->capacity] = job;
+  atomic_thread_fence(memory_order_release);
+  atomic_store_explicit(&d->bottom, b + 1, memory_order_relaxed);
+}
+
+static uint32_t deque_take(Deque* d) {
+  int64_t b = atomic_load_explicit(&d->bottom, memory_order_relaxed) - 1;
+  atomic_store_explicit(&d->bottom, b, memory_order_relaxed);
+  atomic_thread_fence(memory_order_seq_cst);
+  int64_t t = atomic_load_explicit(&d->top, memory_order_relaxed);
+  if (t > b) {
+    atomic_store_explicit(&d->bottom, b + 1, memory_order_relaxed);
+    return DEQUE_EMPTY;
+  }
+  uint32_t job = d->items[b % d->capacity];
+  if (t == b) {
+    // Last item: race any thief for it
+    if (!atomic_compare_exchange_strong_explicit(&d->top, &t, t + 1, memory_order_seq_cst,
+                                                 memory_order_relaxed)) {
+      job = DEQUE_EMPTY;
+    }
+    atomic_store_explicit(&d->bottom, b + 1, memory_order_relaxed);
+  }
+  return job;
+}
+
+static uint32_t deque_steal(Deque* d) {
+  int64_t t = atomic_load_explicit(&d->top, memory_order_acquire);
+  atomic_thread_fence(memory_order_seq_cst);
+  int64_t b = atomic_load_explicit(&d->bottom, memory_order_acquire);
+  if (t >= b) return DEQUE_EMPTY;
+  uint32_t job = d->items[t % d->capacity];
+  if (!atomic_compare_exchange_strong_explicit(&d->top, &t, t + 1, memory_order_seq_cst,
+                                               memory_order_relaxed)) {
+    return DEQUE_ABORT;
+  }
+  return job;
+}
+
+typedef struct Farm {
+  const Job* jobs;
+  const Rom* roms;
+  JobResult* results;
+  uint32_t hz;
+  Chip8Engine engine;
+  Deque* deques;
+  unsigned workers;
+} Farm;
+
+typedef struct Worker {
+  Farm* farm;
+  unsigned id;
+  uint32_t rng;
+  pthread_t thread;
+  uint64_t jobs_stolen;
+} Worker;
+
+static void run_job(Worker* w, Chip8* c8, uint32_t index) {
+  const Farm* farm = w->farm;
+  const Job* job = &farm->jobs[index];
+  const Rom* rom = &farm->roms[job->rom_index];
+  JobResult* res = &farm->results[index];
+
+  chip8_reset(c8);
+  w->rng = job->seed ? job->seed : 1;
+  if (!chip8_load_rom(c8, rom->data, rom->size)) return;
+
+  HeadlessRun run = { job->cycles, farm->hz, job->inputs, job->input_count, NULL, NULL, NULL, 0 };
+  res->executed = headless_run(c8, &run);
+  chip8_get_snapshot(c8, &res->snap);
+  res->ok = true;
+}
+
+// Next job for worker `w`: its own deque first, then one sweep over the
+// others. Returns DEQUE_EMPTY only when every deque was seen empty, which is
+// final since no job spawns more work.
+static uint32_t next_job(Worker* w) {
+  Farm* farm = w->farm;
+  uint32_t job = deque_take(&farm->deques[w->id]);
+  if (job != DEQUE_EMPTY) return job;
+  for (;;) {
+    bool contended = false;
+    for (unsigned i = 1; i < farm->workers; ++i) {
+      unsigned victim = (w->id + i) % farm->workers;
+      job = deque_steal(&farm->deques[victim]);
+      if (job == DEQUE_ABORT) { contended = true; continue; }
+      if (job != DEQUE_EMPTY) { w->jobs_stolen++; return job; }
+    }
+    if (!contended) return DEQUE_EMPTY;
+  }
+}
+
+static void* worker_main(void* arg) {
+  Worker* w = (Worker*)arg;
+  Chip8* c8 = chip8_create(headless_xorshift, &w->rng);
+  if (!c8) return NULL;
+  if (!chip8_set_engine(c8, w->farm->engine)) chip8_set_engine(c8, CHIP8_ENGINE_SWITCH);
+  for (uint32_t job; (job = next_job(w)) != DEQUE_EMPTY;) {
+    run_job(w, c8, job);
+  }
+  chip8_destroy(c8);
+  return NULL;
+}
+
+static double now_seconds(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+static void print_usage(const char* prog) {
+  fprintf(stderr, "Usage: %s manifest.txt [--threads N] [--hz N] [--engine switch|cached|jit]\n", prog);
+}
+
+// Index of path in roms, added if new; SIZE_MAX if out of memory
+static size_t intern_rom(Rom** roms, size_t* count, size_t* cap, const char* path) {
+  for (size_t i = 0; i < *count; ++i) {
+    if (strcmp((*roms)[i].path, path) == 0) return i;
+  }
+  if (*count == *cap) {
+    size_t grown_cap = *cap ? *cap * 2 : 16;
+    Rom* grown = (Rom*)realloc(*roms, grown_cap * sizeof(**roms));
+    if (!grown) return SIZE_MAX;
+    *roms = grown;
+    *cap = grown_cap;
+  }
+  Rom* r = &(*roms)[*count];
+  r->path = strdup(path);
+  if (!r->path) return SIZE_MAX;
+  r->data = NULL;
+  r->size = 0;
+  return (*count)++;
+}
+
+static bool parse_manifest(const char* path, Job** jobs_out, size_t* job_count,
+                           Rom** roms_out, size_t* rom_count) {
+  FILE* f = fopen(path, "r");
+  if (!f) { fprintf(stderr, "Failed to open manifest: %s\n", path); return false; }
+
+  Job* jobs = NULL; size_t njobs = 0, jobs_cap = 0;
+  Rom* roms = NULL; size_t nroms = 0, roms_cap = 0;
+  char line[4096];
+  unsigned lineno = 0;
+  bool ok = true;
+  while (fgets(line, sizeof(line), f)) {
+    ++lineno;
+    size_t len = strlen(line);
+    if (len && line[len - 1] != '\n' && !feof(f)) {
+      int next = getc(f);
+      if (next != '\n' && next != EOF) {
+        fprintf(stderr, "%s:%u: line too long\n", path, lineno);
+        ok = false;
+        break;
+      }
+    }
+    char* save = NULL;
+    char* rom = strtok_r(line, " \t\r\n", &save);
+    if (!rom || rom[0] == '#') continue;
+    char* cycles = strtok_r(NULL, " \t\r\n", &save);
+    char* seed = strtok_r(NULL, " \t\r\n", &save);
+    char* inputs = strtok_r(NULL, " \t\r\n", &save);
+    if (!cycles) { fprintf(stderr, "%s:%u: missing cycle count\n", path, lineno); ok = false; break; }
+
+    if (njobs == jobs_cap) {
+      size_t grown_cap = jobs_cap ? jobs_cap * 2 : 64;
+      Job* grown = (Job*)realloc(jobs, grown_cap * sizeof(*jobs));
+      if (!grown) { fprintf(stderr, "%s:%u: out of memory\n", path, lineno); ok = false; break; }
+      jobs = grown;
+      jobs_cap = grown_cap;
+    }
+    Job* j = &jobs[njobs];
+    memset(j, 0, sizeof(*j));
+    j->rom_index = intern_rom(&roms, &nroms, &roms_cap, rom);
+    if (j->rom_index == SIZE_MAX) { fprintf(stderr, "%s:%u: out of memory\n", path, lineno); ok = false; break; }
+    j->rom_path = roms[j->rom_index].path;
+    j->cycles = strtoull(cycles, NULL, 0);
+    j->seed = seed ? (uint32_t)strtoul(seed, NULL, 0) : 1u;
+    if (!headless_parse_inputs(inputs, &j->inputs, &j->input_count)) {
+      fprintf(stderr, "%s:%u: bad input script '%s'\n", path, lineno, inputs);
+      ok = false;
+      break;
+    }
+    ++njobs;
+  }
+  fclose(f);
+
+  // Each distinct ROM is read once and shared read-only by all workers
+  for (size_t i = 0; ok && i < nroms; ++i) {
+    if (!headless_load_file(roms[i].path, &roms[i].data, &roms[i].size)) {
+      fprintf(stderr, "Failed to read ROM: %s\n", roms[i].path);
+      ok = false;
+    }
+  }
+  *jobs_out = jobs; *job_count = njobs;
+  *roms_out = roms; *rom_count = nroms;
+  return ok;
+}
+
+int main(int argc, char** argv) {
+  if (argc < 2) { print_usage(argv[0]); return 1; }
+  const char* manifest = argv[1];
+  long threads = sysconf(_SC_NPROCESSORS_ONLN);
+  uint32_t hz = 700;
+  Chip8Engine engine = CHIP8_ENGINE_CACHED;
+  for (int i = 2; i < argc; ++i) {
+    if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) { threads = atol(argv[++i]); }
+    else if (strcmp(argv[i], "--hz") == 0 && i + 1 < argc) { hz = (uint32_t)atoi(argv[++i]); }
+    else if (strcmp(argv[i], "--engine") == 0 && i + 1 < argc) {
+      const char* v = argv[++i];
+      if (strcmp(v, "switch") == 0) engine = CHIP8_ENGINE_SWITCH;
+      else if (strcmp(v, "cached") == 0) engine = CHIP8_ENGINE_CACHED;
+      else if (strcmp(v, "jit") == 0) engine = CHIP8_ENGINE_JIT;
+      else { fprintf(stderr, "Unknown engine: %s\n", v); return 1; }
+    } else {
+      fprintf(stderr, "Unknown option: %s\n", argv[i]);
+      print_usage(argv[0]);
+      return 1;
+    }
+  }
+  if (threads < 1) threads = 1;
+
+  Job* jobs = NULL; size_t njobs = 0;
+  Rom* roms = NULL; size_t nroms = 0;
+  bool ok = parse_manifest(manifest, &jobs, &njobs, &roms, &nroms);
+
+  unsigned workers = (unsigned)((size_t)threads < njobs ? (size_t)threads : njobs);
+  if (workers == 0) workers = 1;
+  JobResult* results = (JobResult*)calloc(njobs ? njobs : 1, sizeof(*results));
+  Deque* deques = (Deque*)calloc(workers, sizeof(*deques));
+  Worker* pool = (Worker*)calloc(workers, sizeof(*pool));
+  size_t per = (njobs + workers - 1) / workers;
+  uint32_t* slots = (uint32_t*)malloc((per ? per : 1) * workers * sizeof(*slots));
+  if (!results || !deques || !pool || !slots) ok = false;
+
+  int rc = 1;
+  if (ok) {
+    Farm farm = { jobs, roms, results, hz, engine, deques, workers };
+    for (unsigned w = 0; w < workers; ++w) {
+      atomic_init(&deques[w].top, 0);
+      atomic_init(&deques[w].bottom, 0);
+      deques[w].items = slots + (size_t)w * per;
+      deques[w].capacity = per ? (int64_t)per : 1;
+    }
+    // Round-robin deal, pushed in reverse so each owner pops in manifest order
+    for (size_t i = njobs; i-- > 0;) deque_push(&deques[i % workers], (uint32_t)i);
+
+    double t0 = now_seconds();
+    unsigned started = 0;
+    for (unsigned w = 0; w < workers; ++w) {
+      pool[w].farm = &farm;
+      pool[w].id = w;
+      if (pthread_create(&pool[w].thread, NULL, worker_main, &pool[w]) != 0) break;
+      ++started;
+    }
+    // A thread that failed to start leaves its deque to be stolen from
+    if (started == 0) worker_main(&pool[0]);
+    for (unsigned w = 0; w < started; ++w) pthread_join(pool[w].thread, NULL);
+    double elapsed = now_seconds() - t0;
+
+    uint64_t total_cycles = 0, stolen = 0;
+    size_t failed = 0;
+    printf("# job rom pc I sp dt st V0..VF display_hash executed\n");
+    for (size_t i = 0; i < njobs; ++i) {
+      const JobResult* r = &results[i];
+      if (!r->ok) { printf("%zu %s FAILED\n", i, jobs[i].rom_path); ++failed; continue; }
+      printf("%zu %s %03X %03X %u %u %u ", i, jobs[i].rom_path, r->snap.pc, r->snap.I,
+             r->snap.sp, r->snap.delay_timer, r->snap.sound_timer);
+      for (int v = 0; v < 16; ++v) printf("%02X", r->snap.V[v]);
+      printf(" %08X %llu\n", r->snap.display_hash, (unsigned long long)r->executed);
+      total_cycles += r->executed;
+    }
+    for (unsigned w = 0; w < workers; ++w) stolen += pool[w].jobs_stolen;
+
+    fprintf(stderr, "%zu jobs on %u threads in %.3f s: %.1f jobs/s, %.1f M instr/s, %llu stolen\n",
+            njobs, workers, elapsed, elapsed > 0 ? (double)njobs / elapsed : 0.0,
+            elapsed > 0 ? (double)total_cycles / elapsed / 1e6 : 0.0, (unsigned long long)stolen);
+    rc = failed ? 1 : 0;
+  }
+
+  for (size_t i = 0; i < njobs; ++i) free(jobs[i].inputs);
+  for (size_t i = 0; i < nroms; ++i) { free(roms[i].path); free(roms[i].data); }
+  free(jobs);
+  free(roms);
+  free(results);
+  free(deques);
+  free(pool);
+  free(slots);
+  return rc;
+}
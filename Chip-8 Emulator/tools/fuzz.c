@@ -0,0 +1,338 @@
+// chip8_fuzz: fuzz harness for the core, built around cheap per-input resets.
+//
+//   chip8_fuzz [--rom ROM] [--cycles N] [--warmup N] [--reset clone|restart|state|fresh]
+//              [--engine switch|cached|jit] [--execs N] [--seconds S] [--max-len N]
+//              [--seed S] [--verify] [FILE...]
+//
+// Without --rom every input is a ROM image, loaded into a blank machine and
+// run for --cycles. With --rom the ROM is fixed and each input is a key
+// script: byte pairs of (cycles to run, key event), bit 7 of the event set
+// for a press and its low nibble the key. --warmup runs the fixed ROM that
+// many cycles once, and every input starts from that machine.
+//
+// Each input starts from its base machine by one of:
+//   clone    chip8_clone() of the base: only pages either machine used (default)
+//   restart  chip8_restart(): only pages written since the load, then the warmup again
+//            (without --rom: chip8_set_machine(), which also reinstalls the fonts)
+//   state    chip8_load_state() of a raw state of the base
+//   fresh    chip8_destroy() + chip8_create() + chip8_load_rom() and the warmup
+// --verify also runs every input on a fresh machine and aborts if the states
+// differ, which checks the reset path itself.
+//
+// The built-in driver feeds FILE arguments, or random inputs of up to
+// --max-len bytes until --execs or --seconds runs out, and reports execs/s.
+// With -DCHIP8_LIBFUZZER=ON (Clang) it is a libFuzzer target instead, set up
+// from CHIP8_FUZZ_ROM, CHIP8_FUZZ_CYCLES, CHIP8_FUZZ_WARMUP and
+// CHIP8_FUZZ_RESET.
+#define _DEFAULT_SOURCE
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "chip8.h"
+#include "headless.h"
+
+#define FUZZ_CYCLES_PER_TICK 12 // about 700 Hz
+
+typedef enum ResetMode { RESET_CLONE, RESET_RESTART, RESET_STATE, RESET_FRESH } ResetMode;
+
+typedef struct Fuzz {
+  uint8_t* rom; // NULL: inputs are ROMs
+  size_t rom_size;
+  uint32_t cycles;
+  uint32_t warmup;
+  ResetMode reset;
+  Chip8Engine engine;
+  bool verify;
+  Chip8* base; // the machine every input starts from
+  Chip8* c8;   // the machine inputs run on
+  uint8_t* state;
+  size_t state_size;
+  uint8_t* check[2]; // raw states compared by --verify
+  uint32_t base_rng; // RNG state the base machine left behind
+  uint64_t executed; // instructions across all inputs
+} Fuzz;
+
+static Fuzz g_fuzz;
+
+static const char* const reset_names[] = { "clone", "restart", "state", "fresh" };
+
+// Cxkk draws from one sequence, restarted with every input, so that a run
+// from the base and a run from scratch draw the same numbers
+#define FUZZ_SEED 0x2545F491u
+static uint32_t g_rng_state;
+
+static Chip8* new_machine(const Fuzz* f) {
+  Chip8* c8 = chip8_create(headless_xorshift, &g_rng_state);
+  if (c8 && !chip8_set_engine(c8, f->engine)) chip8_set_engine(c8, CHIP8_ENGINE_SWITCH);
+  return c8;
+}
+
+// Run `cycles`, ticking the timers every FUZZ_CYCLES_PER_TICK. `script` (may
+// be empty) interleaves key events; once it runs out, each Fx0A wait gets a
+// press and release.
+static void run_script(Fuzz* f, Chip8* c8, const uint8_t* script, size_t size, uint32_t cycles) {
+  size_t at = 0;
+  uint32_t done = 0, since_tick = 0;
+  while (done < cycles) {
+    uint32_t slice = FUZZ_CYCLES_PER_TICK - since_tick;
+    if (at + 1 < size) {
+      slice = script[at] < slice ? script[at] : slice;
+      uint8_t event = script[at + 1];
+      if (event & 0x80) chip8_key_down(c8, event & 0xF);
+      else chip8_key_up(c8, event & 0xF);
+      at += 2;
+    }
+    if (slice > cycles - done) slice = cycles - done;
+    Chip8RunResult r;
+    f->executed += chip8_run_cycles(c8, slice, &r);
+    if (r.reason == CHIP8_EXIT_KEY_WAIT && at + 1 >= size) {
+      chip8_key_down(c8, (uint8_t)(done & 0xF));
+      chip8_key_up(c8, (uint8_t)(done & 0xF));
+    }
+    // Time stalled in Fx0A counts, so every input ends
+    uint32_t spent = r.cycles ? r.cycles : slice;
+    done += spent;
+    since_tick += spent;
+    if (since_tick >= FUZZ_CYCLES_PER_TICK) {
+      chip8_tick_60hz(c8);
+      since_tick = 0;
+    }
+  }
+}
+
+// Bring c8 from any earlier input back to the state of f->base
+static Chip8* start_input(Fuzz* f, Chip8* c8) {
+  g_rng_state = f->base_rng;
+  switch (f->reset) {
+  case RESET_CLONE:
+    chip8_clone(c8, f->base);
+    return c8;
+  case RESET_STATE:
+    chip8_load_state(c8, f->state, f->state_size);
+    return c8;
+  case RESET_RESTART:
+    g_rng_state = FUZZ_SEED;
+    if (f->rom) {
+      chip8_restart(c8);
+    } else {
+      // Every input is loaded as a ROM, so there is no image to restart to,
+      // and chip8_reset() keeps a font the last input may have overwritten.
+      // Selecting the machine again clears memory and installs its fonts.
+      chip8_set_machine(c8, chip8_get_machine(c8));
+    }
+    break;
+  case RESET_FRESH:
+    g_rng_state = FUZZ_SEED;
+    chip8_destroy(c8);
+    c8 = new_machine(f);
+    if (!c8) abort();
+    if (f->rom) chip8_load_rom(c8, f->rom, f->rom_size);
+    break;
+  }
+  if (f->rom && f->warmup) run_script(f, c8, NULL, 0, f->warmup);
+  return c8;
+}
+
+static void run_input(Fuzz* f, const uint8_t* data, size_t size) {
+  f->c8 = start_input(f, f->c8);
+  if (f->rom) {
+    run_script(f, f->c8, data, size, f->cycles);
+  } else if (chip8_load_rom(f->c8, data, size)) {
+    run_script(f, f->c8, NULL, 0, f->cycles);
+  }
+  if (!f->verify) return;
+
+  // The same input from scratch
+  g_rng_state = FUZZ_SEED;
+  Chip8* ref = new_machine(f);
+  if (!ref) abort();
+  if (f->rom) {
+    chip8_load_rom(ref, f->rom, f->rom_size);
+    if (f->warmup) run_script(f, ref, NULL, 0, f->warmup);
+    run_script(f, ref, data, size, f->cycles);
+  } else if (chip8_load_rom(ref, data, size)) {
+    run_script(f, ref, NULL, 0, f->cycles);
+  }
+  size_t n = chip8_save_state(f->c8, f->check[0], CHIP8_STATE_MAX_SIZE, CHIP8_STATE_RAW);
+  size_t m = chip8_save_state(ref, f->check[1], CHIP8_STATE_MAX_SIZE, CHIP8_STATE_RAW);
+  chip8_destroy(ref);
+  if (n != m || memcmp(f->check[0], f->check[1], n) != 0) {
+    fprintf(stderr, "--reset %s left a different machine than a fresh one for a %zu-byte input\n",
+            reset_names[f->reset], size);
+    abort();
+  }
+}
+
+static bool fuzz_init(Fuzz* f) {
+  f->base = new_machine(f);
+  f->c8 = new_machine(f);
+  f->state = malloc(CHIP8_STATE_MAX_SIZE);
+  f->check[0] = malloc(CHIP8_STATE_MAX_SIZE);
+  f->check[1] = malloc(CHIP8_STATE_MAX_SIZE);
+  if (!f->base || !f->c8 || !f->state || !f->check[0] || !f->check[1]) return false;
+  g_rng_state = FUZZ_SEED;
+  if (f->rom) {
+    if (!chip8_load_rom(f->base, f->rom, f->rom_size) || !chip8_load_rom(f->c8, f->rom, f->rom_size)) {
+      fprintf(stderr, "ROM too large (%zu bytes)\n", f->rom_size);
+      return false;
+    }
+    if (f->warmup) run_script(f, f->base, NULL, 0, f->warmup);
+  }
+  f->base_rng = g_rng_state;
+  f->state_size = chip8_save_state(f->base, f->state, CHIP8_STATE_MAX_SIZE, CHIP8_STATE_RAW);
+  return f->state_size != 0;
+}
+
+static bool parse_reset(const char* v, ResetMode* out) {
+  for (int i = 0; i < 4; ++i) {
+    if (strcmp(v, reset_names[i]) == 0) {
+      *out = (ResetMode)i;
+      return true;
+    }
+  }
+  return false;
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size);
+int LLVMFuzzerInitialize(int* argc, char*** argv);
+
+int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size) {
+  run_input(&g_fuzz, data, size);
+  return 0;
+}
+
+#ifdef CHIP8_LIBFUZZER
+
+int LLVMFuzzerInitialize(int* argc, char*** argv) {
+  (void)argc;
+  (void)argv;
+  Fuzz* f = &g_fuzz;
+  const char* rom = getenv("CHIP8_FUZZ_ROM");
+  const char* cycles = getenv("CHIP8_FUZZ_CYCLES");
+  const char* warmup = getenv("CHIP8_FUZZ_WARMUP");
+  const char* reset = getenv("CHIP8_FUZZ_RESET");
+  f->cycles = cycles ? (uint32_t)strtoul(cycles, NULL, 0) : 10000;
+  f->warmup = warmup ? (uint32_t)strtoul(warmup, NULL, 0) : 0;
+  f->engine = CHIP8_ENGINE_CACHED;
+  if (reset && !parse_reset(reset, &f->reset)) {
+    fprintf(stderr, "Unknown CHIP8_FUZZ_RESET: %s\n", reset);
+    exit(1);
+  }
+  if (rom && !headless_load_file(rom, &f->rom, &f->rom_size)) {
+    fprintf(stderr, "Failed to read ROM: %s\n", rom);
+    exit(1);
+  }
+  if (!fuzz_init(f)) exit(1);
+  return 0;
+}
+
+#else
+
+static double now_seconds(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+static void print_usage(const char* prog) {
+  fprintf(stderr,
+          "Usage: %s [--rom ROM] [--cycles N] [--warmup N] [--reset clone|restart|state|fresh]\n"
+          "                  [--engine switch|cached|jit] [--execs N] [--seconds S] [--max-len N]\n"
+          "                  [--seed S] [--verify] [FILE...]\n",
+          prog);
+}
+
+int main(int argc, char** argv) {
+  Fuzz* f = &g_fuzz;
+  f->cycles = 10000;
+  f->engine = CHIP8_ENGINE_CACHED;
+  const char* rom_path = NULL;
+  uint64_t execs = 0;
+  double seconds = 5.0;
+  size_t max_len = 0;
+  uint32_t seed = 1;
+  int files = 0;
+  char** file_args = calloc((size_t)argc, sizeof(char*));
+  if (!file_args) return 1;
+
+  for (int i = 1; i < argc; ++i) {
+    bool has_value = i + 1 < argc;
+    if (strcmp(argv[i], "--rom") == 0 && has_value) rom_path = argv[++i];
+    else if (strcmp(argv[i], "--cycles") == 0 && has_value) f->cycles = (uint32_t)strtoul(argv[++i], NULL, 0);
+    else if (strcmp(argv[i], "--warmup") == 0 && has_value) f->warmup = (uint32_t)strtoul(argv[++i], NULL, 0);
+    else if (strcmp(argv[i], "--execs") == 0 && has_value) execs = strtoull(argv[++i], NULL, 0);
+    else if (strcmp(argv[i], "--seconds") == 0 && has_value) seconds = strtod(argv[++i], NULL);
+    else if (strcmp(argv[i], "--max-len") == 0 && has_value) max_len = strtoul(argv[++i], NULL, 0);
+    else if (strcmp(argv[i], "--seed") == 0 && has_value) seed = (uint32_t)strtoul(argv[++i], NULL, 0);
+    else if (strcmp(argv[i], "--verify") == 0) f->verify = true;
+    else if (strcmp(argv[i], "--reset") == 0 && has_value) {
+      if (!parse_reset(argv[++i], &f->reset)) { fprintf(stderr, "Unknown reset: %s\n", argv[i]); return 1; }
+    } else if (strcmp(argv[i], "--engine") == 0 && has_value) {
+      const char* v = argv[++i];
+      if (strcmp(v, "switch") == 0) f->engine = CHIP8_ENGINE_SWITCH;
+      else if (strcmp(v, "cached") == 0) f->engine = CHIP8_ENGINE_CACHED;
+      else if (strcmp(v, "jit") == 0) f->engine = CHIP8_ENGINE_JIT;
+      else { fprintf(stderr, "Unknown engine: %s\n", v); return 1; }
+    } else if (argv[i][0] != '-') {
+      file_args[files++] = argv[i];
+    } else {
+      print_usage(argv[0]);
+      return 1;
+    }
+  }
+  if (rom_path && !headless_load_file(rom_path, &f->rom, &f->rom_size)) {
+    fprintf(stderr, "Failed to read ROM: %s\n", rom_path);
+    return 1;
+  }
+  if (!max_len) max_len = f->rom ? 64 : 1024;
+  if (!fuzz_init(f)) return 1;
+
+  uint8_t* input = malloc(max_len > 0x10000 ? max_len : 0x10000);
+  if (!input) return 1;
+  uint64_t done = 0;
+  double t0 = now_seconds(), t = 0;
+  if (files) {
+    // Replay inputs, e.g. crashes found by a libFuzzer build
+    for (int i = 0; i < files; ++i) {
+      uint8_t* data;
+      size_t size;
+      if (!headless_load_file(file_args[i], &data, &size)) {
+        fprintf(stderr, "Failed to read input: %s\n", file_args[i]);
+        return 1;
+      }
+      run_input(f, data, size);
+      free(data);
+      ++done;
+    }
+    t = now_seconds() - t0;
+  } else {
+    while (execs ? done < execs : t < seconds) {
+      size_t size = 1 + ((size_t)headless_xorshift(&seed) << 8 | headless_xorshift(&seed)) % max_len;
+      for (size_t i = 0; i < size; ++i) input[i] = (uint8_t)headless_xorshift(&seed);
+      run_input(f, input, size);
+      if (++done % 256 == 0 || execs) t = now_seconds() - t0;
+    }
+    t = now_seconds() - t0;
+  }
+
+  printf("%llu execs in %.2f s: %.0f execs/s, %.1f M instructions/s (--reset %s, %u cycles%s)\n",
+         (unsigned long long)done, t, t > 0 ? (double)done / t : 0.0,
+         t > 0 ? (double)f->executed / t * 1e-6 : 0.0, reset_names[f->reset], f->cycles,
+         f->verify ? ", verified" : "");
+  free(input);
+  free(file_args);
+  chip8_destroy(f->base);
+  chip8_destroy(f->c8);
+  free(f->state);
+  free(f->check[0]);
+  free(f->check[1]);
+  free(f->rom);
+  return 0;
+}
+
+#endif
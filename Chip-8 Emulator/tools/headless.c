@@ -0,0 +1,133 @@
+
+#include "headless.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+bool headless_load_file(const char* path, uint8_t** data_out, size_t* size_out) {
+  FILE* f = fopen(path, "rb");
+  if (!f) return false;
+  fseek(f, 0, SEEK_END);
+  long sz = ftell(f);
+  fseek(f, 0, SEEK_SET);
+  if (sz <= 0) { fclose(f); return false; }
+  uint8_t* buf = (uint8_t*)malloc((size_t)sz);
+  if (!buf) { fclose(f); return false; }
+  size_t rd = fread(buf, 1, (size_t)sz, f);
+  fclose(f);
+  if (rd != (size_t)sz) { free(buf); return false; }
+  *data_out = buf; *size_out = (size_t)sz; return true;
+}
+
+bool headless_save_file(const char* path, const void* data, size_t size) {
+  FILE* f = fopen(path, "wb");
+  if (!f) return false;
+  bool ok = fwrite(data, 1, size, f) == size;
+  return fclose(f) == 0 && ok;
+}
+
+bool headless_parse_inputs(const char* text, HeadlessInput** out, size_t* count) {
+  *out = NULL;
+  *count = 0;
+  if (!text || !*text || strcmp(text, "-") == 0) return true;
+
+  size_t cap = 1;
+  for (const char* p = text; *p; ++p) cap += (*p == ',');
+  HeadlessInput* inputs = (HeadlessInput*)malloc(cap * sizeof(*inputs));
+  if (!inputs) return false;
+
+  size_t n = 0;
+  const char* p = text;
+  while (*p) {
+    char sign = *p++;
+    char* end;
+    unsigned long key = strtoul(p, &end, 16);
+    if ((sign != '+' && sign != '-') || end == p || key > 0xF || *end != '@') break;
+    p = end + 1;
+    unsigned long long cycle = strtoull(p, &end, 10);
+    if (end == p) break;
+    inputs[n].cycle = cycle;
+    inputs[n].key = (uint8_t)key;
+    inputs[n].down = sign == '+';
+    ++n;
+    p = end;
+    if (*p == ',') ++p;
+    else if (*p) break;
+  }
+  if (*p) { free(inputs); return false; }
+
+  // Stable insertion sort: same-cycle press/release pairs keep script order
+  for (size_t i = 1; i < n; ++i) {
+    HeadlessInput in = inputs[i];
+    size_t j = i;
+    while (j > 0 && inputs[j - 1].cycle > in.cycle) { inputs[j] = inputs[j - 1]; --j; }
+    inputs[j] = in;
+  }
+  *out = inputs;
+  *count = n;
+  return true;
+}
+
+// Core calls, routed through the movie recorder when there is one
+static void run_key(Chip8* c8, const HeadlessRun* run, const HeadlessInput* in) {
+  if (run->movie) {
+    if (in->down) chip8_movie_key_down(run->movie, c8, in->key);
+    else chip8_movie_key_up(run->movie, c8, in->key);
+  } else {
+    if (in->down) chip8_key_down(c8, in->key);
+    else chip8_key_up(c8, in->key);
+  }
+}
+
+static void run_tick(Chip8* c8, const HeadlessRun* run) {
+  if (run->movie) chip8_movie_tick_60hz(run->movie, c8);
+  else chip8_tick_60hz(c8);
+}
+
+static uint32_t run_span(Chip8* c8, const HeadlessRun* run, uint32_t budget, Chip8RunResult* r) {
+  if (run->movie) return chip8_movie_run_cycles(run->movie, c8, budget, r);
+  return chip8_run_cycles(c8, budget, r);
+}
+
+uint64_t headless_run(Chip8* c8, const HeadlessRun* run) {
+  uint64_t now = 0, executed = 0, ticks = 0;
+  size_t next_input = 0;
+  uint32_t hz = run->hz ? run->hz : 700;
+
+  while (now < run->cycles) {
+    while (next_input < run->input_count && run->inputs[next_input].cycle <= now) {
+      run_key(c8, run, &run->inputs[next_input++]);
+    }
+    uint64_t next_tick = (ticks + 1) * hz / 60;
+    if (next_tick <= now) {
+      run_tick(c8, run);
+      ++ticks;
+      continue;
+    }
+
+    uint64_t until = run->cycles < next_tick ? run->cycles : next_tick;
+    if (next_input < run->input_count && run->inputs[next_input].cycle < until) {
+      until = run->inputs[next_input].cycle;
+    }
+    uint64_t span = until - now;
+    uint32_t budget = span > UINT32_MAX ? UINT32_MAX : (uint32_t)span;
+    if (run->span_limit && budget > run->span_limit) budget = run->span_limit;
+
+    Chip8RunResult r;
+    uint32_t done = run_span(c8, run, budget, &r);
+    executed += done;
+    if (run->on_span) run->on_span(run->span_user, c8);
+    // A key wait stalls the CPU but emulated time keeps passing
+    now += r.reason == CHIP8_EXIT_KEY_WAIT ? budget : done;
+  }
+  return executed;
+}
+
+uint8_t headless_xorshift(void* user) {
+  uint32_t* s = (uint32_t*)user;
+  *s ^= *s << 13;
+  *s ^= *s >> 17;
+  *s ^= *s << 5;
+  return (uint8_t)*s;
+}
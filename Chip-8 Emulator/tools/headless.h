@@ -0,0 +1,53 @@
+
+#ifndef CHIP8_HEADLESS_H
+#define CHIP8_HEADLESS_H
+
+// Helpers shared by the headless tools: file loading, keypad input scripts and
+// a run loop that derives 60 Hz timer ticks from the emulated cycle count.
+// Built on chip8_core only; nothing here touches SDL.
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "chip8.h"
+#include "chip8_movie.h"
+
+// One keypad transition at an emulated cycle.
+typedef struct HeadlessInput {
+  uint64_t cycle;
+  uint8_t key; // 0x0..0xF
+  bool down;
+} HeadlessInput;
+
+typedef struct HeadlessRun {
+  uint64_t cycles;             // emulated CPU cycles to run (stalled cycles count)
+  uint32_t hz;                 // CPU cycles per emulated second; timers tick at 60 Hz
+  const HeadlessInput* inputs; // sorted by cycle, may be NULL
+  size_t input_count;
+  Chip8Movie* movie;           // when set (and recording), inputs and ticks are recorded
+  // Called after every chip8_run_cycles() span, each at most span_limit
+  // cycles (0: no limit), e.g. to drain a trace ring before it wraps
+  void (*on_span)(void* user, Chip8* c8);
+  void* span_user;
+  uint32_t span_limit;
+} HeadlessRun;
+
+// Read a whole file into a malloc'd buffer.
+bool headless_load_file(const char* path, uint8_t** data_out, size_t* size_out);
+
+// Write size bytes to path, replacing it.
+bool headless_save_file(const char* path, const void* data, size_t size);
+
+// Parse an input script "+K@cycle,-K@cycle,..." (K hex key, + press, - release)
+// into a malloc'd array sorted by cycle. "-" or "" means no input.
+bool headless_parse_inputs(const char* text, HeadlessInput** out, size_t* count);
+
+// Run `run->cycles` emulated cycles from the current state, ticking timers and
+// applying inputs on schedule. Returns the number of instructions executed.
+uint64_t headless_run(Chip8* c8, const HeadlessRun* run);
+
+// xorshift32 RNG for chip8_create(); user points at a nonzero uint32_t state.
+uint8_t headless_xorshift(void* user);
+
+#endif // CHIP8_HEADLESS_H
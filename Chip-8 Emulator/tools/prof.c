@@ -0,0 +1,340 @@
+// chip8_prof: profile a headless run of a ROM by the CHIP-8 code it executes.
+//
+//   chip8_prof rom.ch8 [--cycles N] [--hz N] [--seed S] [--inputs SCRIPT]
+//              [--machine chip8|schip|xochip] [--quirks default|vip|chip48|schip|xochip]
+//              [--top N] [--folded FILE]
+//
+// The run is traced (chip8_trace.h) into a ring drained after every span, so
+// every instruction is counted by address and by call path. A shadow call
+// stack follows 2nnn/00EE through the stack pointer of each record. After the
+// run, the control-flow graph is recovered by recursive descent from 0x200
+// (plus any executed address the descent did not reach, such as Bnnn
+// targets), and the counts are reported by subroutine, basic block and
+// straight-line opcode pair, followed by an annotated disassembly. --folded
+// writes one "main;sub_2A0;blk_2A4 count" line per call path and block, the
+// input format of flamegraph.pl and speedscope.
+#define _DEFAULT_SOURCE
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "chip8_stats.h"
+#include "chip8_trace.h"
+#include "disasm.h"
+#include "headless.h"
+#include "profile.h"
+
+#define PROF_RING (1u << 16)   // trace records, drained before they wrap
+
+static double now_seconds(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+static void print_usage(const char* prog) {
+  fprintf(stderr,
+          "Usage: %s rom.ch8 [--cycles N] [--hz N] [--seed S] [--inputs SCRIPT]\n"
+          "                  [--machine chip8|schip|xochip] [--quirks default|vip|chip48|schip|xochip]\n"
+          "                  [--top N] [--folded FILE]\n",
+          prog);
+}
+
+// ---- Reports ----
+
+static char* node_name(const Profile* p, uint32_t node, char* out, size_t size) {
+  if (node == 0) snprintf(out, size, "main");
+  else snprintf(out, size, "sub_%03X", p->nodes[node].entry);
+  return out;
+}
+
+static char* entry_name(uint16_t entry, char* out, size_t size) {
+  if (entry == 0x200) snprintf(out, size, "main");
+  else snprintf(out, size, "sub_%03X", entry);
+  return out;
+}
+
+static double percent(uint64_t n, uint64_t total) {
+  return total ? 100.0 * (double)n / (double)total : 0.0;
+}
+
+typedef struct Ranked {
+  uint64_t value;
+  uint32_t index;
+} Ranked;
+
+static int by_value_desc(const void* a, const void* b) {
+  const Ranked* x = (const Ranked*)a;
+  const Ranked* y = (const Ranked*)b;
+  if (x->value != y->value) return x->value < y->value ? 1 : -1;
+  return x->index < y->index ? -1 : x->index > y->index;
+}
+
+// Self and inclusive instructions by subroutine entry; a recursive path counts once
+static void report_subroutines(const Profile* p, int top) {
+  uint64_t* self = (uint64_t*)calloc(PROF_ADDRS, sizeof(uint64_t));
+  uint64_t* total = (uint64_t*)calloc(PROF_ADDRS, sizeof(uint64_t));
+  Ranked* rank = (Ranked*)calloc(PROF_ADDRS, sizeof(Ranked));
+  if (!self || !total || !rank) { free(self); free(total); free(rank); return; }
+  profile_subroutines(p, self, total);
+  uint32_t n = 0;
+  for (uint32_t e = 0; e < PROF_ADDRS; ++e) {
+    if (total[e]) rank[n++] = (Ranked){ total[e], e };
+  }
+  qsort(rank, n, sizeof(Ranked), by_value_desc);
+  printf("\nSubroutines by inclusive instructions (%u called)\n", n ? n - 1 : 0);
+  printf("%-10s %10s %12s %7s %12s %7s\n", "subroutine", "calls", "self", "%", "inclusive", "%");
+  for (uint32_t i = 0; i < n && (int)i < top; ++i) {
+    uint32_t e = rank[i].index;
+    char name[16];
+    printf("%-10s %10llu %12llu %6.2f%% %12llu %6.2f%%\n", entry_name((uint16_t)e, name, sizeof(name)),
+           (unsigned long long)(e == 0x200 ? p->calls[e] + 1 : p->calls[e]), (unsigned long long)self[e],
+           percent(self[e], p->instructions), (unsigned long long)total[e], percent(total[e], p->instructions));
+  }
+  free(self);
+  free(total);
+  free(rank);
+}
+
+static void report_blocks(const Profile* p, Cfg* g, int top) {
+  // The subroutine that ran each block most
+  for (uint32_t i = 0; i <= p->count_mask; ++i) {
+    const Counter* c = &p->counts[i];
+    if (!c->key) continue;
+    uint32_t node = (uint32_t)((c->key - 1) >> 16);
+    uint16_t pc = (uint16_t)(c->key - 1);
+    Block* b = &g->blocks[g->block_of[pc]];
+    if (c->count > b->owner_count) {
+      b->owner_count = c->count;
+      b->owner = node ? p->nodes[node].entry : 0x200;
+    }
+  }
+  Ranked* rank = (Ranked*)calloc(g->block_count ? g->block_count : 1, sizeof(Ranked));
+  if (!rank) return;
+  uint32_t n = 0;
+  for (uint32_t i = 0; i < g->block_count; ++i) {
+    if (g->blocks[i].instructions) rank[n++] = (Ranked){ g->blocks[i].instructions, i };
+  }
+  qsort(rank, n, sizeof(Ranked), by_value_desc);
+  printf("\nHottest basic blocks (%u of %u executed)\n", n, g->block_count);
+  printf("%-8s %-10s %12s %7s %12s %5s\n", "block", "subroutine", "instructions", "%", "entries", "len");
+  for (uint32_t i = 0; i < n && (int)i < top; ++i) {
+    const Block* b = &g->blocks[rank[i].index];
+    char name[16];
+    printf("blk_%03X  %-10s %12llu %6.2f%% %12llu %5u%s\n", b->start, entry_name(b->owner, name, sizeof(name)),
+           (unsigned long long)b->instructions, percent(b->instructions, p->instructions),
+           (unsigned long long)b->entries, (unsigned)(b->end - b->start) / 2,
+           g->flags[b->start] & CFG_LOOP ? "  loop" : "");
+  }
+  free(rank);
+}
+
+// Classes executed back to back without a taken branch: fusion candidates
+static void report_pairs(const Profile* p, int top) {
+  enum { N = CHIP8_OP_CLASS_COUNT };
+  Ranked rank[N * N];
+  uint32_t n = 0;
+  for (uint32_t a = 0; a < N; ++a) {
+    for (uint32_t b = 0; b < N; ++b) {
+      if (p->pairs[a][b]) rank[n++] = (Ranked){ p->pairs[a][b], a * N + b };
+    }
+  }
+  qsort(rank, n, sizeof(Ranked), by_value_desc);
+  printf("\nHottest straight-line opcode pairs\n");
+  for (uint32_t i = 0; i < n && (int)i < top; ++i) {
+    printf("%-7s -> %-7s %12llu %6.2f%%\n", chip8_stats_class_name((Chip8OpClass)(rank[i].index / N)),
+           chip8_stats_class_name((Chip8OpClass)(rank[i].index % N)), (unsigned long long)rank[i].value,
+           percent(rank[i].value, p->instructions));
+  }
+}
+
+static void report_listing(const Profile* p, const Cfg* g) {
+  printf("\nAnnotated disassembly (instructions executed per address; * = code modified at run time)\n");
+  for (uint32_t i = 0; i < g->block_count; ++i) {
+    const Block* b = &g->blocks[i];
+    if (g->flags[b->start] & CFG_ENTRY || b->start == 0x200) {
+      char name[16];
+      printf("\n%s:\n", entry_name(b->start, name, sizeof(name)));
+    }
+    printf("  blk_%03X:", b->start);
+    if (b->instructions) {
+      printf(" %llu entries, %.2f%%", (unsigned long long)b->entries, percent(b->instructions, p->instructions));
+    } else {
+      printf(" not executed");
+    }
+    printf("%s\n", g->flags[b->start] & CFG_LOOP ? ", loop head" : "");
+    for (uint32_t pc = b->start; pc < b->end; pc += cfg_insn_length(g, pc)) {
+      uint16_t op = cfg_fetch(g, pc);
+      char text[24];
+      disasm_opcode(op, text, sizeof(text));
+      if (p->pc_count[pc]) {
+        printf("  %12llu %6.2f%%", (unsigned long long)p->pc_count[pc], percent(p->pc_count[pc], p->instructions));
+      } else {
+        printf("  %12s %7s", "", "");
+      }
+      printf("  %03X%c %04X  %s", pc, g->flags[pc] & CFG_PATCHED ? '*' : ' ', op, text);
+      if (op == 0xF000 && g->xochip) printf(" 0x%04X", cfg_fetch(g, pc + 2));
+      printf("\n");
+    }
+  }
+}
+
+typedef struct Folded {
+  uint32_t node;
+  uint32_t block;
+  uint64_t count;
+} Folded;
+
+static int by_path(const void* a, const void* b) {
+  const Folded* x = (const Folded*)a;
+  const Folded* y = (const Folded*)b;
+  if (x->node != y->node) return x->node < y->node ? -1 : 1;
+  return x->block < y->block ? -1 : x->block > y->block;
+}
+
+// One "main;sub_2A0;blk_2A4 count" line per call path and block
+static bool write_folded(const Profile* p, const Cfg* g, const char* path) {
+  Folded* rows = (Folded*)malloc((p->count_used ? p->count_used : 1) * sizeof(Folded));
+  FILE* f = rows ? fopen(path, "w") : NULL;
+  if (!f) { free(rows); return false; }
+  uint32_t n = 0;
+  for (uint32_t i = 0; i <= p->count_mask; ++i) {
+    const Counter* c = &p->counts[i];
+    if (!c->key) continue;
+    uint16_t pc = (uint16_t)(c->key - 1);
+    rows[n++] = (Folded){ (uint32_t)((c->key - 1) >> 16), g->blocks[g->block_of[pc]].start, c->count };
+  }
+  qsort(rows, n, sizeof(Folded), by_path);
+  for (uint32_t i = 0; i < n;) {
+    uint64_t sum = 0;
+    uint32_t j = i;
+    for (; j < n && rows[j].node == rows[i].node && rows[j].block == rows[i].block; ++j) sum += rows[j].count;
+    uint32_t path_nodes[17], depth = 0;
+    for (uint32_t at = rows[i].node; depth < 17; at = p->nodes[at].parent) {
+      path_nodes[depth++] = at;
+      if (at == 0) break;
+    }
+    for (uint32_t d = depth; d-- > 0;) {
+      char name[16];
+      fprintf(f, "%s;", node_name(p, path_nodes[d], name, sizeof(name)));
+    }
+    fprintf(f, "blk_%03X %llu\n", rows[i].block, (unsigned long long)sum);
+    i = j;
+  }
+  bool ok = fclose(f) == 0;
+  free(rows);
+  return ok;
+}
+
+int main(int argc, char** argv) {
+  if (argc < 2) { print_usage(argv[0]); return 1; }
+  const char* rom_path = argv[1];
+  HeadlessRun run = { 700000, 700, NULL, 0, NULL, profile_drain, NULL, PROF_RING };
+  uint32_t seed = 0x12345678u;
+  const char* script = NULL;
+  const char* folded_path = NULL;
+  int top = 15;
+  Chip8Machine machine = CHIP8_MACHINE_CHIP8;
+  int quirks = -1;
+  for (int i = 2; i < argc; ++i) {
+    if (strcmp(argv[i], "--cycles") == 0 && i + 1 < argc) { run.cycles = strtoull(argv[++i], NULL, 0); }
+    else if (strcmp(argv[i], "--hz") == 0 && i + 1 < argc) { run.hz = (uint32_t)atoi(argv[++i]); }
+    else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) { seed = (uint32_t)strtoul(argv[++i], NULL, 0); }
+    else if (strcmp(argv[i], "--inputs") == 0 && i + 1 < argc) { script = argv[++i]; }
+    else if (strcmp(argv[i], "--top") == 0 && i + 1 < argc) { top = atoi(argv[++i]); }
+    else if (strcmp(argv[i], "--folded") == 0 && i + 1 < argc) { folded_path = argv[++i]; }
+    else if (strcmp(argv[i], "--machine") == 0 && i + 1 < argc) {
+      const char* v = argv[++i];
+      if (strcmp(v, "chip8") == 0) machine = CHIP8_MACHINE_CHIP8;
+      else if (strcmp(v, "schip") == 0) machine = CHIP8_MACHINE_SCHIP;
+      else if (strcmp(v, "xochip") == 0) machine = CHIP8_MACHINE_XOCHIP;
+      else { fprintf(stderr, "Unknown machine: %s\n", v); return 1; }
+    } else if (strcmp(argv[i], "--quirks") == 0 && i + 1 < argc) {
+      const char* v = argv[++i];
+      if (strcmp(v, "default") == 0) quirks = CHIP8_QUIRKS_DEFAULT;
+      else if (strcmp(v, "vip") == 0) quirks = CHIP8_QUIRKS_VIP;
+      else if (strcmp(v, "chip48") == 0) quirks = CHIP8_QUIRKS_CHIP48;
+      else if (strcmp(v, "schip") == 0) quirks = CHIP8_QUIRKS_SCHIP;
+      else if (strcmp(v, "xochip") == 0) quirks = CHIP8_QUIRKS_XOCHIP;
+      else { fprintf(stderr, "Unknown quirk profile: %s\n", v); return 1; }
+    } else {
+      print_usage(argv[0]);
+      return 1;
+    }
+  }
+
+  uint8_t* rom = NULL; size_t rom_size = 0;
+  if (!headless_load_file(rom_path, &rom, &rom_size)) {
+    fprintf(stderr, "Failed to read ROM: %s\n", rom_path);
+    return 1;
+  }
+  HeadlessInput* inputs = NULL; size_t input_count = 0;
+  if (!headless_parse_inputs(script, &inputs, &input_count)) {
+    fprintf(stderr, "Bad input script: %s\n", script);
+    free(rom);
+    return 1;
+  }
+  run.inputs = inputs;
+  run.input_count = input_count;
+
+  int rc = 1;
+  size_t trace_size = chip8_trace_size(PROF_RING, 0);
+  void* trace = malloc(trace_size);
+  static Profile prof;
+  static Cfg cfg;
+  Chip8* c8 = chip8_create(headless_xorshift, &seed);
+  if (!trace || !c8 || !profile_init(&prof, trace)) {
+    fprintf(stderr, "Out of memory\n");
+    goto done;
+  }
+  chip8_set_machine(c8, machine);
+  if (!chip8_load_rom(c8, rom, rom_size)) {
+    fprintf(stderr, "ROM too large: %s\n", rom_path);
+    goto done;
+  }
+  if (quirks >= 0) {
+    Chip8Quirks q;
+    chip8_quirk_profile((Chip8QuirkProfile)quirks, &q);
+    chip8_set_quirks(c8, &q);
+  }
+  chip8_trace_init(trace, trace_size, PROF_RING, 0, 0);
+  chip8_trace_attach(c8, trace, trace_size);
+  run.span_user = &prof;
+
+  double t0 = now_seconds();
+  uint64_t executed = headless_run(c8, &run);
+  double t = now_seconds() - t0;
+  chip8_trace_detach(c8);
+  if (!cfg_build(&cfg, &prof, rom, rom_size, machine)) {
+    fprintf(stderr, "Out of memory\n");
+    goto done;
+  }
+
+  printf("%s: %llu cycles, %llu instructions (%llu stalled cycles), %u call paths, %.3f s (%.1f ns/instr profiled)\n",
+         rom_path, (unsigned long long)run.cycles, (unsigned long long)executed,
+         (unsigned long long)(run.cycles > executed ? run.cycles - executed : 0), prof.node_count, t,
+         executed ? t * 1e9 / (double)executed : 0.0);
+  if (prof.overflow) printf("warning: call paths or counters overflowed; some instructions are attributed to a caller\n");
+  report_subroutines(&prof, top);
+  report_blocks(&prof, &cfg, top);
+  report_pairs(&prof, top);
+  report_listing(&prof, &cfg);
+  rc = 0;
+  if (folded_path && !write_folded(&prof, &cfg, folded_path)) {
+    fprintf(stderr, "Failed to write %s\n", folded_path);
+    rc = 1;
+  }
+
+done:
+  chip8_destroy(c8);
+  free(cfg.blocks);
+  profile_free(&prof);
+  free(trace);
+  free(inputs);
+  free(rom);
+  return rc;
+}
@@ -0,0 +1,259 @@
+#include "profile.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "chip8_trace.h"
+
+static uint32_t hash_key(uint64_t key) {
+  return (uint32_t)((key * 0x9E3779B97F4A7C15ull) >> 32);
+}
+
+// Slot for key in an open-addressed table of mask + 1 entries
+static Counter* table_slot(Counter* table, uint32_t mask, uint64_t key) {
+  for (uint32_t i = hash_key(key) & mask;; i = (i + 1) & mask) {
+    if (table[i].key == key || table[i].key == 0) return &table[i];
+  }
+}
+
+static bool table_grow(Counter** table, uint32_t* mask) {
+  uint32_t old_size = *mask + 1, size = old_size * 2;
+  Counter* grown = (Counter*)calloc(size, sizeof(Counter));
+  if (!grown) return false;
+  for (uint32_t i = 0; i < old_size; ++i) {
+    if ((*table)[i].key) *table_slot(grown, size - 1, (*table)[i].key) = (*table)[i];
+  }
+  free(*table);
+  *table = grown;
+  *mask = size - 1;
+  return true;
+}
+
+// Child of `parent` for a call to `entry`, created on first use
+static uint32_t call_node(Profile* p, uint32_t parent, uint16_t entry) {
+  uint64_t key = ((uint64_t)parent << 16 | entry) + 1;
+  Counter* slot = table_slot(p->node_index, p->node_index_mask, key);
+  if (slot->key) return (uint32_t)slot->count;
+  if (p->node_count >= PROF_MAX_NODES) {
+    p->overflow = true;
+    return parent;
+  }
+  if ((p->node_count + 1) * 2 > p->node_index_mask + 1) {
+    if (!table_grow(&p->node_index, &p->node_index_mask)) {
+      p->overflow = true;
+      return parent;
+    }
+    slot = table_slot(p->node_index, p->node_index_mask, key);
+  }
+  p->nodes[p->node_count] = (CallNode){ parent, entry };
+  slot->key = key;
+  slot->count = p->node_count;
+  return p->node_count++;
+}
+
+static void count_insn(Profile* p, uint32_t node, uint16_t pc) {
+  uint64_t key = ((uint64_t)node << 16 | pc) + 1;
+  Counter* slot = table_slot(p->counts, p->count_mask, key);
+  if (!slot->key) {
+    if ((p->count_used + 1) * 2 > p->count_mask + 1) {
+      if (!table_grow(&p->counts, &p->count_mask)) { p->overflow = true; return; }
+      slot = table_slot(p->counts, p->count_mask, key);
+    }
+    slot->key = key;
+    ++p->count_used;
+  }
+  ++slot->count;
+}
+
+static void account(Profile* p, const Chip8TraceRecord* r) {
+  uint32_t node = p->frames[p->depth];
+  count_insn(p, node, r->pc);
+  ++p->pc_count[r->pc];
+  p->opcode[r->pc] = r->opcode;
+  ++p->instructions;
+
+  // Straight-line successors only: a skip or jump breaks the pair
+  if (p->have_prev && r->pc == (uint16_t)(p->prev_pc + (p->prev_opcode == 0xF000 ? 4 : 2))) {
+    ++p->pairs[chip8_stats_classify(p->prev_opcode)][chip8_stats_classify(r->opcode)];
+  }
+  p->prev_pc = r->pc;
+  p->prev_opcode = r->opcode;
+  p->have_prev = true;
+
+  // The record's SP is after the instruction; a CALL on a full stack does nothing
+  uint8_t sp = r->sp > 16 ? 16 : r->sp;
+  if ((r->opcode & 0xF000) == 0x2000 && sp > p->depth) {
+    uint16_t entry = r->opcode & 0x0FFF;
+    ++p->calls[entry];
+    p->frames[sp] = call_node(p, node, entry);
+  } else if (sp > p->depth) {
+    // Entered a stack we did not see built (a loaded state): attribute to the caller
+    for (unsigned d = p->depth + 1u; d <= sp; ++d) p->frames[d] = node;
+  }
+  p->depth = sp;
+}
+
+void profile_drain(void* user, Chip8* c8) {
+  (void)c8;
+  Profile* p = (Profile*)user;
+  const Chip8TraceHeader* h = (const Chip8TraceHeader*)p->trace;
+  for (; p->drained < h->cycle; ++p->drained) {
+    const Chip8TraceRecord* r = chip8_trace_record(p->trace, p->drained);
+    if (r) account(p, r);
+  }
+}
+
+bool profile_init(Profile* p, const void* trace) {
+  memset(p, 0, sizeof(*p));
+  p->trace = trace;
+  p->nodes = (CallNode*)malloc(PROF_MAX_NODES * sizeof(CallNode));
+  p->node_index_mask = 1023;
+  p->node_index = (Counter*)calloc(p->node_index_mask + 1, sizeof(Counter));
+  p->count_mask = 4095;
+  p->counts = (Counter*)calloc(p->count_mask + 1, sizeof(Counter));
+  p->pc_count = (uint64_t*)calloc(PROF_ADDRS, sizeof(uint64_t));
+  p->opcode = (uint16_t*)calloc(PROF_ADDRS, sizeof(uint16_t));
+  p->calls = (uint64_t*)calloc(PROF_ADDRS, sizeof(uint64_t));
+  if (!p->nodes || !p->node_index || !p->counts || !p->pc_count || !p->opcode || !p->calls) return false;
+  p->nodes[0] = (CallNode){ 0, 0x200 };
+  p->node_count = 1;
+  return true;
+}
+
+void profile_free(Profile* p) {
+  free(p->nodes);
+  free(p->node_index);
+  free(p->counts);
+  free(p->pc_count);
+  free(p->opcode);
+  free(p->calls);
+}
+
+void profile_subroutines(const Profile* p, uint64_t* self, uint64_t* total) {
+  for (uint32_t i = 0; i <= p->count_mask; ++i) {
+    const Counter* c = &p->counts[i];
+    if (!c->key) continue;
+    uint32_t node = (uint32_t)((c->key - 1) >> 16);
+    self[node ? p->nodes[node].entry : 0x200] += c->count;
+    uint16_t seen[17];
+    unsigned n_seen = 0;
+    for (uint32_t at = node;; at = p->nodes[at].parent) {
+      uint16_t entry = at ? p->nodes[at].entry : 0x200;
+      bool dup = false;
+      for (unsigned k = 0; k < n_seen; ++k) dup |= seen[k] == entry;
+      if (!dup && n_seen < 17) { seen[n_seen++] = entry; total[entry] += c->count; }
+      if (at == 0) break;
+    }
+  }
+}
+
+// ---- Control-flow graph ----
+
+uint16_t cfg_fetch(const Cfg* g, uint32_t pc) {
+  return (uint16_t)(g->image[pc] << 8 | g->image[pc + 1]);
+}
+
+uint32_t cfg_insn_length(const Cfg* g, uint32_t pc) {
+  return g->xochip && cfg_fetch(g, pc) == 0xF000 ? 4 : 2;
+}
+
+static bool is_skip(uint16_t op) {
+  switch (chip8_stats_classify(op)) {
+    case CHIP8_OP_SE_B: case CHIP8_OP_SNE_B: case CHIP8_OP_SE_R: case CHIP8_OP_SNE_R:
+    case CHIP8_OP_SKP: case CHIP8_OP_SKNP:
+      return true;
+    default:
+      return false;
+  }
+}
+
+// True if no instruction follows op within its block
+static bool ends_block(uint16_t op) {
+  switch (chip8_stats_classify(op)) {
+    case CHIP8_OP_RET: case CHIP8_OP_JP: case CHIP8_OP_CALL: case CHIP8_OP_JP_V0: case CHIP8_OP_INVALID:
+      return true;
+    default:
+      return op == 0x00FD || is_skip(op); // SUPER-CHIP EXIT
+  }
+}
+
+static void cfg_target(Cfg* g, uint16_t* work, uint32_t* n, uint32_t from, uint32_t to, uint8_t flags) {
+  if (to + 1 >= g->mem_size) return;
+  if (to <= from) flags |= CFG_LOOP;
+  if ((g->flags[to] & (flags | CFG_LEADER)) != (flags | CFG_LEADER)) {
+    g->flags[to] |= flags | CFG_LEADER;
+    work[(*n)++] = (uint16_t)to;
+  }
+}
+
+// Recursive descent from root, following fallthrough, jumps, calls and both
+// ways of every skip; Bnnn targets are only known from the run
+static void cfg_walk(Cfg* g, uint16_t root) {
+  static uint16_t work[PROF_ADDRS * 4];
+  uint32_t n = 0;
+  cfg_target(g, work, &n, 0, root, 0);
+  while (n) {
+    uint32_t pc = work[--n];
+    while (pc + 1 < g->mem_size && !(g->flags[pc] & CFG_CODE)) {
+      g->flags[pc] |= CFG_CODE;
+      uint16_t op = cfg_fetch(g, pc);
+      uint32_t next = pc + cfg_insn_length(g, pc);
+      if (is_skip(op)) {
+        cfg_target(g, work, &n, pc, next, 0);
+        if (next + 1 < g->mem_size) cfg_target(g, work, &n, pc, next + cfg_insn_length(g, next), 0);
+      } else if ((op & 0xF000) == 0x1000) {
+        cfg_target(g, work, &n, pc, op & 0x0FFF, 0);
+      } else if ((op & 0xF000) == 0x2000) {
+        cfg_target(g, work, &n, pc, op & 0x0FFF, CFG_ENTRY);
+        cfg_target(g, work, &n, pc, next, 0);
+      }
+      if (ends_block(op)) break;
+      pc = next;
+    }
+  }
+}
+
+bool cfg_build(Cfg* g, const Profile* p, const uint8_t* rom, size_t rom_size, Chip8Machine machine) {
+  memset(g->flags, 0, sizeof(g->flags));
+  memset(g->image, 0, sizeof(g->image));
+  g->xochip = machine == CHIP8_MACHINE_XOCHIP;
+  g->mem_size = g->xochip ? PROF_ADDRS : 4096;
+  memcpy(g->image + 0x200, rom, rom_size < g->mem_size - 0x200 ? rom_size : g->mem_size - 0x200);
+  for (uint32_t pc = 0; pc + 1 < g->mem_size; ++pc) {
+    if (p->pc_count[pc] && cfg_fetch(g, pc) != p->opcode[pc]) {
+      g->image[pc] = (uint8_t)(p->opcode[pc] >> 8);
+      g->image[pc + 1] = (uint8_t)p->opcode[pc];
+      g->flags[pc] |= CFG_PATCHED;
+    }
+  }
+
+  cfg_walk(g, 0x200);
+  for (uint32_t pc = 0; pc + 1 < g->mem_size; ++pc) {
+    if (p->pc_count[pc] && !(g->flags[pc] & CFG_CODE)) cfg_walk(g, (uint16_t)pc);
+  }
+
+  // Split at leaders: a block runs from a leader along fallthrough to the
+  // first terminator or the next leader
+  uint32_t leaders = 0;
+  for (uint32_t pc = 0; pc < g->mem_size; ++pc) leaders += (g->flags[pc] & CFG_LEADER) != 0;
+  g->blocks = (Block*)calloc(leaders ? leaders : 1, sizeof(Block));
+  if (!g->blocks) return false;
+  g->block_count = 0;
+  for (uint32_t pc = 0; pc < g->mem_size; ++pc) {
+    if (!(g->flags[pc] & CFG_LEADER)) continue;
+    Block* b = &g->blocks[g->block_count];
+    b->start = (uint16_t)pc;
+    b->entries = p->pc_count[pc];
+    uint32_t at = pc;
+    for (;;) {
+      g->block_of[at] = g->block_count;
+      b->instructions += p->pc_count[at];
+      uint16_t op = cfg_fetch(g, at);
+      at += cfg_insn_length(g, at);
+      if (ends_block(op) || at + 1 >= g->mem_size || (g->flags[at] & (CFG_LEADER | CFG_CODE)) != CFG_CODE) break;
+    }
+    b->end = (uint16_t)(at > 0xFFFF ? 0xFFFF : at);
+    ++g->block_count;
+  }
+  return true;
+}
@@ -0,0 +1,107 @@
+#ifndef CHIP8_PROFILE_H
+#define CHIP8_PROFILE_H
+
+// Profile of a traced run (chip8_trace.h) by the CHIP-8 code it executes:
+// instructions by address and by call path, following 2nnn/00EE through the
+// stack pointer of each record, and the control-flow graph recovered from the
+// ROM afterwards. chip8_prof reports from these; nothing here prints.
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "chip8.h"
+#include "chip8_stats.h"
+
+#define PROF_MAX_NODES 65535u  // call paths tracked; deeper new paths fold into their caller
+#define PROF_ADDRS 65536u      // XO-CHIP address space
+
+// Call tree: node 0 is the code entered at reset ("main")
+typedef struct CallNode {
+  uint32_t parent;
+  uint16_t entry; // subroutine address
+} CallNode;
+
+// Instructions by (call node, address): key is node << 16 | pc, plus one so 0 marks a free slot
+typedef struct Counter {
+  uint64_t key;
+  uint64_t count;
+} Counter;
+
+typedef struct Profile {
+  const void* trace;
+  uint64_t drained; // trace cycles consumed
+
+  CallNode* nodes;
+  uint32_t node_count;
+  Counter* node_index; // (parent, entry) -> node, same layout as the counters
+  uint32_t node_index_mask;
+
+  uint32_t frames[17]; // call node at each stack depth
+  uint8_t depth;
+
+  Counter* counts;
+  uint32_t count_mask; // capacity - 1
+  uint32_t count_used;
+
+  uint64_t* pc_count; // [PROF_ADDRS] instructions by address
+  uint16_t* opcode;   // [PROF_ADDRS] opcode last executed at each address
+  uint64_t* calls;    // [PROF_ADDRS] 2nnn executed, by target
+  uint64_t pairs[CHIP8_OP_CLASS_COUNT][CHIP8_OP_CLASS_COUNT]; // consecutive classes
+  uint16_t prev_pc, prev_opcode;
+  bool have_prev;
+  uint64_t instructions;
+  bool overflow; // ran out of call nodes or memory
+} Profile;
+
+// Allocate the tables for a run traced into `trace`; profile_free() in any case.
+bool profile_init(Profile* p, const void* trace);
+void profile_free(Profile* p);
+
+// HeadlessRun.on_span callback (user: the Profile): count the trace records
+// written since the last call. Call often enough that the ring never wraps.
+void profile_drain(void* user, Chip8* c8);
+
+// Self and inclusive instructions by subroutine entry (0x200 for main), each
+// an array of PROF_ADDRS zeroed counts; a recursive path counts once.
+void profile_subroutines(const Profile* p, uint64_t* self, uint64_t* total);
+
+// ---- Control-flow graph ----
+
+enum {
+  CFG_CODE = 1,     // an instruction starts here
+  CFG_LEADER = 2,   // a basic block starts here
+  CFG_ENTRY = 4,    // a 2nnn target
+  CFG_LOOP = 8,     // target of a backward jump or skip
+  CFG_PATCHED = 16, // executed with an opcode other than the ROM's
+};
+
+typedef struct Block {
+  uint16_t start;
+  uint16_t end;        // exclusive
+  uint64_t instructions;
+  uint64_t entries;    // times its first instruction ran
+  uint16_t owner;      // subroutine that ran it most
+  uint64_t owner_count;
+} Block;
+
+typedef struct Cfg {
+  uint8_t flags[PROF_ADDRS];
+  uint32_t block_of[PROF_ADDRS]; // index into blocks, for instruction starts
+  Block* blocks;
+  uint32_t block_count;
+  uint8_t image[PROF_ADDRS + 4]; // memory as loaded, with executed opcodes patched in
+  uint32_t mem_size;
+  bool xochip;
+} Cfg;
+
+// Recover the basic blocks by recursive descent from 0x200 over the ROM as
+// loaded, with the opcodes the run executed patched in, plus every executed
+// address the descent did not reach (such as Bnnn targets). Block counts come
+// from p; owners are left for the caller. The caller frees g->blocks.
+// False if out of memory.
+bool cfg_build(Cfg* g, const Profile* p, const uint8_t* rom, size_t rom_size, Chip8Machine machine);
+uint16_t cfg_fetch(const Cfg* g, uint32_t pc);
+uint32_t cfg_insn_length(const Cfg* g, uint32_t pc);
+
+#endif // CHIP8_PROFILE_H
@@ -0,0 +1,150 @@
+// chip8_replay: record input movies of headless runs and play movies back
+// unthrottled, checking every frame's display hash against the recording.
+//
+//   chip8_replay record out.c8m rom.ch8 [--cycles N] [--hz N] [--seed S] [--inputs SCRIPT]
+//   chip8_replay play in.c8m rom.ch8 [--engine switch|cached|jit]
+//
+// Movies recorded by the SDL front-end (--record) play back here too. `play`
+// exits with status 1 when a frame differs or playback stalls, so movies can
+// serve as regression tests.
+#define _DEFAULT_SOURCE
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "chip8_movie.h"
+#include "headless.h"
+
+static double now_seconds(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+static void print_usage(const char* prog) {
+  fprintf(stderr,
+          "Usage: %s record out.c8m rom.ch8 [--cycles N] [--hz N] [--seed S] [--inputs SCRIPT]\n"
+          "       %s play in.c8m rom.ch8 [--engine switch|cached|jit]\n",
+          prog, prog);
+}
+
+static int cmd_record(const char* out_path, const uint8_t* rom, size_t rom_size, HeadlessRun* run,
+                      uint32_t seed, const char* script) {
+  HeadlessInput* inputs = NULL; size_t input_count = 0;
+  if (!headless_parse_inputs(script, &inputs, &input_count)) {
+    fprintf(stderr, "Bad input script: %s\n", script);
+    return 1;
+  }
+  run->inputs = inputs;
+  run->input_count = input_count;
+
+  int rc = 1;
+  Chip8Movie* movie = chip8_movie_create(seed);
+  Chip8* c8 = movie ? chip8_create(chip8_movie_rng, movie) : NULL;
+  if (c8 && chip8_movie_record_begin(movie, c8, rom, rom_size)) {
+    run->movie = movie;
+    headless_run(c8, run);
+    size_t size = chip8_movie_size(movie);
+    uint8_t* buf = (uint8_t*)malloc(size);
+    if (buf && chip8_movie_save(movie, buf, size) && headless_save_file(out_path, buf, size)) {
+      Chip8MovieStatus st;
+      chip8_movie_get_status(movie, &st);
+      printf("%s: %llu frames, %llu instructions, %zu bytes\n", out_path, (unsigned long long)st.frames,
+             (unsigned long long)st.instructions, size);
+      rc = 0;
+    } else {
+      fprintf(stderr, "Failed to write movie: %s\n", out_path);
+    }
+    free(buf);
+  }
+  chip8_destroy(c8);
+  chip8_movie_destroy(movie);
+  free(inputs);
+  return rc;
+}
+
+static int cmd_play(const char* movie_path, const uint8_t* rom, size_t rom_size, Chip8Engine engine) {
+  uint8_t* data = NULL; size_t size = 0;
+  Chip8Movie* movie = NULL;
+  if (headless_load_file(movie_path, &data, &size)) movie = chip8_movie_load(data, size);
+  free(data);
+  if (!movie) {
+    fprintf(stderr, "Not a movie file: %s\n", movie_path);
+    return 1;
+  }
+  Chip8* c8 = chip8_create(chip8_movie_rng, movie);
+  if (!c8) { chip8_movie_destroy(movie); return 1; }
+  if (!chip8_set_engine(c8, engine)) fprintf(stderr, "Engine unavailable, using switch interpreter\n");
+  if (!chip8_movie_play_begin(movie, c8, rom, rom_size)) {
+    fprintf(stderr, "%s was recorded with a different ROM\n", movie_path);
+    chip8_destroy(c8);
+    chip8_movie_destroy(movie);
+    return 1;
+  }
+
+  double t0 = now_seconds();
+  chip8_movie_play(movie, c8, UINT64_MAX);
+  double t = now_seconds() - t0;
+
+  Chip8MovieStatus st;
+  chip8_movie_get_status(movie, &st);
+  printf("%s: %llu/%llu frames (%.1f s of play), %llu instructions in %.1f ms (%.0fx real time): ", movie_path,
+         (unsigned long long)st.frames, (unsigned long long)st.total_frames, (double)st.frames / 60.0,
+         (unsigned long long)st.instructions, t * 1e3, t > 0 ? (double)st.frames / 60.0 / t : 0.0);
+  int rc = 1;
+  if (st.stalled) {
+    printf("STALLED in Fx0A after %llu instructions\n", (unsigned long long)st.instructions);
+  } else if (st.mismatches) {
+    printf("MISMATCH at frame %llu (expected %08X, got %08X), %llu frames differ\n",
+           (unsigned long long)st.first_mismatch, st.expected_hash, st.actual_hash,
+           (unsigned long long)st.mismatches);
+  } else {
+    printf("OK\n");
+    rc = 0;
+  }
+  chip8_destroy(c8);
+  chip8_movie_destroy(movie);
+  return rc;
+}
+
+int main(int argc, char** argv) {
+  if (argc < 4) { print_usage(argv[0]); return 1; }
+  bool recording = strcmp(argv[1], "record") == 0;
+  if (!recording && strcmp(argv[1], "play") != 0) { print_usage(argv[0]); return 1; }
+
+  HeadlessRun run = { 700000, 700, NULL, 0, NULL, NULL, NULL, 0 };
+  uint32_t seed = 1;
+  const char* script = "-";
+  Chip8Engine engine = CHIP8_ENGINE_SWITCH;
+  for (int i = 4; i < argc; ++i) {
+    if (recording && strcmp(argv[i], "--cycles") == 0 && i + 1 < argc) { run.cycles = strtoull(argv[++i], NULL, 0); }
+    else if (recording && strcmp(argv[i], "--hz") == 0 && i + 1 < argc) { run.hz = (uint32_t)atoi(argv[++i]); }
+    else if (recording && strcmp(argv[i], "--seed") == 0 && i + 1 < argc) { seed = (uint32_t)strtoul(argv[++i], NULL, 0); }
+    else if (recording && strcmp(argv[i], "--inputs") == 0 && i + 1 < argc) { script = argv[++i]; }
+    else if (!recording && strcmp(argv[i], "--engine") == 0 && i + 1 < argc) {
+      const char* v = argv[++i];
+      if (strcmp(v, "switch") == 0) engine = CHIP8_ENGINE_SWITCH;
+      else if (strcmp(v, "cached") == 0) engine = CHIP8_ENGINE_CACHED;
+      else if (strcmp(v, "jit") == 0) engine = CHIP8_ENGINE_JIT;
+      else { fprintf(stderr, "Unknown engine: %s\n", v); return 1; }
+    } else {
+      fprintf(stderr, "Unknown option: %s\n", argv[i]);
+      print_usage(argv[0]);
+      return 1;
+    }
+  }
+
+  uint8_t* rom = NULL; size_t rom_size = 0;
+  if (!headless_load_file(argv[3], &rom, &rom_size)) {
+    fprintf(stderr, "Failed to read ROM: %s\n", argv[3]);
+    return 1;
+  }
+  int rc = recording ? cmd_record(argv[2], rom, rom_size, &run, seed, script)
+                     : cmd_play(argv[2], rom, rom_size, engine);
+  free(rom);
+  return rc;
+}
@@ -0,0 +1,175 @@
+// chip8_roms: build and query the ROM catalog (catalog.h) the front-end reads.
+//
+//   chip8_roms scan INDEX DIR     index DIR recursively, reusing INDEX if it exists
+//   chip8_roms list INDEX [TEXT]  every entry, or those whose path contains TEXT
+//   chip8_roms show INDEX ROM     the entry for ROM's content
+//   chip8_roms set INDEX ROM|HASH [--machine chip8|schip|xochip]
+//              [--quirks auto|default|vip|chip48|schip|xochip] [--hz N] [--keymap KEYS|default]
+//
+// KEYS are 16 host keys for CHIP-8 keys 0-F (default CATALOG_KEYMAP_DEFAULT).
+// `chip8 rom.ch8 --catalog INDEX` starts a catalogued ROM with its settings.
+#define _DEFAULT_SOURCE
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "catalog.h"
+
+static double now_seconds(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+static void print_usage(const char* prog) {
+  fprintf(stderr,
+          "Usage: %s scan INDEX DIR\n"
+          "       %s list INDEX [TEXT]\n"
+          "       %s show INDEX ROM\n"
+          "       %s set INDEX ROM|HASH [--machine chip8|schip|xochip] "
+          "[--quirks auto|default|vip|chip48|schip|xochip] [--hz N] [--keymap KEYS|default]\n",
+          prog, prog, prog, prog);
+}
+
+static void print_entry(const CatalogEntry* e) {
+  char keys[17] = { 0 }, hz[12] = "-";
+  memcpy(keys, e->keymap, 16);
+  if (e->hz) snprintf(hz, sizeof(hz), "%u", e->hz);
+  printf("%016llx %6u %-7s %-7s %5s %-16s %s\n", (unsigned long long)e->hash, e->size,
+         catalog_machine_name(e->machine), catalog_quirks_name(e->quirks), hz, keys[0] ? keys : "-", e->path);
+}
+
+static void print_header(void) {
+  printf("%-16s %6s %-7s %-7s %5s %-16s %s\n", "hash", "bytes", "machine", "quirks", "hz", "keymap", "path");
+}
+
+static int cmd_scan(const char* index_path, const char* dir) {
+  Catalog* previous = catalog_open(index_path); // NULL for a first scan
+  CatalogScanStats st;
+  double t0 = now_seconds();
+  Catalog* c = catalog_scan(dir, previous, &st);
+  double t = now_seconds() - t0;
+  catalog_close(previous);
+  if (!c) {
+    fprintf(stderr, "Cannot scan %s\n", dir);
+    return 1;
+  }
+  bool ok = catalog_save(c, index_path);
+  if (ok) {
+    printf("%s: %u ROMs from %u files in %.1f ms: %u hashed, %u unchanged, %u duplicates, %u skipped, %u removed\n",
+           index_path, catalog_count(c), st.files, t * 1e3, st.hashed, st.reused, st.duplicates, st.skipped,
+           st.removed);
+  } else {
+    fprintf(stderr, "Failed to write %s\n", index_path);
+  }
+  catalog_close(c);
+  return ok ? 0 : 1;
+}
+
+static int cmd_list(const Catalog* c, const char* text) {
+  double t0 = now_seconds();
+  print_header();
+  CatalogEntry e;
+  uint32_t shown = 0;
+  for (uint32_t i = 0; catalog_get(c, i, &e); ++i) {
+    if (text && !strstr(e.path, text)) continue;
+    print_entry(&e);
+    ++shown;
+  }
+  fprintf(stderr, "%u of %u entries in %.2f ms\n", shown, catalog_count(c), (now_seconds() - t0) * 1e3);
+  return 0;
+}
+
+// A ROM file's entry, or one given by its hash ("0x..." or 16 hex digits)
+static bool lookup(const Catalog* c, const char* rom, CatalogEntry* out) {
+  CatalogMap m;
+  if (catalog_map_file(rom, &m)) {
+    uint64_t hash = catalog_hash(m.data, m.size);
+    catalog_unmap(&m);
+    if (catalog_find(c, hash, out)) return true;
+    fprintf(stderr, "%s (%016llx) is not in the catalog\n", rom, (unsigned long long)hash);
+    return false;
+  }
+  char* end;
+  uint64_t hash = strtoull(rom, &end, 16);
+  if (*rom && !*end && catalog_find(c, hash, out)) return true;
+  fprintf(stderr, "No catalog entry for %s\n", rom);
+  return false;
+}
+
+static int cmd_set(const char* index_path, Catalog* c, const char* rom, int argc, char** argv) {
+  CatalogEntry e;
+  if (!lookup(c, rom, &e)) return 1;
+  for (int i = 0; i < argc; ++i) {
+    const char* v = i + 1 < argc ? argv[i + 1] : NULL;
+    if (!v) { fprintf(stderr, "Missing value for %s\n", argv[i]); return 1; }
+    if (strcmp(argv[i], "--machine") == 0) {
+      if (!catalog_parse_machine(v, &e.machine)) { fprintf(stderr, "Unknown machine: %s\n", v); return 1; }
+    } else if (strcmp(argv[i], "--quirks") == 0) {
+      if (!catalog_parse_quirks(v, &e.quirks)) { fprintf(stderr, "Unknown quirk profile: %s\n", v); return 1; }
+    } else if (strcmp(argv[i], "--hz") == 0) {
+      e.hz = (uint32_t)strtoul(v, NULL, 0);
+    } else if (strcmp(argv[i], "--keymap") == 0) {
+      if (strcmp(v, "default") == 0) {
+        memset(e.keymap, 0, sizeof(e.keymap));
+      } else if (strlen(v) == 16) {
+        if (catalog_keymap_clash(v)) {
+          fprintf(stderr, "A keymap can't use the front-end's control keys (p, n, Escape, Backspace, Tab)\n");
+          return 1;
+        }
+        memcpy(e.keymap, v, sizeof(e.keymap));
+      } else {
+        fprintf(stderr, "A keymap has 16 keys, for CHIP-8 keys 0-F\n");
+        return 1;
+      }
+    } else {
+      fprintf(stderr, "Unknown option: %s\n", argv[i]);
+      return 1;
+    }
+    ++i;
+  }
+  if (!catalog_set(c, &e) || !catalog_save(c, index_path)) {
+    fprintf(stderr, "Failed to write %s\n", index_path);
+    return 1;
+  }
+  catalog_find(c, e.hash, &e);
+  print_header();
+  print_entry(&e);
+  return 0;
+}
+
+int main(int argc, char** argv) {
+  if (argc < 3) { print_usage(argv[0]); return 1; }
+  const char* cmd = argv[1];
+  const char* index_path = argv[2];
+  if (strcmp(cmd, "scan") == 0) {
+    if (argc != 4) { print_usage(argv[0]); return 1; }
+    return cmd_scan(index_path, argv[3]);
+  }
+
+  bool list = strcmp(cmd, "list") == 0, show = strcmp(cmd, "show") == 0, set = strcmp(cmd, "set") == 0;
+  if ((!list && !show && !set) || (list && argc > 4) || (show && argc != 4) || (set && argc < 4)) {
+    print_usage(argv[0]);
+    return 1;
+  }
+  Catalog* c = catalog_open(index_path);
+  if (!c) {
+    fprintf(stderr, "Not a catalog index: %s\n", index_path);
+    return 1;
+  }
+  int rc;
+  if (list) {
+    rc = cmd_list(c, argc == 4 ? argv[3] : NULL);
+  } else if (show) {
+    CatalogEntry e;
+    rc = lookup(c, argv[3], &e) ? (print_header(), print_entry(&e), 0) : 1;
+  } else {
+    rc = cmd_set(index_path, c, argv[3], argc - 4, argv + 4);
+  }
+  catalog_close(c);
+  return rc;
+}
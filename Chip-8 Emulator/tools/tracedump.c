@@ -0,0 +1,271 @@
+// chip8_tracedump: record an execution trace of a headless run into an mmap'd
+// file, and decode, filter and disassemble trace files offline.
+//
+//   chip8_tracedump record out.trace rom.ch8 [--cycles N] [--hz N] [--seed S]
+//                   [--inputs SCRIPT] [--records N] [--checkpoints K]
+//                   [--interval N] [--overhead]
+//   chip8_tracedump dump in.trace [--pc LO[-HI]] [--op VALUE[/MASK]]
+//                   [--class NAME] [--last N] [--checkpoints]
+//
+// The file is the chip8_trace.h buffer itself, mapped shared, so whatever the
+// core wrote before a crash is still on disk.
+#define _DEFAULT_SOURCE
+
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "chip8_stats.h"
+#include "chip8_trace.h"
+#include "disasm.h"
+#include "headless.h"
+
+static double now_seconds(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+static void print_usage(const char* prog) {
+  fprintf(stderr,
+          "Usage: %s record out.trace rom.ch8 [--cycles N] [--hz N] [--seed S] [--inputs SCRIPT]\n"
+          "                 [--records N] [--checkpoints K] [--interval N] [--overhead]\n"
+          "       %s dump in.trace [--pc LO[-HI]] [--op VALUE[/MASK]] [--class NAME] [--last N] [--checkpoints]\n",
+          prog, prog);
+}
+
+typedef struct RecordArgs {
+  const char* out_path;
+  const char* rom_path;
+  HeadlessRun run;
+  uint32_t seed;
+  const char* inputs;
+  uint32_t records;
+  uint32_t checkpoints;
+  uint32_t interval;
+  bool overhead; // also time an untraced run for comparison
+} RecordArgs;
+
+// Time one headless run of the ROM, traced into `trace` when not NULL.
+static double timed_run(const RecordArgs* a, const uint8_t* rom, size_t rom_size, void* trace, size_t trace_size,
+                        uint64_t* executed) {
+  uint32_t seed = a->seed;
+  Chip8* c8 = chip8_create(headless_xorshift, &seed);
+  if (!c8) return -1.0;
+  chip8_load_rom(c8, rom, rom_size);
+  if (trace && !chip8_trace_attach(c8, trace, trace_size)) { chip8_destroy(c8); return -1.0; }
+  double t0 = now_seconds();
+  *executed = headless_run(c8, &a->run);
+  double t = now_seconds() - t0;
+  chip8_trace_detach(c8);
+  chip8_destroy(c8);
+  return t;
+}
+
+static int cmd_record(const RecordArgs* a) {
+  uint8_t* rom = NULL; size_t rom_size = 0;
+  if (!headless_load_file(a->rom_path, &rom, &rom_size)) {
+    fprintf(stderr, "Failed to read ROM: %s\n", a->rom_path);
+    return 1;
+  }
+  HeadlessInput* inputs = NULL; size_t input_count = 0;
+  if (!headless_parse_inputs(a->inputs, &inputs, &input_count)) {
+    fprintf(stderr, "Bad input script: %s\n", a->inputs);
+    free(rom);
+    return 1;
+  }
+  RecordArgs args = *a;
+  args.run.inputs = inputs;
+  args.run.input_count = input_count;
+
+  size_t size = chip8_trace_size(a->records, a->checkpoints);
+  int fd = size ? open(a->out_path, O_RDWR | O_CREAT | O_TRUNC, 0644) : -1;
+  void* map = MAP_FAILED;
+  if (fd >= 0 && ftruncate(fd, (off_t)size) == 0) {
+    map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  }
+  if (fd >= 0) close(fd);
+  int rc = 1;
+  if (map == MAP_FAILED) {
+    fprintf(stderr, size ? "Cannot map %s\n" : "--records must be a power of two (%s)\n", a->out_path);
+  } else {
+    chip8_trace_init(map, size, a->records, a->checkpoints, a->interval);
+    uint64_t executed = 0;
+    double t = timed_run(&args, rom, rom_size, map, size, &executed);
+    const Chip8TraceHeader* h = (const Chip8TraceHeader*)map;
+    uint64_t kept = h->cycle < h->record_capacity ? h->cycle : h->record_capacity;
+    fprintf(stderr, "%s: %llu instructions traced (%llu kept, %llu checkpoints) in %.3f s, %.2f ns/instr\n",
+            a->out_path, (unsigned long long)h->cycle, (unsigned long long)kept,
+            (unsigned long long)h->checkpoints, t, executed ? t * 1e9 / (double)executed : 0.0);
+    if (a->overhead) {
+      uint64_t plain_executed = 0;
+      double plain = timed_run(&args, rom, rom_size, NULL, 0, &plain_executed);
+      fprintf(stderr, "untraced: %.3f s, %.2f ns/instr, tracing costs x%.2f\n", plain,
+              plain_executed ? plain * 1e9 / (double)plain_executed : 0.0, plain > 0 ? t / plain : 0.0);
+    }
+    munmap(map, size);
+    rc = t >= 0 ? 0 : 1;
+  }
+  free(inputs);
+  free(rom);
+  return rc;
+}
+
+typedef struct DumpFilter {
+  uint16_t pc_lo, pc_hi;
+  uint16_t op_value, op_mask;
+  int op_class; // -1: any
+} DumpFilter;
+
+static bool matches(const Chip8TraceRecord* r, const DumpFilter* f) {
+  if (r->pc < f->pc_lo || r->pc > f->pc_hi) return false;
+  if ((r->opcode & f->op_mask) != f->op_value) return false;
+  return f->op_class < 0 || chip8_stats_classify(r->opcode) == (Chip8OpClass)f->op_class;
+}
+
+static void print_record(uint64_t cycle, const Chip8TraceRecord* r) {
+  char text[24];
+  disasm_opcode(r->opcode, text, sizeof(text));
+  printf("%10llu  %03X  %04X  %-16s I=%03X", (unsigned long long)cycle, r->pc, r->opcode, text, r->I);
+  if (r->reg != CHIP8_TRACE_NO_REG && r->reg != 0xF) printf(" V%X=%02X", r->reg, r->value);
+  printf(" VF=%02X SP=%u DT=%u ST=%u\n", r->vf, r->sp, r->delay_timer, r->sound_timer);
+}
+
+static void print_checkpoints(const void* trace) {
+  const Chip8TraceHeader* h = (const Chip8TraceHeader*)trace;
+  Chip8* c8 = chip8_create(NULL, NULL);
+  if (!c8) return;
+  uint64_t first = h->checkpoints > h->checkpoint_capacity ? h->checkpoints - h->checkpoint_capacity : 0;
+  for (uint64_t k = first; k < h->checkpoints; ++k) {
+    const Chip8TraceCheckpoint* cp = chip8_trace_checkpoint(trace, k);
+    Chip8Snapshot s;
+    if (!cp || !chip8_load_state(c8, cp->state, cp->size)) {
+      printf("# checkpoint %llu: unreadable\n", (unsigned long long)k);
+      continue;
+    }
+    chip8_get_snapshot(c8, &s);
+    printf("# checkpoint %llu @ %llu: PC=%03X I=%03X SP=%u DT=%u ST=%u HASH=%08X V:", (unsigned long long)k,
+           (unsigned long long)cp->cycle, s.pc, s.I, s.sp, s.delay_timer, s.sound_timer, s.display_hash);
+    for (int i = 0; i < 16; ++i) printf(" %02X", s.V[i]);
+    printf("\n");
+  }
+  chip8_destroy(c8);
+}
+
+static int cmd_dump(const char* path, const DumpFilter* f, uint64_t last, bool checkpoints) {
+  uint8_t* data = NULL; size_t size = 0;
+  if (!headless_load_file(path, &data, &size) || !chip8_trace_valid(data, size)) {
+    fprintf(stderr, "Not a trace file: %s\n", path);
+    free(data);
+    return 1;
+  }
+  const Chip8TraceHeader* h = (const Chip8TraceHeader*)data;
+  uint64_t first = h->cycle > h->record_capacity ? h->cycle - h->record_capacity : 0;
+  printf("# %llu instructions traced, cycles %llu..%llu kept, %llu checkpoints every %u\n",
+         (unsigned long long)h->cycle, (unsigned long long)first,
+         (unsigned long long)(h->cycle ? h->cycle - 1 : 0), (unsigned long long)h->checkpoints,
+         h->checkpoint_interval);
+  if (checkpoints) print_checkpoints(data);
+
+  // With --last, walk back to the Nth-newest match and print forward from there
+  uint64_t start = first;
+  if (last) {
+    uint64_t found = 0;
+    for (uint64_t c = h->cycle; c-- > first;) {
+      const Chip8TraceRecord* r = chip8_trace_record(data, c);
+      if (r && matches(r, f) && ++found == last) { start = c; break; }
+    }
+  }
+  for (uint64_t c = start; c < h->cycle; ++c) {
+    const Chip8TraceRecord* r = chip8_trace_record(data, c);
+    if (!r || r->cycle != (uint32_t)c) continue; // never written (trace cut short)
+    if (matches(r, f)) print_record(c, r);
+  }
+  free(data);
+  return 0;
+}
+
+static bool parse_range(const char* s, uint16_t* lo, uint16_t* hi) {
+  char* end;
+  unsigned long a = strtoul(s, &end, 16), b = a;
+  if (end == s) return false;
+  if (*end == '-') {
+    const char* t = end + 1;
+    b = strtoul(t, &end, 16);
+    if (end == t) return false;
+  }
+  if (*end || a > 0xFFFF || b > 0xFFFF || a > b) return false;
+  *lo = (uint16_t)a;
+  *hi = (uint16_t)b;
+  return true;
+}
+
+static int parse_class(const char* name) {
+  for (int c = 0; c < CHIP8_OP_CLASS_COUNT; ++c) {
+    if (strcmp(name, chip8_stats_class_name((Chip8OpClass)c)) == 0) return c;
+  }
+  return -1;
+}
+
+int main(int argc, char** argv) {
+  if (argc < 3) { print_usage(argv[0]); return 1; }
+
+  if (strcmp(argv[1], "record") == 0) {
+    if (argc < 4) { print_usage(argv[0]); return 1; }
+    RecordArgs a = { argv[2], argv[3], { 700000, 700, NULL, 0, NULL, NULL, NULL, 0 }, 1, "-", 1u << 20, 64, 100000, false };
+    for (int i = 4; i < argc; ++i) {
+      if (strcmp(argv[i], "--cycles") == 0 && i + 1 < argc) { a.run.cycles = strtoull(argv[++i], NULL, 0); }
+      else if (strcmp(argv[i], "--hz") == 0 && i + 1 < argc) { a.run.hz = (uint32_t)atoi(argv[++i]); }
+      else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) { a.seed = (uint32_t)strtoul(argv[++i], NULL, 0); }
+      else if (strcmp(argv[i], "--inputs") == 0 && i + 1 < argc) { a.inputs = argv[++i]; }
+      else if (strcmp(argv[i], "--records") == 0 && i + 1 < argc) { a.records = (uint32_t)strtoul(argv[++i], NULL, 0); }
+      else if (strcmp(argv[i], "--checkpoints") == 0 && i + 1 < argc) { a.checkpoints = (uint32_t)strtoul(argv[++i], NULL, 0); }
+      else if (strcmp(argv[i], "--interval") == 0 && i + 1 < argc) { a.interval = (uint32_t)strtoul(argv[++i], NULL, 0); }
+      else if (strcmp(argv[i], "--overhead") == 0) { a.overhead = true; }
+      else { fprintf(stderr, "Unknown option: %s\n", argv[i]); print_usage(argv[0]); return 1; }
+    }
+    if (a.seed == 0) a.seed = 1;
+    return cmd_record(&a);
+  }
+
+  if (strcmp(argv[1], "dump") == 0) {
+    DumpFilter f = { 0, 0xFFFF, 0, 0, -1 };
+    uint64_t last = 0;
+    bool checkpoints = false;
+    for (int i = 3; i < argc; ++i) {
+      if (strcmp(argv[i], "--pc") == 0 && i + 1 < argc) {
+        if (!parse_range(argv[++i], &f.pc_lo, &f.pc_hi)) { fprintf(stderr, "Bad PC range: %s\n", argv[i]); return 1; }
+      } else if (strcmp(argv[i], "--op") == 0 && i + 1 < argc) {
+        // VALUE/MASK in hex; a bare VALUE must match exactly
+        char* end;
+        const char* v = argv[++i];
+        unsigned long value = strtoul(v, &end, 16), mask = 0xFFFF;
+        if (*end == '/') mask = strtoul(end + 1, &end, 16);
+        if (*end || value > 0xFFFF || mask > 0xFFFF) { fprintf(stderr, "Bad opcode filter: %s\n", v); return 1; }
+        f.op_mask = (uint16_t)mask;
+        f.op_value = (uint16_t)(value & mask);
+      } else if (strcmp(argv[i], "--class") == 0 && i + 1 < argc) {
+        f.op_class = parse_class(argv[++i]);
+        if (f.op_class < 0) { fprintf(stderr, "Unknown opcode class: %s\n", argv[i]); return 1; }
+      } else if (strcmp(argv[i], "--last") == 0 && i + 1 < argc) {
+        last = strtoull(argv[++i], NULL, 0);
+      } else if (strcmp(argv[i], "--checkpoints") == 0) {
+        checkpoints = true;
+      } else {
+        fprintf(stderr, "Unknown option: %s\n", argv[i]);
+        print_usage(argv[0]);
+        return 1;
+      }
+    }
+    return cmd_dump(argv[2], &f, last, checkpoints);
+  }
+
+  print_usage(argv[0]);
+  return 1;
+}